@@ -44,7 +44,7 @@
 
 //VersionInfoStart
 #define SAVE_VERSION 96
-#define MINOR_VERSION 2
+#define MINOR_VERSION 3
 #define BUILD_NUM 350
 #mesondefine SNAPSHOT_ID
 #mesondefine MOD_ID
@@ -92,6 +92,8 @@
 
 #define BRUSH_DIR "Brushes"
 
+#define THUMBNAIL_CACHE_DIR "ThumbnailCache"
+
 #ifndef M_GRAV
 #define M_GRAV 6.67300e-1
 #endif
@@ -0,0 +1,565 @@
+#include "Config.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common/Format.h"
+#include "common/Platform.h"
+#include "common/String.h"
+#include "common/tpt-rand.h"
+#include "json/json.h"
+
+#include "client/GameSave.h"
+#include "graphics/Graphics.h"
+#include "simulation/Simulation.h"
+#include "simulation/ElementClasses.h"
+#include "simulation/Air.h"
+#include "simulation/Gravity.h"
+#include "simulation/SaveRenderer.h"
+
+
+void EngineProcess() {}
+void ClipboardPush(ByteString) {}
+ByteString ClipboardPull() { return ""; }
+int GetModifiers() { return 0; }
+void SetCursorEnabled(int enabled) {}
+unsigned int GetTicks() { return 0; }
+
+namespace
+{
+	constexpr size_t cacheLine = 64;
+
+	// Counts the cache lines a scan over increasing indices touches in one array
+	class LineCounter
+	{
+		size_t lastLine = SIZE_MAX;
+
+	public:
+		size_t lines = 0;
+
+		void Touch(size_t begin, size_t size)
+		{
+			for (auto line = begin / cacheLine; line <= (begin + size - 1) / cacheLine; line++)
+			{
+				if (line != lastLine)
+				{
+					lines++;
+					lastLine = line;
+				}
+			}
+		}
+	};
+
+	struct Field
+	{
+		size_t offset, size;
+	};
+
+	// One of the per-frame scans over parts[]: which particles it looks at past the type
+	// check, and which of their fields it reads
+	struct Scan
+	{
+		const char *name;
+		int onlyType; // 0 if every live particle is looked at
+		bool wholeParticle;
+		std::vector<Field> fields; // in increasing offset order
+		bool writesFreeList;
+	};
+
+	const std::vector<Scan> &GetScans()
+	{
+		static const std::vector<Scan> scans = {
+			{ "RecalcFreeParticles", 0, false, {
+				{ offsetof(Particle, life), sizeof(int) },
+				{ offsetof(Particle, x), sizeof(float) },
+				{ offsetof(Particle, y), sizeof(float) },
+			}, true },
+			{ "UpdateParticles", 0, true, {}, false },
+			{ "render_parts", 0, true, {}, false },
+			{ "SimulateGoL", PT_LIFE, false, {
+				{ offsetof(Particle, ctype), sizeof(int) },
+				{ offsetof(Particle, x), sizeof(float) },
+				{ offsetof(Particle, y), sizeof(float) },
+				{ offsetof(Particle, tmp), sizeof(int) },
+			}, false },
+		};
+		return scans;
+	}
+
+	enum Layout
+	{
+		// every slot up to parts_lastActiveIndex checked through parts[i].type, free list in parts[i].life
+		layoutParticle,
+		// every slot checked through partTypes[i], free list in parts[i].life
+		layoutTypes,
+		// slots in use found through a bitmap, types in partTypes[i], no free list
+		layoutActive,
+		layoutCount,
+	};
+
+	const char *layoutNames[layoutCount] = { "parts[].type", "partTypes[]", "activeParts" };
+
+	// Bytes a scan pulls in with a given layout
+	size_t ScanBytes(const Simulation *sim, const Scan &scan, Layout layout)
+	{
+		LineCounter partLines, typeLines, activeLines;
+		for (int i = 0; i <= sim->parts_lastActiveIndex; i++)
+		{
+			auto &part = sim->parts[i];
+			auto partOffset = size_t(i) * sizeof(Particle);
+			switch (layout)
+			{
+			case layoutParticle:
+				partLines.Touch(partOffset + offsetof(Particle, type), sizeof(int));
+				break;
+
+			case layoutTypes:
+				typeLines.Touch(size_t(i) * sizeof(int), sizeof(int));
+				break;
+
+			default:
+				activeLines.Touch(size_t(i / 64) * sizeof(uint64_t), sizeof(uint64_t));
+				break;
+			}
+			if (!part.type)
+			{
+				if (scan.writesFreeList && layout != layoutActive)
+					partLines.Touch(partOffset + offsetof(Particle, life), sizeof(int));
+				continue;
+			}
+			if (layout == layoutActive)
+				typeLines.Touch(size_t(i) * sizeof(int), sizeof(int));
+			if (scan.onlyType && part.type != scan.onlyType)
+				continue;
+			if (scan.wholeParticle)
+				partLines.Touch(partOffset, sizeof(Particle));
+			for (auto &field : scan.fields)
+				partLines.Touch(partOffset + field.offset, field.size);
+		}
+		return (partLines.lines + typeLines.lines + activeLines.lines) * cacheLine;
+	}
+
+	std::vector<char> ReadFile(ByteString filename)
+	{
+		std::vector<char> data;
+		std::ifstream fileStream(filename.c_str(), std::ios::binary);
+		if (fileStream.is_open())
+		{
+			data.assign(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>());
+		}
+		return data;
+	}
+
+	// Fills the screen with powder and liquid and then punches holes in it, leaving
+	// parts[] as sparse as it gets after a big explosion
+	void FillSparse(Simulation *sim)
+	{
+		for (int y = CELL; y < YRES - CELL; y++)
+		{
+			for (int x = CELL; x < XRES - CELL; x++)
+			{
+				int t = (y < YRES / 2) ? PT_DUST : PT_WATR;
+				if (x < XRES / 4 && y < YRES / 4)
+					t = PT_LIFE;
+				sim->create_part(-1, x, y, t);
+			}
+		}
+		for (int i = 0; i <= sim->parts_lastActiveIndex; i++)
+		{
+			if (sim->parts[i].type && RNG::Ref().chance(3, 4))
+				sim->kill_part(i);
+		}
+	}
+
+	// Sets the simulation up the way GameModel does when a save is opened
+	bool LoadSave(Simulation *sim, ByteString filename)
+	{
+		auto inputFile = ReadFile(filename);
+		if (inputFile.empty())
+		{
+			std::cerr << "Failed to read " << filename << std::endl;
+			return false;
+		}
+		try
+		{
+			GameSave gameSave(inputFile);
+			sim->gravityMode = gameSave.gravityMode;
+			sim->air->airMode = gameSave.airMode;
+			sim->air->ambientAirTemp = gameSave.ambientAirTemp;
+			sim->edgeMode = gameSave.edgeMode;
+			sim->legacy_enable = gameSave.legacyEnable;
+			sim->water_equal_test = gameSave.waterEEnabled;
+			sim->aheat_enable = gameSave.aheatEnable;
+			if (gameSave.gravityEnable)
+				sim->grav->start_grav_async();
+			sim->Load(&gameSave, true);
+		}
+		catch (ParseException &e)
+		{
+			std::cerr << "Failed to load " << filename << ": " << e.what() << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Runs the vectorised and the scalar air blur kernels over the maps as they are and counts
+	// the cells where their results differ by more than rounding would explain; -ffast-math
+	// builds may reorder the scalar sums, so the two aren't always bit for bit the same
+	int CompareAirBlur(Air *air, float &maxDifference)
+	{
+		constexpr int rowCells = XRES / CELL;
+		static float vx[YRES / CELL][rowCells], vy[YRES / CELL][rowCells], pv[YRES / CELL][rowCells];
+		int mismatches = 0;
+		auto compare = [&mismatches, &maxDifference](const float *a, const float *b) {
+			for (int x = 0; x < rowCells; x++)
+			{
+				float difference = fabsf(a[x] - b[x]);
+				maxDifference = std::max(maxDifference, difference);
+				if (!(difference <= 1e-3f + 1e-5f * std::max(fabsf(a[x]), fabsf(b[x]))))
+					mismatches++;
+			}
+		};
+		for (int y = 0; y < YRES / CELL; y++)
+		{
+			float dh[2][rowCells], dx[2][rowCells];
+			air->blur_airh(y, dh[0], dx[0], true);
+			air->blur_airh(y, dh[1], dx[1], false);
+			compare(dh[0], dh[1]);
+			compare(dx[0], dx[1]);
+		}
+		// blur_air writes to ovx, ovy and opv, which only hold anything between blurring
+		// and advection within update_air
+		for (int y = 0; y < YRES / CELL; y++)
+		{
+			air->blur_air(y, true);
+			std::copy(air->ovx[y], air->ovx[y] + rowCells, vx[y]);
+			std::copy(air->ovy[y], air->ovy[y] + rowCells, vy[y]);
+			std::copy(air->opv[y], air->opv[y] + rowCells, pv[y]);
+			air->blur_air(y, false);
+			compare(vx[y], air->ovx[y]);
+			compare(vy[y], air->ovy[y]);
+			compare(pv[y], air->opv[y]);
+		}
+		return mismatches;
+	}
+
+	Json::Value Timing(double seconds, int frames)
+	{
+		Json::Value timing;
+		timing["totalMs"] = seconds * 1000;
+		timing["meanMs"] = seconds * 1000 / frames;
+		return timing;
+	}
+
+	// Renders thumbnails of every save in a directory the way the save browsers do, from a
+	// number of threads at once, first with an empty thumbnail cache and then from the cache
+	int ThumbnailBench(ByteString directory, int threads)
+	{
+		if (!directory.EndsWith(PATH_SEP))
+			directory += PATH_SEP;
+		std::vector<std::unique_ptr<GameSave>> saves;
+		for (auto &file : Platform::DirectorySearch(directory, "", { ".cps", ".stm" }))
+		{
+			auto data = ReadFile(directory + file);
+			try
+			{
+				saves.push_back(std::make_unique<GameSave>(data));
+			}
+			catch (ParseException &e)
+			{
+				std::cerr << "Skipping " << file << ": " << e.what() << std::endl;
+			}
+		}
+		if (saves.empty())
+		{
+			std::cerr << "No saves in " << directory << std::endl;
+			return 1;
+		}
+
+		auto renderAll = [&saves, threads]() {
+			std::atomic<size_t> next(0);
+			auto worker = [&saves, &next]() {
+				for (size_t i; (i = next++) < saves.size(); )
+				{
+					// a copy, like ThumbnailRendererTask makes
+					GameSave save(*saves[i]);
+					delete SaveRenderer::Ref().RenderThumbnail(&save, XRES / 3, YRES / 3, true);
+				}
+			};
+			auto start = std::chrono::steady_clock::now();
+			std::vector<std::thread> workers;
+			for (int t = 1; t < threads; t++)
+				workers.emplace_back(worker);
+			worker();
+			for (auto &thread : workers)
+				thread.join();
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		};
+		auto timing = [&saves](double seconds) {
+			Json::Value timing;
+			timing["totalMs"] = seconds * 1000;
+			timing["thumbnailsPerSecond"] = saves.size() / seconds;
+			return timing;
+		};
+
+		Json::Value result;
+		result["input"] = directory.c_str();
+		result["saves"] = Json::UInt64(saves.size());
+		result["threads"] = threads;
+		result["rendered"] = timing(renderAll());
+		result["cached"] = timing(renderAll());
+		std::cout << Json::StyledWriter().write(result);
+		return 0;
+	}
+
+	// Serialises and reads back every save in a directory in each container, to compare how
+	// long OPS1's bzip2 and OPS2's deflated blocks take and how large their output is
+	int ContainerBench(ByteString directory)
+	{
+		if (!directory.EndsWith(PATH_SEP))
+			directory += PATH_SEP;
+		std::vector<std::unique_ptr<GameSave>> saves;
+		for (auto &file : Platform::DirectorySearch(directory, "", { ".cps", ".stm" }))
+		{
+			auto data = ReadFile(directory + file);
+			try
+			{
+				saves.push_back(std::make_unique<GameSave>(data));
+				saves.back()->Expand();
+			}
+			catch (ParseException &e)
+			{
+				std::cerr << "Skipping " << file << ": " << e.what() << std::endl;
+			}
+		}
+		if (saves.empty())
+		{
+			std::cerr << "No saves in " << directory << std::endl;
+			return 1;
+		}
+
+		Json::Value result;
+		result["input"] = directory.c_str();
+		result["saves"] = Json::UInt64(saves.size());
+		std::pair<GameSave::Container, const char *> containers[] = {
+			{ GameSave::containerOPS1, "OPS1" },
+			{ GameSave::containerOPS2, "OPS2" },
+		};
+		for (auto &container : containers)
+		{
+			double encodeSeconds = 0, decodeSeconds = 0;
+			uint64_t bytes = 0;
+			for (auto &save : saves)
+			{
+				auto start = std::chrono::steady_clock::now();
+				auto data = save->Serialise(container.first);
+				auto encoded = std::chrono::steady_clock::now();
+				GameSave readBack(data);
+				auto decoded = std::chrono::steady_clock::now();
+				encodeSeconds += std::chrono::duration<double>(encoded - start).count();
+				decodeSeconds += std::chrono::duration<double>(decoded - encoded).count();
+				bytes += data.size();
+			}
+			Json::Value timing;
+			timing["encodeMs"] = encodeSeconds * 1000;
+			timing["decodeMs"] = decodeSeconds * 1000;
+			timing["bytes"] = Json::UInt64(bytes);
+			result[container.second] = timing;
+		}
+		std::cout << Json::StyledWriter().write(result);
+		return 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = 60;
+	unsigned int seed = 1;
+	int threads = 1;
+	bool scanBytes = false;
+	bool hashes = false;
+	bool checkAir = false;
+	ByteString elementsFilename;
+	ByteString thumbnailsDirectory;
+	ByteString containersDirectory;
+	ByteString inputFilename;
+	for (int i = 1; i < argc; i++)
+	{
+		ByteString arg = argv[i];
+		if ((arg == "--frames" || arg == "--seed" || arg == "--threads") && i + 1 < argc)
+		{
+			int value = std::atoi(argv[++i]);
+			if (arg == "--frames")
+				frames = value;
+			else if (arg == "--seed")
+				seed = value;
+			else
+				threads = value;
+		}
+		else if (arg == "--scans")
+		{
+			scanBytes = true;
+		}
+		else if (arg == "--hashes")
+		{
+			hashes = true;
+		}
+		else if (arg == "--check-air")
+		{
+			checkAir = true;
+		}
+		else if (arg == "--elements" && i + 1 < argc)
+		{
+			elementsFilename = argv[++i];
+		}
+		else if (arg == "--thumbnails" && i + 1 < argc)
+		{
+			thumbnailsDirectory = argv[++i];
+		}
+		else if (arg == "--containers" && i + 1 < argc)
+		{
+			containersDirectory = argv[++i];
+		}
+		else if (arg.size() && arg[0] != '-' && !inputFilename.size())
+		{
+			inputFilename = arg;
+		}
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [--frames N] [--seed N] [--threads N] [--scans] [--hashes] [--check-air] [--elements FILE] [inputFilename]" << std::endl;
+			std::cout << "       " << argv[0] << " --thumbnails DIRECTORY [--threads N]" << std::endl;
+			std::cout << "       " << argv[0] << " --containers DIRECTORY" << std::endl;
+			std::cout << "Runs the simulation headless and prints how long each part of a frame took as JSON." << std::endl;
+			std::cout << "Without an input file the screen is filled with sparse powder, liquid and LIFE." << std::endl;
+			std::cout << "--scans adds how many bytes the per-frame scans over parts[] read with each layout." << std::endl;
+			std::cout << "--hashes waits for Newtonian gravity every frame and adds the simulation's state hash after every frame, to find the first frame where two runs differ." << std::endl;
+			std::cout << "--check-air runs the vectorised and the scalar air blur over the air maps after every frame and adds how many cells they disagreed on by more than rounding." << std::endl;
+			std::cout << "--elements times every element's update function and writes the totals to FILE as CSV, which slows the particle update down." << std::endl;
+			std::cout << "--thumbnails renders a thumbnail of every save in DIRECTORY on N threads instead, and prints how many it managed per second." << std::endl;
+			std::cout << "--containers writes and reads back every save in DIRECTORY in each save container instead, and prints the time taken and the size of the output." << std::endl;
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+	if (thumbnailsDirectory.size())
+		return ThumbnailBench(thumbnailsDirectory, std::max(threads, 1));
+	if (containersDirectory.size())
+		return ContainerBench(containersDirectory);
+	if (frames < 1)
+		frames = 1;
+	// a zero seed leaves the generator stuck at zero
+	if (!seed)
+		seed = 1;
+
+	RNG::Ref().seed(seed);
+	Simulation *sim = new Simulation();
+	sim->SetSeed(seed);
+	sim->deterministic = hashes;
+	sim->SetThreads(threads);
+	if (inputFilename.size())
+	{
+		if (!LoadSave(sim, inputFilename))
+			return 1;
+	}
+	else
+	{
+		FillSparse(sim);
+	}
+
+	auto &scans = GetScans();
+	std::vector<std::array<size_t, layoutCount>> bytes(scans.size());
+	sim->phaseTiming = true;
+	sim->phaseTimes.fill(0);
+	sim->elementTiming = elementsFilename.size();
+	double frameTime = 0;
+	Json::Value stateHashes(Json::arrayValue);
+	int64_t airBlurMismatches = 0;
+	float airBlurMaxDifference = 0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		sim->BeforeSim();
+		if (scanBytes)
+		{
+			// not part of the frame time
+			auto scanStart = std::chrono::steady_clock::now();
+			for (size_t s = 0; s < scans.size(); s++)
+				for (int layout = 0; layout < layoutCount; layout++)
+					bytes[s][layout] += ScanBytes(sim, scans[s], Layout(layout));
+			start += std::chrono::steady_clock::now() - scanStart;
+		}
+		sim->UpdateParticles(0, NPART - 1);
+		sim->AfterSim();
+		frameTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (hashes)
+			stateHashes.append(ByteString::Build(Format::Hex(), Format::Width(sim->stateHash, 16)).c_str());
+		// not part of the frame time either
+		if (checkAir)
+			airBlurMismatches += CompareAirBlur(sim->air, airBlurMaxDifference);
+	}
+
+	Json::Value result;
+	result["input"] = inputFilename.size() ? inputFilename.c_str() : "sparse";
+	result["frames"] = frames;
+	result["seed"] = seed;
+	result["threads"] = sim->GetThreads();
+	result["particles"] = sim->NUM_PARTS;
+	Json::Value phases;
+	double phaseTotal = 0;
+	for (int phase = 0; phase < Simulation::phaseCount; phase++)
+	{
+		// nothing is rendered
+		if (phase == Simulation::phaseRender)
+			continue;
+		phases[Simulation::phaseNames[phase]] = Timing(sim->phaseTimes[phase], frames);
+		phaseTotal += sim->phaseTimes[phase];
+	}
+	phases["other"] = Timing(frameTime - phaseTotal, frames);
+	result["phases"] = phases;
+	result["frame"] = Timing(frameTime, frames);
+	if (hashes)
+		result["stateHashes"] = stateHashes;
+	if (checkAir)
+	{
+		result["airBlurMismatches"] = Json::Int64(airBlurMismatches);
+		result["airBlurMaxDifference"] = airBlurMaxDifference;
+	}
+	if (scanBytes)
+	{
+		Json::Value scanResult;
+		for (size_t s = 0; s < scans.size(); s++)
+		{
+			Json::Value layouts;
+			for (int layout = 0; layout < layoutCount; layout++)
+				layouts[layoutNames[layout]] = Json::UInt64(bytes[s][layout] / frames);
+			scanResult[scans[s].name] = layouts;
+		}
+		result["scanBytesPerFrame"] = scanResult;
+	}
+	std::cout << Json::StyledWriter().write(result);
+	if (elementsFilename.size())
+	{
+		std::ofstream elementsFile(elementsFilename.c_str());
+		elementsFile << sim->ElementCostsCSV();
+		if (!elementsFile)
+		{
+			std::cerr << "Failed to write " << elementsFilename << std::endl;
+			delete sim;
+			return 1;
+		}
+	}
+	delete sim;
+	return 0;
+}
@@ -22,6 +22,8 @@
 #include <ctime>
 #include <climits>
 
+#include "common/tpt-thread-local.h"
+
 
 const int initialBufferSize = 128;
 
@@ -919,11 +921,17 @@ int bson_append_finish_array( bson *b ) {
 
 /* Error handling and allocators. */
 
-static bson_err_handler err_handler = NULL;
+/* Per thread, as saves are parsed and serialised on more than one thread at once, each
+   installing its own handler. */
+struct ErrorHandler {
+	bson_err_handler handler = NULL;
+};
+static THREAD_LOCAL(ErrorHandler, errorHandler);
 
 bson_err_handler set_bson_err_handler( bson_err_handler func ) {
-	bson_err_handler old = err_handler;
-	err_handler = func;
+	ErrorHandler &local = errorHandler;
+	bson_err_handler old = local.handler;
+	local.handler = func;
 	return old;
 }
 
@@ -958,8 +966,9 @@ int _bson_errprintf( const char *format, ... ) {
  *  @param
  */
 void bson_builder_error( bson *b ) {
-	if( err_handler )
-		err_handler( "BSON error." );
+	ErrorHandler &local = errorHandler;
+	if( local.handler )
+		local.handler( "BSON error." );
 }
 
 void bson_fatal( int ok ) {
@@ -970,8 +979,9 @@ void bson_fatal_msg( int ok , const char *msg ) {
 	if ( ok )
 		return;
 
-	if ( err_handler ) {
-		err_handler( msg );
+	ErrorHandler &local = errorHandler;
+	if ( local.handler ) {
+		local.handler( msg );
 	}
 
 	bson_errprintf( "error: %s\n" , msg );
@@ -1,5 +1,6 @@
 #include "Client.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <vector>
 #include <map>
@@ -37,6 +38,8 @@
 #include "client/GameSave.h"
 #include "client/SaveFile.h"
 #include "client/SaveInfo.h"
+#include "client/SaveWriterTask.h"
+#include "client/ThumbnailCache.h"
 #include "client/UserInfo.h"
 #include "common/Platform.h"
 #include "common/String.h"
@@ -590,6 +593,20 @@ void Client::Tick()
 		if (CheckUpdate(alternateVersionCheckRequest, false))
 			alternateVersionCheckRequest = nullptr;
 	}
+	// callbacks may finish other writes, so each one is taken off the list before it's polled
+	auto writes = pendingWrites;
+	for (auto *task : writes)
+	{
+		auto it = std::find(pendingWrites.begin(), pendingWrites.end(), task);
+		if (it == pendingWrites.end())
+			continue;
+		pendingWrites.erase(it);
+		task->Poll();
+		if (task->GetDone())
+			task->Finish();
+		else
+			pendingWrites.push_back(task);
+	}
 }
 
 bool Client::CheckUpdate(http::Request *updateRequest, bool checkSession)
@@ -804,6 +821,11 @@ void Client::Shutdown()
 	http::RequestManager::Ref().Shutdown();
 #endif
 
+	// don't quit halfway through writing a save
+	for (auto *task : pendingWrites)
+		task->FinishQuietly();
+	pendingWrites.clear();
+
 	//Save config
 	WritePrefs();
 }
@@ -904,7 +926,13 @@ void Client::MoveStampToFront(ByteString stampID)
 SaveFile * Client::GetStamp(ByteString stampID)
 {
 	ByteString stampFile = ByteString(STAMPS_DIR PATH_SEP + stampID + ".stm");
-	SaveFile *saveFile = LoadSaveFile(stampFile);
+	FinishWrites(stampFile);
+	SaveFile *saveFile;
+	// Stamps with an up to date cached thumbnail parsed fine before, the browser doesn't need them parsed again
+	if (ThumbnailCache::Ref().Contains(stampFile))
+		saveFile = new SaveFile(stampFile, true);
+	else
+		saveFile = LoadSaveFile(stampFile);
 	if (!saveFile)
 		saveFile = LoadSaveFile(stampID);
 	else
@@ -914,11 +942,13 @@ SaveFile * Client::GetStamp(ByteString stampID)
 
 void Client::DeleteStamp(ByteString stampID)
 {
+	ByteString stampFilename = ByteString::Build(STAMPS_DIR, PATH_SEP, stampID, ".stm");
+	// before looking for the stamp, a write that fails calls back into DeleteStamp from here
+	FinishWrites(stampFilename);
 	for (std::list<ByteString>::iterator iterator = stampIDs.begin(), end = stampIDs.end(); iterator != end; ++iterator)
 	{
 		if ((*iterator) == stampID)
 		{
-			ByteString stampFilename = ByteString::Build(STAMPS_DIR, PATH_SEP, stampID, ".stm");
 			remove(stampFilename.c_str());
 			stampIDs.erase(iterator);
 			break;
@@ -928,7 +958,7 @@ void Client::DeleteStamp(ByteString stampID)
 	updateStamps();
 }
 
-ByteString Client::AddStamp(GameSave * saveData)
+ByteString Client::AddStamp(std::unique_ptr<GameSave> saveData, std::function<void (String)> onDone)
 {
 	unsigned t=(unsigned)time(NULL);
 	if (lastStampTime!=t)
@@ -955,17 +985,12 @@ ByteString Client::AddStamp(GameSave * saveData)
 	}
 	saveData->authors = stampInfo;
 
-	unsigned int gameDataLength;
-	char * gameData = saveData->Serialise(gameDataLength);
-	if (gameData == NULL)
-		return "";
-
-	std::ofstream stampStream;
-	stampStream.open(filename.c_str(), std::ios::binary);
-	stampStream.write((const char *)gameData, gameDataLength);
-	stampStream.close();
-
-	delete[] gameData;
+	WriteSaveFile(std::move(saveData), filename, [this, saveID, onDone](String error) {
+		if (error.size())
+			DeleteStamp(saveID);
+		if (onDone)
+			onDone(error);
+	});
 
 	stampIDs.push_front(saveID);
 
@@ -1345,6 +1370,7 @@ SaveInfo * Client::GetSave(int saveID, int saveDate)
 
 SaveFile * Client::LoadSaveFile(ByteString filename)
 {
+	FinishWrites(filename);
 	if (!Platform::FileExists(filename))
 		return nullptr;
 	SaveFile * file = new SaveFile(filename);
@@ -1364,6 +1390,30 @@ SaveFile * Client::LoadSaveFile(ByteString filename)
 	return file;
 }
 
+void Client::WriteSaveFile(std::unique_ptr<GameSave> save, ByteString filename, std::function<void (String)> onDone)
+{
+	// two threads writing the same file would interleave
+	FinishWrites(filename);
+	auto *task = new SaveWriterTask(std::move(save), filename, GameSave::containerOPS2, onDone);
+	task->Start();
+	pendingWrites.push_back(task);
+}
+
+void Client::FinishWrites(ByteString filename)
+{
+	while (true)
+	{
+		auto it = std::find_if(pendingWrites.begin(), pendingWrites.end(), [&filename](SaveWriterTask *task) {
+			return task->GetFilename() == filename;
+		});
+		if (it == pendingWrites.end())
+			break;
+		auto *task = *it;
+		pendingWrites.erase(it);
+		task->Finish();
+	}
+}
+
 std::vector<std::pair<ByteString, int> > * Client::GetTags(int start, int count, String query, int & resultCount)
 {
 	lastError = "";
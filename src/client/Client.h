@@ -4,6 +4,8 @@
 
 #include <vector>
 #include <list>
+#include <functional>
+#include <memory>
 
 #include "common/String.h"
 #include "common/Singleton.h"
@@ -16,6 +18,7 @@ class SaveFile;
 class SaveComment;
 class GameSave;
 class VideoBuffer;
+class SaveWriterTask;
 
 enum LoginStatus {
 	LoginOkay, LoginError
@@ -65,6 +68,8 @@ private:
 	unsigned lastStampTime;
 	int lastStampName;
 
+	std::list<SaveWriterTask *> pendingWrites;
+
 	//Auth session
 	User authUser;
 
@@ -126,7 +131,11 @@ public:
 
 	SaveFile * GetStamp(ByteString stampID);
 	void DeleteStamp(ByteString stampID);
-	ByteString AddStamp(GameSave * saveData);
+	// The stamp is written in the background, onDone is called from Tick once it has been.
+	// The returned ID is listed straight away and can be opened with GetStamp, which waits
+	// for the write, but a stamp whose write fails is deleted again before onDone is called
+	// with the error, so only an empty error means the ID is there to stay.
+	ByteString AddStamp(std::unique_ptr<GameSave> saveData, std::function<void (String)> onDone = nullptr);
 	std::vector<ByteString> GetStamps(int start, int count);
 	void RescanStamps();
 	int GetStampsCount();
@@ -144,6 +153,11 @@ public:
 
 	SaveInfo * GetSave(int saveID, int saveDate);
 	SaveFile * LoadSaveFile(ByteString filename);
+	// Serialises save and writes it to filename on a thread of its own. onDone is called
+	// from Tick with an empty string once the file is written, or with what went wrong.
+	void WriteSaveFile(std::unique_ptr<GameSave> save, ByteString filename, std::function<void (String)> onDone);
+	// Waits for the background writes to filename to finish
+	void FinishWrites(ByteString filename);
 
 	RequestStatus DeleteSave(int saveID);
 	RequestStatus ReportSave(int saveID, String message);
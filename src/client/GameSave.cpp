@@ -6,6 +6,12 @@
 #include <memory>
 #include <set>
 #include <cmath>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <zlib.h>
 
 #include "bzip2/bzlib.h"
 #include "Config.h"
@@ -18,6 +24,265 @@
 #include "common/tpt-minmax.h"
 #include "common/tpt-compat.h"
 
+namespace
+{
+	// OPS2 is the OPS1 header with a '2' in place of the '1', followed by the size of the
+	// blocks the BSON is cut into, the number of blocks, the compressed size of each block
+	// and then the blocks, each deflated on its own
+	constexpr unsigned int opsBlockSize = 0x40000;
+	constexpr int opsBlockLevel = 6;
+	constexpr unsigned int opsBlockHeaderSize = 20;
+
+	void ForEachBlock(int count, const std::function<void (int)> &job)
+	{
+		int threads = std::min(count, std::max(1, int(std::thread::hardware_concurrency())));
+		std::atomic<int> next(0);
+		auto worker = [&job, &next, count]() {
+			for (int i; (i = next++) < count; )
+				job(i);
+		};
+		std::vector<std::thread> workers;
+		for (int i = 1; i < threads; i++)
+			workers.emplace_back(worker);
+		worker();
+		for (auto &thread : workers)
+			thread.join();
+	}
+
+	void WriteLE32(unsigned char *data, unsigned int value)
+	{
+		data[0] = value;
+		data[1] = value >> 8;
+		data[2] = value >> 16;
+		data[3] = value >> 24;
+	}
+
+	unsigned int ReadLE32(const unsigned char *data)
+	{
+		return unsigned(data[0]) | (unsigned(data[1]) << 8) | (unsigned(data[2]) << 16) | (unsigned(data[3]) << 24);
+	}
+
+	char *DeflateBlocks(const unsigned char *bsonData, unsigned int bsonDataLen, int blockW, int blockH, unsigned int &dataLength)
+	{
+		int blockCount = (bsonDataLen + opsBlockSize - 1) / opsBlockSize;
+		std::vector<std::vector<unsigned char>> blocks(blockCount);
+		ForEachBlock(blockCount, [&](int i) {
+			unsigned int begin = i * opsBlockSize;
+			uLong size = std::min(opsBlockSize, bsonDataLen - begin);
+			uLongf compressedSize = compressBound(size);
+			blocks[i].resize(compressedSize);
+			if (compress2(&blocks[i][0], &compressedSize, bsonData + begin, size, opsBlockLevel) != Z_OK)
+				compressedSize = 0; // deflate never produces empty output, so this marks the failure
+			blocks[i].resize(compressedSize);
+		});
+
+		dataLength = opsBlockHeaderSize + 4 * blockCount;
+		for (auto &block : blocks)
+		{
+			if (block.empty())
+				throw BuildException("Save error, could not compress");
+			dataLength += block.size();
+		}
+		char *saveData = new char[dataLength];
+		auto *outputData = (unsigned char *)saveData;
+		outputData[0] = 'O';
+		outputData[1] = 'P';
+		outputData[2] = 'S';
+		outputData[3] = '2';
+		outputData[4] = SAVE_VERSION;
+		outputData[5] = CELL;
+		outputData[6] = blockW;
+		outputData[7] = blockH;
+		WriteLE32(outputData + 8, bsonDataLen);
+		WriteLE32(outputData + 12, opsBlockSize);
+		WriteLE32(outputData + 16, blockCount);
+		auto *blockData = outputData + opsBlockHeaderSize + 4 * blockCount;
+		for (int i = 0; i < blockCount; i++)
+		{
+			WriteLE32(outputData + opsBlockHeaderSize + 4 * i, blocks[i].size());
+			std::copy(blocks[i].begin(), blocks[i].end(), blockData);
+			blockData += blocks[i].size();
+		}
+		return saveData;
+	}
+
+	// Fills all bsonDataLen bytes of bsonData, or throws
+	void InflateBlocks(unsigned char *bsonData, unsigned int bsonDataLen, const unsigned char *inputData, unsigned int inputDataLen)
+	{
+		if (inputDataLen < opsBlockHeaderSize)
+			throw ParseException(ParseException::Corrupt, "Block table missing");
+		uint64_t blockSize = ReadLE32(inputData + 12);
+		uint64_t blockCount = ReadLE32(inputData + 16);
+		if (!blockSize || blockCount != (bsonDataLen + blockSize - 1) / blockSize || blockCount > (inputDataLen - opsBlockHeaderSize) / 4)
+			throw ParseException(ParseException::Corrupt, "Invalid block table");
+		std::vector<uint64_t> offsets(blockCount + 1);
+		offsets[0] = opsBlockHeaderSize + 4 * blockCount;
+		for (uint64_t i = 0; i < blockCount; i++)
+			offsets[i + 1] = offsets[i] + ReadLE32(inputData + opsBlockHeaderSize + 4 * i);
+		if (offsets[blockCount] > inputDataLen)
+			throw ParseException(ParseException::Corrupt, "Blocks truncated");
+
+		std::atomic<bool> failed(false);
+		ForEachBlock(int(blockCount), [&](int i) {
+			uint64_t begin = i * blockSize;
+			uLongf size = uLongf(std::min<uint64_t>(blockSize, bsonDataLen - begin));
+			uLongf expectedSize = size;
+			if (uncompress(bsonData + begin, &size, inputData + offsets[i], uLong(offsets[i + 1] - offsets[i])) != Z_OK || size != expectedSize)
+				failed = true;
+		});
+		if (failed)
+			throw ParseException(ParseException::Corrupt, "Unable to decompress");
+	}
+
+	// Saves from 96.3 on may store particles as columns instead of in parts and partsPos:
+	// a varint particle count, then for each column a varint length and that many bytes.
+	// A column holds one property of every particle, in the order partsPos would have them.
+	enum ParticleColumn
+	{
+		columnPos, // delta of y*fullW+x from the previous particle
+		columnType,
+		columnTemp, // delta from the previous particle of twice the offset from 294.15K, or of twice the temperature plus one if it is 127K or more away
+		columnLife,
+		columnTmp,
+		columnCtype,
+		columnDcolour,
+		columnVx, // 16ths of a pixel per frame
+		columnVy,
+		columnTmp2,
+		columnTmp3,
+		columnTmp4,
+		columnCount,
+	};
+
+	void PutVarint(std::vector<unsigned char> &data, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			data.push_back((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		data.push_back(value);
+	}
+
+	uint64_t GetVarint(const unsigned char *&data, const unsigned char *end)
+	{
+		uint64_t value = 0;
+		for (int shift = 0; ; shift += 7)
+		{
+			if (data == end || shift > 63)
+				throw ParseException(ParseException::Corrupt, "Ran past particle column");
+			value |= uint64_t(*data & 0x7F) << shift;
+			if (!(*data++ & 0x80))
+				return value;
+		}
+	}
+
+	// Each value is zigzag encoded and shifted left by one. The lowest bit says whether
+	// a varint follows with the number of times the value repeats, minus two.
+	class ColumnWriter
+	{
+		std::vector<unsigned char> data;
+		int value = 0;
+		unsigned int repeats = 0;
+		bool pending = false;
+
+		void Flush()
+		{
+			if (!pending)
+				return;
+			uint64_t zigzag = (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+			PutVarint(data, (zigzag << 1) | (repeats ? 1 : 0));
+			if (repeats)
+				PutVarint(data, repeats - 1);
+			pending = false;
+		}
+
+	public:
+		void Push(int newValue)
+		{
+			if (pending && newValue == value)
+			{
+				repeats++;
+				return;
+			}
+			Flush();
+			value = newValue;
+			repeats = 0;
+			pending = true;
+		}
+
+		const std::vector<unsigned char> &Finish()
+		{
+			Flush();
+			return data;
+		}
+	};
+
+	// Adds a particle at pos, y*fullW+x in the save, to the columns. lastPos and lastTemp are
+	// what the deltas are taken from and are updated for the next particle.
+	void PushParticleColumns(std::array<ColumnWriter, columnCount> &columns, const Particle &part, int pos, int &lastPos, int &lastTemp, bool saveTmp34)
+	{
+		columns[columnPos].Push(pos - lastPos);
+		lastPos = pos;
+		columns[columnType].Push(part.type);
+		// Rounded the same way as in the legacy layout, so that converting between the two doesn't change anything
+		int temp;
+		if (fabs(part.temp-294.15f)<127)
+			temp = int(floor(part.temp-294.15f+0.5f)) * 2;
+		else
+			temp = int(part.temp+0.5f) * 2 + 1;
+		columns[columnTemp].Push(temp - lastTemp);
+		lastTemp = temp;
+		columns[columnLife].Push(std::max(0, std::min(0xFFFF, part.life)));
+		columns[columnTmp].Push(part.tmp);
+		columns[columnCtype].Push(part.ctype);
+		columns[columnDcolour].Push((part.dcolour & 0xFF000000 || part.type == PT_LIFE) ? int(part.dcolour) : 0);
+		// same rounding as the single bytes of the legacy layout
+		columns[columnVx].Push(fabs(part.vx) > 0.001f ? std::max(0, std::min(255, int(part.vx*16.0f+127.5f))) - 127 : 0);
+		columns[columnVy].Push(fabs(part.vy) > 0.001f ? std::max(0, std::min(255, int(part.vy*16.0f+127.5f))) - 127 : 0);
+		columns[columnTmp2].Push(part.tmp2);
+		columns[columnTmp3].Push(saveTmp34 ? part.tmp3 : 0);
+		columns[columnTmp4].Push(saveTmp34 ? part.tmp4 : 0);
+	}
+
+	class ColumnReader
+	{
+		const unsigned char *data = nullptr, *end = nullptr;
+		int value = 0;
+		uint64_t repeats = 0;
+
+	public:
+		ColumnReader() = default;
+		ColumnReader(const unsigned char *newData, const unsigned char *newEnd) : data(newData), end(newEnd)
+		{
+		}
+
+		int Next()
+		{
+			if (repeats)
+			{
+				repeats--;
+				return value;
+			}
+			auto encoded = GetVarint(data, end);
+			auto zigzag = uint32_t(encoded >> 1);
+			value = int((zigzag >> 1) ^ -(zigzag & 1));
+			if (encoded & 1)
+			{
+				repeats = GetVarint(data, end) + 1;
+				if (repeats > NPART)
+					throw ParseException(ParseException::Corrupt, "Particle column repeats too long");
+			}
+			return value;
+		}
+
+		bool Done() const
+		{
+			return data == end && !repeats;
+		}
+	};
+}
+
 GameSave::GameSave(const GameSave & save):
     majorVersion(save.majorVersion),
 	waterEEnabled(save.waterEEnabled),
@@ -186,6 +451,12 @@ bool GameSave::Collapsed()
 	return !expanded;
 }
 
+const std::vector<char> &GameSave::CollapsedData() const
+{
+	static const std::vector<char> noData;
+	return (hasOriginalData && !expanded) ? originalData : noData;
+}
+
 void GameSave::Expand()
 {
 	if(hasOriginalData && !expanded)
@@ -216,7 +487,7 @@ void GameSave::read(char * data, int dataSize)
 		}
 		else if(data[0] == 'O' && data[1] == 'P' && data[2] == 'S')
 		{
-			if (data[3] != '1')
+			if (data[3] != '1' && data[3] != '2')
 				throw ParseException(ParseException::WrongVersion, "Save format from newer version");
 			readOPS(data, dataSize);
 		}
@@ -261,10 +532,10 @@ void GameSave::setSize(int newWidth, int newHeight)
 	ambientHeat = Allocate2DArray<float>(blockWidth, blockHeight, 0.0f);
 }
 
-std::vector<char> GameSave::Serialise()
+std::vector<char> GameSave::Serialise(Container container)
 {
 	unsigned int dataSize;
-	char * data = Serialise(dataSize);
+	char * data = Serialise(dataSize, container);
 	if (data == NULL)
 		return std::vector<char>();
 	std::vector<char> dataVect(data, data+dataSize);
@@ -272,11 +543,11 @@ std::vector<char> GameSave::Serialise()
 	return dataVect;
 }
 
-char * GameSave::Serialise(unsigned int & dataSize)
+char * GameSave::Serialise(unsigned int & dataSize, Container container)
 {
 	try
 	{
-		return serialiseOPS(dataSize);
+		return serialiseOPS(dataSize, container);
 	}
 	catch (BuildException & e)
 	{
@@ -603,11 +874,156 @@ void GameSave::CheckBsonFieldFloat(bson_iterator iter, const char *field, float
 	}
 }
 
+// Converts the properties of particles from older saves to what the current version expects
+void GameSave::fixParticle(Particle &part, int savedVersion, bool fakeNewerVersion)
+{
+	switch(part.type)
+	{
+	case PT_SOAP:
+		//Clear soap links, links will be added back in if soapLinkData is present
+		part.ctype &= ~6;
+		break;
+	case PT_BOMB:
+		if (part.tmp!=0 && savedVersion < 81)
+		{
+			part.type = PT_EMBR;
+			part.ctype = 0;
+			if (part.tmp==1)
+				part.tmp = 0;
+		}
+		break;
+	case PT_DUST:
+		if (part.life>0 && savedVersion < 81)
+		{
+			part.type = PT_EMBR;
+			part.ctype = (part.tmp2<<16) | (part.tmp<<8) | part.ctype;
+			part.tmp = 1;
+		}
+		break;
+	case PT_FIRW:
+		if (part.tmp>=2 && savedVersion < 81)
+		{
+			auto caddress = int(restrict_flt(float(part.tmp-4), 0.0f, 199.0f)) * 3;
+			part.type = PT_EMBR;
+			part.tmp = 1;
+			part.ctype = (((firw_data[caddress]))<<16) | (((firw_data[caddress+1]))<<8) | ((firw_data[caddress+2]));
+		}
+		break;
+	case PT_PSTN:
+		if (savedVersion < 87 && part.ctype)
+			part.life = 1;
+		if (savedVersion < 91)
+			part.temp = 283.15f;
+		break;
+	case PT_FILT:
+		if (savedVersion < 89)
+		{
+			if (part.tmp<0 || part.tmp>3)
+				part.tmp = 6;
+			part.ctype = 0;
+		}
+		break;
+	case PT_QRTZ:
+	case PT_PQRT:
+		if (savedVersion < 89)
+		{
+			part.tmp2 = part.tmp;
+			part.tmp = part.ctype;
+			part.ctype = 0;
+		}
+		break;
+	case PT_PHOT:
+		if (savedVersion < 90)
+		{
+			part.flags |= FLAG_PHOTDECO;
+		}
+		break;
+	case PT_VINE:
+		if (savedVersion < 91)
+		{
+			part.tmp = 1;
+		}
+		break;
+	case PT_DLAY:
+		// correct DLAY temperature in older saves
+		// due to either the +.5f now done in DLAY (higher temps), or rounding errors in the old DLAY code (room temperature temps),
+		// the delay in all DLAY from older versions will always be one greater than it should
+		if (savedVersion < 91)
+		{
+			part.temp = part.temp - 1.0f;
+		}
+		break;
+	case PT_CRAY:
+		if (savedVersion < 91)
+		{
+			if (part.tmp2)
+			{
+				part.ctype |= part.tmp2<<8;
+				part.tmp2 = 0;
+			}
+		}
+		break;
+	case PT_CONV:
+		if (savedVersion < 91)
+		{
+			if (part.tmp)
+			{
+				part.ctype |= part.tmp<<8;
+				part.tmp = 0;
+			}
+		}
+		break;
+	case PT_PIPE:
+	case PT_PPIP:
+		if (savedVersion < 93 && !fakeNewerVersion)
+		{
+			if (part.ctype == 1)
+				part.tmp |= 0x00020000; //PFLAG_INITIALIZING
+			part.tmp |= (part.ctype-1)<<18;
+			part.ctype = part.tmp&0xFF;
+		}
+		break;
+	case PT_TSNS:
+	case PT_HSWC:
+	case PT_PSNS:
+	case PT_PUMP:
+		if (savedVersion < 93 && !fakeNewerVersion)
+		{
+			part.tmp = 0;
+		}
+		break;
+	case PT_LIFE:
+		if (savedVersion < 96 && !fakeNewerVersion)
+		{
+			if (part.ctype >= 0 && part.ctype < NGOL)
+			{
+				part.tmp2 = part.tmp;
+				if (!part.dcolour)
+					part.dcolour = builtinGol[part.ctype].colour;
+				part.tmp = builtinGol[part.ctype].colour2;
+			}
+		}
+	}
+	if (PressureInTmp3(part.type))
+	{
+		// pavg[1] used to be saved as a u16, which PressureInTmp3 elements then treated as
+		// an i16. tmp3 is now saved as a u32, or as a u16 if it's small enough. PressureInTmp3
+		// elements will never use the upper 16 bits, and should still treat the lower 16 bits
+		// as an i16, so they need sign extension.
+		auto tmp3 = (unsigned int)(part.tmp3);
+		if (tmp3 & 0x8000U)
+		{
+			tmp3 |= 0xFFFF0000U;
+			part.tmp3 = int(tmp3);
+		}
+	}
+}
+
 void GameSave::readOPS(char * data, int dataLength)
 {
 	unsigned char *inputData = (unsigned char*)data, *bsonData = NULL, *partsData = NULL, *partsPosData = NULL, *fanData = NULL, *wallData = NULL, *soapLinkData = NULL;
-	unsigned char *pressData = NULL, *vxData = NULL, *vyData = NULL, *ambientData = NULL;
-	unsigned int inputDataLen = dataLength, bsonDataLen = 0, partsDataLen, partsPosDataLen, fanDataLen, wallDataLen, soapLinkDataLen;
+	unsigned char *pressData = NULL, *vxData = NULL, *vyData = NULL, *ambientData = NULL, *partsColumnsData = NULL;
+	unsigned int inputDataLen = dataLength, bsonDataLen = 0, partsDataLen, partsPosDataLen, fanDataLen, wallDataLen, soapLinkDataLen, partsColumnsDataLen;
 	unsigned int pressDataLen, vxDataLen, vyDataLen, ambientDataLen;
 	unsigned partsCount = 0;
 	unsigned int blockX, blockY, blockW, blockH, fullX, fullY, fullW, fullH;
@@ -673,10 +1089,17 @@ void GameSave::readOPS(char * data, int dataLength)
 	//(bson_iterator_key returns a pointer into bsonData, which is then used with strcmp)
 	bsonData[bsonDataLen] = 0;
 
-	int bz2ret;
-	if ((bz2ret = BZ2_bzBuffToBuffDecompress((char*)bsonData, &bsonDataLen, (char*)(inputData+12), inputDataLen-12, 0, 0)) != BZ_OK)
+	if (inputData[3] == '2')
 	{
-		throw ParseException(ParseException::Corrupt, String::Build("Unable to decompress (ret ", bz2ret, ")"));
+		InflateBlocks(bsonData, bsonDataLen, inputData, inputDataLen);
+	}
+	else
+	{
+		int bz2ret;
+		if ((bz2ret = BZ2_bzBuffToBuffDecompress((char*)bsonData, &bsonDataLen, (char*)(inputData+12), inputDataLen-12, 0, 0)) != BZ_OK)
+		{
+			throw ParseException(ParseException::Corrupt, String::Build("Unable to decompress (ret ", bz2ret, ")"));
+		}
 	}
 
 	set_bson_err_handler([](const char* err) { throw ParseException(ParseException::Corrupt, "BSON error when parsing save: " + ByteString(err).FromUtf8()); });
@@ -689,6 +1112,7 @@ void GameSave::readOPS(char * data, int dataLength)
 	{
 		CheckBsonFieldUser(iter, "parts", &partsData, &partsDataLen);
 		CheckBsonFieldUser(iter, "partsPos", &partsPosData, &partsPosDataLen);
+		CheckBsonFieldUser(iter, "partsColumns", &partsColumnsData, &partsColumnsDataLen);
 		CheckBsonFieldUser(iter, "wallMap", &wallData, &wallDataLen);
 		CheckBsonFieldUser(iter, "pressMap", &pressData, &pressDataLen);
 		CheckBsonFieldUser(iter, "vxMap", &vxData, &vxDataLen);
@@ -1243,147 +1667,7 @@ void GameSave::readOPS(char * data, int dataLength)
 							i += 4;
 					}
 
-					//Particle specific parsing:
-					switch(particles[newIndex].type)
-					{
-					case PT_SOAP:
-						//Clear soap links, links will be added back in if soapLinkData is present
-						particles[newIndex].ctype &= ~6;
-						break;
-					case PT_BOMB:
-						if (particles[newIndex].tmp!=0 && savedVersion < 81)
-						{
-							particles[newIndex].type = PT_EMBR;
-							particles[newIndex].ctype = 0;
-							if (particles[newIndex].tmp==1)
-								particles[newIndex].tmp = 0;
-						}
-						break;
-					case PT_DUST:
-						if (particles[newIndex].life>0 && savedVersion < 81)
-						{
-							particles[newIndex].type = PT_EMBR;
-							particles[newIndex].ctype = (particles[newIndex].tmp2<<16) | (particles[newIndex].tmp<<8) | particles[newIndex].ctype;
-							particles[newIndex].tmp = 1;
-						}
-						break;
-					case PT_FIRW:
-						if (particles[newIndex].tmp>=2 && savedVersion < 81)
-						{
-							auto caddress = int(restrict_flt(float(particles[newIndex].tmp-4), 0.0f, 199.0f)) * 3;
-							particles[newIndex].type = PT_EMBR;
-							particles[newIndex].tmp = 1;
-							particles[newIndex].ctype = (((firw_data[caddress]))<<16) | (((firw_data[caddress+1]))<<8) | ((firw_data[caddress+2]));
-						}
-						break;
-					case PT_PSTN:
-						if (savedVersion < 87 && particles[newIndex].ctype)
-							particles[newIndex].life = 1;
-						if (savedVersion < 91)
-							particles[newIndex].temp = 283.15f;
-						break;
-					case PT_FILT:
-						if (savedVersion < 89)
-						{
-							if (particles[newIndex].tmp<0 || particles[newIndex].tmp>3)
-								particles[newIndex].tmp = 6;
-							particles[newIndex].ctype = 0;
-						}
-						break;
-					case PT_QRTZ:
-					case PT_PQRT:
-						if (savedVersion < 89)
-						{
-							particles[newIndex].tmp2 = particles[newIndex].tmp;
-							particles[newIndex].tmp = particles[newIndex].ctype;
-							particles[newIndex].ctype = 0;
-						}
-						break;
-					case PT_PHOT:
-						if (savedVersion < 90)
-						{
-							particles[newIndex].flags |= FLAG_PHOTDECO;
-						}
-						break;
-					case PT_VINE:
-						if (savedVersion < 91)
-						{
-							particles[newIndex].tmp = 1;
-						}
-						break;
-					case PT_DLAY:
-						// correct DLAY temperature in older saves
-						// due to either the +.5f now done in DLAY (higher temps), or rounding errors in the old DLAY code (room temperature temps),
-						// the delay in all DLAY from older versions will always be one greater than it should
-						if (savedVersion < 91)
-						{
-							particles[newIndex].temp = particles[newIndex].temp - 1.0f;
-						}
-						break;
-					case PT_CRAY:
-						if (savedVersion < 91)
-						{
-							if (particles[newIndex].tmp2)
-							{
-								particles[newIndex].ctype |= particles[newIndex].tmp2<<8;
-								particles[newIndex].tmp2 = 0;
-							}
-						}
-						break;
-					case PT_CONV:
-						if (savedVersion < 91)
-						{
-							if (particles[newIndex].tmp)
-							{
-								particles[newIndex].ctype |= particles[newIndex].tmp<<8;
-								particles[newIndex].tmp = 0;
-							}
-						}
-						break;
-					case PT_PIPE:
-					case PT_PPIP:
-						if (savedVersion < 93 && !fakeNewerVersion)
-						{
-							if (particles[newIndex].ctype == 1)
-								particles[newIndex].tmp |= 0x00020000; //PFLAG_INITIALIZING
-							particles[newIndex].tmp |= (particles[newIndex].ctype-1)<<18;
-							particles[newIndex].ctype = particles[newIndex].tmp&0xFF;
-						}
-						break;
-					case PT_TSNS:
-					case PT_HSWC:
-					case PT_PSNS:
-					case PT_PUMP:
-						if (savedVersion < 93 && !fakeNewerVersion)
-						{
-							particles[newIndex].tmp = 0;
-						}
-						break;
-					case PT_LIFE:
-						if (savedVersion < 96 && !fakeNewerVersion)
-						{
-							if (particles[newIndex].ctype >= 0 && particles[newIndex].ctype < NGOL)
-							{
-								particles[newIndex].tmp2 = particles[newIndex].tmp;
-								if (!particles[newIndex].dcolour)
-									particles[newIndex].dcolour = builtinGol[particles[newIndex].ctype].colour;
-								particles[newIndex].tmp = builtinGol[particles[newIndex].ctype].colour2;
-							}
-						}
-					}
-					if (PressureInTmp3(particles[newIndex].type))
-					{
-						// pavg[1] used to be saved as a u16, which PressureInTmp3 elements then treated as
-						// an i16. tmp3 is now saved as a u32, or as a u16 if it's small enough. PressureInTmp3
-						// elements will never use the upper 16 bits, and should still treat the lower 16 bits
-						// as an i16, so they need sign extension.
-						auto tmp3 = (unsigned int)(particles[newIndex].tmp3);
-						if (tmp3 & 0x8000U)
-						{
-							tmp3 |= 0xFFFF0000U;
-							particles[newIndex].tmp3 = int(tmp3);
-						}
-					}
+					fixParticle(particles[newIndex], savedVersion, fakeNewerVersion);
 					//note: PSv was used in version 77.0 and every version before, add something in PSv too if the element is that old
 					newIndex++;
 					partsCount++;
@@ -1394,6 +1678,62 @@ void GameSave::readOPS(char * data, int dataLength)
 		if (i != partsDataLen)
 			throw ParseException(ParseException::Corrupt, "Didn't reach end of particle data buffer");
 	}
+	else if (partsColumnsData)
+	{
+		const unsigned char *columnsData = partsColumnsData, *columnsEnd = partsColumnsData + partsColumnsDataLen;
+		auto count = GetVarint(columnsData, columnsEnd);
+		if (count > NPART)
+			throw ParseException(ParseException::Corrupt, "Too many particles");
+		std::array<ColumnReader, columnCount> columns;
+		for (auto &column : columns)
+		{
+			auto columnLen = GetVarint(columnsData, columnsEnd);
+			if (columnLen > uint64_t(columnsEnd - columnsData))
+				throw ParseException(ParseException::Corrupt, "Ran past particle data buffer");
+			column = ColumnReader(columnsData, columnsData + columnLen);
+			columnsData += columnLen;
+		}
+		if (columnsData != columnsEnd)
+			throw ParseException(ParseException::Corrupt, "Didn't reach end of particle data buffer");
+
+		partsCount = 0;
+		unsigned int pos = 0;
+		int temp = 0;
+		for (unsigned int newIndex = 0; newIndex < count; newIndex++)
+		{
+			auto &part = particles[newIndex];
+			memset(&part, 0, sizeof(Particle));
+			int posDelta = columns[columnPos].Next();
+			if (posDelta < 0 || pos + posDelta >= fullW * fullH)
+				throw ParseException(ParseException::Corrupt, "Particle out of range");
+			pos += posDelta;
+			part.x = float(pos % fullW + fullX);
+			part.y = float(pos / fullW + fullY);
+			part.type = columns[columnType].Next();
+			temp = int(unsigned(temp) + unsigned(columns[columnTemp].Next()));
+			if (temp & 1)
+				part.temp = float((temp - 1) / 2);
+			else
+				part.temp = temp / 2 + 294.15f;
+			part.life = columns[columnLife].Next();
+			part.tmp = columns[columnTmp].Next();
+			part.ctype = columns[columnCtype].Next();
+			part.dcolour = columns[columnDcolour].Next();
+			part.vx = columns[columnVx].Next() / 16.0f;
+			part.vy = columns[columnVy].Next() / 16.0f;
+			part.tmp2 = columns[columnTmp2].Next();
+			part.tmp3 = columns[columnTmp3].Next();
+			part.tmp4 = columns[columnTmp4].Next();
+			fixParticle(part, savedVersion, fakeNewerVersion);
+			particlesCount = newIndex+1;
+			partsCount++;
+		}
+		for (auto &column : columns)
+		{
+			if (!column.Done())
+				throw ParseException(ParseException::Corrupt, "Didn't reach end of particle data buffer");
+		}
+	}
 
 	if (soapLinkData)
 	{
@@ -2096,7 +2436,7 @@ void GameSave::readPSv(char * saveDataChar, int dataLength)
 	minimumMinorVersion = minor;\
 }
 
-char * GameSave::serialiseOPS(unsigned int & dataLength)
+char * GameSave::serialiseOPS(unsigned int & dataLength, Container container)
 {
 	int blockX, blockY, blockW, blockH, fullX, fullY, fullW, fullH;
 	int x, y, i;
@@ -2222,19 +2562,31 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 		}
 	}
 
+	// Local saves store particles as columns, which are smaller before compression and don't need
+	// partsPos. Saves for the server and older versions keep the parts and partsPos layout.
+	bool columns = container == containerOPS2;
+	if (columns)
+	{
+		RESTRICTVERSION(96, 3);
+	}
+
 	//Store number of particles in each position
-	auto partsPosData = std::unique_ptr<unsigned char[]>(new unsigned char[fullW*fullH*3]);
+	std::unique_ptr<unsigned char[]> partsPosData;
 	unsigned int partsPosDataLen = 0;
-	if (!partsPosData)
-		throw BuildException("Save error, out of memory (partposdata)");
-	for (y=0;y<fullH;y++)
+	if (!columns)
 	{
-		for (x=0;x<fullW;x++)
+		partsPosData = std::unique_ptr<unsigned char[]>(new unsigned char[fullW*fullH*3]);
+		if (!partsPosData)
+			throw BuildException("Save error, out of memory (partposdata)");
+		for (y=0;y<fullH;y++)
 		{
-			unsigned int posCount = partsPosCount[y*fullW + x];
-			partsPosData[partsPosDataLen++] = (posCount&0x00FF0000)>>16;
-			partsPosData[partsPosDataLen++] = (posCount&0x0000FF00)>>8;
-			partsPosData[partsPosDataLen++] = (posCount&0x000000FF);
+			for (x=0;x<fullW;x++)
+			{
+				unsigned int posCount = partsPosCount[y*fullW + x];
+				partsPosData[partsPosDataLen++] = (posCount&0x00FF0000)>>16;
+				partsPosData[partsPosDataLen++] = (posCount&0x0000FF00)>>8;
+				partsPosData[partsPosDataLen++] = (posCount&0x000000FF);
+			}
 		}
 	}
 
@@ -2253,11 +2605,15 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 
 	// Allocate enough space to store all Particles and 3 bytes on top of that per Particle, for the field descriptors.
 	// In practice, a Particle will never need as much space in the save as in memory; this is just an upper bound to simplify allocation.
-	auto partsData = std::unique_ptr<unsigned char[]>(new unsigned char[NPART * (sizeof(Particle)+3)]);
+	std::unique_ptr<unsigned char[]> partsData;
 	unsigned int partsDataLen = 0;
+	if (!columns)
+		partsData = std::unique_ptr<unsigned char[]>(new unsigned char[NPART * (sizeof(Particle)+3)]);
+	std::array<ColumnWriter, columnCount> partsColumns;
+	int lastPos = 0, lastTemp = 0;
 	auto partsSaveIndex = std::unique_ptr<unsigned[]>(new unsigned[NPART]);
 	unsigned int partsCount = 0;
-	if (!partsData || !partsSaveIndex)
+	if ((!columns && !partsData) || !partsSaveIndex)
 		throw BuildException("Save error, out of memory (partsdata)");
 	std::fill(&partsSaveIndex[0], &partsSaveIndex[NPART], 0);
 	for (y=0;y<fullH;y++)
@@ -2279,6 +2635,92 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 				//Store saved particle index+1 for this partsptr index (0 means not saved)
 				partsSaveIndex[i] = (partsCount++) + 1;
 
+				if (particles[i].type == PT_SOAP)
+					soapCount++;
+
+				if (particles[i].type == PT_RPEL && particles[i].ctype)
+				{
+					RESTRICTVERSION(91, 4);
+				}
+				else if (particles[i].type == PT_NWHL && particles[i].tmp)
+				{
+					RESTRICTVERSION(91, 5);
+				}
+				if (particles[i].type == PT_HEAC || particles[i].type == PT_SAWD || particles[i].type == PT_POLO
+						|| particles[i].type == PT_RFRG || particles[i].type == PT_RFGL || particles[i].type == PT_LSNS)
+				{
+					RESTRICTVERSION(92, 0);
+				}
+				else if ((particles[i].type == PT_FRAY || particles[i].type == PT_INVIS) && particles[i].tmp)
+				{
+					RESTRICTVERSION(92, 0);
+				}
+				else if (particles[i].type == PT_PIPE || particles[i].type == PT_PPIP)
+				{
+					RESTRICTVERSION(93, 0);
+				}
+				if (particles[i].type == PT_TSNS || particles[i].type == PT_PSNS
+				        || particles[i].type == PT_HSWC || particles[i].type == PT_PUMP)
+				{
+					if (particles[i].tmp == 1)
+					{
+						RESTRICTVERSION(93, 0);
+					}
+				}
+				if (PMAPBITS > 8)
+				{
+					if (TypeInCtype(particles[i].type, particles[i].ctype) && particles[i].ctype > 0xFF)
+					{
+						RESTRICTVERSION(93, 0);
+					}
+					else if (TypeInTmp(particles[i].type) && particles[i].tmp > 0xFF)
+					{
+						RESTRICTVERSION(93, 0);
+					}
+					else if (TypeInTmp2(particles[i].type, particles[i].tmp2) && particles[i].tmp2 > 0xFF)
+					{
+						RESTRICTVERSION(93, 0);
+					}
+				}
+				if (particles[i].type == PT_LDTC)
+				{
+					RESTRICTVERSION(94, 0);
+				}
+				if (particles[i].type == PT_TSNS || particles[i].type == PT_PSNS)
+				{
+					if (particles[i].tmp == 2)
+					{
+						RESTRICTVERSION(94, 0);
+					}
+				}
+				if (particles[i].type == PT_LSNS)
+				{
+					if (particles[i].tmp >= 1 || particles[i].tmp <= 3)
+					{
+						RESTRICTVERSION(95, 0);
+					}
+				}
+				if (particles[i].type == PT_LIFE)
+				{
+					RESTRICTVERSION(96, 0);
+				}
+				if (particles[i].type == PT_GLAS && particles[i].life > 0)
+				{
+					RESTRICTVERSION(97, 0);
+				}
+
+				// everything from here on is the legacy layout
+				if (columns)
+				{
+					PushParticleColumns(partsColumns, particles[i], y*fullW + x, lastPos, lastTemp, !PressureInTmp3(particles[i].type) || hasPressure);
+					if (((unsigned(particles[i].tmp3) >> 16) || (unsigned(particles[i].tmp4) >> 16)) && !PressureInTmp3(particles[i].type))
+					{
+						RESTRICTVERSION(97, 0);
+					}
+					i = partsPosLink[i];
+					continue;
+				}
+
 				//Type (required)
 				partsData[partsDataLen++] = particles[i].type;
 
@@ -2446,80 +2888,6 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 					partsData[fieldDesc3Loc] = fieldDesc>>16;
 				}
 
-				if (particles[i].type == PT_SOAP)
-					soapCount++;
-
-				if (particles[i].type == PT_RPEL && particles[i].ctype)
-				{
-					RESTRICTVERSION(91, 4);
-				}
-				else if (particles[i].type == PT_NWHL && particles[i].tmp)
-				{
-					RESTRICTVERSION(91, 5);
-				}
-				if (particles[i].type == PT_HEAC || particles[i].type == PT_SAWD || particles[i].type == PT_POLO
-						|| particles[i].type == PT_RFRG || particles[i].type == PT_RFGL || particles[i].type == PT_LSNS)
-				{
-					RESTRICTVERSION(92, 0);
-				}
-				else if ((particles[i].type == PT_FRAY || particles[i].type == PT_INVIS) && particles[i].tmp)
-				{
-					RESTRICTVERSION(92, 0);
-				}
-				else if (particles[i].type == PT_PIPE || particles[i].type == PT_PPIP)
-				{
-					RESTRICTVERSION(93, 0);
-				}
-				if (particles[i].type == PT_TSNS || particles[i].type == PT_PSNS
-				        || particles[i].type == PT_HSWC || particles[i].type == PT_PUMP)
-				{
-					if (particles[i].tmp == 1)
-					{
-						RESTRICTVERSION(93, 0);
-					}
-				}
-				if (PMAPBITS > 8)
-				{
-					if (TypeInCtype(particles[i].type, particles[i].ctype) && particles[i].ctype > 0xFF)
-					{
-						RESTRICTVERSION(93, 0);
-					}
-					else if (TypeInTmp(particles[i].type) && particles[i].tmp > 0xFF)
-					{
-						RESTRICTVERSION(93, 0);
-					}
-					else if (TypeInTmp2(particles[i].type, particles[i].tmp2) && particles[i].tmp2 > 0xFF)
-					{
-						RESTRICTVERSION(93, 0);
-					}
-				}
-				if (particles[i].type == PT_LDTC)
-				{
-					RESTRICTVERSION(94, 0);
-				}
-				if (particles[i].type == PT_TSNS || particles[i].type == PT_PSNS)
-				{
-					if (particles[i].tmp == 2)
-					{
-						RESTRICTVERSION(94, 0);
-					}
-				}
-				if (particles[i].type == PT_LSNS)
-				{
-					if (particles[i].tmp >= 1 || particles[i].tmp <= 3)
-					{
-						RESTRICTVERSION(95, 0);
-					}
-				}
-				if (particles[i].type == PT_LIFE)
-				{
-					RESTRICTVERSION(96, 0);
-				}
-				if (particles[i].type == PT_GLAS && particles[i].life > 0)
-				{
-					RESTRICTVERSION(97, 0);
-				}
-
 				//Get the pmap entry for the next particle in the same position
 				i = partsPosLink[i];
 			}
@@ -2659,9 +3027,23 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 	}
 
 	bson_append_int(&b, "pmapbits", pmapbits);
-	if (partsData && partsDataLen)
+	std::vector<unsigned char> partsColumnsData;
+	if (columns && partsCount)
 	{
-		bson_append_binary(&b, "parts", (char)BSON_BIN_USER, (const char *)partsData.get(), partsDataLen);
+		PutVarint(partsColumnsData, partsCount);
+		for (auto &column : partsColumns)
+		{
+			auto &columnData = column.Finish();
+			PutVarint(partsColumnsData, columnData.size());
+			partsColumnsData.insert(partsColumnsData.end(), columnData.begin(), columnData.end());
+		}
+	}
+	if ((partsData && partsDataLen) || partsColumnsData.size())
+	{
+		if (partsColumnsData.size())
+			bson_append_binary(&b, "partsColumns", (char)BSON_BIN_USER, (const char *)&partsColumnsData[0], partsColumnsData.size());
+		else
+			bson_append_binary(&b, "parts", (char)BSON_BIN_USER, (const char *)partsData.get(), partsDataLen);
 
 		if (palette.size())
 		{
@@ -2726,6 +3108,9 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 
 	unsigned char *finalData = (unsigned char*)bson_data(&b);
 	unsigned int finalDataLen = bson_size(&b);
+	if (container == containerOPS2)
+		return DeflateBlocks(finalData, finalDataLen, blockW, blockH, dataLength);
+
 	auto outputData = std::unique_ptr<unsigned char[]>(new unsigned char[finalDataLen*2+12]);
 	if (!outputData)
 		throw BuildException(String::Build("Save error, out of memory (finalData): ", finalDataLen*2+12));
@@ -120,8 +120,15 @@ public:
 	GameSave(std::vector<unsigned char> data);
 	~GameSave();
 	void setSize(int width, int height);
-	char * Serialise(unsigned int & dataSize);
-	std::vector<char> Serialise();
+	// OPS1 is what the server and older versions read. OPS2 holds the same data in blocks
+	// that are compressed and decompressed on several threads at once.
+	enum Container
+	{
+		containerOPS1,
+		containerOPS2,
+	};
+	char * Serialise(unsigned int & dataSize, Container container = containerOPS1);
+	std::vector<char> Serialise(Container container = containerOPS1);
 	vector2d Translate(vector2d translate);
 	void Transform(matrix2d transform, vector2d translate);
 	void Transform(matrix2d transform, vector2d translate, vector2d translateReal, int newWidth, int newHeight);
@@ -129,6 +136,9 @@ public:
 	void Expand();
 	void Collapse();
 	bool Collapsed();
+	// The data the save was read from, or an empty vector if it has been expanded since
+	// and may no longer match it
+	const std::vector<char> &CollapsedData() const;
 
 	static bool TypeInCtype(int type, int ctype);
 	static bool TypeInTmp(int type);
@@ -156,9 +166,10 @@ private:
 	template <typename T> void Deallocate2DArray(T ***array, int blockHeight);
 	void dealloc();
 	void read(char * data, int dataSize);
+	static void fixParticle(Particle &part, int savedVersion, bool fakeNewerVersion);
 	void readOPS(char * data, int dataLength);
 	void readPSv(char * data, int dataLength);
-	char * serialiseOPS(unsigned int & dataSize);
+	char * serialiseOPS(unsigned int & dataSize, Container container);
 	void ConvertJsonToBson(bson *b, Json::Value j, int depth = 0);
 	void ConvertBsonToJson(bson_iterator *b, Json::Value *j, int depth = 0);
 };
@@ -1,33 +1,54 @@
 #include "SaveFile.h"
 #include "GameSave.h"
+#include "Client.h"
 
 SaveFile::SaveFile(SaveFile & save):
 	gameSave(NULL),
 	filename(save.filename),
 	displayName(save.displayName),
-	loadingError(save.loadingError)
+	loadingError(save.loadingError),
+	lazy(save.lazy)
 {
 	if (save.gameSave)
 		gameSave = new GameSave(*save.gameSave);
 }
 
-SaveFile::SaveFile(ByteString filename):
+SaveFile::SaveFile(ByteString filename, bool lazy):
 	gameSave(NULL),
 	filename(filename),
 	displayName(filename.FromUtf8()),
-	loadingError("")
+	loadingError(""),
+	lazy(lazy)
 {
 
 }
 
 GameSave * SaveFile::GetGameSave()
 {
+	if (lazy)
+	{
+		lazy = false;
+		try
+		{
+			gameSave = new GameSave(Client::Ref().ReadFile(filename));
+		}
+		catch (const std::exception &e)
+		{
+			loadingError = ByteString(e.what()).FromUtf8();
+		}
+	}
 	return gameSave;
 }
 
+bool SaveFile::IsLazy()
+{
+	return lazy;
+}
+
 void SaveFile::SetGameSave(GameSave * save)
 {
 	gameSave = save;
+	lazy = false;
 }
 
 ByteString SaveFile::GetName()
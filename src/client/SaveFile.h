@@ -8,9 +8,11 @@ class GameSave;
 class SaveFile {
 public:
 	SaveFile(SaveFile & save);
-	SaveFile(ByteString filename);
+	// A lazy SaveFile only reads its save the first time GetGameSave is called
+	SaveFile(ByteString filename, bool lazy = false);
 
 	GameSave * GetGameSave();
+	bool IsLazy();
 	void SetGameSave(GameSave * save);
 	String GetDisplayName();
 	void SetDisplayName(String displayName);
@@ -25,6 +27,7 @@ private:
 	ByteString filename;
 	String displayName;
 	String loadingError;
+	bool lazy;
 };
 
 #endif /* SAVEFILE_H_ */
@@ -0,0 +1,45 @@
+#include "SaveWriterTask.h"
+
+#include "client/Client.h"
+
+SaveWriterTask::SaveWriterTask(std::unique_ptr<GameSave> newSave, ByteString newFilename, GameSave::Container newContainer, std::function<void (String)> newOnDone) :
+	save(std::move(newSave)),
+	filename(newFilename),
+	container(newContainer),
+	onDone(newOnDone)
+{
+}
+
+bool SaveWriterTask::doWork()
+{
+	std::vector<char> saveData = save->Serialise(container);
+	save.reset();
+	if (saveData.size() == 0)
+	{
+		notifyError("Unable to serialize game data.");
+		return false;
+	}
+	if (Client::Ref().WriteFile(saveData, filename))
+	{
+		notifyError("Unable to write save file.");
+		return false;
+	}
+	return true;
+}
+
+void SaveWriterTask::after()
+{
+	if (onDone)
+		onDone(success ? String() : error);
+}
+
+ByteString SaveWriterTask::GetFilename() const
+{
+	return filename;
+}
+
+void SaveWriterTask::FinishQuietly()
+{
+	onDone = nullptr;
+	Finish();
+}
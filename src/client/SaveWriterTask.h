@@ -0,0 +1,32 @@
+#ifndef SAVEWRITERTASK_H
+#define SAVEWRITERTASK_H
+
+#include "tasks/AbandonableTask.h"
+
+#include <functional>
+#include <memory>
+
+#include "client/GameSave.h"
+#include "common/String.h"
+
+// Serialises a save that has already been taken from the simulation and writes it to a
+// file, so that the thread that took it doesn't have to wait for the compression
+class SaveWriterTask : public AbandonableTask
+{
+	std::unique_ptr<GameSave> save;
+	ByteString filename;
+	GameSave::Container container;
+	std::function<void (String)> onDone;
+
+	bool doWork() override;
+	void after() override;
+
+public:
+	// onDone is called from Poll or Finish with an empty string, or with what went wrong
+	SaveWriterTask(std::unique_ptr<GameSave> newSave, ByteString newFilename, GameSave::Container newContainer, std::function<void (String)> newOnDone);
+	ByteString GetFilename() const;
+	// Finish without calling onDone, for when whoever asked for the write has gone away
+	void FinishQuietly();
+};
+
+#endif // SAVEWRITERTASK_H
@@ -0,0 +1,125 @@
+#include "ThumbnailCache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "Format.h"
+#include "common/Platform.h"
+#include "graphics/Graphics.h"
+
+// An entry is a line with the path of the save, a line with its size, modification time
+// and the kind of thumbnail, and then the thumbnail as PTI
+
+ByteString ThumbnailCache::EntryFilename(ByteString filename)
+{
+	// FNV-1a
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (auto ch : filename)
+		hash = (hash ^ uint8_t(ch)) * 0x100000001B3ULL;
+	return ByteString::Build(THUMBNAIL_CACHE_DIR, PATH_SEP, Format::Hex(Format::Width(hash, 16)), ".pti");
+}
+
+ByteString ThumbnailCache::EntryHeader(ByteString filename, ByteString kind)
+{
+	uint64_t size;
+	int64_t modifiedTime;
+	if (!Platform::FileInfo(filename, size, modifiedTime))
+		return "";
+	return ByteString::Build(filename, "\n", size, " ", modifiedTime, " ", kind, "\n");
+}
+
+bool ThumbnailCache::Contains(ByteString filename)
+{
+	// everything up to the kind
+	auto header = EntryHeader(filename, "");
+	if (!header.size())
+		return false;
+	header.pop_back();
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	std::ifstream entry(EntryFilename(filename).c_str(), std::ios::binary);
+	std::vector<char> start(header.size());
+	if (!entry.read(&start[0], start.size()))
+		return false;
+	return ByteString(start.begin(), start.end()) == header;
+}
+
+std::unique_ptr<VideoBuffer> ThumbnailCache::Get(ByteString filename, ByteString kind)
+{
+	auto header = EntryHeader(filename, kind);
+	if (!header.size())
+		return nullptr;
+	std::vector<char> data;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::ifstream entry(EntryFilename(filename).c_str(), std::ios::binary);
+		if (!entry.is_open())
+			return nullptr;
+		data.assign(std::istreambuf_iterator<char>(entry), std::istreambuf_iterator<char>());
+	}
+	if (data.size() <= header.size() || ByteString(data.begin(), data.begin() + header.size()) != header)
+		return nullptr;
+	std::vector<char> pti(data.begin() + header.size(), data.end());
+	return std::unique_ptr<VideoBuffer>(format::PTIToVideoBuffer(pti));
+}
+
+void ThumbnailCache::Put(ByteString filename, ByteString kind, const VideoBuffer &thumbnail)
+{
+	auto header = EntryHeader(filename, kind);
+	if (!header.size())
+		return;
+	auto pti = format::VideoBufferToPTI(thumbnail);
+	if (pti.empty())
+		return;
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	if (!Platform::DirectoryExists(THUMBNAIL_CACHE_DIR))
+		Platform::MakeDirectory(THUMBNAIL_CACHE_DIR);
+	{
+		std::ofstream entry(EntryFilename(filename).c_str(), std::ios::binary);
+		entry.write(header.data(), header.size());
+		entry.write(&pti[0], pti.size());
+	}
+	// an entry that replaced an older one is counted twice until the next Prune
+	if (cacheBytes)
+		cacheBytes += header.size() + pti.size();
+	if (!cacheBytes || cacheBytes > maxCacheBytes)
+		Prune();
+}
+
+void ThumbnailCache::Prune()
+{
+	struct Entry
+	{
+		ByteString filename;
+		uint64_t size;
+		int64_t modifiedTime;
+	};
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+	for (auto &file : Platform::DirectorySearch(THUMBNAIL_CACHE_DIR, "", { ".pti" }))
+	{
+		Entry entry{ ByteString::Build(THUMBNAIL_CACHE_DIR, PATH_SEP, file), 0, 0 };
+		if (!Platform::FileInfo(entry.filename, entry.size, entry.modifiedTime))
+			continue;
+		total += entry.size;
+		entries.push_back(entry);
+	}
+	if (total > maxCacheBytes)
+	{
+		// down to three quarters, so that this doesn't happen again on the next Put
+		std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+			return a.modifiedTime < b.modifiedTime;
+		});
+		for (auto &entry : entries)
+		{
+			if (total <= maxCacheBytes / 4 * 3)
+				break;
+			if (Platform::RemoveFile(entry.filename))
+				total -= entry.size;
+		}
+	}
+	// never 0, so the directory is only looked at again once it has grown
+	cacheBytes = std::max(total, uint64_t(1));
+}
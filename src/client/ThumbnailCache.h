@@ -0,0 +1,44 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+#include "Config.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "common/Singleton.h"
+#include "common/String.h"
+
+class VideoBuffer;
+
+// Thumbnails of local saves and stamps, kept in THUMBNAIL_CACHE_DIR so that opening a
+// folder doesn't have to read, parse and render every save in it again. Entries are
+// keyed by the path, size and modification time of the save, so changing the file
+// invalidates its entry. A save only gets an entry once it has been parsed and rendered,
+// so having one also means the save could be read back then. Entries of saves that were
+// changed or deleted are never read again, so once the directory grows past
+// maxCacheBytes the entries written longest ago are removed.
+class ThumbnailCache: public Singleton<ThumbnailCache>
+{
+	static constexpr uint64_t maxCacheBytes = 64 << 20;
+
+	std::mutex cacheMutex;
+	// Size of the directory as of the last Prune plus what has been written since, 0 until
+	// the first Put of the session has looked at the directory
+	uint64_t cacheBytes = 0;
+
+	ByteString EntryFilename(ByteString filename);
+	ByteString EntryHeader(ByteString filename, ByteString kind);
+	// Removes the oldest entries until the directory is well under maxCacheBytes again,
+	// called with cacheMutex held
+	void Prune();
+
+public:
+	// Whether filename has an entry of any kind that is still valid
+	bool Contains(ByteString filename);
+	// kind tells thumbnails rendered in different sizes or with different options apart
+	std::unique_ptr<VideoBuffer> Get(ByteString filename, ByteString kind);
+	void Put(ByteString filename, ByteString kind, const VideoBuffer &thumbnail);
+};
+
+#endif
@@ -1,10 +1,11 @@
 #include "ThumbnailRendererTask.h"
 
-#include <cmath>
-
 #include "graphics/Graphics.h"
 #include "simulation/SaveRenderer.h"
+#include "client/Client.h"
 #include "client/GameSave.h"
+#include "client/SaveFile.h"
+#include "client/ThumbnailCache.h"
 
 ThumbnailRendererTask::ThumbnailRendererTask(GameSave *save, int width, int height, bool autoRescale, bool decorations, bool fire) :
 	Save(new GameSave(*save)),
@@ -16,29 +17,52 @@ ThumbnailRendererTask::ThumbnailRendererTask(GameSave *save, int width, int heig
 {
 }
 
+ThumbnailRendererTask::ThumbnailRendererTask(SaveFile *file, int width, int height, bool autoRescale, bool decorations, bool fire) :
+	Save(file->IsLazy() ? nullptr : new GameSave(*file->GetGameSave())),
+	Filename(file->GetName()),
+	Width(width),
+	Height(height),
+	Decorations(decorations),
+	Fire(fire),
+	AutoRescale(autoRescale)
+{
+}
+
 ThumbnailRendererTask::~ThumbnailRendererTask()
 {
 }
 
 bool ThumbnailRendererTask::doWork()
 {
-	thumbnail = std::unique_ptr<VideoBuffer>(SaveRenderer::Ref().Render(Save.get(), Decorations, Fire));
-	if (thumbnail)
+	ByteString kind = ByteString::Build(Width, "x", Height, AutoRescale ? " rescale" : "", Decorations ? " deco" : "", Fire ? " fire" : "");
+	if (Filename.size())
 	{
-		if (AutoRescale)
+		thumbnail = ThumbnailCache::Ref().Get(Filename, kind);
+		if (thumbnail)
 		{
-			int scaleX = (int)std::ceil((float)thumbnail->Width / Width);
-			int scaleY = (int)std::ceil((float)thumbnail->Height / Height);
-			int scale = scaleX > scaleY ? scaleX : scaleY;
-			int newWidth = thumbnail->Width / scale, newHeight = thumbnail->Height / scale;
-			thumbnail->Resize(newWidth, newHeight, true);
-			Width = newWidth;
-			Height = newHeight;
+			Width = thumbnail->Width;
+			Height = thumbnail->Height;
+			return true;
 		}
-		else
+		if (!Save)
 		{
-			thumbnail->Resize(Width, Height, true);
+			try
+			{
+				Save = std::make_unique<GameSave>(Client::Ref().ReadFile(Filename));
+			}
+			catch (const std::exception &)
+			{
+				return false;
+			}
 		}
+	}
+	thumbnail = std::unique_ptr<VideoBuffer>(SaveRenderer::Ref().RenderThumbnail(Save.get(), Width, Height, AutoRescale, Decorations, Fire));
+	if (thumbnail)
+	{
+		if (Filename.size())
+			ThumbnailCache::Ref().Put(Filename, kind, *thumbnail);
+		Width = thumbnail->Width;
+		Height = thumbnail->Height;
 		return true;
 	}
 	else
@@ -5,11 +5,15 @@
 
 #include <memory>
 
+#include "common/String.h"
+
 class GameSave;
+class SaveFile;
 class VideoBuffer;
 class ThumbnailRendererTask : public AbandonableTask
 {
 	std::unique_ptr<GameSave> Save;
+	ByteString Filename; // thumbnails of files go through ThumbnailCache
 	int Width, Height;
 	bool Decorations;
 	bool Fire;
@@ -18,6 +22,8 @@ class ThumbnailRendererTask : public AbandonableTask
 
 public:
 	ThumbnailRendererTask(GameSave *save, int width, int height, bool autoRescale = false, bool decorations = true, bool fire = true);
+	// Reads the save itself if file hasn't been yet and the thumbnail isn't cached
+	ThumbnailRendererTask(SaveFile *file, int width, int height, bool autoRescale = false, bool decorations = true, bool fire = true);
 	virtual ~ThumbnailRendererTask();
 
 	virtual bool doWork() override;
@@ -237,6 +237,23 @@ bool FileExists(ByteString filename)
 	}
 }
 
+bool FileInfo(ByteString filename, uint64_t &size, int64_t &modifiedTime)
+{
+#ifdef WIN
+	struct _stat s;
+	if (_stat(filename.c_str(), &s) != 0)
+#else
+	struct stat s;
+	if (stat(filename.c_str(), &s) != 0)
+#endif
+		return false;
+	if (!(s.st_mode & S_IFREG))
+		return false;
+	size = uint64_t(s.st_size);
+	modifiedTime = int64_t(s.st_mtime);
+	return true;
+}
+
 bool DirectoryExists(ByteString directory)
 {
 #ifdef WIN
@@ -2,6 +2,8 @@
 #define PLATFORM_H
 #include "Config.h"
 
+#include <cstdint>
+
 #include "common/String.h"
 
 #ifdef WIN
@@ -23,6 +25,10 @@ namespace Platform
 
 	bool Stat(ByteString filename);
 	bool FileExists(ByteString filename);
+	/**
+	 * @return true if filename is a file, and sets size and modifiedTime to its size and last modification time
+	 */
+	bool FileInfo(ByteString filename, uint64_t &size, int64_t &modifiedTime);
 	bool DirectoryExists(ByteString directory);
 	/**
 	 * @return true on success
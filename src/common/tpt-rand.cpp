@@ -1,4 +1,5 @@
 #include "tpt-rand.h"
+#include "tpt-thread-local.h"
 #include <cstdlib>
 #include <ctime>
 
@@ -62,4 +63,42 @@ void RNG::seed(unsigned int sd)
 	s[1] = sd;
 }
 
+std::array<uint64_t, 2> RNG::state() const
+{
+	return { s[0], s[1] };
+}
+
+void RNG::state(std::array<uint64_t, 2> newState)
+{
+	s[0] = newState[0];
+	s[1] = newState[1];
+}
+
+struct ThreadRNG
+{
+	RNG *rng = nullptr;
+};
+static THREAD_LOCAL(ThreadRNG, threadRNG);
+
+RNG &RNG::Ref()
+{
+	ThreadRNG &local = threadRNG;
+	if (local.rng)
+		return *local.rng;
+	return Singleton<RNG>::Ref();
+}
+
+RNG::Override::Override(RNG &rng)
+{
+	ThreadRNG &local = threadRNG;
+	previous = local.rng;
+	local.rng = &rng;
+}
+
+RNG::Override::~Override()
+{
+	ThreadRNG &local = threadRNG;
+	local.rng = previous;
+}
+
 RNG random_gen;
@@ -3,6 +3,7 @@
 #include "Config.h"
 
 #include <stdint.h>
+#include <array>
 #include "Singleton.h"
 
 class RNG : public Singleton<RNG>
@@ -19,6 +20,23 @@ public:
 
 	RNG();
 	void seed(unsigned int sd);
+	std::array<uint64_t, 2> state() const;
+	void state(std::array<uint64_t, 2> newState);
+
+	// The generator installed on the calling thread by an Override, or the global one
+	static RNG &Ref();
+
+	// Makes RNG::Ref() return another generator on the calling thread while in scope
+	class Override
+	{
+		RNG *previous;
+
+	public:
+		Override(RNG &rng);
+		~Override();
+		Override(const Override &) = delete;
+		Override &operator =(const Override &) = delete;
+	};
 };
 
 extern RNG random_gen;
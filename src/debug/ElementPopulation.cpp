@@ -6,6 +6,9 @@
 
 #include "graphics/Graphics.h"
 
+#include <algorithm>
+#include <vector>
+
 ElementPopulationDebug::ElementPopulationDebug(unsigned int id, Simulation * sim):
 	DebugInfo(id),
 	sim(sim),
@@ -25,15 +28,21 @@ void ElementPopulationDebug::Draw()
 	String halfValString;
 
 
-	float maxVal = 255;
+	// with element timing on, show the time spent in each element's update instead of how many there are
+	bool timing = sim->elementTiming;
+	auto value = [this, timing](int i) {
+		return timing ? float(sim->elementCosts[i].seconds * 1000) : float(sim->partsByType.Count(i));
+	};
+
+	float maxVal = timing ? 1.0f : 255;
 	float scale = 1.0f;
 	int bars = 0;
 	for(int i = 0; i < PT_NUM; i++)
 	{
 		if(sim->elements[i].Enabled)
 		{
-			if(maxVal < sim->elementCount[i])
-				maxVal = float(sim->elementCount[i]);
+			if(maxVal < value(i))
+				maxVal = value(i);
 			bars++;
 		}
 	}
@@ -42,6 +51,11 @@ void ElementPopulationDebug::Draw()
 
 	maxValString = String::Build(maxAverage);
 	halfValString = String::Build(maxAverage/2);
+	if (timing)
+	{
+		maxValString += "ms";
+		halfValString += "ms";
+	}
 
 
 	g->fillrect(xStart-5, yBottom - 263, bars+10+Graphics::textwidth(maxValString)+10, 255 + 13, 0, 0, 0, 180);
@@ -51,12 +65,11 @@ void ElementPopulationDebug::Draw()
 	{
 		if(sim->elements[i].Enabled)
 		{
-			auto count = sim->elementCount[i];
-			auto barSize = int(count * scale - 0.5f);
+			auto barSize = int(value(i) * scale - 0.5f);
 			int barX = bars;//*2;
 
 			g->draw_line(xStart+barX, yBottom+3, xStart+barX, yBottom+2, PIXR(sim->elements[i].Colour), PIXG(sim->elements[i].Colour), PIXB(sim->elements[i].Colour), 255);
-			if(sim->elementCount[i])
+			if(value(i) > 0)
 			{
 				if(barSize > 256)
 				{
@@ -77,6 +90,29 @@ void ElementPopulationDebug::Draw()
 	g->drawtext(xStart + bars + 5, yBottom-5, "0", 255, 255, 255, 255);
 	g->drawtext(xStart + bars + 5, yBottom-132, halfValString, 255, 255, 255, 255);
 	g->drawtext(xStart + bars + 5, yBottom-260, maxValString, 255, 255, 255, 255);
+
+	if (timing)
+	{
+		std::vector<int> slowest;
+		for (int i = 1; i < PT_NUM; i++)
+			if (sim->elementCosts[i].calls)
+				slowest.push_back(i);
+		std::sort(slowest.begin(), slowest.end(), [this](int a, int b) {
+			return sim->elementCosts[a].seconds > sim->elementCosts[b].seconds;
+		});
+		if (slowest.size() > 10)
+			slowest.resize(10);
+		int textX = xStart + bars + 10 + Graphics::textwidth(maxValString);
+		int textY = yBottom - 260;
+		for (auto i : slowest)
+		{
+			auto &cost = sim->elementCosts[i];
+			String text = String::Build(sim->elements[i].Name, ": ", Format::Precision(cost.seconds * 1000, 1), "ms, ", cost.calls, " calls, ", Format::Precision(cost.seconds * 1000000 / cost.calls, 3), "us each");
+			g->fillrect(textX - 2, textY - 2, Graphics::textwidth(text) + 4, 13, 0, 0, 0, 180);
+			g->drawtext(textX, textY, text, PIXR(sim->elements[i].Colour), PIXG(sim->elements[i].Colour), PIXB(sim->elements[i].Colour), 255);
+			textY += 13;
+		}
+	}
 }
 
 ElementPopulationDebug::~ElementPopulationDebug()
@@ -0,0 +1,97 @@
+#include "FrameTimings.h"
+
+#include <algorithm>
+#include <array>
+
+#include "gui/interface/Engine.h"
+
+#include "simulation/Simulation.h"
+
+#include "graphics/Graphics.h"
+
+namespace
+{
+	const int phaseColours[Simulation::phaseCount] = {
+		PIXPACK(0x4080FF), // air
+		PIXPACK(0xC040FF), // gravity
+		PIXPACK(0x808080), // recalc
+		PIXPACK(0xFF4040), // stacking
+		PIXPACK(0x40FF40), // gol
+		PIXPACK(0xFFC020), // particles
+		PIXPACK(0x40FFFF), // aftersim
+		PIXPACK(0xFF80C0), // render
+	};
+}
+
+FrameTimingsDebug::FrameTimingsDebug(unsigned int id, Simulation * sim):
+	DebugInfo(id),
+	sim(sim),
+	maxAverage(20.0f)
+{
+
+}
+
+void FrameTimingsDebug::Draw()
+{
+	Graphics * g = ui::Engine::Ref().g;
+
+	const int barWidth = 2;
+	const int graphHeight = 100;
+	const int graphWidth = Simulation::phaseHistorySize * barWidth;
+	const int lineHeight = 12;
+	int xStart = XRES - 10 - graphWidth;
+	int yBottom = YRES - 10;
+	int yLegend = yBottom - graphHeight - 10 - Simulation::phaseCount * lineHeight;
+
+	float maxVal = 1.0f;
+	std::array<float, Simulation::phaseCount> means = {};
+	for (auto &frame : sim->phaseHistory)
+	{
+		float total = 0;
+		for (int phase = 0; phase < Simulation::phaseCount; phase++)
+		{
+			total += frame[phase];
+			means[phase] += frame[phase] / Simulation::phaseHistorySize;
+		}
+		if (maxVal < total)
+			maxVal = total;
+	}
+	maxAverage = (maxAverage*(1.0f-0.05f)) + (0.05f*maxVal);
+	float scale = graphHeight/maxAverage;
+
+	g->fillrect(xStart-5, yLegend-5, graphWidth+10, yBottom-yLegend+10, 0, 0, 0, 180);
+
+	for (int phase = 0; phase < Simulation::phaseCount; phase++)
+	{
+		auto colour = phaseColours[phase];
+		String text = String::Build(ByteString(Simulation::phaseNames[phase]).FromAscii(), ": ", Format::Precision(means[phase], 2), "ms");
+		g->drawtext(xStart, yLegend + phase * lineHeight, text, PIXR(colour), PIXG(colour), PIXB(colour), 255);
+	}
+	String maxValString = String::Build(Format::Precision(maxAverage, 1), "ms");
+	g->drawtext(xStart + graphWidth - Graphics::textwidth(maxValString), yLegend, maxValString, 255, 255, 255, 255);
+
+	// oldest frame on the left, each one a stack of its phases
+	for (int f = 0; f < Simulation::phaseHistorySize; f++)
+	{
+		auto &frame = sim->phaseHistory[(sim->phaseHistoryPos + f) % Simulation::phaseHistorySize];
+		int barX = xStart + f * barWidth;
+		float bottom = 0;
+		for (int phase = 0; phase < Simulation::phaseCount; phase++)
+		{
+			float top = bottom + frame[phase];
+			int y0 = int(bottom * scale), y1 = std::min(int(top * scale), graphHeight);
+			if (y1 > y0)
+			{
+				auto colour = phaseColours[phase];
+				g->fillrect(barX, yBottom - y1, barWidth, y1 - y0, PIXR(colour), PIXG(colour), PIXB(colour), 255);
+			}
+			bottom = top;
+		}
+	}
+	g->draw_line(xStart, yBottom - graphHeight, xStart + graphWidth - 1, yBottom - graphHeight, 255, 255, 255, 120);
+}
+
+FrameTimingsDebug::~FrameTimingsDebug()
+{
+
+}
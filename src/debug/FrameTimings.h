@@ -0,0 +1,14 @@
+#pragma once
+
+#include "DebugInfo.h"
+
+class Simulation;
+class FrameTimingsDebug : public DebugInfo
+{
+	Simulation * sim;
+	float maxAverage;
+public:
+	FrameTimingsDebug(unsigned int id, Simulation * sim);
+	void Draw() override;
+	virtual ~FrameTimingsDebug();
+};
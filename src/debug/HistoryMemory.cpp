@@ -0,0 +1,30 @@
+#include "HistoryMemory.h"
+
+#include "gui/interface/Engine.h"
+#include "gui/game/GameModel.h"
+
+#include "graphics/Graphics.h"
+
+HistoryMemoryDebug::HistoryMemoryDebug(unsigned int id, GameModel * model):
+	DebugInfo(id),
+	model(model)
+{
+
+}
+
+void HistoryMemoryDebug::Draw()
+{
+	Graphics * g = ui::Engine::Ref().g;
+
+	const float mib = 1024.0f * 1024.0f;
+	String info = String::Build("Undo history: ", model->HistorySize(), " entries, ",
+		Format::Precision(model->HistoryBytes() / mib, 2), " of ",
+		Format::Precision(model->GetUndoHistoryBudget() / mib, 0), " MiB");
+	g->fillrect(7, YRES-42, g->textwidth(info)+5, 14, 0, 0, 0, 180);
+	g->drawtext(10, YRES-38, info, 255, 255, 255, 255);
+}
+
+HistoryMemoryDebug::~HistoryMemoryDebug()
+{
+
+}
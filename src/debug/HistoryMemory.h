@@ -0,0 +1,13 @@
+#pragma once
+
+#include "DebugInfo.h"
+
+class GameModel;
+class HistoryMemoryDebug : public DebugInfo
+{
+	GameModel * model;
+public:
+	HistoryMemoryDebug(unsigned int id, GameModel * model);
+	void Draw() override;
+	virtual ~HistoryMemoryDebug();
+};
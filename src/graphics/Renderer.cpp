@@ -18,6 +18,7 @@
 #include "simulation/ElementGraphics.h"
 #include "simulation/Air.h"
 #include "simulation/Gravity.h"
+#include "simulation/PhaseTimer.h"
 #include "simulation/ElementClasses.h"
 
 #ifdef LUACONSOLE
@@ -41,6 +42,7 @@
 
 void Renderer::RenderBegin()
 {
+	UpdateFrame();
 #ifdef OGLI
 #ifdef OGLR
 	draw_air();
@@ -151,6 +153,26 @@ void Renderer::RenderBegin()
 #endif
 }
 
+void Renderer::SetFrame(const SimulationFrame *newFrame)
+{
+	externalFrame = newFrame;
+}
+
+void Renderer::UpdateFrame()
+{
+#ifndef FONTEDITOR
+	if (externalFrame)
+	{
+		frame = externalFrame;
+	}
+	else if (sim)
+	{
+		ownFrame.Reference(*sim);
+		frame = &ownFrame;
+	}
+#endif
+}
+
 void Renderer::RenderEnd()
 {
 #ifdef OGLI
@@ -347,11 +369,11 @@ void Renderer::FinaliseParts()
 		glUniform1i(glGetUniformLocation(lensProg, "pTex"), 0);
 		glActiveTexture(GL_TEXTURE1);
 		glBindTexture(GL_TEXTURE_2D, partsTFX);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_RED, GL_FLOAT, sim->gravx);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_RED, GL_FLOAT, frame->gravx);
 		glUniform1i(glGetUniformLocation(lensProg, "tfX"), 1);
 		glActiveTexture(GL_TEXTURE2);
 		glBindTexture(GL_TEXTURE_2D, partsTFY);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_GREEN, GL_FLOAT, sim->gravy);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_GREEN, GL_FLOAT, frame->gravy);
 		glUniform1i(glGetUniformLocation(lensProg, "tfY"), 2);
 		glActiveTexture(GL_TEXTURE0);
 		glUniform1fv(glGetUniformLocation(lensProg, "xres"), 1, &xres);
@@ -716,13 +738,13 @@ void Renderer::DrawWalls()
 
 	for (int y = 0; y < YRES/CELL; y++)
 		for (int x = 0; x < XRES/CELL; x++)
-			if (sim->bmap[y][x])
+			if (frame->bmap[y][x])
 			{
-				unsigned char wt = sim->bmap[y][x];
+				unsigned char wt = frame->bmap[y][x];
 				if (wt >= UI_WALLCOUNT)
 					continue;
-				pixel pc = sim->wtypes[wt].colour;
-				pixel gc = sim->wtypes[wt].eglow;
+				pixel pc = frame->wtypes[wt].colour;
+				pixel gc = frame->wtypes[wt].eglow;
 
 				int cr = PIXR(pc);
 				int cg = PIXG(pc);
@@ -736,14 +758,14 @@ void Renderer::DrawWalls()
 #else
 	for (int y = 0; y < YRES/CELL; y++)
 		for (int x =0; x < XRES/CELL; x++)
-			if (sim->bmap[y][x])
+			if (frame->bmap[y][x])
 			{
-				unsigned char wt = sim->bmap[y][x];
+				unsigned char wt = frame->bmap[y][x];
 				if (wt >= UI_WALLCOUNT)
 					continue;
-				unsigned char powered = sim->emap[y][x];
-				pixel pc = PIXPACK(sim->wtypes[wt].colour);
-				pixel gc = PIXPACK(sim->wtypes[wt].eglow);
+				unsigned char powered = frame->emap[y][x];
+				pixel pc = PIXPACK(frame->wtypes[wt].colour);
+				pixel gc = PIXPACK(frame->wtypes[wt].eglow);
 
 				if (findingElement)
 				{
@@ -751,7 +773,7 @@ void Renderer::DrawWalls()
 					gc = PIXRGB(PIXR(gc)/10,PIXG(gc)/10,PIXB(gc)/10);
 				}
 
-				switch (sim->wtypes[wt].drawstyle)
+				switch (frame->wtypes[wt].drawstyle)
 				{
 				case 0:
 					if (wt == WL_EWALL || wt == WL_STASIS)
@@ -807,7 +829,7 @@ void Renderer::DrawWalls()
 						float yf = y*CELL + CELL*0.5f;
 						int oldX = (int)(xf+0.5f), oldY = (int)(yf+0.5f);
 						int newX, newY;
-						float xVel = sim->vx[y][x]*0.125f, yVel = sim->vy[y][x]*0.125f;
+						float xVel = frame->vx[y][x]*0.125f, yVel = frame->vy[y][x]*0.125f;
 						// there is no velocity here, draw a streamline and continue
 						if (!xVel && !yVel)
 						{
@@ -834,9 +856,9 @@ void Renderer::DrawWalls()
 							{
 								int wallX = newX/CELL;
 								int wallY = newY/CELL;
-								xVel = sim->vx[wallY][wallX]*0.125f;
-								yVel = sim->vy[wallY][wallX]*0.125f;
-								if (wallX != x && wallY != y && sim->bmap[wallY][wallX] == WL_STREAM)
+								xVel = frame->vx[wallY][wallX]*0.125f;
+								yVel = frame->vy[wallY][wallX]*0.125f;
+								if (wallX != x && wallY != y && frame->bmap[wallY][wallX] == WL_STREAM)
 									break;
 							}
 							xf += xVel;
@@ -875,7 +897,7 @@ void Renderer::DrawWalls()
 				// when in blob view, draw some blobs...
 				if (render_mode & PMODE_BLOB)
 				{
-					switch (sim->wtypes[wt].drawstyle)
+					switch (frame->wtypes[wt].drawstyle)
 					{
 					case 0:
 						if (wt == WL_EWALL || wt == WL_STASIS)
@@ -956,10 +978,10 @@ void Renderer::DrawWalls()
 					}
 				}
 
-				if (sim->wtypes[wt].eglow && powered)
+				if (frame->wtypes[wt].eglow && powered)
 				{
 					// glow if electrified
-					pixel glow = sim->wtypes[wt].eglow;
+					pixel glow = frame->wtypes[wt].eglow;
 					int alpha = 255;
 					int cr = (alpha*PIXR(glow) + (255-alpha)*fire_r[y/CELL][x/CELL]) >> 8;
 					int cg = (alpha*PIXG(glow) + (255-alpha)*fire_g[y/CELL][x/CELL]) >> 8;
@@ -982,22 +1004,21 @@ void Renderer::DrawWalls()
 #ifndef FONTEDITOR
 void Renderer::DrawSigns()
 {
-	int x, y, w, h;
-	std::vector<sign> signs = sim->signs;
 #ifdef OGLR
 	GLint prevFbo;
 	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, partsFbo);
 	glTranslated(0, MENUSIZE, 0);
 #endif
-	for (auto &currentSign : signs)
+	for (auto &drawnSign : frame->signs)
 	{
+		auto &currentSign = drawnSign.original;
 		if (currentSign.text.length())
 		{
-			String text = currentSign.getDisplayText(sim, x, y, w, h);
+			int x = drawnSign.x, y = drawnSign.y, w = drawnSign.w, h = drawnSign.h;
 			clearrect(x, y, w+1, h);
 			drawrect(x, y, w+1, h, 192, 192, 192, 255);
-			drawtext(x+3, y+4, text, 255, 255, 255, 255);
+			drawtext(x+3, y+4, drawnSign.text, 255, 255, 255, 255);
 
 			if (currentSign.ju != sign::None)
 			{
@@ -1044,12 +1065,12 @@ void Renderer::render_gravlensing(pixel * source)
 		for(ny = 0; ny < YRES; ny++)
 		{
 			co = (ny/CELL)*(XRES/CELL)+(nx/CELL);
-			rx = (int)(nx-sim->gravx[co]*0.75f+0.5f);
-			ry = (int)(ny-sim->gravy[co]*0.75f+0.5f);
-			gx = (int)(nx-sim->gravx[co]*0.875f+0.5f);
-			gy = (int)(ny-sim->gravy[co]*0.875f+0.5f);
-			bx = (int)(nx-sim->gravx[co]+0.5f);
-			by = (int)(ny-sim->gravy[co]+0.5f);
+			rx = (int)(nx-frame->gravx[co]*0.75f+0.5f);
+			ry = (int)(ny-frame->gravy[co]*0.75f+0.5f);
+			gx = (int)(nx-frame->gravx[co]*0.875f+0.5f);
+			gy = (int)(ny-frame->gravy[co]*0.875f+0.5f);
+			bx = (int)(nx-frame->gravx[co]+0.5f);
+			by = (int)(ny-frame->gravy[co]+0.5f);
 			if(rx >= 0 && rx < XRES && ry >= 0 && ry < YRES && gx >= 0 && gx < XRES && gy >= 0 && gy < YRES && bx >= 0 && bx < XRES && by >= 0 && by < YRES)
 			{
 				t = dst[ny*(VIDXRES)+nx];
@@ -1203,11 +1224,15 @@ void Renderer::render_parts()
 	int orbd[4] = {0, 0, 0, 0}, orbl[4] = {0, 0, 0, 0};
 	float gradv, flicker;
 	Particle * parts;
-	Element *elements;
-	if(!sim)
+	const Element *elements;
+	UpdateFrame();
+	if(!frame)
 		return;
-	parts = sim->parts;
-	elements = sim->elements.data();
+	// * Drawing a frame captured by SimulationRunner happens while the simulation is busy with the
+	//   next one, so it isn't part of that one's time.
+	PhaseTimer timer(sim, Simulation::phaseRender, !externalFrame);
+	parts = frame->parts;
+	elements = frame->elements;
 #ifdef OGLR
 	float fnx, fny;
 	int cfireV = 0, cfireC = 0, cfire = 0;
@@ -1240,20 +1265,23 @@ void Renderer::render_parts()
 	}
 #endif
 	foundElements = 0;
-	for(i = 0; i<=sim->parts_lastActiveIndex; i++) {
-		if (sim->parts[i].type && sim->parts[i].type >= 0 && sim->parts[i].type < PT_NUM) {
-			t = sim->parts[i].type;
+	for(i = frame->activeParts->Next(0); i<=frame->parts_lastActiveIndex; i = frame->activeParts->Next(i+1)) {
+		if (frame->partTypes[i] >= 0 && frame->partTypes[i] < PT_NUM) {
+			t = frame->partTypes[i];
 
-			nx = (int)(sim->parts[i].x+0.5f);
-			ny = (int)(sim->parts[i].y+0.5f);
+			nx = (int)(frame->parts[i].x+0.5f);
+			ny = (int)(frame->parts[i].y+0.5f);
 #ifdef OGLR
-			fnx = sim->parts[i].x;
-			fny = sim->parts[i].y;
+			fnx = frame->parts[i].x;
+			fny = frame->parts[i].y;
 #endif
 
 			if(nx >= XRES || nx < 0 || ny >= YRES || ny < 0)
 				continue;
-			if(TYP(sim->photons[ny][nx]) && !(sim->elements[t].Properties & TYPE_ENERGY) && t!=PT_STKM && t!=PT_STKM2 && t!=PT_FIGH)
+			if(TYP(frame->photons[ny][nx]) && !(elements[t].Properties & TYPE_ENERGY) && t!=PT_STKM && t!=PT_STKM2 && t!=PT_FIGH)
+				continue;
+			// only fire is rendered, and this type never makes any
+			if (fireOnly && graphicscache[t].isready && !graphicscache[t].firea && !(colour_mode & COLOUR_HEAT))
 				continue;
 
 			//Defaults
@@ -1264,10 +1292,10 @@ void Renderer::render_parts()
 			colb = PIXB(elements[t].Colour);
 			firer = fireg = fireb = firea = 0;
 
-			deca = (sim->parts[i].dcolour>>24)&0xFF;
-			decr = (sim->parts[i].dcolour>>16)&0xFF;
-			decg = (sim->parts[i].dcolour>>8)&0xFF;
-			decb = (sim->parts[i].dcolour)&0xFF;
+			deca = (frame->parts[i].dcolour>>24)&0xFF;
+			decr = (frame->parts[i].dcolour>>16)&0xFF;
+			decg = (frame->parts[i].dcolour>>8)&0xFF;
+			decb = (frame->parts[i].dcolour)&0xFF;
 
 			if(decorations_enable && blackDecorations)
 			{
@@ -1295,7 +1323,7 @@ void Renderer::render_parts()
 				}
 				else if(!(colour_mode & COLOUR_BASC))
 				{
-					if (!elements[t].Graphics || (*(elements[t].Graphics))(this, &(sim->parts[i]), nx, ny, &pixel_mode, &cola, &colr, &colg, &colb, &firea, &firer, &fireg, &fireb)) //That's a lot of args, a struct might be better
+					if (!elements[t].Graphics || (*(elements[t].Graphics))(this, &(frame->parts[i]), nx, ny, &pixel_mode, &cola, &colr, &colg, &colb, &firea, &firer, &fireg, &fireb)) //That's a lot of args, a struct might be better
 					{
 						graphicscache[t].isready = 1;
 						graphicscache[t].pixel_mode = pixel_mode;
@@ -1309,10 +1337,10 @@ void Renderer::render_parts()
 						graphicscache[t].fireb = fireb;
 					}
 				}
-				if((elements[t].Properties & PROP_HOT_GLOW) && sim->parts[i].temp>(elements[t].HighTemperature-800.0f))
+				if((elements[t].Properties & PROP_HOT_GLOW) && frame->parts[i].temp>(elements[t].HighTemperature-800.0f))
 				{
 					gradv = 3.1415/(2*elements[t].HighTemperature-(elements[t].HighTemperature-800.0f));
-					caddress = int((sim->parts[i].temp>elements[t].HighTemperature)?elements[t].HighTemperature-(elements[t].HighTemperature-800.0f):sim->parts[i].temp-(elements[t].HighTemperature-800.0f));
+					caddress = int((frame->parts[i].temp>elements[t].HighTemperature)?elements[t].HighTemperature-(elements[t].HighTemperature-800.0f):frame->parts[i].temp-(elements[t].HighTemperature-800.0f));
 					colr += int(sin(gradv*caddress) * 226);
 					colg += int(sin(gradv*caddress*4.55 +3.14) * 34);
 					colb += int(sin(gradv*caddress*2.22 +3.14) * 64);
@@ -1336,7 +1364,7 @@ void Renderer::render_parts()
 				{
 					constexpr float min_temp = MIN_TEMP;
 					constexpr float max_temp = MAX_TEMP;
-					caddress = int(restrict_flt((sim->parts[i].temp - min_temp) / (max_temp - min_temp) * 1024, 0, 1023)) * 3;
+					caddress = int(restrict_flt((frame->parts[i].temp - min_temp) / (max_temp - min_temp) * 1024, 0, 1023)) * 3;
 					firea = 255;
 					firer = colr = color_data[caddress];
 					fireg = colg = color_data[caddress+1];
@@ -1352,10 +1380,10 @@ void Renderer::render_parts()
 				else if(colour_mode & COLOUR_LIFE)
 				{
 					gradv = 0.4f;
-					if (!(sim->parts[i].life<5))
-						q = int(sqrt((float)sim->parts[i].life));
+					if (!(frame->parts[i].life<5))
+						q = int(sqrt((float)frame->parts[i].life));
 					else
-						q = sim->parts[i].life;
+						q = frame->parts[i].life;
 					colr = colg = colb = int(sin(gradv*q) * 100 + 128);
 					cola = 255;
 					if(pixel_mode & (FIREMODE | PMODE_GLOW))
@@ -1395,7 +1423,7 @@ void Renderer::render_parts()
 				if (colour_mode & COLOUR_GRAD)
 				{
 					auto frequency = 0.05f;
-					auto q = int(sim->parts[i].temp-40);
+					auto q = int(frame->parts[i].temp-40);
 					colr = int(sin(frequency*q) * 16 + colr);
 					colg = int(sin(frequency*q) * 16 + colg);
 					colb = int(sin(frequency*q) * 16 + colb);
@@ -1443,6 +1471,10 @@ void Renderer::render_parts()
 					}
 				}
 
+				// the pixels of warm-up frames are thrown away
+				if (fireOnly)
+					goto fire;
+
 				//Pixel rendering
 				if (pixel_mode & EFFECT_LINES)
 				{
@@ -1455,20 +1487,20 @@ void Renderer::render_parts()
 				if(pixel_mode & PSPEC_STICKMAN)
 				{
 					int legr, legg, legb;
-					playerst *cplayer;
+					const playerst *cplayer;
 					if(t==PT_STKM)
-						cplayer = &sim->player;
+						cplayer = frame->player;
 					else if(t==PT_STKM2)
-						cplayer = &sim->player2;
-					else if (t==PT_FIGH && sim->parts[i].tmp >= 0 && sim->parts[i].tmp < MAX_FIGHTERS)
-						cplayer = &sim->fighters[(unsigned char)sim->parts[i].tmp];
+						cplayer = frame->player2;
+					else if (t==PT_FIGH && frame->parts[i].tmp >= 0 && frame->parts[i].tmp < MAX_FIGHTERS)
+						cplayer = &frame->fighters[(unsigned char)frame->parts[i].tmp];
 					else
 						continue;
 
 					if (mousePos.X>(nx-3) && mousePos.X<(nx+3) && mousePos.Y<(ny+3) && mousePos.Y>(ny-3)) //If mouse is in the head
 					{
-						String hp = String::Build(Format::Width(sim->parts[i].life, 3));
-						drawtext(mousePos.X-8-2*(sim->parts[i].life<100)-2*(sim->parts[i].life<10), mousePos.Y-12, hp, 255, 255, 255, 255);
+						String hp = String::Build(Format::Width(frame->parts[i].life, 3));
+						drawtext(mousePos.X-8-2*(frame->parts[i].life<100)-2*(frame->parts[i].life<10), mousePos.Y-12, hp, 255, 255, 255, 255);
 					}
 
 					if (findingElement == t)
@@ -1796,7 +1828,7 @@ void Renderer::render_parts()
 					lineV[clineV++] = fny+5;
 					cline++;
 #else
-					gradv = 4*sim->parts[i].life + flicker;
+					gradv = 4*frame->parts[i].life + flicker;
 					for (x = 0; gradv>0.5; x++) {
 						addpixel(nx+x, ny, colr, colg, colb, int(gradv));
 						addpixel(nx-x, ny, colr, colg, colb, int(gradv));
@@ -1860,7 +1892,7 @@ void Renderer::render_parts()
 					lineV[clineV++] = fny+10;
 					cline++;
 #else
-					gradv = flicker + fabs(parts[i].vx)*17 + fabs(sim->parts[i].vy)*17;
+					gradv = flicker + fabs(parts[i].vx)*17 + fabs(frame->parts[i].vy)*17;
 					blendpixel(nx, ny, colr, colg, colb, int((gradv*4)>255?255:(gradv*4)) );
 					blendpixel(nx+1, ny, colr, colg, colb,int( (gradv*2)>255?255:(gradv*2)) );
 					blendpixel(nx-1, ny, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
@@ -1960,13 +1992,13 @@ void Renderer::render_parts()
 					int r;
 					float drad = 0.0f;
 					float ddist = 0.0f;
-					sim->orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
+					Simulation::orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
 					for (r = 0; r < 4; r++) {
 						ddist = ((float)orbd[r])/16.0f;
 						drad = (M_PI * ((float)orbl[r]) / 180.0f)*1.41f;
 						nxo = (int)(ddist*cos(drad));
 						nyo = (int)(ddist*sin(drad));
-						if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(sim->pmap[ny+nyo][nx+nxo]) != PT_PRTI)
+						if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(frame->pmap[ny+nyo][nx+nxo]) != PT_PRTI)
 							addpixel(nx+nxo, ny+nyo, colr, colg, colb, 255-orbd[r]);
 					}
 				}
@@ -1977,27 +2009,27 @@ void Renderer::render_parts()
 					int r;
 					float drad = 0.0f;
 					float ddist = 0.0f;
-					sim->orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
+					Simulation::orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
 					for (r = 0; r < 4; r++) {
 						ddist = ((float)orbd[r])/16.0f;
 						drad = (M_PI * ((float)orbl[r]) / 180.0f)*1.41f;
 						nxo = (int)(ddist*cos(drad));
 						nyo = (int)(ddist*sin(drad));
-						if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(sim->pmap[ny+nyo][nx+nxo]) != PT_PRTO)
+						if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(frame->pmap[ny+nyo][nx+nxo]) != PT_PRTO)
 							addpixel(nx+nxo, ny+nyo, colr, colg, colb, 255-orbd[r]);
 					}
 				}
 				if (pixel_mode & EFFECT_DBGLINES && !(display_mode&DISPLAY_PERS))
 				{
 					// draw lines connecting wifi/portal channels
-					if (mousePos.X == nx && mousePos.Y == ny && i == ID(sim->pmap[ny][nx]) && debugLines)
+					if (mousePos.X == nx && mousePos.Y == ny && i == ID(frame->pmap[ny][nx]) && debugLines)
 					{
 						int type = parts[i].type, tmp = (int)((parts[i].temp-73.15f)/100+1), othertmp;
 						if (type == PT_PRTI)
 							type = PT_PRTO;
 						else if (type == PT_PRTO)
 							type = PT_PRTI;
-						for (int z = 0; z <= sim->parts_lastActiveIndex; z++)
+						for (int z = 0; z <= frame->parts_lastActiveIndex; z++)
 						{
 							if (parts[z].type == type)
 							{
@@ -2008,6 +2040,7 @@ void Renderer::render_parts()
 						}
 					}
 				}
+fire:
 				//Fire effects
 				if(firea && (pixel_mode & FIRE_BLEND))
 				{
@@ -2259,7 +2292,7 @@ void Renderer::render_parts()
 void Renderer::draw_other() // EMP effect
 {
 	int i, j;
-	int emp_decor = sim->emp_decor;
+	int emp_decor = frame->emp_decor;
 	if (emp_decor>40) emp_decor = 40;
 	if (emp_decor<0) emp_decor = 0;
 	if (!(render_mode & EFFECT)) // not in nothing mode
@@ -2317,15 +2350,15 @@ void Renderer::draw_grav()
 		for (x=0; x<XRES/CELL; x++)
 		{
 			ca = y*(XRES/CELL)+x;
-			if(fabsf(sim->gravx[ca]) <= 0.001f && fabsf(sim->gravy[ca]) <= 0.001f)
+			if(fabsf(frame->gravx[ca]) <= 0.001f && fabsf(frame->gravy[ca]) <= 0.001f)
 				continue;
 			nx = float(x*CELL);
 			ny = float(y*CELL);
-			dist = fabsf(sim->gravy[ca])+fabsf(sim->gravx[ca]);
+			dist = fabsf(frame->gravy[ca])+fabsf(frame->gravx[ca]);
 			for(i = 0; i < 4; i++)
 			{
-				nx -= sim->gravx[ca]*0.5f;
-				ny -= sim->gravy[ca]*0.5f;
+				nx -= frame->gravx[ca]*0.5f;
+				ny -= frame->gravy[ca]*0.5f;
 				addpixel((int)(nx+0.5f), (int)(ny+0.5f), 255, 255, 255, (int)(dist*20.0f));
 			}
 		}
@@ -2342,16 +2375,16 @@ int HeatToColour(float temp)
 
 void Renderer::draw_air()
 {
-	if(!sim->aheat_enable && (display_mode & DISPLAY_AIRH))
+	if(!frame->aheat_enable && (display_mode & DISPLAY_AIRH))
 		return;
 #ifndef OGLR
 	if(!(display_mode & DISPLAY_AIR))
 		return;
 	int x, y, i, j;
-	float (*pv)[XRES/CELL] = sim->air->pv;
-	float (*hv)[XRES/CELL] = sim->air->hv;
-	float (*vx)[XRES/CELL] = sim->air->vx;
-	float (*vy)[XRES/CELL] = sim->air->vy;
+	const float (*pv)[XRES/CELL] = frame->pv;
+	const float (*hv)[XRES/CELL] = frame->hv;
+	const float (*vx)[XRES/CELL] = frame->vx;
+	const float (*vy)[XRES/CELL] = frame->vy;
 	pixel c = 0;
 	for (y=0; y<YRES/CELL; y++)
 		for (x=0; x<XRES/CELL; x++)
@@ -2444,15 +2477,15 @@ void Renderer::draw_air()
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, airVX);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_RED, GL_FLOAT, sim->air->vx);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_RED, GL_FLOAT, frame->vx);
 	glUniform1i(glGetUniformLocation(airProg, "airX"), 0);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, airVY);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_GREEN, GL_FLOAT, sim->air->vy);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_GREEN, GL_FLOAT, frame->vy);
 	glUniform1i(glGetUniformLocation(airProg, "airY"), 1);
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_2D, airPV);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_BLUE, GL_FLOAT, sim->air->pv);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, XRES/CELL, YRES/CELL, GL_BLUE, GL_FLOAT, frame->pv);
 	glUniform1i(glGetUniformLocation(airProg, "airP"), 2);
 	glActiveTexture(GL_TEXTURE0);
 
@@ -2486,7 +2519,7 @@ void Renderer::draw_grav_zones()
 	{
 		for (x=0; x<XRES/CELL; x++)
 		{
-			if(sim->grav->gravmask[y*(XRES/CELL)+x])
+			if(frame->gravmask[y*(XRES/CELL)+x])
 			{
 				for (j=0; j<CELL; j++)//draws the colors
 					for (i=0; i<CELL; i++)
@@ -2525,6 +2558,7 @@ pixel Renderer::GetPixel(int x, int y)
 
 Renderer::Renderer(Graphics * g, Simulation * sim):
 	sim(NULL),
+	frame(NULL),
 	g(NULL),
 	render_mode(0),
 	colour_mode(0),
@@ -2533,6 +2567,7 @@ Renderer::Renderer(Graphics * g, Simulation * sim):
 	gravityFieldEnabled(false),
 	decorations_enable(1),
 	blackDecorations(false),
+	fireOnly(false),
 	debugLines(false),
 	sampleColor(0xFFFFFFFF),
 	findingElement(0),
@@ -2543,7 +2578,8 @@ Renderer::Renderer(Graphics * g, Simulation * sim):
 	zoomScopeSize(32),
 	zoomEnabled(false),
 	ZFACTOR(8),
-	gridSize(0)
+	gridSize(0),
+	externalFrame(NULL)
 {
 	this->g = g;
 	this->sim = sim;
@@ -9,6 +9,7 @@
 
 #include "Graphics.h"
 #include "gui/interface/Point.h"
+#include "simulation/SimulationFrame.h"
 
 class RenderPreset;
 class Simulation;
@@ -38,7 +39,10 @@ typedef struct gcache_item gcache_item;
 class Renderer
 {
 public:
-	Simulation * sim;
+	Simulation * sim; // NULL when only ever drawing frames set with SetFrame, see SaveRenderer
+	// What is drawn of sim, valid from the start of RenderBegin or render_parts; graphics
+	// functions read element properties through frame->elements, not sim
+	const SimulationFrame * frame;
 	Graphics * g;
 	gcache_item *graphicscache;
 
@@ -60,6 +64,7 @@ public:
 	bool gravityFieldEnabled;
 	int decorations_enable;
 	bool blackDecorations;
+	bool fireOnly; // render_parts only adds to the fire layer, for building it up before a still frame
 	bool debugLines;
 	pixel sampleColor;
 	int findingElement;
@@ -96,6 +101,9 @@ public:
 	void ClearAccumulation();
 	void clearScreen(float alpha);
 	void SetSample(int x, int y);
+	// Draws newFrame instead of sim as it is at the time until called again with NULL; newFrame
+	// must stay valid until then
+	void SetFrame(const SimulationFrame *newFrame);
 
 #ifdef OGLR
 	void checkShader(GLuint shader, const char * shname);
@@ -166,6 +174,9 @@ public:
 
 private:
 	int gridSize;
+	const SimulationFrame * externalFrame;
+	SimulationFrame ownFrame;
+	void UpdateFrame();
 #ifdef OGLR
 	GLuint zoomTex, airBuf, fireAlpha, glowAlpha, blurAlpha, partsFboTex, partsFbo, partsTFX, partsTFY, airPV, airVY, airVX;
 	GLuint fireProg, airProg_Pressure, airProg_Velocity, airProg_Cracker, lensProg;
@@ -5,6 +5,7 @@
 #include "client/Client.h"
 #include "client/GameSave.h"
 #include "client/SaveFile.h"
+#include "client/ThumbnailCache.h"
 #include "common/Platform.h"
 #include "graphics/Graphics.h"
 #include "gui/Style.h"
@@ -44,6 +45,16 @@ class LoadFilesTask: public Task
 		notifyProgress(-1);
 		for(std::vector<ByteString>::iterator iter = files.begin(), end = files.end(); iter != end; ++iter)
 		{
+			ByteString filename = (*iter).SplitFromEndBy(PATH_SEP).After();
+			filename = filename.SplitFromEndBy('.').Before();
+			if (ThumbnailCache::Ref().Contains(directory + *iter))
+			{
+				// Its thumbnail is cached, so it parsed fine when it was rendered; parse it again only if it's opened
+				SaveFile * saveFile = new SaveFile(directory + *iter, true);
+				saveFile->SetDisplayName(filename.FromUtf8());
+				saveFiles.push_back(saveFile);
+				continue;
+			}
 			SaveFile * saveFile = new SaveFile(directory + *iter);
 			try
 			{
@@ -54,8 +65,6 @@ class LoadFilesTask: public Task
 				saveFile->SetGameSave(tempSave);
 				saveFiles.push_back(saveFile);
 
-				ByteString filename = (*iter).SplitFromEndBy(PATH_SEP).After();
-				filename = filename.SplitFromEndBy('.').Before();
 				saveFile->SetDisplayName(filename.FromUtf8());
 			}
 			catch(std::exception & e)
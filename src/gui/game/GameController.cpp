@@ -11,6 +11,7 @@
 #include "Notification.h"
 #include "QuickOptions.h"
 #include "RenderPreset.h"
+#include "SimulationRunner.h"
 #include "Tool.h"
 
 #ifdef LUACONSOLE
@@ -27,6 +28,8 @@
 #include "debug/DebugLines.h"
 #include "debug/DebugParts.h"
 #include "debug/ElementPopulation.h"
+#include "debug/FrameTimings.h"
+#include "debug/HistoryMemory.h"
 #include "debug/ParticleDebug.h"
 #include "graphics/Renderer.h"
 #include "simulation/Air.h"
@@ -34,6 +37,7 @@
 #include "simulation/Simulation.h"
 #include "simulation/SimulationData.h"
 #include "simulation/Snapshot.h"
+#include "simulation/Timeline.h"
 
 #include "gui/dialogues/ErrorMessage.h"
 #include "gui/dialogues/InformationMessage.h"
@@ -88,6 +92,12 @@ GameController::GameController():
 	gameView = new GameView();
 	gameModel = new GameModel();
 	gameModel->BuildQuickOptionMenu(this);
+	simRunner = std::make_unique<SimulationRunner>(gameModel->GetSimulation(), [this]() {
+		StepSimulation();
+	}, [this]() {
+		return !commandInterface->HooksSimulation();
+	}, float(Client::Ref().GetPrefNumber("Simulation.ThreadedTps", 60)));
+	simRunner->SetThreaded(Client::Ref().GetPrefBool("Simulation.Threaded", false));
 
 	gameView->AttachController(this);
 	gameModel->AddObserver(gameView);
@@ -106,10 +116,13 @@ GameController::GameController():
 	debugInfo.push_back(new ElementPopulationDebug(0x2, gameModel->GetSimulation()));
 	debugInfo.push_back(new DebugLines(0x4, gameView, this));
 	debugInfo.push_back(new ParticleDebug(0x8, gameModel->GetSimulation(), gameModel));
+	debugInfo.push_back(new FrameTimingsDebug(0x10, gameModel->GetSimulation()));
+	debugInfo.push_back(new HistoryMemoryDebug(0x20, gameModel));
 }
 
 GameController::~GameController()
 {
+	simRunner.reset();
 	if(search)
 	{
 		delete search;
@@ -175,7 +188,8 @@ void GameController::HistoryRestore()
 	//   the last history entry is what this Ctrl+Z brings you back to, not the current state.
 	if (!beforeRestore)
 	{
-		beforeRestore = gameModel->GetSimulation()->CreateSnapshot();
+		beforeRestore = std::make_unique<Snapshot>();
+		gameModel->GetSimulation()->CopySnapshot(*beforeRestore);
 		beforeRestore->Authors = Client::Ref().GetAuthorInfo();
 	}
 	gameModel->HistoryRestore();
@@ -189,7 +203,7 @@ void GameController::HistorySnapshot()
 	// * Calling HistorySnapshot means the user decided to use the current state and
 	//   forfeit the option to go back to whatever they Ctrl+Z'd their way back from.
 	beforeRestore.reset();
-	gameModel->HistoryPush(gameModel->GetSimulation()->CreateSnapshot());
+	gameModel->HistorySnapshot();
 }
 
 void GameController::HistoryForward()
@@ -210,11 +224,34 @@ void GameController::HistoryForward()
 	}
 }
 
+bool GameController::TimelineRewind(size_t framesBack)
+{
+	auto *timeline = gameModel->GetTimeline();
+	if (!timeline || framesBack >= timeline->Size())
+	{
+		return false;
+	}
+	HistorySnapshot();
+	auto snap = timeline->Rewind(framesBack);
+	gameModel->GetSimulation()->Restore(*snap);
+	return true;
+}
+
 GameView * GameController::GetView()
 {
 	return gameView;
 }
 
+bool GameController::ScriptsDrawElements()
+{
+	return commandInterface->HooksElementGraphics();
+}
+
+SimulationRunner * GameController::GetSimulationRunner()
+{
+	return simRunner.get();
+}
+
 int GameController::GetSignAt(int x, int y)
 {
 	Simulation * sim = gameModel->GetSimulation();
@@ -380,8 +417,10 @@ void GameController::DrawRect(int toolSelection, ui::Point point1, ui::Point poi
 	Brush * cBrush = gameModel->GetBrush();
 	if(!activeTool || !cBrush)
 		return;
-	activeTool->SetStrength(1.0f);
-	activeTool->DrawRect(sim, cBrush, point1, point2);
+	simRunner->Post([sim, activeTool, cBrush, point1, point2]() {
+		activeTool->SetStrength(1.0f);
+		activeTool->DrawRect(sim, cBrush, point1, point2);
+	});
 }
 
 void GameController::DrawLine(int toolSelection, ui::Point point1, ui::Point point2)
@@ -392,8 +431,10 @@ void GameController::DrawLine(int toolSelection, ui::Point point1, ui::Point poi
 	Brush * cBrush = gameModel->GetBrush();
 	if(!activeTool || !cBrush)
 		return;
-	activeTool->SetStrength(1.0f);
-	activeTool->DrawLine(sim, cBrush, point1, point2);
+	simRunner->Post([sim, activeTool, cBrush, point1, point2]() {
+		activeTool->SetStrength(1.0f);
+		activeTool->DrawLine(sim, cBrush, point1, point2);
+	});
 }
 
 void GameController::DrawFill(int toolSelection, ui::Point point)
@@ -404,8 +445,10 @@ void GameController::DrawFill(int toolSelection, ui::Point point)
 	Brush * cBrush = gameModel->GetBrush();
 	if(!activeTool || !cBrush)
 		return;
-	activeTool->SetStrength(1.0f);
-	activeTool->DrawFill(sim, cBrush, point);
+	simRunner->Post([sim, activeTool, cBrush, point]() {
+		activeTool->SetStrength(1.0f);
+		activeTool->DrawFill(sim, cBrush, point);
+	});
 }
 
 void GameController::DrawPoints(int toolSelection, ui::Point oldPos, ui::Point newPos, bool held)
@@ -419,11 +462,14 @@ void GameController::DrawPoints(int toolSelection, ui::Point oldPos, ui::Point n
 		return;
 	}
 
-	activeTool->SetStrength(gameModel->GetToolStrength());
-	if (!held)
-		activeTool->Draw(sim, cBrush, newPos);
-	else
-		activeTool->DrawLine(sim, cBrush, oldPos, newPos, true);
+	auto strength = gameModel->GetToolStrength();
+	simRunner->Post([sim, activeTool, cBrush, oldPos, newPos, held, strength]() {
+		activeTool->SetStrength(strength);
+		if (!held)
+			activeTool->Draw(sim, cBrush, newPos);
+		else
+			activeTool->DrawLine(sim, cBrush, oldPos, newPos, true);
+	});
 }
 
 bool GameController::LoadClipboard()
@@ -468,7 +514,9 @@ void GameController::ToolClick(int toolSelection, ui::Point point)
 	Brush * cBrush = gameModel->GetBrush();
 	if(!activeTool || !cBrush)
 		return;
-	activeTool->Click(sim, cBrush, point);
+	simRunner->Post([sim, activeTool, cBrush, point]() {
+		activeTool->Click(sim, cBrush, point);
+	});
 }
 
 ByteString GameController::StampRegion(ui::Point point1, ui::Point point2)
@@ -477,11 +525,10 @@ ByteString GameController::StampRegion(ui::Point point1, ui::Point point2)
 	if(newSave)
 	{
 		newSave->paused = gameModel->GetPaused();
-		ByteString stampName = Client::Ref().AddStamp(newSave);
-		delete newSave;
-		if (stampName.length() == 0)
-			new ErrorMessage("Could not create stamp", "Error serializing save file");
-		return stampName;
+		return Client::Ref().AddStamp(std::unique_ptr<GameSave>(newSave), [](String error) {
+			if (error.size())
+				new ErrorMessage("Could not create stamp", error);
+		});
 	}
 	else
 	{
@@ -666,7 +713,7 @@ bool GameController::KeyPress(int key, int scan, bool repeat, bool shift, bool c
 			sim->player2.comm = (int)(sim->player2.comm)|0x04;
 		}
 
-		if (!sim->elementCount[PT_STKM2] || ctrl)
+		if (!sim->partsByType.Count(PT_STKM2) || ctrl)
 		{
 			switch(scan)
 			{
@@ -737,7 +784,11 @@ void GameController::Tick()
 	if(firstTick)
 	{
 #ifdef LUACONSOLE
-		((LuaScriptInterface*)commandInterface)->Init();
+		{
+			// autorun scripts may hook element functions
+			auto simLock = simRunner->Lock();
+			((LuaScriptInterface*)commandInterface)->Init();
+		}
 #endif
 #if !defined(MACOSX) && !defined(NO_INSTALL_CHECK)
 		if (Client::Ref().IsFirstRun())
@@ -749,24 +800,44 @@ void GameController::Tick()
 	}
 	if (gameModel->SelectNextIdentifier.length())
 	{
+		auto simLock = simRunner->Lock();
 		gameModel->BuildMenus();
 		gameModel->SetActiveTool(gameModel->SelectNextTool, gameModel->GetToolFromIdentifier(gameModel->SelectNextIdentifier));
 		gameModel->SelectNextIdentifier.clear();
 	}
-	for(std::vector<DebugInfo*>::iterator iter = debugInfo.begin(), end = debugInfo.end(); iter != end; iter++)
+	gameModel->HistoryPoll();
+	if (debugFlags)
 	{
-		if ((*iter)->debugID & debugFlags)
-			(*iter)->Draw();
+		auto simLock = simRunner->Lock();
+		for(std::vector<DebugInfo*>::iterator iter = debugInfo.begin(), end = debugInfo.end(); iter != end; iter++)
+		{
+			if ((*iter)->debugID & debugFlags)
+				(*iter)->Draw();
+		}
 	}
 	commandInterface->OnTick();
 }
 
+void GameController::SetDebugFlags(unsigned int flags)
+{
+	debugFlags = flags;
+	// only time the phases of each frame while something is showing them
+	gameModel->GetSimulation()->phaseTiming = flags & 0x10;
+}
+
 void GameController::Blur()
 {
 	// Tell lua that mouse is up (even if it really isn't)
 	MouseUp(0, 0, 0, 1);
 	BlurEvent ev;
 	commandInterface->HandleEvent(LuaEvents::blur, &ev);
+	// Other windows touch the simulation without locking it
+	simRunner->Hold();
+}
+
+void GameController::Focus()
+{
+	simRunner->Release();
 }
 
 void GameController::Exit()
@@ -781,6 +852,7 @@ void GameController::ResetAir()
 {
 	Simulation * sim = gameModel->GetSimulation();
 	sim->air->Clear();
+	sim->MarkAllDirty();
 	for (int i = 0; i < NPART; i++)
 	{
 		if (GameSave::PressureInTmp3(sim->parts[i].type))
@@ -798,7 +870,7 @@ void GameController::ResetSpark()
 		{
 			if (sim->parts[i].ctype >= 0 && sim->parts[i].ctype < PT_NUM && sim->elements[sim->parts[i].ctype].Enabled)
 			{
-				sim->parts[i].type = sim->parts[i].ctype;
+				sim->SetPartType(i, sim->parts[i].ctype);
 				sim->parts[i].ctype = sim->parts[i].life = 0;
 			}
 			else
@@ -879,21 +951,15 @@ void GameController::LoadRenderPreset(int presetNum)
 	renderer->SetColourMode(preset.ColourMode);
 }
 
-void GameController::Update()
+void GameController::StepSimulation()
 {
-	ui::Point pos = gameView->GetMousePosition();
-	gameModel->GetRenderer()->mousePos = PointTranslate(pos);
-	if (pos.X < XRES && pos.Y < YRES)
-		gameView->SetSample(gameModel->GetSimulation()->GetSample(PointTranslate(pos).X, PointTranslate(pos).Y));
-	else
-		gameView->SetSample(gameModel->GetSimulation()->GetSample(pos.X, pos.Y));
-
 	Simulation * sim = gameModel->GetSimulation();
 	sim->BeforeSim();
 	if (!sim->sys_pause || sim->framerender)
 	{
 		sim->UpdateParticles(0, NPART);
 		sim->AfterSim();
+		gameModel->TimelineRecord();
 	}
 
 	//if either STKM or STK2 isn't out, reset it's selected element. Defaults to PT_DUST unless right selected is something else
@@ -901,13 +967,9 @@ void GameController::Update()
 	if (!sim->player.spwn || !sim->player2.spwn)
 	{
 		int rightSelected = PT_DUST;
-		Tool * activeTool = gameModel->GetActiveTool(1);
-		if (activeTool->GetIdentifier().BeginsWith("DEFAULT_PT_"))
-		{
-			int sr = activeTool->GetToolID();
-			if (sr && sim->IsElementOrNone(sr))
-				rightSelected = sr;
-		}
+		int sr = stickmanElement;
+		if (sr && sim->IsElementOrNone(sr))
+			rightSelected = sr;
 
 		void Element_STKM_set_element(Simulation *sim, playerst *playerp, int element);
 		if (!sim->player.spwn)
@@ -915,6 +977,36 @@ void GameController::Update()
 		if (!sim->player2.spwn)
 			Element_STKM_set_element(sim, &sim->player2, rightSelected);
 	}
+}
+
+void GameController::Update()
+{
+	ui::Point pos = gameView->GetMousePosition();
+	gameModel->GetRenderer()->mousePos = PointTranslate(pos);
+	// * While the simulation is busy with a tick on its thread, the last sample stays up.
+	if (auto simLock = simRunner->TryLock())
+	{
+		if (pos.X < XRES && pos.Y < YRES)
+			gameView->SetSample(gameModel->GetSimulation()->GetSample(PointTranslate(pos).X, PointTranslate(pos).Y));
+		else
+			gameView->SetSample(gameModel->GetSimulation()->GetSample(pos.X, pos.Y));
+	}
+
+	// * StepSimulation may run on the simulation's thread, so it gets a copy of the element it
+	//   needs from the active tool, applied along with the edits before the next tick.
+	Tool *activeTool = gameModel->GetActiveTool(1);
+	int rightSelected = activeTool->GetIdentifier().BeginsWith("DEFAULT_PT_") ? activeTool->GetToolID() : 0;
+	if (rightSelected != postedStickmanElement)
+	{
+		postedStickmanElement = rightSelected;
+		simRunner->Post([this, rightSelected]() {
+			stickmanElement = rightSelected;
+		});
+	}
+
+	simRunner->Update();
+	gameModel->GetRenderer()->SetFrame(simRunner->GetFrame());
+
 	if(renderOptions && renderOptions->HasExited)
 	{
 		delete renderOptions;
@@ -1204,13 +1296,13 @@ void GameController::OpenLocalSaveWindow(bool asCurrent)
 
 			gameModel->SetSaveFile(&tempSave, gameView->ShiftBehaviour());
 			Platform::MakeDirectory(LOCAL_SAVE_DIR);
-			std::vector<char> saveData = gameSave->Serialise();
-			if (saveData.size() == 0)
-				new ErrorMessage("Error", "Unable to serialize game data.");
-			else if (Client::Ref().WriteFile(saveData, gameModel->GetSaveFile()->GetName()))
-				new ErrorMessage("Error", "Unable to write save file.");
-			else
-				gameModel->SetInfoTip("Saved Successfully");
+			// compressed and written in the background, the model keeps its own copy
+			Client::Ref().WriteSaveFile(std::unique_ptr<GameSave>(new GameSave(*gameSave)), gameModel->GetSaveFile()->GetName(), [this](String error) {
+				if (error.size())
+					new ErrorMessage("Error", error);
+				else
+					gameModel->SetInfoTip("Saved Successfully");
+			});
 		}
 	}
 }
@@ -1260,6 +1352,12 @@ void GameController::OpenSavePreview()
 void GameController::OpenLocalBrowse()
 {
 	new FileBrowserActivity(LOCAL_SAVE_DIR PATH_SEP, [this](std::unique_ptr<SaveFile> file) {
+		// Saves with a cached thumbnail are only read here
+		if (!file->GetGameSave())
+		{
+			new ErrorMessage("Error loading save", file->GetError());
+			return;
+		}
 		HistorySnapshot();
 		LoadSaveFile(file.get());
 	});
@@ -1334,11 +1432,16 @@ void GameController::OpenStamps()
 		SaveFile *file = localBrowser->GetSave();
 		if (file)
 		{
-			if (file->GetError().length())
+			// Stamps with a cached thumbnail are only read here, which is what sets the error
+			GameSave *stamp = file->GetGameSave();
+			if (file->GetError().length() || !stamp)
+			{
 				new ErrorMessage("Error loading stamp", file->GetError());
-			else if (localBrowser->GetMoveToFront())
+				return;
+			}
+			if (localBrowser->GetMoveToFront())
 				Client::Ref().MoveStampToFront(file->GetDisplayName().ToUtf8());
-			LoadStamp(file->GetGameSave());
+			LoadStamp(stamp);
 		}
 	});
 	ui::Engine::Ref().ShowWindow(localBrowser->GetView());
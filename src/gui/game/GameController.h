@@ -35,6 +35,7 @@ class GameSave;
 class LoginController;
 class TagsController;
 class ConsoleController;
+class SimulationRunner;
 class GameController: public ClientListener
 {
 private:
@@ -55,13 +56,22 @@ private:
 	std::vector<DebugInfo*> debugInfo;
 	std::unique_ptr<Snapshot> beforeRestore;
 	unsigned int debugFlags;
+	std::unique_ptr<SimulationRunner> simRunner;
+	// The right selected element, if it is one, for respawning stickmen; the copy StepSimulation
+	// uses, and the one last Posted to simRunner
+	int stickmanElement = 0;
+	int postedStickmanElement = -1;
 	
 	void OpenSaveDone();
+	// One tick of the simulation, run by simRunner
+	void StepSimulation();
 public:
 	bool HasDone;
 	GameController();
 	~GameController();
 	GameView * GetView();
+	SimulationRunner * GetSimulationRunner();
+	bool ScriptsDrawElements();
 	int GetSignAt(int x, int y);
 	String GetSignText(int signID);
 	std::pair<int, sign::Type> GetSignSplit(int signID);
@@ -76,6 +86,7 @@ public:
 	bool KeyRelease(int key, int scan, bool repeat, bool shift, bool ctrl, bool alt);
 	void Tick();
 	void Blur();
+	void Focus();
 	void Exit();
 
 	void Install();
@@ -83,6 +94,8 @@ public:
 	void HistoryRestore();
 	void HistorySnapshot();
 	void HistoryForward();
+	// Restores the simulation to how it was framesBack recorded frames ago, see GameModel::SetTimeline
+	bool TimelineRewind(size_t framesBack);
 
 	void AdjustGridSize(int direction);
 	void InvertAirSim();
@@ -112,7 +125,7 @@ public:
 	bool GetBrushEnable();
 	void SetDebugHUD(bool hudState);
 	bool GetDebugHUD();
-	void SetDebugFlags(unsigned int flags) { debugFlags = flags; }
+	void SetDebugFlags(unsigned int flags);
 	void SetActiveMenu(int menuID);
 	std::vector<Menu*> GetMenuList();
 	int GetNumMenus(bool onlyEnabled);
@@ -27,17 +27,83 @@
 #include "simulation/Simulation.h"
 #include "simulation/Snapshot.h"
 #include "simulation/SnapshotDelta.h"
+#include "simulation/Timeline.h"
 #include "simulation/ElementClasses.h"
 #include "simulation/ElementGraphics.h"
 #include "simulation/ToolClasses.h"
 
 #include "gui/game/DecorationTool.h"
+#include "gui/game/HistoryCompressTask.h"
 #include "gui/interface/Engine.h"
 
 HistoryEntry::~HistoryEntry()
 {
 	// * Needed because Snapshot and SnapshotDelta are incomplete types in GameModel.h,
 	//   so the default dtor for ~HistoryEntry cannot be generated.
+	if (compressTask)
+	{
+		compressTask->Abandon();
+	}
+}
+
+void HistoryEntry::SetDelta(std::unique_ptr<SnapshotDelta> newDelta)
+{
+	if (compressTask)
+	{
+		compressTask->Abandon();
+		compressTask = nullptr;
+	}
+	compressed = std::vector<char>();
+	delta = std::move(newDelta);
+	if (delta)
+	{
+		compressTask = new HistoryCompressTask(delta);
+		compressTask->Start();
+	}
+}
+
+std::shared_ptr<SnapshotDelta> HistoryEntry::GetDelta() const
+{
+	if (delta)
+	{
+		return delta;
+	}
+	return SnapshotDelta::Decompress(compressed);
+}
+
+bool HistoryEntry::Poll()
+{
+	if (!compressTask)
+	{
+		return false;
+	}
+	compressTask->Poll();
+	if (!compressTask->GetDone())
+	{
+		return false;
+	}
+	if (compressTask->GetSuccess())
+	{
+		compressed = compressTask->TakeCompressed();
+		delta.reset();
+	}
+	compressTask->Finish();
+	compressTask = nullptr;
+	return true;
+}
+
+size_t HistoryEntry::Bytes() const
+{
+	size_t bytes = sizeof(HistoryEntry) + compressed.capacity();
+	if (snap)
+	{
+		bytes += snap->Bytes();
+	}
+	if (delta)
+	{
+		bytes += delta->Bytes();
+	}
+	return bytes;
 }
 
 GameModel::GameModel():
@@ -116,6 +182,8 @@ GameModel::GameModel():
 		sim->grav->start_grav_async();
 	sim->aheat_enable =  Client::Ref().GetPrefInteger("Simulation.AmbientHeat", 0);
 	sim->pretty_powder =  Client::Ref().GetPrefInteger("Simulation.PrettyPowder", 0);
+	sim->SetThreads(Client::Ref().GetPrefInteger("Simulation.Threads", 1));
+	sim->air->SetAsync(Client::Ref().GetPrefBool("Simulation.AirThread", false));
 
 	Favorite::Ref().LoadFavoritesFromPrefs();
 
@@ -151,6 +219,7 @@ GameModel::GameModel():
 	// cap due to memory usage (this is about 3.4GB of RAM)
 	if (undoHistoryLimit > 200)
 		SetUndoHistoryLimit(200);
+	undoHistoryBudget = size_t(std::max(Client::Ref().GetPrefInteger("Simulation.UndoHistoryMemory", 256), 1)) << 20;
 
 	mouseClickRequired = Client::Ref().GetPrefBool("MouseClickRequired", false);
 	includePressure = Client::Ref().GetPrefBool("Simulation.IncludePressure", true);
@@ -176,6 +245,8 @@ GameModel::~GameModel()
 	Client::Ref().SetPref("Simulation.NewtonianGravity", sim->grav->IsEnabled());
 	Client::Ref().SetPref("Simulation.AmbientHeat", sim->aheat_enable);
 	Client::Ref().SetPref("Simulation.PrettyPowder", sim->pretty_powder);
+	Client::Ref().SetPref("Simulation.Threads", sim->GetThreads());
+	Client::Ref().SetPref("Simulation.AirThread", sim->air->IsAsync());
 
 	Client::Ref().SetPref("Decoration.Red", (int)colour.Red);
 	Client::Ref().SetPref("Decoration.Green", (int)colour.Green);
@@ -693,6 +764,21 @@ int GameModel::GetDecoSpace()
 //
 //   * After all this, the front of the deque is truncated such that there are on more than
 //     undoHistoryLimit entries left.
+// * Every SnapshotDelta is deflated on a thread of its own as soon as it is placed in the history,
+//   see HistoryCompressTask. GameModel::HistoryPoll picks up the result and drops the
+//   SnapshotDelta, which is decompressed again whenever HistoryRestore, HistoryForward or
+//   HistoryPush need it. Once nothing is being compressed, the front of the deque is also
+//   truncated until the history and historyCurrent fit in undoHistoryBudget bytes, leaving at
+//   least history[N-1] and whatever historyPosition points to. Waiting for the compression
+//   means entries aren't evicted to make room for memory that is about to be freed anyway.
+// * GameModel::HistorySnapshot pushes the current state of the simulation. Creating a Snapshot of
+//   it and diffing that against history[N-1] means copying and comparing all particles, even if
+//   only a few were touched since. If there were no discarded history entries and the simulation
+//   hasn't been stepped or restored since it created the Snapshot in history[N-1], it can
+//   instead bring that Snapshot, A, up to date in place, only looking at the particles it knows
+//   to have changed, and hand back the SnapshotDelta a it took to do so. A becomes A', a takes
+//   its place in history[N-2] and the result is the same as above, without a second Snapshot
+//   ever having existed.
 
 const Snapshot *GameModel::HistoryCurrent() const
 {
@@ -717,7 +803,7 @@ void GameModel::HistoryRestore()
 	}
 	else
 	{
-		historyCurrent = history[historyPosition].delta->Restore(*historyCurrent);
+		historyCurrent = history[historyPosition].GetDelta()->Restore(*historyCurrent);
 	}
 }
 
@@ -743,7 +829,7 @@ void GameModel::HistoryForward()
 	}
 	else
 	{
-		historyCurrent = history[historyPosition - 1U].delta->Forward(*historyCurrent);
+		historyCurrent = history[historyPosition - 1U].GetDelta()->Forward(*historyCurrent);
 	}
 }
 
@@ -755,7 +841,7 @@ void GameModel::HistoryPush(std::unique_ptr<Snapshot> last)
 		rebaseOnto = history.back().snap.get();
 		if (historyPosition < history.size())
 		{
-			historyCurrent = history[historyPosition - 1U].delta->Restore(*historyCurrent);
+			historyCurrent = history[historyPosition - 1U].GetDelta()->Restore(*historyCurrent);
 			rebaseOnto = historyCurrent.get();
 		}
 	}
@@ -766,18 +852,86 @@ void GameModel::HistoryPush(std::unique_ptr<Snapshot> last)
 	if (rebaseOnto)
 	{
 		auto &prev = history.back();
-		prev.delta = SnapshotDelta::FromSnapshots(*rebaseOnto, *last);
+		prev.SetDelta(SnapshotDelta::FromSnapshots(*rebaseOnto, *last));
 		prev.snap.reset();
 	}
 	history.emplace_back();
 	history.back().snap = std::move(last);
 	historyPosition += 1U;
 	historyCurrent.reset();
+	HistoryTrim();
+}
+
+void GameModel::HistorySnapshot()
+{
+	if (historyPosition && historyPosition == history.size())
+	{
+		if (auto delta = sim->UpdateSnapshot(*history.back().snap))
+		{
+			auto last = std::move(history.back().snap);
+			history.back().SetDelta(std::move(delta));
+			history.emplace_back();
+			history.back().snap = std::move(last);
+			historyPosition += 1U;
+			HistoryTrim();
+			return;
+		}
+	}
+	HistoryPush(sim->CreateSnapshot());
+}
+
+void GameModel::HistoryTrim()
+{
 	while (undoHistoryLimit < history.size())
 	{
 		history.pop_front();
 		historyPosition -= 1U;
 	}
+	for (auto &entry : history)
+	{
+		if (entry.compressTask)
+		{
+			return;
+		}
+	}
+	auto bytes = HistoryBytes();
+	while (bytes > undoHistoryBudget && history.size() > 1U && historyPosition > 0U)
+	{
+		bytes -= history.front().Bytes();
+		history.pop_front();
+		historyPosition -= 1U;
+	}
+}
+
+void GameModel::HistoryPoll()
+{
+	bool compressed = false;
+	for (auto &entry : history)
+	{
+		if (entry.Poll())
+		{
+			compressed = true;
+		}
+	}
+	if (compressed)
+	{
+		HistoryTrim();
+	}
+}
+
+size_t GameModel::HistoryBytes() const
+{
+	size_t bytes = historyCurrent ? historyCurrent->Bytes() : 0U;
+	for (auto &entry : history)
+	{
+		bytes += entry.Bytes();
+	}
+	return bytes;
+}
+
+size_t GameModel::HistorySize() const
+{
+	return history.size();
 }
 
 unsigned int GameModel::GetUndoHistoryLimit()
@@ -791,6 +945,40 @@ void GameModel::SetUndoHistoryLimit(unsigned int undoHistoryLimit_)
 	Client::Ref().SetPref("Simulation.UndoHistoryLimit", undoHistoryLimit);
 }
 
+void GameModel::SetTimeline(size_t maxFrames, size_t maxBytes, size_t keyframeInterval)
+{
+	timeline.reset();
+	if (maxFrames)
+	{
+		timeline = std::make_unique<Timeline>(maxFrames, maxBytes, keyframeInterval);
+	}
+}
+
+Timeline *GameModel::GetTimeline()
+{
+	return timeline.get();
+}
+
+void GameModel::TimelineRecord()
+{
+	if (timeline)
+	{
+		timeline->Record(*sim);
+	}
+}
+
+size_t GameModel::GetUndoHistoryBudget()
+{
+	return undoHistoryBudget;
+}
+
+void GameModel::SetUndoHistoryBudget(size_t undoHistoryBudget_)
+{
+	undoHistoryBudget = undoHistoryBudget_;
+	Client::Ref().SetPref("Simulation.UndoHistoryMemory", int(undoHistoryBudget >> 20));
+	HistoryTrim();
+}
+
 void GameModel::SetVote(int direction)
 {
 	if(currentSave)
@@ -966,6 +1154,8 @@ void GameModel::SetSave(SaveInfo * newSave, bool invertIncludePressure)
 			sim->grav->stop_grav_async();
 		sim->clear_sim();
 		ren->ClearAccumulation();
+		if (timeline)
+			timeline->Clear();
 		if (!sim->Load(saveData, !invertIncludePressure))
 		{
 			// This save was created before logging existed
@@ -1032,6 +1222,8 @@ void GameModel::SetSaveFile(SaveFile * newSave, bool invertIncludePressure)
 		}
 		sim->clear_sim();
 		ren->ClearAccumulation();
+		if (timeline)
+			timeline->Clear();
 		if (!sim->Load(saveData, !invertIncludePressure))
 		{
 			Client::Ref().OverwriteAuthorInfo(saveData->authors);
@@ -1337,6 +1529,8 @@ void GameModel::ClearSimulation()
 
 	sim->clear_sim();
 	ren->ClearAccumulation();
+	if (timeline)
+		timeline->Clear();
 	Client::Ref().ClearAuthorInfo();
 
 	notifySaveChanged();
@@ -24,6 +24,8 @@ class Renderer;
 class Snapshot;
 struct SnapshotDelta;
 class GameSave;
+class HistoryCompressTask;
+class Timeline;
 
 class ToolSelection
 {
@@ -37,9 +39,17 @@ public:
 struct HistoryEntry
 {
 	std::unique_ptr<Snapshot> snap;
-	std::unique_ptr<SnapshotDelta> delta;
+	std::shared_ptr<SnapshotDelta> delta;
+	// delta, deflated by compressTask; delta is dropped once this is filled
+	std::vector<char> compressed;
+	HistoryCompressTask *compressTask = nullptr;
 
 	~HistoryEntry();
+	void SetDelta(std::unique_ptr<SnapshotDelta> newDelta);
+	std::shared_ptr<SnapshotDelta> GetDelta() const;
+	// Returns true if compressTask finished since the last call
+	bool Poll();
+	size_t Bytes() const;
 };
 
 class GameModel
@@ -78,6 +88,10 @@ private:
 	std::unique_ptr<Snapshot> historyCurrent;
 	unsigned int historyPosition;
 	unsigned int undoHistoryLimit;
+	size_t undoHistoryBudget;
+	void HistoryTrim();
+	// nullptr unless recording, see Timeline
+	std::unique_ptr<Timeline> timeline;
 	bool mouseClickRequired;
 	bool includePressure;
 	bool perfectCircle = true;
@@ -157,8 +171,20 @@ public:
 	bool HistoryCanForward() const;
 	void HistoryForward();
 	void HistoryPush(std::unique_ptr<Snapshot> last);
+	void HistorySnapshot();
 	unsigned int GetUndoHistoryLimit();
 	void SetUndoHistoryLimit(unsigned int undoHistoryLimit_);
+	// In bytes, kept in the config in MiB
+	size_t GetUndoHistoryBudget();
+	void SetUndoHistoryBudget(size_t undoHistoryBudget_);
+	void HistoryPoll();
+	size_t HistoryBytes() const;
+	size_t HistorySize() const;
+
+	// Starts recording every frame the simulation is stepped, or stops if maxFrames is 0
+	void SetTimeline(size_t maxFrames, size_t maxBytes, size_t keyframeInterval);
+	Timeline *GetTimeline();
+	void TimelineRecord();
 
 	void UpdateQuickOptions();
 
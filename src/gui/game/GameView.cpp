@@ -14,6 +14,7 @@
 #include "Notification.h"
 #include "ToolButton.h"
 #include "QuickOptions.h"
+#include "SimulationRunner.h"
 
 #include "client/SaveInfo.h"
 #include "client/SaveFile.h"
@@ -1603,6 +1604,11 @@ void GameView::OnBlur()
 	c->Blur();
 }
 
+void GameView::OnFocus()
+{
+	c->Focus();
+}
+
 void GameView::OnFileDrop(ByteString filename)
 {
 	if (!(filename.EndsWith(".cps") || filename.EndsWith(".stm")))
@@ -1619,6 +1625,7 @@ void GameView::OnFileDrop(ByteString filename)
 		new ErrorMessage("Error loading save", "Dropped save file could not be loaded: " + saveFile->GetError());
 		return;
 	}
+	auto simLock = c->GetSimulationRunner()->Lock();
 	c->LoadSaveFile(saveFile);
 	delete saveFile;
 
@@ -1657,7 +1664,9 @@ void GameView::OnTick(float dt)
 		}
 	}
 
-	int foundSignID = c->GetSignAt(mousePosition.X, mousePosition.Y);
+	// * Signs are only looked up while the simulation isn't busy with a tick on its thread.
+	auto simLock = c->GetSimulationRunner()->TryLock();
+	int foundSignID = simLock ? c->GetSignAt(mousePosition.X, mousePosition.Y) : -1;
 	if (foundSignID != -1)
 	{
 		String str = c->GetSignText(foundSignID);
@@ -1740,6 +1749,10 @@ void GameView::DoMouseMove(int x, int y, int dx, int dy)
 
 void GameView::DoMouseDown(int x, int y, unsigned button)
 {
+	// * Clicks and key presses may do anything to the simulation, so they wait for the tick in
+	//   progress, if it is running on a thread of its own. Brush strokes don't, see
+	//   GameController::DrawPoints.
+	auto simLock = c->GetSimulationRunner()->Lock();
 	if(introText > 50)
 		introText = 50;
 	if(c->MouseDown(x, y, button))
@@ -1748,12 +1761,14 @@ void GameView::DoMouseDown(int x, int y, unsigned button)
 
 void GameView::DoMouseUp(int x, int y, unsigned button)
 {
+	auto simLock = c->GetSimulationRunner()->Lock();
 	if(c->MouseUp(x, y, button, 0))
 		Window::DoMouseUp(x, y, button);
 }
 
 void GameView::DoMouseWheel(int x, int y, int d)
 {
+	auto simLock = c->GetSimulationRunner()->Lock();
 	if(c->MouseWheel(x, y, d))
 		Window::DoMouseWheel(x, y, d);
 }
@@ -1772,6 +1787,7 @@ void GameView::DoTextEditing(String text)
 
 void GameView::DoKeyPress(int key, int scan, bool repeat, bool shift, bool ctrl, bool alt)
 {
+	auto simLock = c->GetSimulationRunner()->Lock();
 	if (shift && !shiftBehaviour)
 		enableShiftBehaviour();
 	if (ctrl && !ctrlBehaviour)
@@ -1784,6 +1800,7 @@ void GameView::DoKeyPress(int key, int scan, bool repeat, bool shift, bool ctrl,
 
 void GameView::DoKeyRelease(int key, int scan, bool repeat, bool shift, bool ctrl, bool alt)
 {
+	auto simLock = c->GetSimulationRunner()->Lock();
 	if (!shift && shiftBehaviour)
 		disableShiftBehaviour();
 	if (!ctrl && ctrlBehaviour)
@@ -2013,6 +2030,10 @@ void GameView::OnDraw()
 	Graphics * g = GetGraphics();
 	if (ren)
 	{
+		// * Element graphics functions set by scripts may look at the simulation itself.
+		std::unique_lock<SimulationRunner::Mutex> simLock;
+		if (c->ScriptsDrawElements())
+			simLock = c->GetSimulationRunner()->Lock();
 		ren->clearScreen(1.0f);
 		ren->RenderBegin();
 		ren->SetSample(c->PointTranslate(currentMouse).X, c->PointTranslate(currentMouse).Y);
@@ -2361,6 +2382,8 @@ void GameView::OnDraw()
 		//FPS and some version info
 		StringBuilder fpsInfo;
 		fpsInfo << Format::Precision(2) << "FPS: " << ui::Engine::Ref().GetFps();
+		if (c->GetSimulationRunner()->GetThreaded())
+			fpsInfo << " TPS: " << c->GetSimulationRunner()->GetTps();
 
 		if (showDebug)
 		{
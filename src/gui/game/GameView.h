@@ -205,6 +205,7 @@ public:
 	void OnTick(float dt) override;
 	void OnDraw() override;
 	void OnBlur() override;
+	void OnFocus() override;
 	void OnFileDrop(ByteString filename) override;
 
 	//Top-level handlers, for Lua interface
@@ -0,0 +1,30 @@
+#include "HistoryCompressTask.h"
+
+#include "simulation/SnapshotDelta.h"
+
+#include <stdexcept>
+
+HistoryCompressTask::HistoryCompressTask(std::shared_ptr<const SnapshotDelta> newDelta) :
+	delta(newDelta)
+{
+}
+
+bool HistoryCompressTask::doWork()
+{
+	try
+	{
+		compressed = delta->Compress();
+	}
+	catch (const std::runtime_error &e)
+	{
+		notifyError(ByteString(e.what()).FromUtf8());
+		return false;
+	}
+	delta.reset();
+	return true;
+}
+
+std::vector<char> HistoryCompressTask::TakeCompressed()
+{
+	return std::move(compressed);
+}
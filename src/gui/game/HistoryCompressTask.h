@@ -0,0 +1,26 @@
+#ifndef HISTORYCOMPRESSTASK_H
+#define HISTORYCOMPRESSTASK_H
+
+#include "tasks/AbandonableTask.h"
+
+#include <memory>
+#include <vector>
+
+struct SnapshotDelta;
+
+// Deflates a SnapshotDelta of the undo history, which is going to sit there untouched until
+// the user undoes that far back, if ever
+class HistoryCompressTask : public AbandonableTask
+{
+	std::shared_ptr<const SnapshotDelta> delta;
+	std::vector<char> compressed;
+
+	bool doWork() override;
+
+public:
+	HistoryCompressTask(std::shared_ptr<const SnapshotDelta> newDelta);
+	// Only valid once the task is done
+	std::vector<char> TakeCompressed();
+};
+
+#endif // HISTORYCOMPRESSTASK_H
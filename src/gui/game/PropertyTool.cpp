@@ -281,6 +281,7 @@ void PropertyTool::SetProperty(Simulation *sim, ui::Point position)
 		return;
 	}
 
+	sim->MarkPartDirty(ID(i));
 	switch (propType)
 	{
 		case StructProperty::Float:
@@ -296,6 +297,7 @@ void PropertyTool::SetProperty(Simulation *sim, ui::Point position)
 		default:
 			break;
 	}
+	sim->PartMoved(ID(i));
 }
 
 void PropertyTool::Draw(Simulation *sim, Brush *cBrush, ui::Point position)
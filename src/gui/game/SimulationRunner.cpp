@@ -0,0 +1,254 @@
+#include "SimulationRunner.h"
+
+#include "simulation/Simulation.h"
+#include "simulation/SimulationFrame.h"
+
+#include <chrono>
+
+SimulationRunner::SimulationRunner(Simulation *newSim, std::function<void ()> newStep, std::function<bool ()> newMayThread, float newTargetTps) :
+	sim(newSim),
+	step(newStep),
+	mayThread(newMayThread),
+	targetTps(newTargetTps)
+{
+}
+
+SimulationRunner::~SimulationRunner()
+{
+	Stop();
+}
+
+void SimulationRunner::ApplyEdits()
+{
+	std::vector<Edit> toApply;
+	{
+		std::lock_guard<std::mutex> l(stateMutex);
+		std::swap(toApply, edits);
+	}
+	for (auto &edit : toApply)
+	{
+		edit();
+	}
+}
+
+void SimulationRunner::Run()
+{
+	using Clock = std::chrono::steady_clock;
+	auto lastStart = Clock::time_point();
+	double tickTimeAvg = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> l(stateMutex);
+			if (held)
+			{
+				lastStart = Clock::time_point();
+			}
+			stateCv.wait(l, [this]() { return stopping || (!held && !blocked); });
+			if (stopping)
+			{
+				return;
+			}
+		}
+		auto start = Clock::now();
+		{
+			std::lock_guard<Mutex> simLock(simMutex);
+			{
+				// * Hold may have been called while this was waiting for simMutex.
+				std::lock_guard<std::mutex> l(stateMutex);
+				if (held || stopping)
+				{
+					lastStart = Clock::time_point();
+					continue;
+				}
+			}
+			// * Edits may run Lua too, e.g. CtypeDraw hooks.
+			if (!mayThread())
+			{
+				std::lock_guard<std::mutex> l(stateMutex);
+				blocked = true;
+				lastStart = Clock::time_point();
+				continue;
+			}
+			ApplyEdits();
+			step();
+			back->Capture(*sim);
+		}
+		std::unique_lock<std::mutex> l(stateMutex);
+		std::swap(back, ready);
+		readyFresh = true;
+		if (lastStart != Clock::time_point())
+		{
+			tickTimeAvg = tickTimeAvg * 0.8 + std::chrono::duration<double>(start - lastStart).count() * 0.2;
+			tps = tickTimeAvg > 0 ? float(1.0 / tickTimeAvg) : 0;
+		}
+		lastStart = start;
+		if (targetTps > 0)
+		{
+			auto next = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetTps));
+			stateCv.wait_until(l, next, [this]() { return stopping; });
+		}
+	}
+}
+
+void SimulationRunner::Start()
+{
+	{
+		auto simLock = Lock();
+		back = std::make_unique<SimulationFrame>();
+		ready = std::make_unique<SimulationFrame>();
+		front = std::make_unique<SimulationFrame>();
+		front->Capture(*sim);
+	}
+	std::lock_guard<std::mutex> l(stateMutex);
+	readyFresh = false;
+	blocked = false;
+	stopping = false;
+	threaded = true;
+	tps = 0;
+	thread = std::thread([this]() { Run(); });
+}
+
+void SimulationRunner::Stop()
+{
+	{
+		std::lock_guard<std::mutex> l(stateMutex);
+		if (!threaded)
+		{
+			return;
+		}
+		stopping = true;
+	}
+	stateCv.notify_all();
+	thread.join();
+	std::lock_guard<std::mutex> l(stateMutex);
+	threaded = false;
+	tps = 0;
+	back.reset();
+	ready.reset();
+	front.reset();
+}
+
+void SimulationRunner::SetThreaded(bool newThreaded)
+{
+	std::lock_guard<std::mutex> l(stateMutex);
+	wantThreaded = newThreaded;
+}
+
+bool SimulationRunner::GetThreaded()
+{
+	std::lock_guard<std::mutex> l(stateMutex);
+	return wantThreaded;
+}
+
+void SimulationRunner::SetTargetTps(float newTargetTps)
+{
+	{
+		std::lock_guard<std::mutex> l(stateMutex);
+		targetTps = newTargetTps;
+	}
+	stateCv.notify_all();
+}
+
+float SimulationRunner::GetTargetTps()
+{
+	std::lock_guard<std::mutex> l(stateMutex);
+	return targetTps;
+}
+
+float SimulationRunner::GetTps()
+{
+	std::lock_guard<std::mutex> l(stateMutex);
+	return tps;
+}
+
+void SimulationRunner::Update()
+{
+	bool isThreaded, shouldBeThreaded;
+	{
+		std::lock_guard<std::mutex> l(stateMutex);
+		isThreaded = threaded;
+		shouldBeThreaded = wantThreaded;
+	}
+	shouldBeThreaded = shouldBeThreaded && mayThread();
+	// * Starting and stopping the thread only happens here, where nothing on this thread holds
+	//   simMutex, which the thread may be waiting for.
+	if (isThreaded && !shouldBeThreaded)
+	{
+		Stop();
+	}
+	else if (!isThreaded && shouldBeThreaded)
+	{
+		Start();
+	}
+	if (!shouldBeThreaded)
+	{
+		auto simLock = Lock();
+		step();
+	}
+}
+
+void SimulationRunner::Post(Edit edit)
+{
+	{
+		std::lock_guard<std::mutex> l(stateMutex);
+		if (threaded && !held)
+		{
+			edits.push_back(std::move(edit));
+			return;
+		}
+	}
+	auto simLock = Lock();
+	edit();
+}
+
+std::unique_lock<SimulationRunner::Mutex> SimulationRunner::Lock()
+{
+	std::unique_lock<Mutex> simLock(simMutex);
+	ApplyEdits();
+	return simLock;
+}
+
+std::unique_lock<SimulationRunner::Mutex> SimulationRunner::TryLock()
+{
+	std::unique_lock<Mutex> simLock(simMutex, std::try_to_lock);
+	if (simLock)
+	{
+		ApplyEdits();
+	}
+	return simLock;
+}
+
+void SimulationRunner::Hold()
+{
+	{
+		std::lock_guard<std::mutex> l(stateMutex);
+		held = true;
+	}
+	// * Waits for the tick in progress and applies whatever was Posted before this.
+	Lock();
+}
+
+void SimulationRunner::Release()
+{
+	{
+		std::lock_guard<std::mutex> l(stateMutex);
+		held = false;
+	}
+	stateCv.notify_all();
+}
+
+const SimulationFrame *SimulationRunner::GetFrame()
+{
+	std::lock_guard<std::mutex> l(stateMutex);
+	if (!threaded)
+	{
+		return nullptr;
+	}
+	if (readyFresh)
+	{
+		std::swap(front, ready);
+		readyFresh = false;
+	}
+	return front.get();
+}
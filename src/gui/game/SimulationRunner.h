@@ -0,0 +1,91 @@
+#ifndef SIMULATIONRUNNER_H
+#define SIMULATIONRUNNER_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Simulation;
+class SimulationFrame;
+
+// Steps a Simulation, either right there in Update, which is how it has always been done, or on
+// a thread of its own at up to a set number of ticks per second, so that slow ticks don't hold up
+// input and drawing.
+// * Everything that touches the simulation outside of a tick takes a Lock first, which waits for
+//   the tick in progress, if any. Brush and tool edits are Posted instead, which never waits; they
+//   are applied right before the next tick, or the next time something takes a Lock.
+// * After every tick on the thread, what the renderer needs is Captured into a SimulationFrame.
+//   There are three of them: one being drawn, one captured last and not yet picked up by
+//   GetFrame, and one being captured into, so neither side ever waits for the other.
+// * No ticks are run while Held, e.g. while another window is in front of the game.
+// * Only the game's thread may run Lua, so while mayThread says scripts have hooked something a
+//   tick calls, no ticks are run on the thread, and the next Update takes the simulation back.
+class SimulationRunner
+{
+public:
+	using Mutex = std::recursive_mutex;
+	using Edit = std::function<void ()>;
+
+private:
+	Simulation *sim;
+	std::function<void ()> step;
+	std::function<bool ()> mayThread;
+	Mutex simMutex;
+
+	// Guards everything below
+	std::mutex stateMutex;
+	std::condition_variable stateCv;
+	std::vector<Edit> edits;
+	std::unique_ptr<SimulationFrame> back, ready, front;
+	bool readyFresh = false;
+	bool threaded = false;
+	bool wantThreaded = false;
+	bool held = false;
+	bool blocked = false;
+	bool stopping = false;
+	float targetTps;
+	float tps = 0;
+	std::thread thread;
+
+	// Only with simMutex held
+	void ApplyEdits();
+	void Run();
+	void Start();
+	void Stop();
+
+public:
+	// step runs one tick, with the simulation locked; mayThread is called with it locked too, or
+	// from the game's thread
+	SimulationRunner(Simulation *newSim, std::function<void ()> newStep, std::function<bool ()> newMayThread, float newTargetTps);
+	~SimulationRunner();
+	SimulationRunner(const SimulationRunner &) = delete;
+	SimulationRunner &operator =(const SimulationRunner &) = delete;
+
+	// Takes effect at the next Update, and only while mayThread allows it
+	void SetThreaded(bool newThreaded);
+	bool GetThreaded();
+	// 0 runs as many ticks as the simulation can manage
+	void SetTargetTps(float newTargetTps);
+	float GetTargetTps();
+	// Ticks per second measured on the thread, 0 unless threaded
+	float GetTps();
+
+	// Call once per frame of the game, without a Lock; runs a tick unless threaded
+	void Update();
+
+	void Post(Edit edit);
+	std::unique_lock<Mutex> Lock();
+	// Only owns the lock if it could be taken without waiting
+	std::unique_lock<Mutex> TryLock();
+	void Hold();
+	void Release();
+
+	// The frame captured last, NULL unless threaded; it stays valid until the next call, and
+	// until the next Update that turns threading off
+	const SimulationFrame *GetFrame();
+};
+
+#endif // SIMULATIONRUNNER_H
@@ -145,9 +145,9 @@ void SaveButton::Tick(float dt)
 					triedThumbnail = true;
 				}
 			}
-			else if (file && file->GetGameSave())
+			else if (file && (file->IsLazy() || file->GetGameSave()))
 			{
-				thumbnailRenderer = new ThumbnailRendererTask(file->GetGameSave(), thumbBoxSize.X, thumbBoxSize.Y, true, true, false);
+				thumbnailRenderer = new ThumbnailRendererTask(file, thumbBoxSize.X, thumbBoxSize.Y, true, true, false);
 				thumbnailRenderer->Start();
 				triedThumbnail = true;
 			}
@@ -193,7 +193,7 @@ void SaveButton::Draw(const Point& screenPos)
 		else
 			g->draw_image(thumbnail.get(), screenPos.X+(Size.X-thumbSize.X)/2, screenPos.Y+(Size.Y-21-thumbSize.Y)/2, 255);
 	}
-	else if (file && !file->GetGameSave())
+	else if (file && !file->IsLazy() && !file->GetGameSave())
 		g->drawtext(screenPos.X+(Size.X-Graphics::textwidth("Error loading save"))/2, screenPos.Y+(Size.Y-28)/2, "Error loading save", 180, 180, 180, 255);
 	if(save)
 	{
@@ -112,19 +112,16 @@ void LocalSaveActivity::saveWrite(ByteString finalFilename)
 	localSaveInfo["date"] = (Json::Value::UInt64)time(NULL);
 	Client::Ref().SaveAuthorInfo(&localSaveInfo);
 	gameSave->authors = localSaveInfo;
-	std::vector<char> saveData = gameSave->Serialise();
-	if (saveData.size() == 0)
-		new ErrorMessage("Error", "Unable to serialize game data.");
-	else if (Client::Ref().WriteFile(saveData, finalFilename))
-		new ErrorMessage("Error", "Unable to write save file.");
-	else
+	// this activity is gone by the time the write is done, so only failures are reported
+	Client::Ref().WriteSaveFile(std::unique_ptr<GameSave>(new GameSave(*gameSave)), finalFilename, [](String error) {
+		if (error.size())
+			new ErrorMessage("Error", error);
+	});
+	if (onSaved)
 	{
-		if (onSaved)
-		{
-			onSaved(&save);
-		}
-		Exit();
+		onSaved(&save);
 	}
+	Exit();
 }
 
 void LocalSaveActivity::OnDraw()
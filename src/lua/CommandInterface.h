@@ -27,6 +27,11 @@ public:
 	virtual void OnTick() { }
 
 	virtual bool HandleEvent(LuaEvents::EventTypes eventType, Event * event) { return true; }
+	// Whether any element is drawn by a graphics function set by a script
+	virtual bool HooksElementGraphics() { return false; }
+	// Whether any element function the simulation calls in a tick or when drawing with a tool
+	// is set by a script
+	virtual bool HooksSimulation() { return false; }
 
 	virtual int Command(String command);
 	virtual String FormatCommand(String command);
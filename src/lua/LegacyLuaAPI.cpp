@@ -124,6 +124,7 @@ int luacon_partwrite(lua_State* l)
 	if (offset == -1)
 		return luaL_error(l, "Invalid property");
 
+	luacon_sim->MarkPartDirty(i);
 	switch(format)
 	{
 	case CommandInterface::FormatInt:
@@ -137,6 +138,7 @@ int luacon_partwrite(lua_State* l)
 	default:
 		break;
 	}
+	luacon_sim->PartMoved(i);
 	return 0;
 }
 
@@ -264,6 +266,8 @@ int luacon_elementwrite(lua_State* l)
 
 	luacon_model->BuildMenus();
 	luacon_sim->init_can_move();
+	// an element's properties decide which of the maps its particles go on
+	luacon_sim->InvalidateMaps();
 	std::fill(&luacon_ren->graphicscache[0], &luacon_ren->graphicscache[PT_NUM], gcache_item());
 
 	return 0;
@@ -710,6 +714,7 @@ int luatpt_set_property(lua_State* l)
 				ny = (int)(parts[i].y + .5f);
 				if (nx >= x && nx < x+w && ny >= y && ny < y+h && (!partsel || partsel == parts[i].type))
 				{
+					luacon_sim->MarkPartDirty(i);
 					if (format == CommandInterface::FormatElement)
 						luacon_sim->part_change_type(i, nx, ny, t);
 					else if(format == CommandInterface::FormatFloat)
@@ -719,6 +724,9 @@ int luatpt_set_property(lua_State* l)
 				}
 			}
 		}
+		// particles moved in bulk are put back on the maps in one go by the next frame
+		if (offset == offsetof(Particle, x) || offset == offsetof(Particle, y))
+			luacon_sim->InvalidateMaps();
 	}
 	else
 	{
@@ -743,12 +751,14 @@ int luatpt_set_property(lua_State* l)
 		if (partsel && partsel != luacon_sim->parts[i].type)
 			return 0;
 
+		luacon_sim->MarkPartDirty(i);
 		if (format == CommandInterface::FormatElement)
 			luacon_sim->part_change_type(i, int(luacon_sim->parts[i].x + 0.5f), int(luacon_sim->parts[i].y + 0.5f), t);
 		else if (format == CommandInterface::FormatFloat)
 			*((float*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = f;
 		else
 			*((int*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = t;
+		luacon_sim->PartMoved(i);
 	}
 	return 0;
 }
@@ -27,6 +27,7 @@
 #include "client/GameSave.h"
 #include "client/SaveFile.h"
 #include "client/SaveInfo.h"
+#include "common/Format.h"
 #include "common/Platform.h"
 #include "graphics/Graphics.h"
 #include "graphics/Renderer.h"
@@ -36,6 +37,7 @@
 #include "simulation/ElementGraphics.h"
 #include "simulation/GOLString.h"
 #include "simulation/Simulation.h"
+#include "simulation/Timeline.h"
 #include "simulation/ToolClasses.h"
 #include "simulation/SaveRenderer.h"
 
@@ -45,6 +47,7 @@
 #include "gui/game/GameView.h"
 #include "gui/game/GameController.h"
 #include "gui/game/GameModel.h"
+#include "gui/game/SimulationRunner.h"
 #include "gui/game/Tool.h"
 #include "gui/game/Brush.h"
 
@@ -800,6 +803,8 @@ void LuaScriptInterface::initSimulationAPI()
 	struct luaL_Reg simulationAPIMethods [] = {
 		{"partNeighbours", simulation_partNeighbours},
 		{"partNeighbors", simulation_partNeighbours},
+		{"nearestPart", simulation_nearestPart},
+		{"partsInRadius", simulation_partsInRadius},
 		{"partChangeType", simulation_partChangeType},
 		{"partCreate", simulation_partCreate},
 		{"partProperty", simulation_partProperty},
@@ -857,7 +862,18 @@ void LuaScriptInterface::initSimulationAPI()
 		{"neighbors", simulation_neighbours},
 		{"framerender", simulation_framerender},
 		{"gspeed", simulation_gspeed},
+		{"threads", simulation_threads},
+		{"airThread", simulation_airThread},
+		{"frameTimings", simulation_frameTimings},
+		{"elementTimings", simulation_elementTimings},
+		{"elementTimingsCSV", simulation_elementTimingsCSV},
 		{"takeSnapshot", simulation_takeSnapshot},
+		{"timeline", simulation_timeline},
+		{"timelineRewind", simulation_timelineRewind},
+		{"seed", simulation_seed},
+		{"deterministic", simulation_deterministic},
+		{"threaded", simulation_threaded},
+		{"stateHash", simulation_stateHash},
 		{"replaceModeFlags", simulation_replaceModeFlags},
 		{"listCustomGol", simulation_listCustomGol},
 		{"addCustomGol", simulation_addCustomGol},
@@ -1008,6 +1024,44 @@ int LuaScriptInterface::simulation_partNeighbours(lua_State * l)
 	return 1;
 }
 
+// Both go by positions as of the first question since the particle update, see ParticleGrid;
+// from element update functions, or after moving particles, they may miss particles that moved.
+int LuaScriptInterface::simulation_nearestPart(lua_State * l)
+{
+	int x = luaL_checkinteger(l, 1);
+	int y = luaL_checkinteger(l, 2);
+	int t = luaL_checkinteger(l, 3);
+	int maxDistance = luaL_optint(l, 4, XRES + YRES);
+	if (t <= 0 || t >= PT_NUM)
+		return luaL_error(l, "Invalid element ID (%d)", t);
+	int distance;
+	int i = luacon_sim->partsGrid.Nearest(*luacon_sim, t, x, y, maxDistance, [](int) { return true; }, &distance);
+	if (i < 0)
+		return 0;
+	lua_pushinteger(l, i);
+	lua_pushinteger(l, distance);
+	return 2;
+}
+
+int LuaScriptInterface::simulation_partsInRadius(lua_State * l)
+{
+	float x = luaL_checknumber(l, 1);
+	float y = luaL_checknumber(l, 2);
+	float radius = luaL_checknumber(l, 3);
+	int t = luaL_checkinteger(l, 4);
+	if (t <= 0 || t >= PT_NUM)
+		return luaL_error(l, "Invalid element ID (%d)", t);
+	std::vector<int> found;
+	luacon_sim->partsGrid.InRadius(*luacon_sim, t, x, y, radius, found);
+	lua_createtable(l, int(found.size()), 0);
+	for (int k = 0; k < int(found.size()); k++)
+	{
+		lua_pushinteger(l, found[k]);
+		lua_rawseti(l, -2, k + 1);
+	}
+	return 1;
+}
+
 int LuaScriptInterface::simulation_partChangeType(lua_State * l)
 {
 	int partIndex = lua_tointeger(l, 1);
@@ -1080,8 +1134,10 @@ int LuaScriptInterface::simulation_partPosition(lua_State * l)
 
 	if(argCount == 3)
 	{
+		luacon_sim->MarkPartDirty(particleID);
 		luacon_sim->parts[particleID].x = lua_tonumber(l, 2);
 		luacon_sim->parts[particleID].y = lua_tonumber(l, 3);
+		luacon_sim->PartMoved(particleID);
 		return 0;
 	}
 	else
@@ -1145,7 +1201,9 @@ int LuaScriptInterface::simulation_partProperty(lua_State * l)
 		}
 		else
 		{
+			luacon_sim->MarkPartDirty(particleID);
 			LuaSetProperty(l, *prop, propertyAddress, 3);
+			luacon_sim->PartMoved(particleID);
 		}
 		return 0;
 	}
@@ -1735,6 +1793,7 @@ int LuaScriptInterface::simulation_resetTemp(lua_State * l)
 	{
 		if (luacon_sim->parts[i].type && (luacon_sim->elements[luacon_sim->parts[i].type].HeatConduct || !onlyConductors))
 		{
+			luacon_sim->MarkPartDirty(i);
 			luacon_sim->parts[i].temp = luacon_sim->elements[luacon_sim->parts[i].type].DefaultProperties.temp;
 		}
 	}
@@ -1999,7 +2058,7 @@ int LuaScriptInterface::simulation_elementCount(lua_State * l)
 	if (element < 0 || element >= PT_NUM)
 		return luaL_error(l, "Invalid element ID (%d)", element);
 
-	lua_pushnumber(l, luacon_sim->elementCount[element]);
+	lua_pushnumber(l, luacon_sim->partsByType.Count(element));
 	return 1;
 }
 
@@ -2123,12 +2182,32 @@ int LuaScriptInterface::simulation_brush(lua_State * l)
 
 int PartsClosure(lua_State *l)
 {
-	for (int i = lua_tointeger(l, lua_upvalueindex(1)); i <= luacon_sim->parts_lastActiveIndex; ++i)
+	int i = luacon_sim->activeParts.Next(lua_tointeger(l, lua_upvalueindex(1)));
+	if (i <= luacon_sim->parts_lastActiveIndex)
+	{
+		lua_pushnumber(l, i + 1);
+		lua_replace(l, lua_upvalueindex(1));
+		lua_pushnumber(l, i);
+		return 1;
+	}
+	return 0;
+}
+
+// Goes through the particles of one type there were when the loop started, skipping
+// the ones that have been killed or changed into something else since
+static int TypePartsClosure(lua_State *l)
+{
+	int t = lua_tointeger(l, lua_upvalueindex(1));
+	int next = lua_tointeger(l, lua_upvalueindex(2));
+	int count = int(lua_objlen(l, lua_upvalueindex(3)) / sizeof(int));
+	auto *ids = (const int *)lua_touserdata(l, lua_upvalueindex(3));
+	for (; next < count; next++)
 	{
-		if (luacon_sim->parts[i].type)
+		int i = ids[next];
+		if (luacon_sim->partTypes[i] == t)
 		{
-			lua_pushnumber(l, i + 1);
-			lua_replace(l, lua_upvalueindex(1));
+			lua_pushnumber(l, next + 1);
+			lua_replace(l, lua_upvalueindex(2));
 			lua_pushnumber(l, i);
 			return 1;
 		}
@@ -2207,8 +2286,22 @@ int LuaScriptInterface::simulation_neighbours(lua_State * l)
 
 int LuaScriptInterface::simulation_parts(lua_State *l)
 {
+	if (lua_isnoneornil(l, 1))
+	{
+		lua_pushnumber(l, 0);
+		lua_pushcclosure(l, PartsClosure, 1);
+		return 1;
+	}
+	int t = luaL_checkinteger(l, 1);
+	if (t <= 0 || t >= PT_NUM)
+		return luaL_error(l, "Invalid element ID (%d)", t);
+	auto &bucket = luacon_sim->partsByType.Sorted(t);
+	lua_pushnumber(l, t);
 	lua_pushnumber(l, 0);
-	lua_pushcclosure(l, PartsClosure, 1);
+	void *ids = lua_newuserdata(l, bucket.size() * sizeof(int));
+	if (bucket.size())
+		memcpy(ids, &bucket[0], bucket.size() * sizeof(int));
+	lua_pushcclosure(l, TypePartsClosure, 3);
 	return 1;
 }
 
@@ -2266,12 +2359,195 @@ int LuaScriptInterface::simulation_gspeed(lua_State * l)
 	return 0;
 }
 
+int LuaScriptInterface::simulation_threads(lua_State * l)
+{
+	if (lua_gettop(l) == 0)
+	{
+		lua_pushinteger(l, luacon_sim->GetThreads());
+		return 1;
+	}
+	int threads = luaL_checkinteger(l, 1);
+	if (threads < 1)
+		return luaL_error(l, "Thread count must be at least 1");
+	luacon_sim->SetThreads(threads);
+	return 0;
+}
+
+int LuaScriptInterface::simulation_airThread(lua_State * l)
+{
+	if (lua_gettop(l) == 0)
+	{
+		lua_pushboolean(l, luacon_sim->air->IsAsync());
+		lua_pushnumber(l, luacon_sim->air->GetAsyncSavedTime());
+		return 2;
+	}
+	luaL_checktype(l, 1, LUA_TBOOLEAN);
+	luacon_sim->air->SetAsync(lua_toboolean(l, 1));
+	return 0;
+}
+
+int LuaScriptInterface::simulation_frameTimings(lua_State * l)
+{
+	if (lua_gettop(l) > 0)
+	{
+		luaL_checktype(l, 1, LUA_TBOOLEAN);
+		luacon_sim->phaseTiming = lua_toboolean(l, 1);
+		return 0;
+	}
+	// milliseconds spent on each phase, over the frames in the history and in the last one
+	auto &history = luacon_sim->phaseHistory;
+	auto &last = history[(luacon_sim->phaseHistoryPos + Simulation::phaseHistorySize - 1) % Simulation::phaseHistorySize];
+	lua_newtable(l);
+	for (int phase = 0; phase < Simulation::phaseCount; phase++)
+	{
+		float total = 0, max = 0;
+		for (auto &frame : history)
+		{
+			total += frame[phase];
+			max = std::max(max, frame[phase]);
+		}
+		lua_newtable(l);
+		lua_pushnumber(l, total / Simulation::phaseHistorySize);
+		lua_setfield(l, -2, "mean");
+		lua_pushnumber(l, max);
+		lua_setfield(l, -2, "max");
+		lua_pushnumber(l, last[phase]);
+		lua_setfield(l, -2, "last");
+		lua_setfield(l, -2, Simulation::phaseNames[phase]);
+	}
+	lua_pushboolean(l, luacon_sim->phaseTiming);
+	return 2;
+}
+
+int LuaScriptInterface::simulation_elementTimings(lua_State * l)
+{
+	if (lua_gettop(l) > 0)
+	{
+		luaL_checktype(l, 1, LUA_TBOOLEAN);
+		bool timing = lua_toboolean(l, 1);
+		if (timing && !luacon_sim->elementTiming)
+			luacon_sim->elementCosts.fill(ElementCost());
+		luacon_sim->elementTiming = timing;
+		return 0;
+	}
+	lua_newtable(l);
+	for (int t = 1; t < PT_NUM; t++)
+	{
+		auto &cost = luacon_sim->elementCosts[t];
+		if (!cost.calls)
+			continue;
+		lua_newtable(l);
+		lua_pushnumber(l, double(cost.calls));
+		lua_setfield(l, -2, "calls");
+		lua_pushnumber(l, cost.seconds * 1000);
+		lua_setfield(l, -2, "totalMs");
+		lua_pushnumber(l, cost.seconds * 1000000 / cost.calls);
+		lua_setfield(l, -2, "meanUs");
+		lua_rawseti(l, -2, t);
+	}
+	lua_pushboolean(l, luacon_sim->elementTiming);
+	return 2;
+}
+
+int LuaScriptInterface::simulation_elementTimingsCSV(lua_State * l)
+{
+	auto csv = luacon_sim->ElementCostsCSV();
+	if (lua_gettop(l) == 0)
+	{
+		lua_pushlstring(l, csv.data(), csv.size());
+		return 1;
+	}
+	ByteString filename = luaL_checkstring(l, 1);
+	// WriteFile returns true if it failed
+	lua_pushboolean(l, !Client::Ref().WriteFile(std::vector<char>(csv.begin(), csv.end()), filename));
+	return 1;
+}
+
 int LuaScriptInterface::simulation_takeSnapshot(lua_State * l)
 {
 	luacon_controller->HistorySnapshot();
 	return 0;
 }
 
+int LuaScriptInterface::simulation_timeline(lua_State * l)
+{
+	if (lua_gettop(l) > 0)
+	{
+		int maxFrames = luaL_checkint(l, 1);
+		int maxMemory = luaL_optint(l, 2, 512);
+		int keyframeInterval = luaL_optint(l, 3, 60);
+		luacon_model->SetTimeline(std::max(maxFrames, 0), size_t(std::max(maxMemory, 1)) << 20, std::max(keyframeInterval, 1));
+		return 0;
+	}
+	auto *timeline = luacon_model->GetTimeline();
+	if (!timeline)
+	{
+		lua_pushinteger(l, 0);
+		lua_pushinteger(l, 0);
+		return 2;
+	}
+	lua_pushinteger(l, timeline->Size());
+	lua_pushnumber(l, double(timeline->Bytes()));
+	return 2;
+}
+
+int LuaScriptInterface::simulation_timelineRewind(lua_State * l)
+{
+	int framesBack = luaL_checkint(l, 1);
+	lua_pushboolean(l, framesBack >= 0 && luacon_controller->TimelineRewind(framesBack));
+	return 1;
+}
+
+int LuaScriptInterface::simulation_seed(lua_State * l)
+{
+	luacon_sim->SetSeed(luaL_checkinteger(l, 1));
+	return 0;
+}
+
+int LuaScriptInterface::simulation_deterministic(lua_State * l)
+{
+	if (lua_gettop(l) == 0)
+	{
+		lua_pushboolean(l, luacon_sim->deterministic);
+		return 1;
+	}
+	luaL_checktype(l, 1, LUA_TBOOLEAN);
+	luacon_sim->deterministic = lua_toboolean(l, 1);
+	luacon_sim->stateHash = 0;
+	return 0;
+}
+
+int LuaScriptInterface::simulation_threaded(lua_State * l)
+{
+	auto *runner = luacon_controller->GetSimulationRunner();
+	int args = lua_gettop(l);
+	if (args == 0)
+	{
+		lua_pushboolean(l, runner->GetThreaded());
+		lua_pushnumber(l, runner->GetTargetTps());
+		lua_pushnumber(l, runner->GetTps());
+		return 3;
+	}
+	luaL_checktype(l, 1, LUA_TBOOLEAN);
+	if (args > 1)
+	{
+		float targetTps = luaL_checknumber(l, 2);
+		if (targetTps < 0)
+			return luaL_error(l, "Invalid target TPS");
+		runner->SetTargetTps(targetTps);
+	}
+	runner->SetThreaded(lua_toboolean(l, 1));
+	return 0;
+}
+
+int LuaScriptInterface::simulation_stateHash(lua_State * l)
+{
+	// too wide for a Lua number
+	lua_pushstring(l, ByteString::Build(Format::Hex(), Format::Width(luacon_sim->stateHash, 16)).c_str());
+	lua_pushinteger(l, luacon_sim->currentTick);
+	return 2;
+}
+
 int LuaScriptInterface::simulation_replaceModeFlags(lua_State *l)
 {
 	if (lua_gettop(l) == 0)
@@ -2677,6 +2953,7 @@ void LuaScriptInterface::initElementsAPI()
 	SETCONST(l, PROP_NOAMBHEAT);
 	lua_pushinteger(l, 0); lua_setfield(l, -2, "PROP_DRAWONCTYPE");
 	SETCONST(l, PROP_NOCTYPEDRAW);
+	SETCONST(l, PROP_TILELOCAL);
 	SETCONST(l, FLAG_STAGNANT);
 	SETCONST(l, FLAG_SKIPMOVE);
 	SETCONST(l, FLAG_MOVABLE);
@@ -2866,6 +3143,7 @@ int LuaScriptInterface::elements_loadDefault(lua_State * l)
 		}
 	}
 	luacon_ci->custom_init_can_move();
+	luacon_sim->InvalidateMaps();
 	std::fill(luacon_ren->graphicscache, luacon_ren->graphicscache+PT_NUM, gcache_item());
 	SaveRenderer::Ref().Flush(0, PT_NUM);
 	return 0;
@@ -2995,7 +3273,7 @@ static int luaGraphicsWrapper(GRAPHICS_FUNC_ARGS)
 	if (lua_gr_func[cpart->type])
 	{
 		int cache = 0, callret;
-		int i = cpart - ren->sim->parts; // pointer arithmetic be like
+		int i = cpart - ren->frame->parts; // pointer arithmetic be like
 		lua_rawgeti(luacon_ci->l, LUA_REGISTRYINDEX, lua_gr_func[cpart->type]);
 		lua_pushinteger(luacon_ci->l, i);
 		lua_pushinteger(luacon_ci->l, *colr);
@@ -3242,6 +3520,7 @@ int LuaScriptInterface::elements_element(lua_State * l)
 
 		luacon_model->BuildMenus();
 		luacon_ci->custom_init_can_move();
+		luacon_sim->InvalidateMaps();
 		luacon_ren->graphicscache[id].isready = 0;
 		SaveRenderer::Ref().Flush(id, id + 1);
 
@@ -3310,6 +3589,7 @@ int LuaScriptInterface::elements_property(lua_State * l)
 
 			luacon_model->BuildMenus();
 			luacon_ci->custom_init_can_move();
+			luacon_sim->InvalidateMaps();
 			luacon_ren->graphicscache[id].isready = 0;
 			SaveRenderer::Ref().Flush(id, id + 1);
 		}
@@ -4190,18 +4470,55 @@ void LuaScriptInterface::initHttpAPI()
 
 bool LuaScriptInterface::HandleEvent(LuaEvents::EventTypes eventType, Event * event)
 {
-	return LuaEvents::HandleEvent(this, event, ByteString::Build("tptevents-", eventType));
+	auto eventName = ByteString::Build("tptevents-", eventType);
+	// * Handlers may do anything to the simulation, so they wait for the tick in progress, if the
+	//   simulation is running on a thread of its own. Events nothing listens to don't.
+	// * Looking for handlers without the lock is fine, as the simulation's thread never runs Lua:
+	//   it doesn't tick while HooksSimulation.
+	lua_pushstring(l, eventName.c_str());
+	lua_rawget(l, LUA_REGISTRYINDEX);
+	bool hasHandlers = lua_istable(l, -1) && lua_objlen(l, -1);
+	lua_pop(l, 1);
+	std::unique_lock<SimulationRunner::Mutex> simLock;
+	if (hasHandlers)
+		simLock = c->GetSimulationRunner()->Lock();
+	return LuaEvents::HandleEvent(this, event, eventName);
+}
+
+bool LuaScriptInterface::HooksElementGraphics()
+{
+	for (auto &element : luacon_sim->elements)
+	{
+		if (element.Graphics == luaGraphicsWrapper)
+			return true;
+	}
+	return false;
+}
+
+bool LuaScriptInterface::HooksSimulation()
+{
+	for (auto &element : luacon_sim->elements)
+	{
+		if (element.Update == luaUpdateWrapper || element.Create == luaCreateWrapper ||
+		        element.CreateAllowed == luaCreateAllowedWrapper || element.ChangeType == luaChangeTypeWrapper ||
+		        element.CtypeDraw == luaCtypeDrawWrapper)
+			return true;
+	}
+	return false;
 }
 
 void LuaScriptInterface::OnTick()
 {
-	lua_getglobal(l, "simulation");
-	if (lua_istable(l, -1))
+	if (auto simLock = c->GetSimulationRunner()->TryLock())
 	{
-		lua_pushinteger(l, luacon_sim->NUM_PARTS);
-		lua_setfield(l, -2, "NUM_PARTS");
+		lua_getglobal(l, "simulation");
+		if (lua_istable(l, -1))
+		{
+			lua_pushinteger(l, luacon_sim->NUM_PARTS);
+			lua_setfield(l, -2, "NUM_PARTS");
+		}
+		lua_pop(l, 1);
 	}
-	lua_pop(l, 1);
 	TickEvent ev;
 	HandleEvent(LuaEvents::tick, &ev);
 }
@@ -57,6 +57,8 @@ class LuaScriptInterface: public CommandInterface
 	void initSimulationAPI();
 	static void set_map(int x, int y, int width, int height, float value, int mapType);
 	static int simulation_partNeighbours(lua_State * l);
+	static int simulation_nearestPart(lua_State * l);
+	static int simulation_partsInRadius(lua_State * l);
 	static int simulation_partChangeType(lua_State * l);
 	static int simulation_partCreate(lua_State * l);
 	static int simulation_partProperty(lua_State * l);
@@ -112,7 +114,18 @@ class LuaScriptInterface: public CommandInterface
 	static int simulation_neighbours(lua_State * l);
 	static int simulation_framerender(lua_State * l);
 	static int simulation_gspeed(lua_State * l);
+	static int simulation_threads(lua_State * l);
+	static int simulation_airThread(lua_State * l);
+	static int simulation_frameTimings(lua_State * l);
+	static int simulation_elementTimings(lua_State * l);
+	static int simulation_elementTimingsCSV(lua_State * l);
 	static int simulation_takeSnapshot(lua_State *l);
+	static int simulation_timeline(lua_State *l);
+	static int simulation_timelineRewind(lua_State *l);
+	static int simulation_seed(lua_State *l);
+	static int simulation_deterministic(lua_State *l);
+	static int simulation_threaded(lua_State *l);
+	static int simulation_stateHash(lua_State *l);
 	static int simulation_replaceModeFlags(lua_State *l);
 	static int simulation_listCustomGol(lua_State *l);
 	static int simulation_addCustomGol(lua_State *l);
@@ -215,6 +228,8 @@ public:
 
 	void OnTick() override;
 	bool HandleEvent(LuaEvents::EventTypes eventType, Event * event) override;
+	bool HooksElementGraphics() override;
+	bool HooksSimulation() override;
 
 	void Init();
 	void SetWindow(ui::Window * window);
@@ -26,6 +26,8 @@ TPTScriptInterface::TPTScriptInterface(GameController * c, GameModel * m): Comma
 
 int TPTScriptInterface::Command(String command)
 {
+	// commands like set and reset write to particles directly, see Simulation::UpdateSnapshot
+	m->GetSimulation()->MarkAllDirty();
 	lastError = "";
 	std::deque<String> words;
 	std::deque<AnyType> commandWords;
@@ -427,6 +429,9 @@ AnyType TPTScriptInterface::tptS_set(std::deque<String> * words)
 	}
 	else
 		throw GeneralException("Invalid selector");
+	// particles moved in bulk are put back on the maps in one go by the next frame
+	if (propertyOffset == offsetof(Particle, x) || propertyOffset == offsetof(Particle, y))
+		sim->InvalidateMaps();
 	return NumberType(returnValue);
 }
 
@@ -0,0 +1,142 @@
+#include "ActiveParticles.h"
+
+#include <algorithm>
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+static int LowestBit(uint64_t word)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)(word & 0xFFFFFFFFU)))
+		return int(index);
+	_BitScanForward(&index, (unsigned long)(word >> 32));
+	return int(index) + 32;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+static int HighestBit(uint64_t word)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(word >> 32)))
+		return int(index) + 32;
+	_BitScanReverse(&index, (unsigned long)(word & 0xFFFFFFFFU));
+	return int(index);
+#else
+	return 63 - __builtin_clzll(word);
+#endif
+}
+
+ActiveParticles::ActiveParticles()
+{
+	Clear();
+}
+
+int ActiveParticles::Next(int i) const
+{
+	if (i >= NPART)
+		return NPART;
+	int word = i / 64;
+	uint64_t bits = active[word].load(std::memory_order_relaxed) & (~uint64_t(0) << (i % 64));
+	while (!bits)
+	{
+		if (++word == wordCount)
+			return NPART;
+		bits = active[word].load(std::memory_order_relaxed);
+	}
+	return word * 64 + LowestBit(bits);
+}
+
+int ActiveParticles::Prev(int i) const
+{
+	if (i < 0)
+		return -1;
+	if (i >= NPART)
+		i = NPART - 1;
+	int word = i / 64;
+	uint64_t bits = active[word].load(std::memory_order_relaxed) & (~uint64_t(0) >> (63 - i % 64));
+	while (!bits)
+	{
+		if (--word < 0)
+			return -1;
+		bits = active[word].load(std::memory_order_relaxed);
+	}
+	return word * 64 + HighestBit(bits);
+}
+
+int ActiveParticles::FirstFree() const
+{
+	for (int word = 0; word < wordCount; word++)
+	{
+		uint64_t bits = ~active[word].load(std::memory_order_relaxed);
+		if (bits)
+		{
+			int i = word * 64 + LowestBit(bits);
+			return i < NPART ? i : NPART;
+		}
+	}
+	return NPART;
+}
+
+int ActiveParticles::Alloc()
+{
+	if (freed.size())
+	{
+		int i = freed.back();
+		freed.pop_back();
+		return i;
+	}
+	if (Full())
+		return -1;
+	int i = spareWord * 64 + LowestBit(spare[spareWord]);
+	spare[spareWord] &= spare[spareWord] - 1;
+	return i;
+}
+
+void ActiveParticles::Free(int i)
+{
+	freed.push_back(i);
+}
+
+bool ActiveParticles::Full()
+{
+	if (freed.size())
+		return false;
+	while (spareWord < wordCount && !spare[spareWord])
+		spareWord++;
+	return spareWord == wordCount;
+}
+
+void ActiveParticles::Reset()
+{
+	for (int word = 0; word < wordCount; word++)
+		spare[word] = ~active[word].load(std::memory_order_relaxed);
+	if (NPART % 64)
+		spare[wordCount - 1] &= (uint64_t(1) << (NPART % 64)) - 1;
+	spareWord = 0;
+	freed.clear();
+}
+
+void ActiveParticles::ForgetFreedBelow(int i)
+{
+	freed.erase(std::remove_if(freed.begin(), freed.end(), [i](int index) {
+		return index < i;
+	}), freed.end());
+}
+
+void ActiveParticles::Clear()
+{
+	for (auto &word : active)
+		word.store(0, std::memory_order_relaxed);
+	Reset();
+}
+
+void ActiveParticles::CopyActive(const ActiveParticles &other)
+{
+	for (int word = 0; word < wordCount; word++)
+		active[word].store(other.active[word].load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
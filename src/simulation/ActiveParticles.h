@@ -0,0 +1,68 @@
+#ifndef ACTIVEPARTICLES_H
+#define ACTIVEPARTICLES_H
+#include "Config.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Keeps track of which indices of Simulation::parts are in use, so that loops over
+// particles can skip over the holes 64 at a time, and hands out free indices.
+// Free indices are handed out in the order the free list threaded through
+// parts[i].life used to: indices freed since the last Reset, most recent first,
+// then the ones that were free at the last Reset, lowest first.
+class ActiveParticles
+{
+	static constexpr int wordCount = (NPART + 63) / 64;
+
+	// written to by concurrently updated tiles, see UpdateParticlesTiled
+	std::array<std::atomic<uint64_t>, wordCount> active;
+	std::array<uint64_t, wordCount> spare;
+	int spareWord;
+	std::vector<int> freed;
+
+public:
+	ActiveParticles();
+	ActiveParticles(const ActiveParticles &) = delete;
+	ActiveParticles &operator =(const ActiveParticles &) = delete;
+
+	bool Active(int i) const
+	{
+		return (active[i / 64].load(std::memory_order_relaxed) >> (i % 64)) & 1;
+	}
+
+	void Add(int i)
+	{
+		active[i / 64].fetch_or(uint64_t(1) << (i % 64), std::memory_order_relaxed);
+	}
+
+	void Remove(int i)
+	{
+		active[i / 64].fetch_and(~(uint64_t(1) << (i % 64)), std::memory_order_relaxed);
+	}
+
+	// First index in use at or after i, NPART if there is none
+	int Next(int i) const;
+	// Last index in use at or before i, -1 if there is none
+	int Prev(int i) const;
+	// First index not in use, NPART if there is none
+	int FirstFree() const;
+
+	// Takes a free index, -1 if there is none
+	int Alloc();
+	// Hands back an index that is no longer in use, it is the next one Alloc hands out
+	void Free(int i);
+	bool Full();
+
+	// Starts handing out indices that are not in use right now, lowest first
+	void Reset();
+	// Forgets about indices freed since Reset that are lower than i; they only become
+	// available again at the next Reset
+	void ForgetFreedBelow(int i);
+	void Clear();
+	// Marks the same indices in use as other does, for drawing a copy of the particles
+	void CopyActive(const ActiveParticles &other);
+};
+
+#endif
@@ -2,6 +2,11 @@
 
 #include <cmath>
 #include <algorithm>
+#include <cstring>
+#include <chrono>
+#ifdef X86_SSE2
+# include <emmintrin.h>
+#endif
 
 #include "Simulation.h"
 #include "ElementClasses.h"
@@ -44,14 +49,158 @@ void Air::Clear()
 	std::fill(&pv[0][0], &pv[0][0]+((XRES/CELL)*(YRES/CELL)), 0.0f);
 	std::fill(&vy[0][0], &vy[0][0]+((XRES/CELL)*(YRES/CELL)), 0.0f);
 	std::fill(&vx[0][0], &vx[0][0]+((XRES/CELL)*(YRES/CELL)), 0.0f);
+	DiscardAsyncResult();
 }
 
 void Air::ClearAirH()
 {
 	std::fill(&hv[0][0], &hv[0][0]+((XRES/CELL)*(YRES/CELL)), ambientAirTemp);
+	DiscardAsyncResult();
 }
 
-void Air::update_airh(void)
+#ifdef X86_SSE2
+// Four consecutive cells of a blocked air map as lane masks, all ones where air isn't blocked
+static inline __m128 OpenMask(const unsigned char *blockMap, int blockBits)
+{
+	int bytes;
+	memcpy(&bytes, blockMap, sizeof(bytes));
+	__m128i zero = _mm_setzero_si128();
+	__m128i lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(lanes, _mm_set1_epi32(blockBits)), zero));
+}
+
+// Adds f times a neighbour, or times the cell itself where the neighbour is blocked; same
+// operations in the same order as the scalar code, so the results are the same too unless
+// the compiler is allowed to reorder the scalar code, as release builds with -ffast-math are
+static inline __m128 BlurTerm(__m128 sum, __m128 open, const float *neighbour, __m128 centre, __m128 f)
+{
+	__m128 value = _mm_or_ps(_mm_and_ps(open, _mm_loadu_ps(neighbour)), _mm_andnot_ps(open, centre));
+	return _mm_add_ps(sum, _mm_mul_ps(value, f));
+}
+#endif
+
+// Runs kernel over ambient heat and vx for the cells in row y, neighbours heat can't get
+// into count as the cell itself; simd false keeps to the scalar loop, for comparing the two
+void Air::blur_airh(int y, float *dh, float *dx, bool simd)
+{
+	auto blurCells = [this, y, dh, dx](int x0, int x1) {
+		for (int x=x0; x<x1; x++)
+		{
+			float sumH = 0.0f, sumX = 0.0f;
+			for (int j=-1; j<2; j++)
+			{
+				for (int i=-1; i<2; i++)
+				{
+					float f = kernel[i+1+(j+1)*3];
+					if (y+j>0 && y+j<YRES/CELL-2 &&
+					        x+i>0 && x+i<XRES/CELL-2 &&
+					        !(bmap_blockairh[y+j][x+i]&0x8))
+					{
+						sumH += hv[y+j][x+i]*f;
+						sumX += vx[y+j][x+i]*f;
+					}
+					else
+					{
+						sumH += hv[y][x]*f;
+						sumX += vx[y][x]*f;
+					}
+				}
+			}
+			dh[x] = sumH;
+			dx[x] = sumX;
+		}
+	};
+	int x = 0;
+#ifdef X86_SSE2
+	if (simd)
+	{
+		// every neighbour of these is inside the part of the map heat moves in, so only
+		// the ones blocked by walls and insulators need masking
+		blurCells(0, 2);
+		for (x = 2; x + 4 <= XRES/CELL-3; x += 4)
+		{
+			__m128 centreH = _mm_loadu_ps(&hv[y][x]), centreX = _mm_loadu_ps(&vx[y][x]);
+			__m128 sumH = _mm_setzero_ps(), sumX = _mm_setzero_ps();
+			for (int j=-1; j<2; j++)
+			{
+				bool rowOpen = y+j>0 && y+j<YRES/CELL-2;
+				for (int i=-1; i<2; i++)
+				{
+					__m128 open = rowOpen ? OpenMask(&bmap_blockairh[y+j][x+i], 0x8) : _mm_setzero_ps();
+					__m128 f = _mm_set1_ps(kernel[i+1+(j+1)*3]);
+					sumH = BlurTerm(sumH, open, rowOpen ? &hv[y+j][x+i] : &hv[y][x], centreH, f);
+					sumX = BlurTerm(sumX, open, rowOpen ? &vx[y+j][x+i] : &vx[y][x], centreX, f);
+				}
+			}
+			_mm_storeu_ps(&dh[x], sumH);
+			_mm_storeu_ps(&dx[x], sumX);
+		}
+	}
+#endif
+	blurCells(x, XRES/CELL);
+}
+
+// Same as blur_airh but for pressure and velocity, with the results going in ovx, ovy and opv
+void Air::blur_air(int y, bool simd)
+{
+	auto blurCells = [this, y](int x0, int x1) {
+		for (int x=x0; x<x1; x++)
+		{
+			float dx = 0.0f, dy = 0.0f, dp = 0.0f;
+			for (int j=-1; j<2; j++)
+				for (int i=-1; i<2; i++)
+					if (y+j>0 && y+j<YRES/CELL-1 &&
+					        x+i>0 && x+i<XRES/CELL-1 &&
+					        !bmap_blockair[y+j][x+i])
+					{
+						float f = kernel[i+1+(j+1)*3];
+						dx += vx[y+j][x+i]*f;
+						dy += vy[y+j][x+i]*f;
+						dp += pv[y+j][x+i]*f;
+					}
+					else
+					{
+						float f = kernel[i+1+(j+1)*3];
+						dx += vx[y][x]*f;
+						dy += vy[y][x]*f;
+						dp += pv[y][x]*f;
+					}
+			ovx[y][x] = dx;
+			ovy[y][x] = dy;
+			opv[y][x] = dp;
+		}
+	};
+	int x = 0;
+#ifdef X86_SSE2
+	if (simd)
+	{
+		blurCells(0, 2);
+		for (x = 2; x + 4 <= XRES/CELL-2; x += 4)
+		{
+			__m128 centreX = _mm_loadu_ps(&vx[y][x]), centreY = _mm_loadu_ps(&vy[y][x]), centreP = _mm_loadu_ps(&pv[y][x]);
+			__m128 dx = _mm_setzero_ps(), dy = _mm_setzero_ps(), dp = _mm_setzero_ps();
+			for (int j=-1; j<2; j++)
+			{
+				bool rowOpen = y+j>0 && y+j<YRES/CELL-1;
+				for (int i=-1; i<2; i++)
+				{
+					__m128 open = rowOpen ? OpenMask(&bmap_blockair[y+j][x+i], 0xFF) : _mm_setzero_ps();
+					__m128 f = _mm_set1_ps(kernel[i+1+(j+1)*3]);
+					dx = BlurTerm(dx, open, rowOpen ? &vx[y+j][x+i] : &vx[y][x], centreX, f);
+					dy = BlurTerm(dy, open, rowOpen ? &vy[y+j][x+i] : &vy[y][x], centreY, f);
+					dp = BlurTerm(dp, open, rowOpen ? &pv[y+j][x+i] : &pv[y][x], centreP, f);
+				}
+			}
+			_mm_storeu_ps(&ovx[y][x], dx);
+			_mm_storeu_ps(&ovy[y][x], dy);
+			_mm_storeu_ps(&opv[y][x], dp);
+		}
+	}
+#endif
+	blurCells(x, XRES/CELL);
+}
+
+void Air::update_airh(int gravityMode)
 {
 	int x, y, i, j;
 	float odh, dh, dx, dy, f, tx, ty;
@@ -73,31 +222,25 @@ void Air::update_airh(void)
 	}
 	for (y=0; y<YRES/CELL; y++) //update velocity and pressure
 	{
+		// vy is changed as this goes, so only heat and vx can be blurred a row at a time
+		float rowDh[XRES/CELL], rowDx[XRES/CELL];
+		blur_airh(y, rowDh, rowDx);
 		for (x=0; x<XRES/CELL; x++)
 		{
-			dh = 0.0f;
-			dx = 0.0f;
+			dh = rowDh[x];
+			dx = rowDx[x];
 			dy = 0.0f;
 			for (j=-1; j<2; j++)
 			{
 				for (i=-1; i<2; i++)
 				{
+					f = kernel[i+1+(j+1)*3];
 					if (y+j>0 && y+j<YRES/CELL-2 &&
 					        x+i>0 && x+i<XRES/CELL-2 &&
 					        !(bmap_blockairh[y+j][x+i]&0x8))
-						{
-						f = kernel[i+1+(j+1)*3];
-						dh += hv[y+j][x+i]*f;
-						dx += vx[y+j][x+i]*f;
 						dy += vy[y+j][x+i]*f;
-					}
 					else
-					{
-						f = kernel[i+1+(j+1)*3];
-						dh += hv[y][x]*f;
-						dx += vx[y][x]*f;
 						dy += vy[y][x]*f;
-					}
 				}
 			}
 			tx = x - dx*0.7f;
@@ -115,7 +258,7 @@ void Air::update_airh(void)
 				dh += AIR_VADV*(1.0f-tx)*ty*((bmap_blockairh[j+1][i]&0x8) ? odh : hv[j+1][i]);
 				dh += AIR_VADV*tx*ty*((bmap_blockairh[j+1][i+1]&0x8) ? odh : hv[j+1][i+1]);
 			}
-			if(!sim.gravityMode)
+			if(!gravityMode)
 			{ //Vertical gravity only for the time being
 				float airdiff = hv[y-1][x]-hv[y][x];
 				if(airdiff>0 && !(bmap_blockairh[y-1][x]&0x8))
@@ -130,7 +273,7 @@ void Air::update_airh(void)
 void Air::update_air(void)
 {
 	int x = 0, y = 0, i = 0, j = 0;
-	float dp = 0.0f, dx = 0.0f, dy = 0.0f, f = 0.0f, tx = 0.0f, ty = 0.0f;
+	float dp = 0.0f, dx = 0.0f, dy = 0.0f, tx = 0.0f, ty = 0.0f;
 	const float advDistanceMult = 0.7f;
 	float stepX, stepY;
 	int stepLimit, step;
@@ -210,30 +353,15 @@ void Air::update_air(void)
 					vy[y][x] = 0;
 			}
 
+		for (y=0; y<YRES/CELL; y++)
+			blur_air(y);
+
 		for (y=0; y<YRES/CELL; y++) //update velocity and pressure
 			for (x=0; x<XRES/CELL; x++)
 			{
-				dx = 0.0f;
-				dy = 0.0f;
-				dp = 0.0f;
-				for (j=-1; j<2; j++)
-					for (i=-1; i<2; i++)
-						if (y+j>0 && y+j<YRES/CELL-1 &&
-						        x+i>0 && x+i<XRES/CELL-1 &&
-						        !bmap_blockair[y+j][x+i])
-						{
-							f = kernel[i+1+(j+1)*3];
-							dx += vx[y+j][x+i]*f;
-							dy += vy[y+j][x+i]*f;
-							dp += pv[y+j][x+i]*f;
-						}
-						else
-						{
-							f = kernel[i+1+(j+1)*3];
-							dx += vx[y][x]*f;
-							dy += vy[y][x]*f;
-							dp += pv[y][x]*f;
-						}
+				dx = ovx[y][x];
+				dy = ovy[y][x];
+				dp = opv[y][x];
 
 				tx = x - dx*advDistanceMult;
 				ty = y - dy*advDistanceMult;
@@ -350,6 +478,7 @@ void Air::Invert()
 			vx[ny][nx] = -vx[ny][nx];
 			vy[ny][nx] = -vy[ny][nx];
 		}
+	DiscardAsyncResult();
 }
 
 // called when loading saves / stamps to ensure nothing "leaks" the first frame
@@ -373,7 +502,7 @@ void Air::RecalculateBlockAirMaps()
 			}
 		}
 		// mostly accurate insulator blocking, besides checking GEL
-		else if ((type == PT_HSWC && sim.parts[i].life != 10) || sim.elements[type].HeatConduct <= (random_gen()%250))
+		else if ((type == PT_HSWC && sim.parts[i].life != 10) || sim.elements[type].HeatConduct <= (RNG::Ref()()%250))
 		{
 			int x = ((int)(sim.parts[i].x+0.5f))/CELL, y = ((int)(sim.parts[i].y+0.5f))/CELL;
 			if (sim.InBounds(x, y) && !(bmap_blockairh[y][x]&0x8))
@@ -382,6 +511,121 @@ void Air::RecalculateBlockAirMaps()
 	}
 }
 
+void Air::SetAsync(bool async)
+{
+	if (async == IsAsync())
+		return;
+	if (async)
+	{
+		th_air = std::make_unique<Air>(sim);
+		th_air->bmap = th_bmap;
+		th_air->fvx = th_fvx;
+		th_air->fvy = th_fvy;
+		airthread_done = false;
+		air_busy = false;
+		th_started = false;
+		savedTime = 0.0f;
+		airthread = std::thread([this]() { update_air_thread(); });
+	}
+	else
+	{
+		{
+			std::lock_guard<std::mutex> l(airmutex);
+			airthread_done = true;
+		}
+		aircv.notify_all();
+		airthread.join();
+		th_air.reset();
+		savedTime = 0.0f;
+	}
+}
+
+void Air::DiscardAsyncResult()
+{
+	ignoreNextResult = true;
+}
+
+void Air::update_air_thread()
+{
+	std::unique_lock<std::mutex> l(airmutex);
+	while (true)
+	{
+		aircv.wait(l, [this]() { return airthread_done || air_busy; });
+		if (airthread_done)
+			return;
+		l.unlock();
+		auto start = std::chrono::steady_clock::now();
+		th_air->update_air();
+		if (th_heat)
+			th_air->update_airh(th_gravityMode);
+		auto solveTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		l.lock();
+		th_solveTime = solveTime;
+		air_busy = false;
+		aircv.notify_all();
+	}
+}
+
+// Takes what the air thread made of the maps as they were a frame ago and applies the
+// change to the maps as they are now, so that whatever particles did to them in the
+// meantime isn't lost, then hands the air thread the maps as they are now
+void Air::update_air_async(bool heat, int gravityMode)
+{
+	auto start = std::chrono::steady_clock::now();
+	float solveTime;
+	{
+		std::unique_lock<std::mutex> l(airmutex);
+		aircv.wait(l, [this]() { return !air_busy; });
+		solveTime = th_solveTime;
+	}
+	if (th_started && !ignoreNextResult)
+	{
+		for (int y = 0; y < YRES/CELL; y++)
+			for (int x = 0; x < XRES/CELL; x++)
+			{
+				vx[y][x] += th_air->vx[y][x] - th_vx[y][x];
+				vy[y][x] += th_air->vy[y][x] - th_vy[y][x];
+				pv[y][x] += th_air->pv[y][x] - th_pv[y][x];
+			}
+		if (th_heat)
+			for (int y = 0; y < YRES/CELL; y++)
+				for (int x = 0; x < XRES/CELL; x++)
+					hv[y][x] += th_air->hv[y][x] - th_hv[y][x];
+	}
+	ignoreNextResult = false;
+
+	memcpy(th_vx, vx, sizeof(vx));
+	memcpy(th_vy, vy, sizeof(vy));
+	memcpy(th_pv, pv, sizeof(pv));
+	memcpy(th_hv, hv, sizeof(hv));
+	memcpy(th_air->vx, vx, sizeof(vx));
+	memcpy(th_air->vy, vy, sizeof(vy));
+	memcpy(th_air->pv, pv, sizeof(pv));
+	memcpy(th_air->hv, hv, sizeof(hv));
+	memcpy(th_air->bmap_blockair, bmap_blockair, sizeof(bmap_blockair));
+	memcpy(th_air->bmap_blockairh, bmap_blockairh, sizeof(bmap_blockairh));
+	memcpy(th_bmap, bmap, sizeof(th_bmap));
+	memcpy(th_fvx, fvx, sizeof(th_fvx));
+	memcpy(th_fvy, fvy, sizeof(th_fvy));
+	th_air->airMode = airMode;
+	th_air->ambientAirTemp = ambientAirTemp;
+	{
+		std::lock_guard<std::mutex> l(airmutex);
+		th_heat = heat;
+		th_gravityMode = gravityMode;
+		air_busy = true;
+	}
+	aircv.notify_all();
+
+	// the main thread would have spent solveTime on this, it spent the time since start instead
+	if (th_started)
+	{
+		auto spent = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		savedTime = savedTime*(1.0f-0.05f) + (solveTime - spent)*0.05f;
+	}
+	th_started = true;
+}
+
 Air::Air(Simulation & simulation):
 	sim(simulation),
 	airMode(0),
@@ -400,3 +644,8 @@ Air::Air(Simulation & simulation):
 	std::fill(&pv[0][0], &pv[0][0]+((XRES/CELL)*(YRES/CELL)), 0.0f);
 	std::fill(&opv[0][0], &opv[0][0]+((XRES/CELL)*(YRES/CELL)), 0.0f);
 }
+
+Air::~Air()
+{
+	SetAsync(false);
+}
@@ -2,10 +2,42 @@
 #define AIR_H
 #include "Config.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
 class Simulation;
 
 class Air
 {
+private:
+	// Air solved on a thread of its own while particles update, one frame behind;
+	// see update_air_async
+	std::unique_ptr<Air> th_air;
+	// What th_air started from, its result minus this is added to the maps
+	float th_vx[YRES/CELL][XRES/CELL];
+	float th_vy[YRES/CELL][XRES/CELL];
+	float th_pv[YRES/CELL][XRES/CELL];
+	float th_hv[YRES/CELL][XRES/CELL];
+	unsigned char th_bmap[YRES/CELL][XRES/CELL];
+	float th_fvx[YRES/CELL][XRES/CELL];
+	float th_fvy[YRES/CELL][XRES/CELL];
+	bool th_heat = false;
+	int th_gravityMode = 0;
+
+	std::thread airthread;
+	std::mutex airmutex;
+	std::condition_variable aircv;
+	bool air_busy = false;
+	bool airthread_done = false;
+	bool th_started = false;
+	bool ignoreNextResult = false;
+	float th_solveTime = 0.0f;
+	float savedTime = 0.0f;
+
+	void update_air_thread();
+
 public:
 	Simulation & sim;
 	int airMode;
@@ -28,13 +60,25 @@ public:
 	unsigned char bmap_blockairh[YRES/CELL][XRES/CELL];
 	float kernel[9];
 	void make_kernel(void);
-	void update_airh(void);
+	void blur_airh(int y, float *dh, float *dx, bool simd = true);
+	void blur_air(int y, bool simd = true);
+	void update_airh(int gravityMode);
 	void update_air(void);
 	void Clear();
 	void ClearAirH();
 	void Invert();
 	void RecalculateBlockAirMaps();
+
+	bool IsAsync() const { return bool(th_air); }
+	void SetAsync(bool async);
+	void update_air_async(bool heat, int gravityMode);
+	// The maps were replaced, what the air thread is working on no longer applies
+	void DiscardAsyncResult();
+	// Milliseconds per frame the main thread didn't spend on air, averaged over recent frames
+	float GetAsyncSavedTime() const { return savedTime; }
+
 	Air(Simulation & sim);
+	~Air();
 };
 
 #endif
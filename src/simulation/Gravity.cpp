@@ -135,7 +135,7 @@ void Gravity::grav_fft_cleanup()
 }
 #endif
 
-void Gravity::gravity_update_async()
+void Gravity::gravity_update_async(bool lockstep)
 {
 	int result;
 	if (!enabled)
@@ -145,7 +145,12 @@ void Gravity::gravity_update_async()
 
 	{
 		std::unique_lock<std::mutex> l(gravmutex, std::defer_lock);
-		if (l.try_lock())
+		if (lockstep)
+		{
+			l.lock();
+			gravcv.wait(l, [this]() { return grav_ready; });
+		}
+		if (l.owns_lock() || l.try_lock())
 		{
 			result = grav_ready;
 			if (result) //Did the gravity thread finish?
@@ -175,7 +180,7 @@ void Gravity::gravity_update_async()
 
 	if (signal_grav)
 	{
-		gravcv.notify_one();
+		gravcv.notify_all();
 	}
 	unsigned int size = (XRES / CELL) * (YRES / CELL);
 	membwand(gravy, gravmask, size * sizeof(float), size * sizeof(unsigned));
@@ -209,6 +214,7 @@ void Gravity::update_grav_async()
 			done = 1;
 			grav_ready = 1;
 			thread_done = gravthread_done;
+			gravcv.notify_all();
 		}
 		else
 		{
@@ -79,7 +79,9 @@ public:
 
 	void Clear();
 
-	void gravity_update_async();
+	// Takes the gravity thread's result if it has one ready, or waits for it if lockstep is set,
+	// so that the result doesn't depend on how fast the thread is
+	void gravity_update_async(bool lockstep = false);
 
 	void start_grav_async();
 	void stop_grav_async();
@@ -0,0 +1,51 @@
+#include "ParticleBuckets.h"
+
+#include <algorithm>
+
+ParticleBuckets::ParticleBuckets() :
+	position(NPART)
+{
+	Clear();
+}
+
+const std::vector<int> &ParticleBuckets::Sorted(int t)
+{
+	auto &bucket = buckets[t];
+	if (!sorted[t])
+	{
+		std::sort(bucket.begin(), bucket.end());
+		for (int p = 0; p < int(bucket.size()); p++)
+			position[bucket[p]] = p;
+		sorted[t] = true;
+	}
+	return bucket;
+}
+
+void ParticleBuckets::Add(int i, int t)
+{
+	auto &bucket = buckets[t];
+	if (bucket.size() && bucket.back() > i)
+		sorted[t] = false;
+	position[i] = int(bucket.size());
+	bucket.push_back(i);
+}
+
+void ParticleBuckets::Remove(int i, int t)
+{
+	auto &bucket = buckets[t];
+	int p = position[i];
+	if (p != int(bucket.size()) - 1)
+	{
+		bucket[p] = bucket.back();
+		position[bucket[p]] = p;
+		sorted[t] = false;
+	}
+	bucket.pop_back();
+}
+
+void ParticleBuckets::Clear()
+{
+	for (auto &bucket : buckets)
+		bucket.clear();
+	sorted.fill(true);
+}
@@ -0,0 +1,40 @@
+#ifndef PARTICLEBUCKETS_H
+#define PARTICLEBUCKETS_H
+#include "Config.h"
+
+#include <array>
+#include <vector>
+
+#include "ElementDefs.h"
+
+// Indices of the particles of each type, so that passes which only care about one
+// type don't have to look at every particle, and so that the number of particles of
+// a type is always exact. Buckets are unordered, Sorted puts one in index order for
+// passes whose result depends on the order particles are looked at in.
+class ParticleBuckets
+{
+	std::array<std::vector<int>, PT_NUM> buckets;
+	std::array<bool, PT_NUM> sorted;
+	std::vector<int> position; // where each particle is in its bucket
+
+public:
+	ParticleBuckets();
+
+	int Count(int t) const
+	{
+		return int(buckets[t].size());
+	}
+
+	const std::vector<int> &Get(int t) const
+	{
+		return buckets[t];
+	}
+
+	const std::vector<int> &Sorted(int t);
+
+	void Add(int i, int t);
+	void Remove(int i, int t);
+	void Clear();
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "ParticleGrid.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "Simulation.h"
+
+ParticleGrid::ParticleGrid()
+{
+}
+
+void ParticleGrid::Add(int i, int t)
+{
+	auto &grid = grids[t];
+	if (!grid.indexed)
+		return;
+	blockOf[i] = -2;
+	grid.added.push_back(i);
+}
+
+void ParticleGrid::Remove(int i, int t)
+{
+	auto &grid = grids[t];
+	if (!grid.indexed)
+		return;
+	int b = blockOf[i];
+	if (b >= 0)
+	{
+		auto &block = grid.blocks[b];
+		int s = slot[i];
+		if (s != int(block.size()) - 1)
+		{
+			block[s] = block.back();
+			slot[block[s]] = s;
+		}
+		block.pop_back();
+	}
+	// * Left in added if it was there, Prepare skips it since blockOf isn't -2 any more.
+	blockOf[i] = -1;
+}
+
+void ParticleGrid::Clear()
+{
+	for (auto &grid : grids)
+	{
+		if (!grid.indexed)
+			continue;
+		for (auto &block : grid.blocks)
+			block.clear();
+		grid.added.clear();
+		grid.fresh = false;
+	}
+	std::fill(blockOf.begin(), blockOf.end(), -1);
+}
+
+void ParticleGrid::Invalidate()
+{
+	for (auto &grid : grids)
+		grid.fresh = false;
+}
+
+void ParticleGrid::Insert(const Simulation &sim, TypeGrid &grid, int i)
+{
+	int bx = std::clamp(int(sim.parts[i].x + 0.5f), 0, XRES - 1) / CELL;
+	int by = std::clamp(int(sim.parts[i].y + 0.5f), 0, YRES - 1) / CELL;
+	int b = by * blocksX + bx;
+	auto &block = grid.blocks[b];
+	blockOf[i] = b;
+	slot[i] = int(block.size());
+	block.push_back(i);
+}
+
+ParticleGrid::TypeGrid &ParticleGrid::Prepare(const Simulation &sim, int t)
+{
+	auto &grid = grids[t];
+	if (!grid.indexed)
+	{
+		// * Nothing is allocated until the first type is indexed, most simulations never need to.
+		if (blockOf.empty())
+		{
+			blockOf.assign(NPART, -1);
+			slot.resize(NPART);
+		}
+		grid.indexed = true;
+		grid.blocks.resize(blocksX * blocksY);
+	}
+	if (!grid.fresh)
+	{
+		for (auto &block : grid.blocks)
+		{
+			for (auto i : block)
+				blockOf[i] = -1;
+			block.clear();
+		}
+		// * blockOf is shared by every type, and added can still hold particles that have been
+		//   removed since, whose index may be in another type's index by now.
+		for (auto i : grid.added)
+		{
+			if (blockOf[i] == -2 && sim.partTypes[i] == t)
+				blockOf[i] = -1;
+		}
+		grid.added.clear();
+		for (auto i : sim.partsByType.Get(t))
+			Insert(sim, grid, i);
+		grid.fresh = true;
+	}
+	else
+	{
+		for (auto i : grid.added)
+		{
+			if (blockOf[i] == -2 && sim.partTypes[i] == t)
+				Insert(sim, grid, i);
+		}
+		grid.added.clear();
+	}
+	return grid;
+}
+
+int ParticleGrid::Nearest(const Simulation &sim, int t, int x, int y, int maxDistance, const Accept &accept, int *distance)
+{
+	// * No two points on the screen are further apart than this, so limiting maxDistance to it and
+	//   keeping x, y just past it from the screen doesn't change what is found, and keeps the
+	//   distances below from overflowing.
+	constexpr int farthest = XRES + YRES;
+	maxDistance = std::min(maxDistance, farthest);
+	x = std::clamp(x, -farthest - 1, XRES + farthest);
+	y = std::clamp(y, -farthest - 1, YRES + farthest);
+	int foundI = -1;
+	int foundDistance = maxDistance + 1;
+	auto consider = [&](int i) {
+		if (sim.partTypes[i] != t)
+			return;
+		int d = std::abs(int(sim.parts[i].x) - x) + std::abs(int(sim.parts[i].y) - y);
+		if ((d < foundDistance || (d == foundDistance && i < foundI)) && accept(i))
+		{
+			foundDistance = d;
+			foundI = i;
+		}
+	};
+	auto &bucket = sim.partsByType.Get(t);
+	if (bucket.empty())
+		return -1;
+	auto &grid = Prepare(sim, t);
+	int cx = std::clamp(x, 0, XRES - 1) / CELL;
+	int cy = std::clamp(y, 0, YRES - 1) / CELL;
+	// * Rings of blocks around the one x, y is in. A particle in ring r is at least (r - 1) * CELL + 1
+	//   away from x, y, one less since blocks go by rounded positions and distances by truncated ones.
+	//   Sparse types are cheaper to just look through than to find in a mostly empty grid.
+	int blocksLeft = int(bucket.size());
+	for (int r = 0; r <= std::max(blocksX, blocksY); r++)
+	{
+		// * Equally near particles further out may still have a lower index
+		if (std::max(r - 1, 0) * CELL > foundDistance)
+			break;
+		int x0 = cx - r, x1 = cx + r, y0 = cy - r, y1 = cy + r;
+		for (int by = std::max(y0, 0); by <= std::min(y1, blocksY - 1); by++)
+		{
+			// * Only the edge of the ring, the inside has been looked at already
+			int step = (by == y0 || by == y1) ? 1 : x1 - x0;
+			for (int bx = x0; bx <= x1; bx += step)
+			{
+				if (bx < 0 || bx >= blocksX)
+					continue;
+				for (auto i : grid.blocks[by * blocksX + bx])
+					consider(i);
+				if (--blocksLeft < 0)
+				{
+					foundI = -1;
+					foundDistance = maxDistance + 1;
+					for (auto i : bucket)
+						consider(i);
+					if (distance)
+						*distance = foundDistance;
+					return foundI;
+				}
+			}
+		}
+	}
+	if (distance)
+		*distance = foundDistance;
+	return foundI;
+}
+
+void ParticleGrid::InRadius(const Simulation &sim, int t, float x, float y, float radius, std::vector<int> &found)
+{
+	found.clear();
+	auto consider = [&](int i) {
+		if (sim.partTypes[i] != t)
+			return;
+		float dx = sim.parts[i].x - x, dy = sim.parts[i].y - y;
+		if (dx * dx + dy * dy <= radius * radius)
+			found.push_back(i);
+	};
+	auto &bucket = sim.partsByType.Get(t);
+	if (bucket.empty() || radius < 0)
+		return;
+	auto &grid = Prepare(sim, t);
+	// * Blocks go by rounded positions, hence the extra pixel on each side
+	int bx0 = std::clamp(int(x - radius) - 1, 0, XRES - 1) / CELL;
+	int by0 = std::clamp(int(y - radius) - 1, 0, YRES - 1) / CELL;
+	int bx1 = std::clamp(int(x + radius) + 1, 0, XRES - 1) / CELL;
+	int by1 = std::clamp(int(y + radius) + 1, 0, YRES - 1) / CELL;
+	if ((bx1 - bx0 + 1) * (by1 - by0 + 1) > int(bucket.size()))
+	{
+		for (auto i : bucket)
+			consider(i);
+	}
+	else
+	{
+		for (int by = by0; by <= by1; by++)
+			for (int bx = bx0; bx <= bx1; bx++)
+				for (auto i : grid.blocks[by * blocksX + bx])
+					consider(i);
+	}
+	std::sort(found.begin(), found.end());
+}
@@ -0,0 +1,59 @@
+#ifndef PARTICLEGRID_H
+#define PARTICLEGRID_H
+#include "Config.h"
+
+#include <array>
+#include <functional>
+#include <vector>
+
+#include "ElementDefs.h"
+
+class Simulation;
+
+// Which CELL sized block the particles of a type are in, for finding particles of that type
+// near a point without looking at every one of them. A type is only indexed once something
+// asks about it. Particles created, killed or changed into or out of an indexed type go in or
+// out of the index right away, see Add and Remove. Positions are only taken again the first
+// time a type is asked about after Invalidate, which BeforeSim and UpdateParticles call every
+// frame, so questions between frames see where particles are, but a particle that moves during
+// the particle update, or is moved by a script, is found where it was when the first question
+// since then was asked.
+class ParticleGrid
+{
+	static constexpr int blocksX = XRES/CELL;
+	static constexpr int blocksY = YRES/CELL;
+
+	struct TypeGrid
+	{
+		bool indexed = false;
+		bool fresh = false;
+		std::vector<std::vector<int>> blocks;
+		std::vector<int> added; // not in blocks yet, see Prepare
+	};
+	std::array<TypeGrid, PT_NUM> grids;
+	std::vector<int> blockOf; // -1 if not in the index, -2 if in added, empty until a type is indexed
+	std::vector<int> slot; // where each particle is in its block
+
+	TypeGrid &Prepare(const Simulation &sim, int t);
+	void Insert(const Simulation &sim, TypeGrid &grid, int i);
+
+public:
+	using Accept = std::function<bool (int)>;
+
+	ParticleGrid();
+
+	void Add(int i, int t);
+	void Remove(int i, int t);
+	void Clear();
+	// Positions are taken again before the next question
+	void Invalidate();
+
+	// The particle of type t nearest to x, y that accept agrees to, no further than maxDistance,
+	// or -1. Distance is the taxicab distance to (int)parts[i].x, (int)parts[i].y, ties go to the
+	// lowest index.
+	int Nearest(const Simulation &sim, int t, int x, int y, int maxDistance, const Accept &accept, int *distance = nullptr);
+	// Every particle of type t within radius of x, y, in index order
+	void InRadius(const Simulation &sim, int t, float x, float y, float radius, std::vector<int> &found);
+};
+
+#endif
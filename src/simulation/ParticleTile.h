@@ -0,0 +1,88 @@
+#ifndef PARTICLETILE_H
+#define PARTICLETILE_H
+#include "Config.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "common/tpt-rand.h"
+
+// Tiles used by the multi-threaded particle update. Tiles are CELL aligned and
+// coloured like a 2x2 checkerboard; tiles of the same colour are one tile apart,
+// so as long as nothing a particle does reaches further than TILE_REACH pixels
+// outside its own tile, all tiles of one colour can be updated concurrently.
+constexpr int TILE_CELLS = 24;
+constexpr int TILE_SIZE = TILE_CELLS * CELL;
+constexpr int TILES_X = (XRES + TILE_SIZE - 1) / TILE_SIZE;
+constexpr int TILES_Y = (YRES + TILE_SIZE - 1) / TILE_SIZE;
+// Keep one CELL of air and wall maps between the areas touched by two tiles of the same colour
+constexpr int TILE_REACH = (TILE_SIZE - 2 * CELL) / 2 - 1;
+// Free indices a tile must have left before it updates a particle, otherwise the particle
+// is left to the serial fixup pass; PLNT creates the most in one update, up to 16
+constexpr int TILE_CREATE_RESERVE = 16;
+
+// Calls to one element's Update function and the time they took, see Simulation::elementTiming
+struct ElementCost
+{
+	uint64_t calls = 0;
+	double seconds = 0;
+};
+
+// A particle the tiled update could not finish on its own, handed to the serial fixup pass
+struct DeferredParticle
+{
+	enum Stage
+	{
+		stageStart,
+		stageUpdate,
+		stageMove,
+	};
+	int i;
+	Stage stage;
+	int surround_space, nt;
+	float pGravX, pGravY;
+	bool transitionOccurred;
+
+	bool operator <(const DeferredParticle &other) const
+	{
+		return i < other.i;
+	}
+};
+
+struct ParticleTile
+{
+	int x0, y0, x1, y1;
+	bool concurrent;
+	std::vector<int> parts;
+	std::vector<DeferredParticle> deferred;
+
+	// Book-keeping that would otherwise touch shared state, merged back after every phase
+	RNG rng;
+	std::vector<int> spareParts; // handed out in order
+	size_t nextSparePart;
+	std::vector<int> freedParts; // handed out most recently freed first
+	int lastActiveIndex;
+	struct TypeChange
+	{
+		int i, from, to;
+	};
+	std::vector<TypeChange> typeChanges; // applied to partsByType in order
+	std::vector<ElementCost> elementCosts; // one per type if elementTiming was set when the phase started, added to Simulation::elementCosts
+
+	int FreeCount() const
+	{
+		return int(freedParts.size() + spareParts.size() - nextSparePart);
+	}
+
+	bool Contains(int x, int y) const
+	{
+		return x >= x0 && x < x1 && y >= y0 && y < y1;
+	}
+
+	bool ContainsReach(int x, int y, int reach) const
+	{
+		return x - reach >= x0 - TILE_REACH && x + reach < x1 + TILE_REACH && y - reach >= y0 - TILE_REACH && y + reach < y1 + TILE_REACH;
+	}
+};
+
+#endif
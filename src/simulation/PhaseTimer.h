@@ -0,0 +1,37 @@
+#ifndef PHASETIMER_H
+#define PHASETIMER_H
+#include "Config.h"
+
+#include <chrono>
+
+#include "Simulation.h"
+
+// Adds the time it lives for to one of Simulation::phaseTimes, if phaseTiming was
+// set when it was created. Costs a branch on each end when timing is off.
+class PhaseTimer
+{
+	Simulation *sim;
+	Simulation::FramePhase phase;
+	bool enabled;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	// Timing is off if newSim is NULL, e.g. when drawing a save without a simulation
+	PhaseTimer(Simulation *newSim, Simulation::FramePhase newPhase, bool enable = true) : sim(newSim), phase(newPhase), enabled(newSim && newSim->phaseTiming && enable)
+	{
+		if (enabled)
+			start = std::chrono::steady_clock::now();
+	}
+
+	PhaseTimer(Simulation &newSim, Simulation::FramePhase newPhase, bool enable = true) : PhaseTimer(&newSim, newPhase, enable)
+	{
+	}
+
+	~PhaseTimer()
+	{
+		if (enabled)
+			sim->phaseTimes[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+#endif
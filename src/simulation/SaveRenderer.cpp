@@ -1,47 +1,114 @@
 #include "SaveRenderer.h"
 
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
 #include "client/GameSave.h"
 
 #include "graphics/Graphics.h"
 #include "graphics/Renderer.h"
 
-#include "Simulation.h"
+#include "SimulationFrame.h"
+
+SaveRenderer::SaveRenderer()
+{
+#if defined(OGLR) || defined(OGLI)
+	// everything goes through the one GL context
+	maxContexts = 1;
+#else
+	// each context holds a screen sized buffer or three and a copy of a save's particles
+	maxContexts = std::min(std::max(std::thread::hardware_concurrency(), 1U), 4U);
+#endif
+}
+
+SaveRenderer::Context & SaveRenderer::AcquireContext()
+{
+	std::unique_lock<std::mutex> lock(contextMutex);
+	while (true)
+	{
+		for (auto &context : contexts)
+		{
+			if (!context->busy)
+			{
+				context->busy = true;
+				return *context;
+			}
+		}
+		if (contexts.size() < maxContexts)
+			break;
+		contextFree.wait(lock);
+	}
 
-SaveRenderer::SaveRenderer(){
-	g = new Graphics();
-	sim = new Simulation();
-	ren = new Renderer(g, sim);
-	ren->decorations_enable = true;
-	ren->blackDecorations = true;
+	auto context = std::make_unique<Context>();
+	context->g = new Graphics();
+	context->frame = new SimulationFrame();
+	context->ren = new Renderer(context->g, nullptr);
+	context->ren->SetFrame(context->frame);
+	context->ren->decorations_enable = true;
+	context->ren->blackDecorations = true;
+	context->busy = true;
 
 #if defined(OGLR) || defined(OGLI)
 	glEnable(GL_TEXTURE_2D);
-	glGenTextures(1, &fboTex);
-	glBindTexture(GL_TEXTURE_2D, fboTex);
+	glGenTextures(1, &context->fboTex);
+	glBindTexture(GL_TEXTURE_2D, context->fboTex);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, XRES, YRES, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
 
 	//FBO
-	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glGenFramebuffers(1, &context->fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context->fbo);
 	glEnable(GL_BLEND);
-	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fboTex, 0);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, context->fboTex, 0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // Reset framebuffer binding
 	glDisable(GL_TEXTURE_2D);
 #endif
+	contexts.push_back(std::move(context));
+	return *contexts.back();
+}
+
+void SaveRenderer::ReleaseContext(Context & context)
+{
+	{
+		std::lock_guard<std::mutex> lock(contextMutex);
+		context.busy = false;
+	}
+	contextFree.notify_one();
 }
 
 void SaveRenderer::Flush(int begin, int end)
 {
-	std::lock_guard<std::mutex> gx(renderMutex);
-	std::fill(ren->graphicscache + begin, ren->graphicscache + end, gcache_item());
+	{
+		std::unique_lock<std::mutex> lock(contextMutex);
+		for (auto &context : contexts)
+		{
+			contextFree.wait(lock, [&context]() { return !context->busy; });
+			std::fill(context->ren->graphicscache + begin, context->ren->graphicscache + end, gcache_item());
+		}
+	}
+	// wake up anyone who was waiting for a context while this one held the lock
+	contextFree.notify_all();
+	std::lock_guard<std::mutex> lock(thumbnailCacheMutex);
+	thumbnailCache.clear();
+	thumbnailCacheOrder.clear();
 }
 
 VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire, Renderer *renderModeSource)
 {
-	std::lock_guard<std::mutex> gx(renderMutex);
+	auto &context = AcquireContext();
+	VideoBuffer * thumb = Render(context, save, decorations, fire, renderModeSource);
+	ReleaseContext(context);
+	return thumb;
+}
+
+VideoBuffer * SaveRenderer::Render(Context & context, GameSave * save, bool decorations, bool fire, Renderer *renderModeSource)
+{
+	auto g = context.g;
+	auto ren = context.ren;
+	RNG::Override rngOverride(context.rng);
 
 	ren->ResetModes();
 	if (renderModeSource)
@@ -58,9 +125,8 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 	bool doCollapse = save->Collapsed();
 
 	g->Clear();
-	sim->clear_sim();
 
-	if(!sim->Load(save, true))
+	if(context.frame->Load(*save))
 	{
 		ren->decorations_enable = true;
 		ren->blackDecorations = !decorations;
@@ -69,7 +135,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 		unsigned char * texData = NULL;
 
 		glTranslated(0, MENUSIZE, 0);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context.fbo);
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
@@ -82,6 +148,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 #else
 		if (fire)
 		{
+			ren->fireOnly = true;
 			int frame = 15;
 			while(frame)
 			{
@@ -90,6 +157,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 				ren->render_fire();
 				ren->clearScreen(1.0f);
 			}
+			ren->fireOnly = false;
 		}
 
 		ren->RenderBegin();
@@ -100,7 +168,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 		glTranslated(0, -MENUSIZE, 0);
 
 		glEnable( GL_TEXTURE_2D );
-		glBindTexture(GL_TEXTURE_2D, fboTex);
+		glBindTexture(GL_TEXTURE_2D, context.fboTex);
 
 		pData = new pixel[XRES*YRES];
 		texData = new unsigned char[(XRES*YRES)*PIXELSIZE];
@@ -133,6 +201,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 
 		if (fire)
 		{
+			ren->fireOnly = true;
 	   		int frame = 15;
 			while(frame)
 			{
@@ -141,6 +210,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 				ren->render_fire();
 				ren->clearScreen(1.0f);
 			}
+			ren->fireOnly = false;
 		}
 
 		ren->RenderBegin();
@@ -167,8 +237,6 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 
 VideoBuffer * SaveRenderer::Render(unsigned char * saveData, int dataSize, bool decorations, bool fire)
 {
-	std::lock_guard<std::mutex> g(renderMutex);
-
 	GameSave * tempSave;
 	try {
 		tempSave = new GameSave((char*)saveData, dataSize);
@@ -186,6 +254,59 @@ VideoBuffer * SaveRenderer::Render(unsigned char * saveData, int dataSize, bool
 	return thumb;
 }
 
+VideoBuffer * SaveRenderer::RenderThumbnail(GameSave * save, int width, int height, bool autoRescale, bool decorations, bool fire)
+{
+	// FNV-1a
+	auto &data = save->CollapsedData();
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (auto ch : data)
+		hash = (hash ^ uint8_t(ch)) * 0x100000001B3ULL;
+	ThumbnailKey key = { hash, width, height, autoRescale, decorations, fire };
+	if (data.size())
+	{
+		std::lock_guard<std::mutex> lock(thumbnailCacheMutex);
+		auto it = thumbnailCache.find(key);
+		if (it != thumbnailCache.end())
+			return new VideoBuffer(*it->second);
+	}
+
+	VideoBuffer * thumbnail = Render(save, decorations, fire);
+	if (!thumbnail)
+		return nullptr;
+	if (autoRescale)
+	{
+		int scaleX = (int)std::ceil((float)thumbnail->Width / width);
+		int scaleY = (int)std::ceil((float)thumbnail->Height / height);
+		int scale = scaleX > scaleY ? scaleX : scaleY;
+		thumbnail->Resize(thumbnail->Width / scale, thumbnail->Height / scale, true);
+	}
+	else
+	{
+		thumbnail->Resize(width, height, true);
+	}
+
+	if (data.size())
+	{
+		std::lock_guard<std::mutex> lock(thumbnailCacheMutex);
+		if (thumbnailCache.emplace(key, std::make_unique<VideoBuffer>(*thumbnail)).second)
+		{
+			thumbnailCacheOrder.push_back(key);
+			if (thumbnailCacheOrder.size() > thumbnailCacheSize)
+			{
+				thumbnailCache.erase(thumbnailCacheOrder.front());
+				thumbnailCacheOrder.pop_front();
+			}
+		}
+	}
+	return thumbnail;
+}
+
 SaveRenderer::~SaveRenderer()
 {
+	for (auto &context : contexts)
+	{
+		delete context->ren;
+		delete context->frame;
+		delete context->g;
+	}
 }
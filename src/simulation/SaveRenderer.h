@@ -5,30 +5,72 @@
 #include "graphics/OpenGLHeaders.h"
 #endif
 #include "common/Singleton.h"
+#include "common/tpt-rand.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <tuple>
+#include <vector>
 
 class GameSave;
 class VideoBuffer;
 class Graphics;
-class Simulation;
+class SimulationFrame;
 class Renderer;
 
+// Renders saves for thumbnails and previews. Each render gets a context of its own out
+// of a small pool, so renders from different threads don't have to wait for each other.
+// Saves are drawn straight from their particles, see SimulationFrame::Load; nothing is
+// simulated, so there is no Simulation, air or gravity behind a context.
 class SaveRenderer: public Singleton<SaveRenderer> {
-	Graphics * g;
-	Simulation * sim;
-	Renderer * ren;
-	std::mutex renderMutex;
+	struct Context
+	{
+		Graphics * g;
+		SimulationFrame * frame;
+		Renderer * ren;
+		RNG rng; // so that rendering doesn't draw numbers from the game's generator
+		bool busy;
+#if defined(OGLR) || defined(OGLI)
+		GLuint fboTex, fbo;
+#endif
+	};
+	std::vector<std::unique_ptr<Context>> contexts;
+	size_t maxContexts;
+	std::mutex contextMutex;
+	std::condition_variable contextFree;
+
+	Context & AcquireContext();
+	void ReleaseContext(Context & context);
+	VideoBuffer * Render(Context & context, GameSave * save, bool decorations, bool fire, Renderer *renderModeSource);
+
+	struct ThumbnailKey
+	{
+		uint64_t hash;
+		int width, height;
+		bool autoRescale, decorations, fire;
+
+		bool operator <(const ThumbnailKey &other) const
+		{
+			return std::tie(hash, width, height, autoRescale, decorations, fire) < std::tie(other.hash, other.width, other.height, other.autoRescale, other.decorations, other.fire);
+		}
+	};
+	static constexpr size_t thumbnailCacheSize = 256;
+	std::map<ThumbnailKey, std::unique_ptr<VideoBuffer>> thumbnailCache;
+	std::deque<ThumbnailKey> thumbnailCacheOrder; // oldest first
+	std::mutex thumbnailCacheMutex;
+
 public:
 	SaveRenderer();
 	VideoBuffer * Render(GameSave * save, bool decorations = true, bool fire = true, Renderer *renderModeSource = nullptr);
 	VideoBuffer * Render(unsigned char * saveData, int saveDataSize, bool decorations = true, bool fire = true);
+	// Renders save scaled down to width by height, or to fit in them if autoRescale is set.
+	// Thumbnails of saves that haven't been changed since they were read are cached.
+	VideoBuffer * RenderThumbnail(GameSave * save, int width, int height, bool autoRescale, bool decorations = true, bool fire = true);
 	void Flush(int begin, int end);
 	virtual ~SaveRenderer();
-
-private:
-#if defined(OGLR) || defined(OGLI)
-	GLuint fboTex, fbo;
-#endif
 };
 
 #endif /* SAVERENDERER_H_ */
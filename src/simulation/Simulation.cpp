@@ -1,5 +1,8 @@
 #include "Simulation.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <cmath>
 #include <set>
@@ -14,8 +17,12 @@
 #include "CoordStack.h"
 #include "ElementClasses.h"
 #include "Gravity.h"
+#include "PhaseTimer.h"
 #include "Sample.h"
 #include "Snapshot.h"
+#include "SnapshotDelta.h"
+#include "WaterBodies.h"
+#include "WorkerPool.h"
 
 #include "Misc.h"
 #include "ToolClasses.h"
@@ -43,43 +50,74 @@ extern int Element_LOLZ_lolz[XRES/9][YRES/9];
 extern int Element_LOVE_RuleTable[9][9];
 extern int Element_LOVE_love[XRES/9][YRES/9];
 
-int Simulation::Load(const GameSave * save, bool includePressure)
+struct TileBinding
 {
-	return Load(save, includePressure, 0, 0);
+	ParticleTile *tile = nullptr;
+};
+// The tile the calling thread is updating, see UpdateParticlesTiled
+static THREAD_LOCAL(TileBinding, currentTile);
+
+static ParticleTile *CurrentTile()
+{
+	TileBinding &binding = currentTile;
+	return binding.tile;
 }
 
-int Simulation::Load(const GameSave * originalSave, bool includePressure, int fullX, int fullY)
+// For HashState; HashWords runs four lanes of xxHash64's round, HashMix folds them together
+static uint64_t HashMix(uint64_t hash, uint64_t value)
 {
-	if (!originalSave)
-		return 1;
-	auto save = std::unique_ptr<GameSave>(new GameSave(*originalSave));
-	try
+	hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+	hash ^= hash >> 33;
+	hash *= 0xC2B2AE3D27D4EB4FULL;
+	hash ^= hash >> 29;
+	hash *= 0x165667B19E3779F9ULL;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+static uint64_t HashWords(uint64_t hash, const void *data, size_t size)
+{
+	auto round = [](uint64_t lane, uint64_t word) {
+		lane += word * 0xC2B2AE3D27D4EB4FULL;
+		lane = (lane << 31) | (lane >> 33);
+		return lane * 0x9E3779B185EBCA87ULL;
+	};
+	auto *bytes = static_cast<const unsigned char *>(data);
+	// four lanes, so that their multiplications don't have to wait for each other
+	uint64_t lanes[4] = { hash, hash + 1, hash + 2, hash + 3 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
 	{
-		save->Expand();
+		for (int lane = 0; lane < 4; lane++)
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + i + lane * 8, 8);
+			lanes[lane] = round(lanes[lane], word);
+		}
 	}
-	catch (const ParseException &e)
+	for (; i + 4 <= size; i += 4)
 	{
-#ifdef LUACONSOLE
-		luacon_ci->SetLastError(ByteString(e.what()).FromUtf8());
-#endif
-		return 1;
+		uint32_t word;
+		std::memcpy(&word, bytes + i, 4);
+		lanes[0] = round(lanes[0], word);
 	}
+	hash = HashMix(lanes[0], size);
+	for (int lane = 1; lane < 4; lane++)
+		hash = HashMix(hash, lanes[lane]);
+	return hash;
+}
 
-	//Align to blockMap
-	int blockX = (fullX + CELL/2)/CELL;
-	int blockY = (fullY + CELL/2)/CELL;
-	fullX = blockX*CELL;
-	fullY = blockY*CELL;
-	unsigned int pmapmask = (1<<save->pmapbits)-1;
+const char *const Simulation::phaseNames[Simulation::phaseCount] = { "air", "gravity", "recalc", "stacking", "gol", "particles", "aftersim", "render" };
 
-	int partMap[PT_NUM];
+void Simulation::MapPalette(const GameSave &save, const Element *elements, int (&partMap)[PT_NUM])
+{
 	for(int i = 0; i < PT_NUM; i++)
 	{
 		partMap[i] = i;
 	}
-	if(save->palette.size())
+	if(save.palette.size())
 	{
-		for(auto &pi : save->palette)
+		for(auto &pi : save.palette)
 		{
 			if (pi.second > 0 && pi.second < PT_NUM)
 			{
@@ -97,6 +135,74 @@ int Simulation::Load(const GameSave * originalSave, bool includePressure, int fu
 			}
 		}
 	}
+}
+
+void Simulation::MapPartTypes(Particle &part, const int (&partMap)[PT_NUM], int pmapbits)
+{
+	unsigned int pmapmask = (1<<pmapbits)-1;
+	part.type = partMap[part.type];
+
+	// These store type in ctype, but are special because they store extra information in the bits after type
+	if (part.type == PT_CRAY || part.type == PT_DRAY || part.type == PT_CONV)
+	{
+		int ctype = part.ctype & pmapmask;
+		int extra = part.ctype >> pmapbits;
+		if (ctype >= 0 && ctype < PT_NUM)
+			ctype = partMap[ctype];
+		part.ctype = PMAP(extra, ctype);
+	}
+	else if (GameSave::TypeInCtype(part.type, part.ctype))
+	{
+		part.ctype = partMap[part.ctype];
+	}
+	// also stores extra bits past type (only STOR right now)
+	if (GameSave::TypeInTmp(part.type))
+	{
+		int tmp = part.tmp & pmapmask;
+		int extra = part.tmp >> pmapbits;
+		tmp = partMap[TYP(tmp)];
+		part.tmp = PMAP(extra, tmp);
+	}
+	if (GameSave::TypeInTmp2(part.type, part.tmp2))
+	{
+		part.tmp2 = partMap[part.tmp2];
+	}
+}
+
+int Simulation::Load(const GameSave * save, bool includePressure)
+{
+	return Load(save, includePressure, 0, 0);
+}
+
+int Simulation::Load(const GameSave * originalSave, bool includePressure, int fullX, int fullY)
+{
+	if (!originalSave)
+		return 1;
+	RNG::Override rngOverride(rng);
+	MarkAllDirty();
+	auto save = std::unique_ptr<GameSave>(new GameSave(*originalSave));
+	try
+	{
+		save->Expand();
+	}
+	catch (const ParseException &e)
+	{
+#ifdef LUACONSOLE
+		luacon_ci->SetLastError(ByteString(e.what()).FromUtf8());
+#endif
+		return 1;
+	}
+	// * The maps are rebuilt at the end rather than followed as particles are replaced and placed below
+	InvalidateMaps();
+
+	//Align to blockMap
+	int blockX = (fullX + CELL/2)/CELL;
+	int blockY = (fullY + CELL/2)/CELL;
+	fullX = blockX*CELL;
+	fullY = blockY*CELL;
+
+	int partMap[PT_NUM];
+	MapPalette(*save, elements.data(), partMap);
 
 	int r;
 	bool doFullScan = false;
@@ -127,7 +233,7 @@ int Simulation::Load(const GameSave * originalSave, bool includePressure, int fu
 			tempPart->type = 0;
 			continue;
 		}
-		if ((tempPart->type == PT_SPAWN || tempPart->type == PT_SPAWN2) && elementCount[type])
+		if ((tempPart->type == PT_SPAWN || tempPart->type == PT_SPAWN2) && partsByType.Count(type))
 		{
 			tempPart->type = 0;
 			continue;
@@ -187,45 +293,18 @@ int Simulation::Load(const GameSave * originalSave, bool includePressure, int fu
 	{
 		Particle tempPart = save->particles[n];
 		if (tempPart.type > 0 && tempPart.type < PT_NUM)
-			tempPart.type = partMap[tempPart.type];
+			MapPartTypes(tempPart, partMap, save->pmapbits);
 		else
 			continue;
 
-		// These store type in ctype, but are special because they store extra information in the bits after type
-		if (tempPart.type == PT_CRAY || tempPart.type == PT_DRAY || tempPart.type == PT_CONV)
-		{
-			int ctype = tempPart.ctype & pmapmask;
-			int extra = tempPart.ctype >> save->pmapbits;
-			if (ctype >= 0 && ctype < PT_NUM)
-				ctype = partMap[ctype];
-			tempPart.ctype = PMAP(extra, ctype);
-		}
-		else if (GameSave::TypeInCtype(tempPart.type, tempPart.ctype))
-		{
-			tempPart.ctype = partMap[tempPart.ctype];
-		}
-		// also stores extra bits past type (only STOR right now)
-		if (GameSave::TypeInTmp(tempPart.type))
-		{
-			int tmp = tempPart.tmp & pmapmask;
-			int extra = tempPart.tmp >> save->pmapbits;
-			tmp = partMap[TYP(tmp)];
-			tempPart.tmp = PMAP(extra, tmp);
-		}
-		if (GameSave::TypeInTmp2(tempPart.type, tempPart.tmp2))
-		{
-			tempPart.tmp2 = partMap[tempPart.tmp2];
-		}
-
 		// Allocate particle (this location is guaranteed to be empty due to "full scan" logic above)
-		if (pfree == -1)
+		i = activeParts.Alloc();
+		if (i == -1)
 			break;
-		i = pfree;
-		pfree = parts[i].life;
 		if (i > parts_lastActiveIndex)
 			parts_lastActiveIndex = i;
 		parts[i] = tempPart;
-		elementCount[tempPart.type]++;
+		SetPartType(i, tempPart.type);
 
 
 		void Element_STKM_init_legs(Simulation * sim, playerst *playerp, int i);
@@ -299,7 +378,7 @@ int Simulation::Load(const GameSave * originalSave, bool includePressure, int fu
 			else
 			{
 				// Should not be possible because we verify with CanAlloc above this
-				parts[i].type = 0;
+				SetPartType(i, 0);
 			}
 			break;
 		}
@@ -350,6 +429,9 @@ int Simulation::Load(const GameSave * originalSave, bool includePressure, int fu
 			signs.push_back(tempSign);
 		}
 	}
+	// what the air thread is working on would be added on top of the pasted air
+	if (includePressure && (save->hasPressure || save->hasAmbientHeat))
+		air->DiscardAsyncResult();
 	for(int saveBlockX = 0; saveBlockX < save->blockWidth; saveBlockX++)
 	{
 		for(int saveBlockY = 0; saveBlockY < save->blockHeight; saveBlockY++)
@@ -554,35 +636,79 @@ void Simulation::SaveSimOptions(GameSave * gameSave)
 	gameSave->aheatEnable = aheat_enable;
 }
 
+// Everything but the particles and portal particles, which UpdateSnapshot only copies if it has to
+void Simulation::CopyToSnapshot(Snapshot &snap)
+{
+	snap.AirPressure    .assign   (&pv  [0][0]      , &pv  [0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.AirVelocityX   .assign   (&vx  [0][0]      , &vx  [0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.AirVelocityY   .assign   (&vy  [0][0]      , &vy  [0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.AmbientHeat    .assign   (&hv  [0][0]      , &hv  [0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.BlockMap       .assign   (&bmap[0][0]      , &bmap[0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.ElecMap        .assign   (&emap[0][0]      , &emap[0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.FanVelocityX   .assign   (&fvx [0][0]      , &fvx [0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.FanVelocityY   .assign   (&fvy [0][0]      , &fvy [0][0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.GravVelocityX  .assign   (&gravx  [0]      , &gravx  [0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.GravVelocityY  .assign   (&gravy  [0]      , &gravy  [0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.GravValue      .assign   (&gravp  [0]      , &gravp  [0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.GravMap        .assign   (&gravmap[0]      , &gravmap[0] + ((XRES / CELL) * (YRES / CELL)));
+	snap.WirelessData   .assign   (&wireless[0][0]  , &wireless[CHANNELS - 1][2 - 1]               );
+	snap.stickmen       .assign   (&fighters[0]     , &fighters[MAX_FIGHTERS]                      );
+	snap.stickmen       .push_back(player2);
+	snap.stickmen       .push_back(player);
+	snap.signs = signs;
+}
+
 std::unique_ptr<Snapshot> Simulation::CreateSnapshot()
 {
 	auto snap = std::make_unique<Snapshot>();
-	snap->AirPressure    .insert   (snap->AirPressure    .begin(), &pv  [0][0]      , &pv  [0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->AirVelocityX   .insert   (snap->AirVelocityX   .begin(), &vx  [0][0]      , &vx  [0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->AirVelocityY   .insert   (snap->AirVelocityY   .begin(), &vy  [0][0]      , &vy  [0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->AmbientHeat    .insert   (snap->AmbientHeat    .begin(), &hv  [0][0]      , &hv  [0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->BlockMap       .insert   (snap->BlockMap       .begin(), &bmap[0][0]      , &bmap[0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->ElecMap        .insert   (snap->ElecMap        .begin(), &emap[0][0]      , &emap[0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->FanVelocityX   .insert   (snap->FanVelocityX   .begin(), &fvx [0][0]      , &fvx [0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->FanVelocityY   .insert   (snap->FanVelocityY   .begin(), &fvy [0][0]      , &fvy [0][0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->GravVelocityX  .insert   (snap->GravVelocityX  .begin(), &gravx  [0]      , &gravx  [0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->GravVelocityY  .insert   (snap->GravVelocityY  .begin(), &gravy  [0]      , &gravy  [0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->GravValue      .insert   (snap->GravValue      .begin(), &gravp  [0]      , &gravp  [0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->GravMap        .insert   (snap->GravMap        .begin(), &gravmap[0]      , &gravmap[0] + ((XRES / CELL) * (YRES / CELL)));
-	snap->Particles      .insert   (snap->Particles      .begin(), &parts  [0]      , &parts[parts_lastActiveIndex + 1]            );
-	snap->PortalParticles.insert   (snap->PortalParticles.begin(), &portalp[0][0][0], &portalp [CHANNELS - 1][8 - 1][80 - 1]       );
-	snap->WirelessData   .insert   (snap->WirelessData   .begin(), &wireless[0][0]  , &wireless[CHANNELS - 1][2 - 1]               );
-	snap->stickmen       .insert   (snap->stickmen       .begin(), &fighters[0]     , &fighters[MAX_FIGHTERS]                      );
-	snap->stickmen       .push_back(player2);
-	snap->stickmen       .push_back(player);
-	snap->signs = signs;
+	CreateSnapshot(*snap);
 	return snap;
 }
 
+void Simulation::CopySnapshot(Snapshot &snap)
+{
+	CopyToSnapshot(snap);
+	snap.Particles      .assign   (&parts  [0]      , &parts[parts_lastActiveIndex + 1]            );
+	snap.PortalParticles.assign   (&portalp[0][0][0], &portalp [CHANNELS - 1][8 - 1][80 - 1]       );
+	// serials start at 1, and snapshotSerial is only 0 while everything is dirty
+	snap.SimulationSerial = 0;
+}
+
+void Simulation::CreateSnapshot(Snapshot &snap)
+{
+	CopySnapshot(snap);
+	static std::atomic<uint64_t> lastSerial(0);
+	snapshotSerial = ++lastSerial;
+	snap.SimulationSerial = snapshotSerial;
+	snapshotDirtyAll = false;
+	snapshotDirtyBegin = NPART;
+	snapshotDirtyEnd = 0;
+}
+
+std::unique_ptr<SnapshotDelta> Simulation::UpdateSnapshot(Snapshot &snap)
+{
+	if (snapshotDirtyAll || snap.SimulationSerial != snapshotSerial)
+		return nullptr;
+	Snapshot partial;
+	CopyToSnapshot(partial);
+	// The particles past the end of the old snapshot are new to it, whether they were marked or not
+	size_t oldCount = snap.Particles.size();
+	size_t newCount = parts_lastActiveIndex + 1;
+	size_t begin = std::min({ size_t(snapshotDirtyBegin), oldCount, newCount });
+	size_t end = newCount > oldCount ? newCount : std::min(size_t(snapshotDirtyEnd), newCount);
+	if (end > begin)
+		partial.Particles.insert(partial.Particles.begin(), &parts[begin], &parts[end]);
+	auto delta = SnapshotDelta::FromPartialSnapshot(snap, partial, begin, newCount);
+	snapshotDirtyBegin = NPART;
+	snapshotDirtyEnd = 0;
+	return delta;
+}
+
 void Simulation::Restore(const Snapshot &snap)
 {
-	std::fill(elementCount, elementCount + PT_NUM, 0);
-	elementRecount = true;
+	RNG::Override rngOverride(rng);
+	MarkAllDirty();
+	InvalidateMaps();
 	force_stacking_check = true;
 	for (auto &part : parts)
 	{
@@ -596,6 +722,7 @@ void Simulation::Restore(const Snapshot &snap)
 	std::copy(snap.ElecMap        .begin(), snap.ElecMap        .end(), &emap[0][0]      );
 	std::copy(snap.FanVelocityX   .begin(), snap.FanVelocityX   .end(), &fvx[0][0]       );
 	std::copy(snap.FanVelocityY   .begin(), snap.FanVelocityY   .end(), &fvy[0][0]       );
+	air->DiscardAsyncResult();
 	if (grav->IsEnabled())
 	{
 		grav->Clear();
@@ -605,6 +732,15 @@ void Simulation::Restore(const Snapshot &snap)
 		std::copy(snap.GravMap      .begin(), snap.GravMap      .end(), &gravmap[0]      );
 	}
 	std::copy(snap.Particles      .begin(), snap.Particles      .end(), &parts[0]        );
+	memset(partTypes, 0, sizeof(partTypes));
+	activeParts.Clear();
+	partsByType.Clear();
+	partsGrid.Clear();
+	for (int i = 0; i < NPART; i++)
+	{
+		if (parts[i].type)
+			SetPartType(i, parts[i].type);
+	}
 	std::copy(snap.PortalParticles.begin(), snap.PortalParticles.end(), &portalp[0][0][0]);
 	std::copy(snap.WirelessData   .begin(), snap.WirelessData   .end(), &wireless[0][0]  );
 	std::copy(snap.stickmen       .begin(), snap.stickmen.end() - 2   , &fighters[0]     );
@@ -620,10 +756,9 @@ void Simulation::Restore(const Snapshot &snap)
 void Simulation::clear_area(int area_x, int area_y, int area_w, int area_h)
 {
 	float fx = area_x-.5f, fy = area_y-.5f;
-	for (int i = 0; i <= parts_lastActiveIndex; i++)
+	for (int i = activeParts.Next(0); i <= parts_lastActiveIndex; i = activeParts.Next(i + 1))
 	{
-		if (parts[i].type)
-			if (parts[i].x >= fx && parts[i].x <= fx+area_w+1 && parts[i].y >= fy && parts[i].y <= fy+area_h+1)
+		if (parts[i].x >= fx && parts[i].x <= fx+area_w+1 && parts[i].y >= fy && parts[i].y <= fy+area_h+1)
 				kill_part(i);
 	}
 	int cx1 = area_x/CELL, cy1 = area_y/CELL, cx2 = (area_x+area_w)/CELL, cy2 = (area_y+area_h)/CELL;
@@ -705,6 +840,7 @@ int Simulation::flood_prop(int x, int y, size_t propoffset, PropertyValue propva
 					i = photons[y][x];
 				if (!i)
 					continue;
+				MarkPartDirty(ID(i));
 				switch (proptype) {
 					case StructProperty::Float:
 						*((float*)(((char*)&parts[ID(i)])+propoffset)) = propvalue.Float;
@@ -722,6 +858,7 @@ int Simulation::flood_prop(int x, int y, size_t propoffset, PropertyValue propva
 					default:
 						break;
 				}
+				PartMoved(ID(i));
 				bitmap[(y*XRES)+x] = 1;
 				did_something = 1;
 			}
@@ -894,75 +1031,33 @@ int Simulation::FloodINST(int x, int y)
 
 bool Simulation::flood_water(int x, int y, int i)
 {
-	int x1, x2, originalY = y;
-	int r = pmap[y][x];
-	if (!r)
+	if (!pmap[y][x])
 		return false;
+	if (!waterBodies)
+		waterBodies = std::make_unique<WaterBodies>();
+	auto &body = waterBodies->Find(*this, x, y);
+	// Openings are deepest first, only those at least two rows below the particle are worth moving to
+	auto &openings = body.openings;
+	while (body.next < openings.size() && openings[body.next].y > y)
+	{
+		// Try a random opening on the deepest row left, so that the surface fills evenly
+		auto rowEnd = body.next + 1;
+		while (rowEnd < openings.size() && openings[rowEnd].y == openings[body.next].y)
+			rowEnd++;
+		std::swap(openings[body.next], openings[RNG::Ref().between(int(body.next), int(rowEnd) - 1)]);
+		auto to = openings[body.next++];
+		if (pmap[to.y][to.x] || !eval_move(parts[i].type, to.x, to.y, nullptr))
+			continue;
 
-	// Bitmap for checking where we've already looked
-	auto bitmapPtr = std::unique_ptr<char[]>(new char[XRES * YRES]);
-	char *bitmap = bitmapPtr.get();
-	std::fill(&bitmap[0], &bitmap[XRES * YRES], 0);
-
-	try
-	{
-		CoordStack& cs = getCoordStackSingleton();
-		cs.clear();
-
-		cs.push(x, y);
-		do
-		{
-			cs.pop(x, y);
-			x1 = x2 = x;
-			while (x1 >= CELL)
-			{
-				if (elements[TYP(pmap[y][x1 - 1])].Falldown != 2 || bitmap[(y * XRES) + x1 - 1])
-					break;
-				x1--;
-			}
-			while (x2 < XRES-CELL)
-			{
-				if (elements[TYP(pmap[y][x2 + 1])].Falldown != 2 || bitmap[(y * XRES) + x1 - 1])
-					break;
-				x2++;
-			}
-			for (int x = x1; x <= x2; x++)
-			{
-				if ((y - 1) > originalY && !pmap[y - 1][x])
-				{
-					// Try to move the water to a random position on this line, because there's probably a free location somewhere
-					int randPos = RNG::Ref().between(x, x2);
-					if (!pmap[y - 1][randPos] && eval_move(parts[i].type, randPos, y - 1, nullptr))
-						x = randPos;
-					// Couldn't move to random position, so try the original position on the left
-					else if (!eval_move(parts[i].type, x, y - 1, nullptr))
-						continue;
-
-					int oldx = (int)(parts[i].x + 0.5f);
-					int oldy = (int)(parts[i].y + 0.5f);
-					pmap[y - 1][x] = pmap[oldy][oldx];
-					pmap[oldy][oldx] = 0;
-					parts[i].x = float(x);
-					parts[i].y = float(y - 1);
-					return true;
-				}
-
-				bitmap[(y * XRES) + x] = 1;
-			}
-			if (y >= CELL + 1)
-				for (int x = x1; x <= x2; x++)
-					if (elements[TYP(pmap[y - 1][x])].Falldown == 2 && !bitmap[((y - 1) * XRES) + x])
-						cs.push(x, y - 1);
-			if (y < YRES - CELL - 1)
-				for (int x = x1; x <= x2; x++)
-					if (elements[TYP(pmap[y + 1][x])].Falldown == 2 && !bitmap[((y + 1) * XRES) + x])
-						cs.push(x, y + 1);
-		} while (cs.getSize() > 0);
-	}
-	catch (std::exception &e)
-	{
-		std::cerr << e.what() << std::endl;
-		return false;
+		int oldx = (int)(parts[i].x + 0.5f);
+		int oldy = (int)(parts[i].y + 0.5f);
+		pmap[to.y][to.x] = pmap[oldy][oldx];
+		pmap[oldy][oldx] = 0;
+		parts[i].x = float(to.x);
+		parts[i].y = float(to.y);
+		PartMoved(i);
+		waterBodies->Claim(body, to.x, to.y);
+		return true;
 	}
 	return false;
 }
@@ -1026,6 +1121,16 @@ void Simulation::SetEdgeMode(int newEdgeMode)
 	}
 }
 
+void Simulation::SetThreads(int newThreads)
+{
+	workers->SetThreads(newThreads);
+}
+
+int Simulation::GetThreads() const
+{
+	return workers->GetThreads();
+}
+
 #ifndef RENDERER
 void Simulation::ApplyDecoration(int x, int y, int colR_, int colG_, int colB_, int colA_, int mode)
 {
@@ -1037,6 +1142,7 @@ void Simulation::ApplyDecoration(int x, int y, int colR_, int colG_, int colB_,
 		rp = photons[y][x];
 	if (!rp)
 		return;
+	MarkPartDirty(ID(rp));
 
 	ta = float((parts[ID(rp)].dcolour>>24)&0xFF);
 	tr = float((parts[ID(rp)].dcolour>>16)&0xFF);
@@ -1386,6 +1492,8 @@ int Simulation::Tool(int x, int y, int tool, int brushX, int brushY, float stren
 		cpart = &(parts[ID(r)]);
 	else if ((r = photons[y][x]))
 		cpart = &(parts[ID(r)]);
+	if (cpart)
+		MarkPartDirty(ID(r));
 	return tools[tool].Perform(this, cpart, x, y, brushX, brushY, strength);
 }
 
@@ -2284,6 +2392,7 @@ void Simulation::create_arc(int sx, int sy, int dx, int dy, int midpoints, int v
 
 void Simulation::clear_sim(void)
 {
+	MarkAllDirty();
 	debug_currentParticle = 0;
 	emp_decor = 0;
 	emp_trigger_count = 0;
@@ -2291,11 +2400,12 @@ void Simulation::clear_sim(void)
 	memset(bmap, 0, sizeof(bmap));
 	memset(emap, 0, sizeof(emap));
 	memset(parts, 0, sizeof(Particle)*NPART);
-	for (int i = 0; i < NPART-1; i++)
-		parts[i].life = i+1;
-	parts[NPART-1].life = -1;
-	pfree = 0;
+	memset(partTypes, 0, sizeof(partTypes));
+	activeParts.Clear();
+	partsByType.Clear();
+	partsGrid.Clear();
 	parts_lastActiveIndex = 0;
+	InvalidateMaps();
 	memset(pmap, 0, sizeof(pmap));
 	memset(fvx, 0, sizeof(fvx));
 	memset(fvy, 0, sizeof(fvy));
@@ -2304,8 +2414,6 @@ void Simulation::clear_sim(void)
 	memset(gol, 0, sizeof(gol));
 	memset(portalp, 0, sizeof(portalp));
 	memset(fighters, 0, sizeof(fighters));
-	std::fill(elementCount, elementCount+PT_NUM, 0);
-	elementRecount = true;
 	fighcount = 0;
 	player.spwn = 0;
 	player.spawnID = -1;
@@ -2635,7 +2743,7 @@ int Simulation::try_move(int i, int x, int y, int nx, int ny)
 				if (!portalp[parts[ID(r)].tmp][count][nnx].type)
 				{
 					portalp[parts[ID(r)].tmp][count][nnx] = parts[i];
-					parts[i].type=PT_NONE;
+					SetPartType(i, PT_NONE);
 					break;
 				}
 		}
@@ -2862,11 +2970,13 @@ int Simulation::try_move(int i, int x, int y, int nx, int ny)
 				pmap[ny][nx] = (s&~PMAPMASK)|parts[ID(s)].type;
 				parts[ID(s)].x = float(nx);
 				parts[ID(s)].y = float(ny);
+				PartMoved(ID(s));
 			}
 			else
 				pmap[ny][nx] = 0;
 			parts[ri].x = float(x);
 			parts[ri].y = float(y);
+			PartMoved(ri);
 			pmap[y][x] = PMAP(ri, parts[ri].type);
 			return 1;
 		}
@@ -2875,6 +2985,7 @@ int Simulation::try_move(int i, int x, int y, int nx, int ny)
 			pmap[ny][nx] = 0;
 		parts[ri].x += float(x - nx);
 		parts[ri].y += float(y - ny);
+		PartMoved(ri);
 		int rx = int(parts[ri].x + 0.5f);
 		int ry = int(parts[ri].y + 0.5f);
 		// This check will never fail unless the pmap array has already been corrupted via another bug
@@ -2916,6 +3027,7 @@ int Simulation::do_move(int i, int x, int y, float nxf, float nyf)
 		int t = parts[i].type;
 		parts[i].x = nxf;
 		parts[i].y = nyf;
+		PartMoved(i);
 		if (ny!=y || nx!=x)
 		{
 			if (ID(pmap[y][x]) == i)
@@ -3103,6 +3215,32 @@ int Simulation::get_normal_interp(int pt, float x0, float y0, float dx, float dy
 	return get_normal(pt, x, y, dx, dy, nx, ny);
 }
 
+// Takes a free index, out of the ones handed to the tile this thread is updating if there is one
+int Simulation::AllocParticle()
+{
+	ParticleTile *tile = CurrentTile();
+	if (!tile)
+		return activeParts.Alloc();
+	if (tile->freedParts.size())
+	{
+		int i = tile->freedParts.back();
+		tile->freedParts.pop_back();
+		return i;
+	}
+	if (tile->nextSparePart < tile->spareParts.size())
+		return tile->spareParts[tile->nextSparePart++];
+	return -1;
+}
+
+void Simulation::FreeParticle(int i)
+{
+	ParticleTile *tile = CurrentTile();
+	if (tile)
+		tile->freedParts.push_back(i);
+	else
+		activeParts.Free(i);
+}
+
 void Simulation::kill_part(int i)//kills particle number i
 {
 	if (i < 0 || i >= NPART)
@@ -3129,11 +3267,8 @@ void Simulation::kill_part(int i)//kills particle number i
 	if (t == PT_NONE)
 		return;
 
-	elementCount[t]--;
-
-	parts[i].type = PT_NONE;
-	parts[i].life = pfree;
-	pfree = i;
+	SetPartType(i, PT_NONE);
+	FreeParticle(i);
 }
 
 // Changes the type of particle number i, to t.  This also changes pmap at the same time
@@ -3158,11 +3293,7 @@ bool Simulation::part_change_type(int i, int x, int y, int t)
 	if (elements[t].ChangeType)
 		(*(elements[t].ChangeType))(this, i, x, y, parts[i].type, t);
 
-	if (parts[i].type > 0 && parts[i].type < PT_NUM && elementCount[parts[i].type])
-		elementCount[parts[i].type]--;
-	elementCount[t]++;
-
-	parts[i].type = t;
+	SetPartType(i, t);
 	if (elements[t].Properties & TYPE_ENERGY)
 	{
 		photons[y][x] = PMAP(i, t);
@@ -3178,11 +3309,50 @@ bool Simulation::part_change_type(int i, int x, int y, int t)
 	return false;
 }
 
+// Sets parts[i].type without any of the side effects of part_change_type, keeping
+// partTypes, activeParts and partsByType in step with it
+void Simulation::SetPartType(int i, int t)
+{
+	MarkPartDirty(i);
+	int oldType = partTypes[i];
+	parts[i].type = t;
+	if (oldType == t)
+		return;
+	// * Unlinked as the type it was counted as, see LinkPart
+	if (mapsCurrent)
+		UnlinkPart(i);
+	partTypes[i] = t;
+	if (mapsCurrent && t)
+		LinkPart(i, PartCell(i));
+	if (!oldType)
+		activeParts.Add(i);
+	else if (!t)
+		activeParts.Remove(i);
+
+	// buckets aren't safe to change from concurrently updated tiles, see UpdateParticlesTiled
+	if (ParticleTile *tile = CurrentTile())
+	{
+		tile->typeChanges.push_back({ i, oldType, t });
+		return;
+	}
+	if (oldType)
+	{
+		partsByType.Remove(i, oldType);
+		partsGrid.Remove(i, oldType);
+	}
+	if (t)
+	{
+		partsByType.Add(i, t);
+		partsGrid.Add(i, t);
+	}
+}
+
 //the function for creating a particle, use p=-1 for creating a new particle, -2 is from a brush, or a particle number to replace a particle.
 //tv = Type (PMAPBITS bits) + Var (32-PMAPBITS bits), var is usually 0
 int Simulation::create_part(int p, int x, int y, int t, int v)
 {
 	int i, oldType = PT_NONE;
+	ParticleTile *tile = CurrentTile();
 
 	if (x<0 || y<0 || x>=XRES || y>=YRES || t<=0 || t>=PT_NUM || !elements[t].Enabled)
 		return -1;
@@ -3193,6 +3363,7 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 		int index = ID(pmap[y][x]);
 		if(type == PT_WIRE)
 		{
+			MarkPartDirty(index);
 			parts[index].ctype = PT_DUST;
 			return index;
 		}
@@ -3203,7 +3374,7 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 			FloodINST(x, y);
 			return index;
 		}
-		parts[index].type = PT_SPRK;
+		SetPartType(index, PT_SPRK);
 		parts[index].life = 4;
 		parts[index].ctype = type;
 		pmap[y][x] = (pmap[y][x]&~PMAPMASK) | PT_SPRK;
@@ -3218,7 +3389,10 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 		{
 			int drawOn = TYP(pmap[y][x]);
 			if (elements[drawOn].CtypeDraw)
+			{
+				MarkPartDirty(ID(pmap[y][x]));
 				elements[drawOn].CtypeDraw(this, ID(pmap[y][x]), t, v);
+			}
 			return -1;
 		}
 		else if (IsWallBlocking(x, y, t))
@@ -3245,24 +3419,21 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 		{
 			return -1;
 		}
-		if (pfree == -1)
+		i = AllocParticle();
+		if (i == -1)
 			return -1;
-		i = pfree;
-		pfree = parts[i].life;
 	}
 	else if (p == -2)//creating from brush
 	{
-		if (pfree == -1)
+		i = AllocParticle();
+		if (i == -1)
 			return -1;
-		i = pfree;
-		pfree = parts[i].life;
 	}
 	else if (p == -3)//skip pmap checks, e.g. for sing explosion
 	{
-		if (pfree == -1)
+		i = AllocParticle();
+		if (i == -1)
 			return -1;
-		i = pfree;
-		pfree = parts[i].life;
 	}
 	else
 	{
@@ -3277,18 +3448,19 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 
 		if (elements[oldType].ChangeType)
 			(*(elements[oldType].ChangeType))(this, p, oldX, oldY, oldType, t);
-		if (oldType)
-			elementCount[oldType]--;
 
 		i = p;
 	}
 
-	if (i>parts_lastActiveIndex) parts_lastActiveIndex = i;
+	int &lastActiveIndex = tile ? tile->lastActiveIndex : parts_lastActiveIndex;
+	if (i>lastActiveIndex) lastActiveIndex = i;
 
 	parts[i] = elements[t].DefaultProperties;
-	parts[i].type = t;
 	parts[i].x = (float)x;
 	parts[i].y = (float)y;
+	SetPartType(i, t);
+	// a particle replaced by one of the same type may still be linked where it was
+	PartMoved(i);
 
 	//and finally set the pmap/photon maps to the newly created particle
 	if (elements[t].Properties & TYPE_ENERGY)
@@ -3316,7 +3488,6 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 	if (elements[t].ChangeType)
 		(*(elements[t].ChangeType))(this, i, x, y, oldType, t);
 
-	elementCount[t]++;
 	return i;
 }
 
@@ -3347,9 +3518,8 @@ void Simulation::create_gain_photon(int pp)//photons from PHOT going through GLO
 	float xx, yy;
 	int i, lr, temp_bin, nx, ny;
 
-	if (pfree == -1)
+	if (activeParts.Full())
 		return;
-	i = pfree;
 
 	lr = RNG::Ref().between(0, 1);
 
@@ -3370,13 +3540,13 @@ void Simulation::create_gain_photon(int pp)//photons from PHOT going through GLO
 	if (TYP(pmap[ny][nx]) != PT_GLOW)
 		return;
 
-	pfree = parts[i].life;
+	i = activeParts.Alloc();
 	if (i>parts_lastActiveIndex) parts_lastActiveIndex = i;
 
-	parts[i].type = PT_PHOT;
-	parts[i].life = 680;
 	parts[i].x = xx;
 	parts[i].y = yy;
+	SetPartType(i, PT_PHOT);
+	parts[i].life = 680;
 	parts[i].vx = parts[pp].vx;
 	parts[i].vy = parts[pp].vy;
 	parts[i].temp = parts[ID(pmap[ny][nx])].temp;
@@ -3396,9 +3566,8 @@ void Simulation::create_cherenkov_photon(int pp)//photons from NEUT going throug
 	int i, lr, nx, ny;
 	float r;
 
-	if (pfree == -1)
+	if (activeParts.Full())
 		return;
-	i = pfree;
 
 	nx = (int)(parts[pp].x + 0.5f);
 	ny = (int)(parts[pp].y + 0.5f);
@@ -3408,16 +3577,16 @@ void Simulation::create_cherenkov_photon(int pp)//photons from NEUT going throug
 	if (hypotf(parts[pp].vx, parts[pp].vy) < 1.44f)
 		return;
 
-	pfree = parts[i].life;
+	i = activeParts.Alloc();
 	if (i>parts_lastActiveIndex) parts_lastActiveIndex = i;
 
 	lr = RNG::Ref().between(0, 1);
 
-	parts[i].type = PT_PHOT;
-	parts[i].ctype = 0x00000F80;
-	parts[i].life = 680;
 	parts[i].x = parts[pp].x;
 	parts[i].y = parts[pp].y;
+	SetPartType(i, PT_PHOT);
+	parts[i].ctype = 0x00000F80;
+	parts[i].life = 680;
 	parts[i].temp = parts[ID(pmap[ny][nx])].temp;
 	parts[i].tmp = 0;
 	parts[i].tmp3 = 0;
@@ -3457,7 +3626,28 @@ void Simulation::delete_part(int x, int y)//calls kill_part with the particle lo
 
 void Simulation::UpdateParticles(int start, int end)
 {
-	int i, j, x, y, t, nx, ny, r, surround_space, s, rt, nt;
+	PhaseTimer timer(*this, phaseParticles);
+	RNG::Override rngOverride(rng);
+	MarkAllDirty();
+	if (workers && workers->GetThreads() > 1 && start <= 0 && end >= parts_lastActiveIndex && !water_equal_test)
+		UpdateParticlesTiled();
+	else
+	{
+		//the main particle loop function, goes over all particles.
+		for (int i = activeParts.Next(start); i <= end && i <= parts_lastActiveIndex; i = activeParts.Next(i + 1))
+			UpdateParticle(i, nullptr, nullptr);
+	}
+	// particles have moved, for whatever asks between now and the next frame
+	partsGrid.Invalidate();
+
+	//'f' was pressed (single frame)
+	if (framerender)
+		framerender--;
+}
+
+void Simulation::UpdateParticle(int i, ParticleTile *tile, const DeferredParticle *resume)
+{
+	int j, x, y, t, nx, ny, r, surround_space, s, rt, nt;
 	float mv, dx, dy, nrx, nry, dp, ctemph, ctempl, gravtot;
 	int fin_x, fin_y, clear_x, clear_y, stagnant;
 	float fin_xf, fin_yf, clear_xf, clear_yf;
@@ -3468,1226 +3658,1434 @@ void Simulation::UpdateParticles(int start, int end)
 	int surround[8];
 	int surround_hconduct[8];
 	float pGravX, pGravY, pGravD;
+	float gel_scale;
 	bool transitionOccurred;
 
-	//the main particle loop function, goes over all particles.
-	for (i = start; i <= end && i <= parts_lastActiveIndex; i++)
-		if (parts[i].type)
-		{
-			t = parts[i].type;
-
-			x = (int)(parts[i].x+0.5f);
-			y = (int)(parts[i].y+0.5f);
-
-			//this kills any particle out of the screen, or in a wall where it isn't supposed to go
-			if (x<CELL || y<CELL || x>=XRES-CELL || y>=YRES-CELL ||
-			        (bmap[y/CELL][x/CELL] &&
-			         (bmap[y/CELL][x/CELL]==WL_WALL ||
-			          bmap[y/CELL][x/CELL]==WL_WALLELEC ||
-			          bmap[y/CELL][x/CELL]==WL_ALLOWAIR ||
-			          (bmap[y/CELL][x/CELL]==WL_DESTROYALL) ||
-			          (bmap[y/CELL][x/CELL]==WL_ALLOWLIQUID && !(elements[t].Properties&TYPE_LIQUID)) ||
-			          (bmap[y/CELL][x/CELL]==WL_ALLOWPOWDER && !(elements[t].Properties&TYPE_PART)) ||
-			          (bmap[y/CELL][x/CELL]==WL_ALLOWGAS && !(elements[t].Properties&TYPE_GAS)) || //&& elements[t].Falldown!=0 && parts[i].type!=PT_FIRE && parts[i].type!=PT_SMKE && parts[i].type!=PT_CFLM) ||
-					  (bmap[y/CELL][x/CELL]==WL_ALLOWENERGY && !(elements[t].Properties&TYPE_ENERGY)) ||
-			          (bmap[y/CELL][x/CELL]==WL_EWALL && !emap[y/CELL][x/CELL])) && (t!=PT_STKM) && (t!=PT_STKM2) && (t!=PT_FIGH)))
-			{
-				kill_part(i);
-				continue;
-			}
+	if (resume)
+	{
+		// finish a particle the tiled update had to give up on, see UpdateParticlesTiled
+		t = parts[i].type;
+		x = (int)(parts[i].x+0.5f);
+		y = (int)(parts[i].y+0.5f);
+		surround_space = resume->surround_space;
+		nt = resume->nt;
+		pGravX = resume->pGravX;
+		pGravY = resume->pGravY;
+		transitionOccurred = resume->transitionOccurred;
+		if (resume->stage == DeferredParticle::stageUpdate)
+			goto update;
+		if (resume->stage == DeferredParticle::stageMove)
+			goto killed;
+	}
 
-			// Make sure that STASIS'd particles don't tick.
-			if (bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8) {
-				continue;
-			}
+	t = parts[i].type;
+
+	x = (int)(parts[i].x+0.5f);
+	y = (int)(parts[i].y+0.5f);
+
+	if (tile && (!tile->Contains(x, y) || !tileLocalType[t] || tile->FreeCount() < TILE_CREATE_RESERVE))
+	{
+		tile->deferred.push_back({ i, DeferredParticle::stageStart, 0, 0, 0.0f, 0.0f, false });
+		return;
+	}
+
+	//this kills any particle out of the screen, or in a wall where it isn't supposed to go
+	if (x<CELL || y<CELL || x>=XRES-CELL || y>=YRES-CELL ||
+	        (bmap[y/CELL][x/CELL] &&
+	         (bmap[y/CELL][x/CELL]==WL_WALL ||
+	          bmap[y/CELL][x/CELL]==WL_WALLELEC ||
+	          bmap[y/CELL][x/CELL]==WL_ALLOWAIR ||
+	          (bmap[y/CELL][x/CELL]==WL_DESTROYALL) ||
+	          (bmap[y/CELL][x/CELL]==WL_ALLOWLIQUID && !(elements[t].Properties&TYPE_LIQUID)) ||
+	          (bmap[y/CELL][x/CELL]==WL_ALLOWPOWDER && !(elements[t].Properties&TYPE_PART)) ||
+	          (bmap[y/CELL][x/CELL]==WL_ALLOWGAS && !(elements[t].Properties&TYPE_GAS)) || //&& elements[t].Falldown!=0 && parts[i].type!=PT_FIRE && parts[i].type!=PT_SMKE && parts[i].type!=PT_CFLM) ||
+			  (bmap[y/CELL][x/CELL]==WL_ALLOWENERGY && !(elements[t].Properties&TYPE_ENERGY)) ||
+	          (bmap[y/CELL][x/CELL]==WL_EWALL && !emap[y/CELL][x/CELL])) && (t!=PT_STKM) && (t!=PT_STKM2) && (t!=PT_FIGH)))
+	{
+		kill_part(i);
+		return;
+	}
 
-			if (bmap[y/CELL][x/CELL]==WL_DETECT && emap[y/CELL][x/CELL]<8)
-				set_emap(x/CELL, y/CELL);
+	// Make sure that STASIS'd particles don't tick.
+	if (bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8) {
+		return;
+	}
 
-			//adding to velocity from the particle's velocity
-			vx[y/CELL][x/CELL] = vx[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vx;
-			vy[y/CELL][x/CELL] = vy[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vy;
+	if (bmap[y/CELL][x/CELL]==WL_DETECT && emap[y/CELL][x/CELL]<8)
+		set_emap(x/CELL, y/CELL);
 
-			if (elements[t].HotAir)
+	//adding to velocity from the particle's velocity
+	vx[y/CELL][x/CELL] = vx[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vx;
+	vy[y/CELL][x/CELL] = vy[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vy;
+
+	if (elements[t].HotAir)
+	{
+		if (t==PT_GAS||t==PT_NBLE)
+		{
+			if (pv[y/CELL][x/CELL]<3.5f)
+				pv[y/CELL][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL]);
+			if (y+CELL<YRES && pv[y/CELL+1][x/CELL]<3.5f)
+				pv[y/CELL+1][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL]);
+			if (x+CELL<XRES)
 			{
-				if (t==PT_GAS||t==PT_NBLE)
-				{
-					if (pv[y/CELL][x/CELL]<3.5f)
-						pv[y/CELL][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL]);
-					if (y+CELL<YRES && pv[y/CELL+1][x/CELL]<3.5f)
-						pv[y/CELL+1][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL]);
-					if (x+CELL<XRES)
-					{
-						if (pv[y/CELL][x/CELL+1]<3.5f)
-							pv[y/CELL][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL+1]);
-						if (y+CELL<YRES && pv[y/CELL+1][x/CELL+1]<3.5f)
-							pv[y/CELL+1][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL+1]);
-					}
-				}
-				else//add the hotair variable to the pressure map, like black hole, or white hole.
-				{
-					pv[y/CELL][x/CELL] += elements[t].HotAir;
-					if (y+CELL<YRES)
-						pv[y/CELL+1][x/CELL] += elements[t].HotAir;
-					if (x+CELL<XRES)
-					{
-						pv[y/CELL][x/CELL+1] += elements[t].HotAir;
-						if (y+CELL<YRES)
-							pv[y/CELL+1][x/CELL+1] += elements[t].HotAir;
-					}
-				}
+				if (pv[y/CELL][x/CELL+1]<3.5f)
+					pv[y/CELL][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL+1]);
+				if (y+CELL<YRES && pv[y/CELL+1][x/CELL+1]<3.5f)
+					pv[y/CELL+1][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL+1]);
 			}
-
-			pGravX = pGravY = 0;
-			if (!(elements[t].Properties & TYPE_SOLID))
+		}
+		else//add the hotair variable to the pressure map, like black hole, or white hole.
+		{
+			pv[y/CELL][x/CELL] += elements[t].HotAir;
+			if (y+CELL<YRES)
+				pv[y/CELL+1][x/CELL] += elements[t].HotAir;
+			if (x+CELL<XRES)
 			{
-				if (elements[t].Gravity)
-				{
-					//Gravity mode by Moach
-					switch (gravityMode)
-					{
-					default:
-					case 0:
-						pGravX = 0.0f;
-						pGravY = elements[t].Gravity;
-						break;
-					case 1:
-						pGravX = pGravY = 0.0f;
-						break;
-					case 2:
-						pGravD = 0.01f - hypotf(float(x - XCNTR), float(y - YCNTR));
-						pGravX = elements[t].Gravity * ((float)(x - XCNTR) / pGravD);
-						pGravY = elements[t].Gravity * ((float)(y - YCNTR) / pGravD);
-						break;
-					}
-				}
-				if (elements[t].NewtonianGravity)
-				{
-					//Get some gravity from the gravity map
-					pGravX += elements[t].NewtonianGravity * gravx[(y/CELL)*(XRES/CELL)+(x/CELL)];
-					pGravY += elements[t].NewtonianGravity * gravy[(y/CELL)*(XRES/CELL)+(x/CELL)];
-				}
+				pv[y/CELL][x/CELL+1] += elements[t].HotAir;
+				if (y+CELL<YRES)
+					pv[y/CELL+1][x/CELL+1] += elements[t].HotAir;
 			}
+		}
+	}
 
-			//velocity updates for the particle
-			if (t != PT_SPNG || !(parts[i].flags&FLAG_MOVABLE))
+	pGravX = pGravY = 0;
+	if (!(elements[t].Properties & TYPE_SOLID))
+	{
+		if (elements[t].Gravity)
+		{
+			//Gravity mode by Moach
+			switch (gravityMode)
 			{
-				parts[i].vx *= elements[t].Loss;
-				parts[i].vy *= elements[t].Loss;
+			default:
+			case 0:
+				pGravX = 0.0f;
+				pGravY = elements[t].Gravity;
+				break;
+			case 1:
+				pGravX = pGravY = 0.0f;
+				break;
+			case 2:
+				pGravD = 0.01f - hypotf(float(x - XCNTR), float(y - YCNTR));
+				pGravX = elements[t].Gravity * ((float)(x - XCNTR) / pGravD);
+				pGravY = elements[t].Gravity * ((float)(y - YCNTR) / pGravD);
+				break;
 			}
-			//particle gets velocity from the vx and vy maps
-			parts[i].vx += elements[t].Advection*vx[y/CELL][x/CELL] + pGravX;
-			parts[i].vy += elements[t].Advection*vy[y/CELL][x/CELL] + pGravY;
+		}
+		if (elements[t].NewtonianGravity)
+		{
+			//Get some gravity from the gravity map
+			pGravX += elements[t].NewtonianGravity * gravx[(y/CELL)*(XRES/CELL)+(x/CELL)];
+			pGravY += elements[t].NewtonianGravity * gravy[(y/CELL)*(XRES/CELL)+(x/CELL)];
+		}
+	}
 
+	//velocity updates for the particle
+	if (t != PT_SPNG || !(parts[i].flags&FLAG_MOVABLE))
+	{
+		parts[i].vx *= elements[t].Loss;
+		parts[i].vy *= elements[t].Loss;
+	}
+	//particle gets velocity from the vx and vy maps
+	parts[i].vx += elements[t].Advection*vx[y/CELL][x/CELL] + pGravX;
+	parts[i].vy += elements[t].Advection*vy[y/CELL][x/CELL] + pGravY;
 
-			if (elements[t].Diffusion)//the random diffusion that gasses have
-			{
+
+	if (elements[t].Diffusion)//the random diffusion that gasses have
+	{
 #ifdef REALISTIC
-				//The magic number controls diffusion speed
-				parts[i].vx += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
-				parts[i].vy += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		//The magic number controls diffusion speed
+		parts[i].vx += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		parts[i].vy += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
 #else
-				parts[i].vx += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
-				parts[i].vy += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		parts[i].vx += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		parts[i].vy += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
 #endif
+	}
+
+	transitionOccurred = false;
+
+	j = surround_space = nt = 0;//if nt is greater than 1 after this, then there is a particle around the current particle, that is NOT the current particle's type, for water movement.
+	for (nx=-1; nx<2; nx++)
+		for (ny=-1; ny<2; ny++) {
+			if (nx||ny) {
+				surround[j] = r = pmap[y+ny][x+nx];
+				j++;
+				if (!TYP(r))
+					surround_space++;//there is empty space
+				if (TYP(r)!=t)
+					nt++;//there is nothing or a different particle
 			}
+		}
 
-			transitionOccurred = false;
-
-			j = surround_space = nt = 0;//if nt is greater than 1 after this, then there is a particle around the current particle, that is NOT the current particle's type, for water movement.
-			for (nx=-1; nx<2; nx++)
-				for (ny=-1; ny<2; ny++) {
-					if (nx||ny) {
-						surround[j] = r = pmap[y+ny][x+nx];
-						j++;
-						if (!TYP(r))
-							surround_space++;//there is empty space
-						if (TYP(r)!=t)
-							nt++;//there is nothing or a different particle
-					}
+	gel_scale = 1.0f;
+	if (t==PT_GEL)
+		gel_scale = parts[i].tmp*2.55f;
+
+	if (!legacy_enable)
+	{
+		if (y-2 >= 0 && y-2 < YRES && (elements[t].Properties&TYPE_LIQUID) && (t!=PT_GEL || gel_scale > (1 + RNG::Ref().between(0, 254)))) {//some heat convection for liquids
+			r = pmap[y-2][x];
+			if (!(!r || parts[i].type != TYP(r))) {
+				if (parts[i].temp>parts[ID(r)].temp) {
+					swappage = parts[i].temp;
+					parts[i].temp = parts[ID(r)].temp;
+					parts[ID(r)].temp = swappage;
 				}
+			}
+		}
 
-			float gel_scale = 1.0f;
-			if (t==PT_GEL)
-				gel_scale = parts[i].tmp*2.55f;
-
-			if (!legacy_enable)
-			{
-				if (y-2 >= 0 && y-2 < YRES && (elements[t].Properties&TYPE_LIQUID) && (t!=PT_GEL || gel_scale > (1 + RNG::Ref().between(0, 254)))) {//some heat convection for liquids
-					r = pmap[y-2][x];
-					if (!(!r || parts[i].type != TYP(r))) {
-						if (parts[i].temp>parts[ID(r)].temp) {
-							swappage = parts[i].temp;
-							parts[i].temp = parts[ID(r)].temp;
-							parts[ID(r)].temp = swappage;
-						}
-					}
-				}
-
-				//heat transfer code
-				h_count = 0;
+		//heat transfer code
+		h_count = 0;
 #ifdef REALISTIC
-				if (t&&(t!=PT_HSWC||parts[i].life==10)&&(elements[t].HeatConduct*gel_scale))
+		if (t&&(t!=PT_HSWC||parts[i].life==10)&&(elements[t].HeatConduct*gel_scale))
 #else
-				if (t && (t!=PT_HSWC||parts[i].life==10) && RNG::Ref().chance(int(elements[t].HeatConduct*gel_scale), 250))
+		if (t && (t!=PT_HSWC||parts[i].life==10) && RNG::Ref().chance(int(elements[t].HeatConduct*gel_scale), 250))
 #endif
-				{
-					if (aheat_enable && !(elements[t].Properties&PROP_NOAMBHEAT))
-					{
+		{
+			if (aheat_enable && !(elements[t].Properties&PROP_NOAMBHEAT))
+			{
 #ifdef REALISTIC
-						c_heat = parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight) + hv[y/CELL][x/CELL]*100*(pv[y/CELL][x/CELL]+273.15f)/256;
-						float c_Cm = 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight)  + 100*(pv[y/CELL][x/CELL]+273.15f)/256;
-						pt = c_heat/c_Cm;
-						pt = restrict_flt(pt, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
-						parts[i].temp = pt;
-						//Pressure increase from heat (temporary)
-						pv[y/CELL][x/CELL] += (pt-hv[y/CELL][x/CELL])*0.004;
-						hv[y/CELL][x/CELL] = pt;
+				c_heat = parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight) + hv[y/CELL][x/CELL]*100*(pv[y/CELL][x/CELL]+273.15f)/256;
+				float c_Cm = 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight)  + 100*(pv[y/CELL][x/CELL]+273.15f)/256;
+				pt = c_heat/c_Cm;
+				pt = restrict_flt(pt, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
+				parts[i].temp = pt;
+				//Pressure increase from heat (temporary)
+				pv[y/CELL][x/CELL] += (pt-hv[y/CELL][x/CELL])*0.004;
+				hv[y/CELL][x/CELL] = pt;
 #else
-						c_heat = (hv[y/CELL][x/CELL]-parts[i].temp)*0.04;
-						c_heat = restrict_flt(c_heat, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
-						parts[i].temp += c_heat;
-						hv[y/CELL][x/CELL] -= c_heat;
+				c_heat = (hv[y/CELL][x/CELL]-parts[i].temp)*0.04;
+				c_heat = restrict_flt(c_heat, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
+				parts[i].temp += c_heat;
+				hv[y/CELL][x/CELL] -= c_heat;
 #endif
-					}
-					c_heat = 0.0f;
+			}
+			c_heat = 0.0f;
 #ifdef REALISTIC
-					float c_Cm = 0.0f;
+			float c_Cm = 0.0f;
 #endif
-					for (j=0; j<8; j++)
-					{
-						surround_hconduct[j] = i;
-						r = surround[j];
-						if (!r)
-							continue;
-						rt = TYP(r);
-						if (rt && elements[rt].HeatConduct && (rt!=PT_HSWC||parts[ID(r)].life==10)
-						        && (t!=PT_FILT||(rt!=PT_BRAY&&rt!=PT_BIZR&&rt!=PT_BIZRG))
-						        && (rt!=PT_FILT||(t!=PT_BRAY&&t!=PT_PHOT&&t!=PT_BIZR&&t!=PT_BIZRG))
-						        && (t!=PT_ELEC||rt!=PT_DEUT)
-						        && (t!=PT_DEUT||rt!=PT_ELEC)
-						        && (t!=PT_HSWC || rt!=PT_FILT || parts[i].tmp != 1)
-						        && (t!=PT_FILT || rt!=PT_HSWC || parts[ID(r)].tmp != 1))
-						{
-							surround_hconduct[j] = ID(r);
+			for (j=0; j<8; j++)
+			{
+				surround_hconduct[j] = i;
+				r = surround[j];
+				if (!r)
+					continue;
+				rt = TYP(r);
+				if (rt && elements[rt].HeatConduct && (rt!=PT_HSWC||parts[ID(r)].life==10)
+				        && (t!=PT_FILT||(rt!=PT_BRAY&&rt!=PT_BIZR&&rt!=PT_BIZRG))
+				        && (rt!=PT_FILT||(t!=PT_BRAY&&t!=PT_PHOT&&t!=PT_BIZR&&t!=PT_BIZRG))
+				        && (t!=PT_ELEC||rt!=PT_DEUT)
+				        && (t!=PT_DEUT||rt!=PT_ELEC)
+				        && (t!=PT_HSWC || rt!=PT_FILT || parts[i].tmp != 1)
+				        && (t!=PT_FILT || rt!=PT_HSWC || parts[ID(r)].tmp != 1))
+				{
+					surround_hconduct[j] = ID(r);
 #ifdef REALISTIC
-							if (rt==PT_GEL)
-								gel_scale = parts[ID(r)].tmp*2.55f;
-							else gel_scale = 1.0f;
+					if (rt==PT_GEL)
+						gel_scale = parts[ID(r)].tmp*2.55f;
+					else gel_scale = 1.0f;
 
-							c_heat += parts[ID(r)].temp*96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
-							c_Cm += 96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
+					c_heat += parts[ID(r)].temp*96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
+					c_Cm += 96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
 #else
-							c_heat += parts[ID(r)].temp;
+					c_heat += parts[ID(r)].temp;
 #endif
-							h_count++;
-						}
-					}
+					h_count++;
+				}
+			}
 #ifdef REALISTIC
-					if (t==PT_GEL)
-						gel_scale = parts[i].tmp*2.55f;
-					else gel_scale = 1.0f;
+			if (t==PT_GEL)
+				gel_scale = parts[i].tmp*2.55f;
+			else gel_scale = 1.0f;
 
-					if (t == PT_PHOT)
-						pt = (c_heat+parts[i].temp*96.645)/(c_Cm+96.645);
-					else
-						pt = (c_heat+parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight))/(c_Cm+96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight));
+			if (t == PT_PHOT)
+				pt = (c_heat+parts[i].temp*96.645)/(c_Cm+96.645);
+			else
+				pt = (c_heat+parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight))/(c_Cm+96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight));
 
-					c_heat += parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
-					c_Cm += 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
-					parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
+			c_heat += parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
+			c_Cm += 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
+			parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
 #else
-					pt = (c_heat+parts[i].temp)/(h_count+1);
-					pt = parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
-					for (j=0; j<8; j++)
-					{
-						parts[surround_hconduct[j]].temp = pt;
-					}
+			pt = (c_heat+parts[i].temp)/(h_count+1);
+			pt = parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
+			for (j=0; j<8; j++)
+			{
+				parts[surround_hconduct[j]].temp = pt;
+			}
 #endif
 
-					ctemph = ctempl = pt;
-					// change boiling point with pressure
-					if (((elements[t].Properties&TYPE_LIQUID) && IsElementOrNone(elements[t].HighTemperatureTransition) && (elements[elements[t].HighTemperatureTransition].Properties&TYPE_GAS))
-					        || t==PT_LNTG || t==PT_SLTW)
-						ctemph -= 2.0f*pv[y/CELL][x/CELL];
-					else if (((elements[t].Properties&TYPE_GAS) && IsElementOrNone(elements[t].LowTemperatureTransition) && (elements[elements[t].LowTemperatureTransition].Properties&TYPE_LIQUID))
-					         || t==PT_WTRV)
-						ctempl -= 2.0f*pv[y/CELL][x/CELL];
-					s = 1;
-
-					//A fix for ice with ctype = 0
-					if ((t==PT_ICEI || t==PT_SNOW) && (!IsElement(parts[i].ctype) || parts[i].ctype==PT_ICEI || parts[i].ctype==PT_SNOW))
-						parts[i].ctype = PT_WATR;
-
-					if (elements[t].HighTemperatureTransition>-1 && ctemph>=elements[t].HighTemperature)
-					{
-						// particle type change due to high temperature
-#ifdef REALISTIC
-						float dbt = ctempl - pt;
-						if (elements[t].HighTemperatureTransition != PT_NUM)
-						{
-							if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
-							{
-								pt = (c_heat - platent[t])/c_Cm;
-								t = elements[t].HighTemperatureTransition;
-							}
-							else
-							{
-								parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
-								s = 0;
-							}
-						}
-#else
-						if (elements[t].HighTemperatureTransition != PT_NUM)
-							t = elements[t].HighTemperatureTransition;
-#endif
-						else if (t == PT_ICEI || t == PT_SNOW)
-						{
-							if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != t)
-							{
-								if (elements[parts[i].ctype].LowTemperatureTransition==PT_ICEI || elements[parts[i].ctype].LowTemperatureTransition==PT_SNOW)
-								{
-									if (pt<elements[parts[i].ctype].LowTemperature)
-										s = 0;
-								}
-								else if (pt<273.15f)
-									s = 0;
+			ctemph = ctempl = pt;
+			// change boiling point with pressure
+			if (((elements[t].Properties&TYPE_LIQUID) && IsElementOrNone(elements[t].HighTemperatureTransition) && (elements[elements[t].HighTemperatureTransition].Properties&TYPE_GAS))
+			        || t==PT_LNTG || t==PT_SLTW)
+				ctemph -= 2.0f*pv[y/CELL][x/CELL];
+			else if (((elements[t].Properties&TYPE_GAS) && IsElementOrNone(elements[t].LowTemperatureTransition) && (elements[elements[t].LowTemperatureTransition].Properties&TYPE_LIQUID))
+			         || t==PT_WTRV)
+				ctempl -= 2.0f*pv[y/CELL][x/CELL];
+			s = 1;
 
-								if (s)
-								{
+			//A fix for ice with ctype = 0
+			if ((t==PT_ICEI || t==PT_SNOW) && (!IsElement(parts[i].ctype) || parts[i].ctype==PT_ICEI || parts[i].ctype==PT_SNOW))
+				parts[i].ctype = PT_WATR;
+
+			if (elements[t].HighTemperatureTransition>-1 && ctemph>=elements[t].HighTemperature)
+			{
+				// particle type change due to high temperature
 #ifdef REALISTIC
-									//One ice table value for all it's kinds
-									if (platent[t] <= (c_heat - (elements[parts[i].ctype].LowTemperature - dbt)*c_Cm))
-									{
-										pt = (c_heat - platent[t])/c_Cm;
-										t = parts[i].ctype;
-										parts[i].ctype = PT_NONE;
-										parts[i].life = 0;
-									}
-									else
-									{
-										parts[i].temp = restrict_flt(elements[parts[i].ctype].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
-										s = 0;
-									}
+				float dbt = ctempl - pt;
+				if (elements[t].HighTemperatureTransition != PT_NUM)
+				{
+					if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
+					{
+						pt = (c_heat - platent[t])/c_Cm;
+						t = elements[t].HighTemperatureTransition;
+					}
+					else
+					{
+						parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
+						s = 0;
+					}
+				}
 #else
-									t = parts[i].ctype;
-									parts[i].ctype = PT_NONE;
-									parts[i].life = 0;
+				if (elements[t].HighTemperatureTransition != PT_NUM)
+					t = elements[t].HighTemperatureTransition;
 #endif
-								}
-							}
-							else
+				else if (t == PT_ICEI || t == PT_SNOW)
+				{
+					if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != t)
+					{
+						if (elements[parts[i].ctype].LowTemperatureTransition==PT_ICEI || elements[parts[i].ctype].LowTemperatureTransition==PT_SNOW)
+						{
+							if (pt<elements[parts[i].ctype].LowTemperature)
 								s = 0;
 						}
-						else if (t == PT_SLTW)
+						else if (pt<273.15f)
+							s = 0;
+
+						if (s)
 						{
 #ifdef REALISTIC
-							if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
+							//One ice table value for all it's kinds
+							if (platent[t] <= (c_heat - (elements[parts[i].ctype].LowTemperature - dbt)*c_Cm))
 							{
 								pt = (c_heat - platent[t])/c_Cm;
-
-								if (RNG::Ref().chance(1, 4))
-									t = PT_SALT;
-								else
-									t = PT_WTRV;
+								t = parts[i].ctype;
+								parts[i].ctype = PT_NONE;
+								parts[i].life = 0;
 							}
 							else
 							{
-								parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
+								parts[i].temp = restrict_flt(elements[parts[i].ctype].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
 								s = 0;
 							}
 #else
-							if (RNG::Ref().chance(1, 4))
-								t = PT_SALT;
-							else
-								t = PT_WTRV;
+							t = parts[i].ctype;
+							parts[i].ctype = PT_NONE;
+							parts[i].life = 0;
 #endif
 						}
-						else if (t == PT_BRMT)
-						{
-							if (parts[i].ctype == PT_TUNG)
-							{
-								if (ctemph < elements[parts[i].ctype].HighTemperature)
-									s = 0;
-								else
-								{
-									t = PT_LAVA;
-									parts[i].type = PT_TUNG;
-								}
-							}
-							else if (ctemph >= elements[t].HighTemperature)
-								t = PT_LAVA;
-							else
-								s = 0;
-						}
-						else if (t == PT_CRMC)
-						{
-							float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
-							if (ctemph < pres+elements[PT_CRMC].HighTemperature)
-								s = 0;
-							else
-								t = PT_LAVA;
-						}
+					}
+					else
+						s = 0;
+				}
+				else if (t == PT_SLTW)
+				{
+#ifdef REALISTIC
+					if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
+					{
+						pt = (c_heat - platent[t])/c_Cm;
+
+						if (RNG::Ref().chance(1, 4))
+							t = PT_SALT;
 						else
-							s = 0;
+							t = PT_WTRV;
 					}
-					else if (elements[t].LowTemperatureTransition > -1 && ctempl<elements[t].LowTemperature)
+					else
 					{
-						// particle type change due to low temperature
-#ifdef REALISTIC
-						float dbt = ctempl - pt;
-						if (elements[t].LowTemperatureTransition != PT_NUM)
-						{
-							if (platent[elements[t].LowTemperatureTransition] >= (c_heat - (elements[t].LowTemperature - dbt)*c_Cm))
-							{
-								pt = (c_heat + platent[elements[t].LowTemperatureTransition])/c_Cm;
-								t = elements[t].LowTemperatureTransition;
-							}
-							else
-							{
-								parts[i].temp = restrict_flt(elements[t].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
-								s = 0;
-							}
-						}
+						parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
+						s = 0;
+					}
 #else
-						if (elements[t].LowTemperatureTransition != PT_NUM)
-							t = elements[t].LowTemperatureTransition;
+					if (RNG::Ref().chance(1, 4))
+						t = PT_SALT;
+					else
+						t = PT_WTRV;
 #endif
-						else if (t == PT_WTRV)
+				}
+				else if (t == PT_BRMT)
+				{
+					if (parts[i].ctype == PT_TUNG)
+					{
+						if (ctemph < elements[parts[i].ctype].HighTemperature)
+							s = 0;
+						else
 						{
-							if (pt < 273.0f)
-								t = PT_RIME;
-							else
-								t = PT_DSTW;
+							t = PT_LAVA;
+							SetPartType(i, PT_TUNG);
 						}
-						else if (t == PT_LAVA)
-						{
-							if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != PT_LAVA && elements[parts[i].ctype].Enabled)
-							{
-								if (parts[i].ctype == PT_THRM && pt >= elements[PT_BMTL].HighTemperature)
-									s = 0;
-								else if ((parts[i].ctype == PT_VIBR || parts[i].ctype == PT_BVBR) && pt >= 273.15f)
-									s = 0;
-								else if (parts[i].ctype == PT_TUNG)
-								{
-									// TUNG does its own melting in its update function, so HighTemperatureTransition is not LAVA so it won't be handled by the code for HighTemperatureTransition==PT_LAVA below
-									// However, the threshold is stored in HighTemperature to allow it to be changed from Lua
-									if (pt >= elements[parts[i].ctype].HighTemperature)
-										s = 0;
-								}
-								else if (parts[i].ctype == PT_CRMC)
-								{
-									float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
-									if (ctemph >= pres+elements[PT_CRMC].HighTemperature)
-										s = 0;
-								}
-								else if (elements[parts[i].ctype].HighTemperatureTransition == PT_LAVA || parts[i].ctype == PT_HEAC)
-								{
-									if (pt >= elements[parts[i].ctype].HighTemperature)
-										s = 0;
-								}
-								else if (pt>=973.0f)
-									s = 0; // freezing point for lava with any other (not listed in ptransitions as turning into lava) ctype
-								if (s)
-								{
-									t = parts[i].ctype;
-									parts[i].ctype = PT_NONE;
-									if (t == PT_THRM)
-									{
-										parts[i].tmp = 0;
-										t = PT_BMTL;
-									}
-									if (t == PT_PLUT)
-									{
-										parts[i].tmp = 0;
-										t = PT_LAVA;
-									}
-								}
-							}
-							else if (pt<973.0f)
-								t = PT_STNE;
-							else
-								s = 0;
-						}
-						else
-							s = 0;
 					}
+					else if (ctemph >= elements[t].HighTemperature)
+						t = PT_LAVA;
 					else
 						s = 0;
+				}
+				else if (t == PT_CRMC)
+				{
+					float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
+					if (ctemph < pres+elements[PT_CRMC].HighTemperature)
+						s = 0;
+					else
+						t = PT_LAVA;
+				}
+				else
+					s = 0;
+			}
+			else if (elements[t].LowTemperatureTransition > -1 && ctempl<elements[t].LowTemperature)
+			{
+				// particle type change due to low temperature
 #ifdef REALISTIC
-					pt = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
-					for (j=0; j<8; j++)
+				float dbt = ctempl - pt;
+				if (elements[t].LowTemperatureTransition != PT_NUM)
+				{
+					if (platent[elements[t].LowTemperatureTransition] >= (c_heat - (elements[t].LowTemperature - dbt)*c_Cm))
+					{
+						pt = (c_heat + platent[elements[t].LowTemperatureTransition])/c_Cm;
+						t = elements[t].LowTemperatureTransition;
+					}
+					else
 					{
-						parts[surround_hconduct[j]].temp = pt;
+						parts[i].temp = restrict_flt(elements[t].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
+						s = 0;
 					}
+				}
+#else
+				if (elements[t].LowTemperatureTransition != PT_NUM)
+					t = elements[t].LowTemperatureTransition;
 #endif
-					if (s) // particle type change occurred
+				else if (t == PT_WTRV)
+				{
+					if (pt < 273.0f)
+						t = PT_RIME;
+					else
+						t = PT_DSTW;
+				}
+				else if (t == PT_LAVA)
+				{
+					if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != PT_LAVA && elements[parts[i].ctype].Enabled)
 					{
-						if (t==PT_ICEI || t==PT_LAVA || t==PT_SNOW)
-							parts[i].ctype = parts[i].type;
-						if (!(t==PT_ICEI && parts[i].ctype==PT_FRZW))
-							parts[i].life = 0;
-						if (t == PT_FIRE)
-						{
-							//hackish, if tmp isn't 0 the FIRE might turn into DSTW later
-							//idealy transitions should use create_part(i) but some elements rely on properties staying constant
-							//and I don't feel like checking each one right now
-							parts[i].tmp = 0;
-						}
-						if ((elements[t].Properties&TYPE_GAS) && !(elements[parts[i].type].Properties&TYPE_GAS))
-							pv[y/CELL][x/CELL] += 0.50f;
-
-						if (t == PT_NONE)
+						if (parts[i].ctype == PT_THRM && pt >= elements[PT_BMTL].HighTemperature)
+							s = 0;
+						else if ((parts[i].ctype == PT_VIBR || parts[i].ctype == PT_BVBR) && pt >= 273.15f)
+							s = 0;
+						else if (parts[i].ctype == PT_TUNG)
 						{
-							kill_part(i);
-							goto killed;
+							// TUNG does its own melting in its update function, so HighTemperatureTransition is not LAVA so it won't be handled by the code for HighTemperatureTransition==PT_LAVA below
+							// However, the threshold is stored in HighTemperature to allow it to be changed from Lua
+							if (pt >= elements[parts[i].ctype].HighTemperature)
+								s = 0;
 						}
-						// part_change_type could refuse to change the type and kill the particle
-						// for example, changing type to STKM but one already exists
-						// we need to account for that to not cause simulation corruption issues
-						if (part_change_type(i,x,y,t))
-							goto killed;
-
-						if (t==PT_FIRE || t==PT_PLSM || t==PT_CFLM)
-							parts[i].life = RNG::Ref().between(120, 169);
-						if (t == PT_LAVA)
+						else if (parts[i].ctype == PT_CRMC)
 						{
-							if (parts[i].ctype == PT_BRMT) parts[i].ctype = PT_BMTL;
-							else if (parts[i].ctype == PT_SAND) parts[i].ctype = PT_GLAS;
-							else if (parts[i].ctype == PT_BGLA) parts[i].ctype = PT_GLAS;
-							else if (parts[i].ctype == PT_PQRT) parts[i].ctype = PT_QRTZ;
-							else if (parts[i].ctype == PT_LITH && parts[i].tmp2 > 3) parts[i].ctype = PT_GLAS;
-							parts[i].life = RNG::Ref().between(240, 359);
+							float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
+							if (ctemph >= pres+elements[PT_CRMC].HighTemperature)
+								s = 0;
 						}
-						transitionOccurred = true;
-					}
-
-					pt = parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
-					if (t == PT_LAVA)
-					{
-						parts[i].life = int(restrict_flt((parts[i].temp-700)/7, 0, 400));
-						if (parts[i].ctype==PT_THRM&&parts[i].tmp>0)
+						else if (elements[parts[i].ctype].HighTemperatureTransition == PT_LAVA || parts[i].ctype == PT_HEAC)
 						{
-							parts[i].tmp--;
-							parts[i].temp = 3500;
+							if (pt >= elements[parts[i].ctype].HighTemperature)
+								s = 0;
 						}
-						if (parts[i].ctype==PT_PLUT&&parts[i].tmp>0)
+						else if (pt>=973.0f)
+							s = 0; // freezing point for lava with any other (not listed in ptransitions as turning into lava) ctype
+						if (s)
 						{
-							parts[i].tmp--;
-							parts[i].temp = MAX_TEMP;
+							t = parts[i].ctype;
+							parts[i].ctype = PT_NONE;
+							if (t == PT_THRM)
+							{
+								parts[i].tmp = 0;
+								t = PT_BMTL;
+							}
+							if (t == PT_PLUT)
+							{
+								parts[i].tmp = 0;
+								t = PT_LAVA;
+							}
 						}
 					}
+					else if (pt<973.0f)
+						t = PT_STNE;
+					else
+						s = 0;
 				}
 				else
-				{
-					if (!(air->bmap_blockairh[y/CELL][x/CELL]&0x8))
-						air->bmap_blockairh[y/CELL][x/CELL]++;
-					parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
-				}
+					s = 0;
 			}
-
-			if (t==PT_LIFE)
-			{
-				parts[i].temp = restrict_flt(parts[i].temp-50.0f, MIN_TEMP, MAX_TEMP);
-			}
-			if (t==PT_WIRE)
+			else
+				s = 0;
+#ifdef REALISTIC
+			pt = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
+			for (j=0; j<8; j++)
 			{
-				//wire_placed = 1;
+				parts[surround_hconduct[j]].temp = pt;
 			}
-			//spark updates from walls
-			if ((elements[t].Properties&PROP_CONDUCTS) || t==PT_SPRK)
+#endif
+			if (s) // particle type change occurred
 			{
-				nx = x % CELL;
-				if (nx == 0)
-					nx = x/CELL - 1;
-				else if (nx == CELL-1)
-					nx = x/CELL + 1;
-				else
-					nx = x/CELL;
-				ny = y % CELL;
-				if (ny == 0)
-					ny = y/CELL - 1;
-				else if (ny == CELL-1)
-					ny = y/CELL + 1;
-				else
-					ny = y/CELL;
-				if (nx>=0 && ny>=0 && nx<XRES/CELL && ny<YRES/CELL)
+				if (t==PT_ICEI || t==PT_LAVA || t==PT_SNOW)
+					parts[i].ctype = parts[i].type;
+				if (!(t==PT_ICEI && parts[i].ctype==PT_FRZW))
+					parts[i].life = 0;
+				if (t == PT_FIRE)
 				{
-					if (t!=PT_SPRK)
-					{
-						if (emap[ny][nx]==12 && !parts[i].life && bmap[ny][nx] != WL_STASIS)
-						{
-							part_change_type(i,x,y,PT_SPRK);
-							parts[i].life = 4;
-							parts[i].ctype = t;
-							t = PT_SPRK;
-						}
-					}
-					else if (bmap[ny][nx]==WL_DETECT || bmap[ny][nx]==WL_EWALL || bmap[ny][nx]==WL_ALLOWLIQUID || bmap[ny][nx]==WL_WALLELEC || bmap[ny][nx]==WL_ALLOWALLELEC || bmap[ny][nx]==WL_EHOLE)
-						set_emap(nx, ny);
-				}
-			}
-
-			//the basic explosion, from the .explosive variable
-			if ((elements[t].Explosive&2) && pv[y/CELL][x/CELL]>2.5f)
-			{
-				parts[i].life = RNG::Ref().between(180, 259);
-				parts[i].temp = restrict_flt(elements[PT_FIRE].DefaultProperties.temp + (elements[t].Flammable/2), MIN_TEMP, MAX_TEMP);
-				t = PT_FIRE;
-				part_change_type(i,x,y,t);
-				pv[y/CELL][x/CELL] += 0.25f * CFDS;
-			}
-
-
-			s = 1;
-			gravtot = fabs(gravy[(y/CELL)*(XRES/CELL)+(x/CELL)])+fabs(gravx[(y/CELL)*(XRES/CELL)+(x/CELL)]);
-			if (elements[t].HighPressureTransition>-1 && pv[y/CELL][x/CELL]>elements[t].HighPressure) {
-				// particle type change due to high pressure
-				if (elements[t].HighPressureTransition!=PT_NUM)
-					t = elements[t].HighPressureTransition;
-				else if (t==PT_BMTL) {
-					if (pv[y/CELL][x/CELL]>2.5f)
-						t = PT_BRMT;
-					else if (pv[y/CELL][x/CELL]>1.0f && parts[i].tmp==1)
-						t = PT_BRMT;
-					else s = 0;
+					//hackish, if tmp isn't 0 the FIRE might turn into DSTW later
+					//idealy transitions should use create_part(i) but some elements rely on properties staying constant
+					//and I don't feel like checking each one right now
+					parts[i].tmp = 0;
 				}
-				else s = 0;
-			} else if (elements[t].LowPressureTransition>-1 && pv[y/CELL][x/CELL]<elements[t].LowPressure && gravtot<=(elements[t].LowPressure/4.0f)) {
-				// particle type change due to low pressure
-				if (elements[t].LowPressureTransition!=PT_NUM)
-					t = elements[t].LowPressureTransition;
-				else s = 0;
-			} else if (elements[t].HighPressureTransition>-1 && gravtot>(elements[t].HighPressure/4.0f)) {
-				// particle type change due to high gravity
-				if (elements[t].HighPressureTransition!=PT_NUM)
-					t = elements[t].HighPressureTransition;
-				else if (t==PT_BMTL) {
-					if (gravtot>0.625f)
-						t = PT_BRMT;
-					else if (gravtot>0.25f && parts[i].tmp==1)
-						t = PT_BRMT;
-					else s = 0;
-				}
-				else s = 0;
-			} else s = 0;
+				if ((elements[t].Properties&TYPE_GAS) && !(elements[parts[i].type].Properties&TYPE_GAS))
+					pv[y/CELL][x/CELL] += 0.50f;
 
-			// particle type change occurred
-			if (s)
-			{
 				if (t == PT_NONE)
 				{
 					kill_part(i);
 					goto killed;
 				}
-				parts[i].life = 0;
 				// part_change_type could refuse to change the type and kill the particle
 				// for example, changing type to STKM but one already exists
 				// we need to account for that to not cause simulation corruption issues
 				if (part_change_type(i,x,y,t))
 					goto killed;
-				if (t == PT_FIRE)
+
+				if (t==PT_FIRE || t==PT_PLSM || t==PT_CFLM)
 					parts[i].life = RNG::Ref().between(120, 169);
+				if (t == PT_LAVA)
+				{
+					if (parts[i].ctype == PT_BRMT) parts[i].ctype = PT_BMTL;
+					else if (parts[i].ctype == PT_SAND) parts[i].ctype = PT_GLAS;
+					else if (parts[i].ctype == PT_BGLA) parts[i].ctype = PT_GLAS;
+					else if (parts[i].ctype == PT_PQRT) parts[i].ctype = PT_QRTZ;
+					else if (parts[i].ctype == PT_LITH && parts[i].tmp2 > 3) parts[i].ctype = PT_GLAS;
+					parts[i].life = RNG::Ref().between(240, 359);
+				}
 				transitionOccurred = true;
 			}
 
-			//call the particle update function, if there is one
-			if (elements[t].Update)
+			pt = parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
+			if (t == PT_LAVA)
 			{
-				if ((*(elements[t].Update))(this, i, x, y, surround_space, nt, parts, pmap))
-					continue;
-				x = (int)(parts[i].x+0.5f);
-				y = (int)(parts[i].y+0.5f);
+				parts[i].life = int(restrict_flt((parts[i].temp-700)/7, 0, 400));
+				if (parts[i].ctype==PT_THRM&&parts[i].tmp>0)
+				{
+					parts[i].tmp--;
+					parts[i].temp = 3500;
+				}
+				if (parts[i].ctype==PT_PLUT&&parts[i].tmp>0)
+				{
+					parts[i].tmp--;
+					parts[i].temp = MAX_TEMP;
+				}
 			}
+		}
+		else
+		{
+			if (!(air->bmap_blockairh[y/CELL][x/CELL]&0x8))
+				air->bmap_blockairh[y/CELL][x/CELL]++;
+			parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
+		}
+	}
 
-			if(legacy_enable)//if heat sim is off
-				Element::legacyUpdate(this, i,x,y,surround_space,nt, parts, pmap);
+	if (t==PT_LIFE)
+	{
+		parts[i].temp = restrict_flt(parts[i].temp-50.0f, MIN_TEMP, MAX_TEMP);
+	}
+	if (t==PT_WIRE)
+	{
+		//wire_placed = 1;
+	}
+	//spark updates from walls
+	if ((elements[t].Properties&PROP_CONDUCTS) || t==PT_SPRK)
+	{
+		nx = x % CELL;
+		if (nx == 0)
+			nx = x/CELL - 1;
+		else if (nx == CELL-1)
+			nx = x/CELL + 1;
+		else
+			nx = x/CELL;
+		ny = y % CELL;
+		if (ny == 0)
+			ny = y/CELL - 1;
+		else if (ny == CELL-1)
+			ny = y/CELL + 1;
+		else
+			ny = y/CELL;
+		if (nx>=0 && ny>=0 && nx<XRES/CELL && ny<YRES/CELL)
+		{
+			if (t!=PT_SPRK)
+			{
+				if (emap[ny][nx]==12 && !parts[i].life && bmap[ny][nx] != WL_STASIS)
+				{
+					part_change_type(i,x,y,PT_SPRK);
+					parts[i].life = 4;
+					parts[i].ctype = t;
+					t = PT_SPRK;
+				}
+			}
+			else if (bmap[ny][nx]==WL_DETECT || bmap[ny][nx]==WL_EWALL || bmap[ny][nx]==WL_ALLOWLIQUID || bmap[ny][nx]==WL_WALLELEC || bmap[ny][nx]==WL_ALLOWALLELEC || bmap[ny][nx]==WL_EHOLE)
+				set_emap(nx, ny);
+		}
+	}
+
+	//the basic explosion, from the .explosive variable
+	if ((elements[t].Explosive&2) && pv[y/CELL][x/CELL]>2.5f)
+	{
+		parts[i].life = RNG::Ref().between(180, 259);
+		parts[i].temp = restrict_flt(elements[PT_FIRE].DefaultProperties.temp + (elements[t].Flammable/2), MIN_TEMP, MAX_TEMP);
+		t = PT_FIRE;
+		part_change_type(i,x,y,t);
+		pv[y/CELL][x/CELL] += 0.25f * CFDS;
+	}
+
+
+	s = 1;
+	gravtot = fabs(gravy[(y/CELL)*(XRES/CELL)+(x/CELL)])+fabs(gravx[(y/CELL)*(XRES/CELL)+(x/CELL)]);
+	if (elements[t].HighPressureTransition>-1 && pv[y/CELL][x/CELL]>elements[t].HighPressure) {
+		// particle type change due to high pressure
+		if (elements[t].HighPressureTransition!=PT_NUM)
+			t = elements[t].HighPressureTransition;
+		else if (t==PT_BMTL) {
+			if (pv[y/CELL][x/CELL]>2.5f)
+				t = PT_BRMT;
+			else if (pv[y/CELL][x/CELL]>1.0f && parts[i].tmp==1)
+				t = PT_BRMT;
+			else s = 0;
+		}
+		else s = 0;
+	} else if (elements[t].LowPressureTransition>-1 && pv[y/CELL][x/CELL]<elements[t].LowPressure && gravtot<=(elements[t].LowPressure/4.0f)) {
+		// particle type change due to low pressure
+		if (elements[t].LowPressureTransition!=PT_NUM)
+			t = elements[t].LowPressureTransition;
+		else s = 0;
+	} else if (elements[t].HighPressureTransition>-1 && gravtot>(elements[t].HighPressure/4.0f)) {
+		// particle type change due to high gravity
+		if (elements[t].HighPressureTransition!=PT_NUM)
+			t = elements[t].HighPressureTransition;
+		else if (t==PT_BMTL) {
+			if (gravtot>0.625f)
+				t = PT_BRMT;
+			else if (gravtot>0.25f && parts[i].tmp==1)
+				t = PT_BRMT;
+			else s = 0;
+		}
+		else s = 0;
+	} else s = 0;
+
+	// particle type change occurred
+	if (s)
+	{
+		if (t == PT_NONE)
+		{
+			kill_part(i);
+			goto killed;
+		}
+		parts[i].life = 0;
+		// part_change_type could refuse to change the type and kill the particle
+		// for example, changing type to STKM but one already exists
+		// we need to account for that to not cause simulation corruption issues
+		if (part_change_type(i,x,y,t))
+			goto killed;
+		if (t == PT_FIRE)
+			parts[i].life = RNG::Ref().between(120, 169);
+		transitionOccurred = true;
+	}
+
+	if (tile && !tileLocalType[t])
+	{
+		tile->deferred.push_back({ i, DeferredParticle::stageUpdate, surround_space, nt, pGravX, pGravY, transitionOccurred });
+		return;
+	}
+
+update:
+	//call the particle update function, if there is one
+	if (elements[t].Update)
+	{
+		int updateResult;
+		if (tile ? tile->elementCosts.size() : elementTiming)
+		{
+			auto start = std::chrono::steady_clock::now();
+			updateResult = (*(elements[t].Update))(this, i, x, y, surround_space, nt, parts, pmap);
+			auto &cost = tile ? tile->elementCosts[t] : elementCosts[t];
+			cost.calls++;
+			cost.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		else
+			updateResult = (*(elements[t].Update))(this, i, x, y, surround_space, nt, parts, pmap);
+		if (updateResult)
+			return;
+		x = (int)(parts[i].x+0.5f);
+		y = (int)(parts[i].y+0.5f);
+	}
+
+	if(legacy_enable)//if heat sim is off
+		Element::legacyUpdate(this, i,x,y,surround_space,nt, parts, pmap);
 
 killed:
-			if (parts[i].type == PT_NONE)//if its dead, skip to next particle
-				continue;
+	if (parts[i].type == PT_NONE)//if its dead, skip to next particle
+		return;
 
-			if (transitionOccurred)
-				continue;
+	if (transitionOccurred)
+		return;
 
-			if (!parts[i].vx&&!parts[i].vy)//if its not moving, skip to next particle, movement code it next
-				continue;
+	if (!parts[i].vx&&!parts[i].vy)//if its not moving, skip to next particle, movement code it next
+		return;
 
-			mv = fmaxf(fabsf(parts[i].vx), fabsf(parts[i].vy));
-			if (mv < ISTP)
+	if (tile)
+	{
+		// don't let the movement code reach into the area of another tile that is being updated at the same time
+		float reach = fmaxf(fabsf(parts[i].vx), fabsf(parts[i].vy)) + 2.0f;
+		if (elements[t].Falldown > 1)
+		{
+			float liquidReach = (t == PT_GEL) ? std::max(30.0f, parts[i].tmp*0.20f+5.0f) : 30.0f;
+			reach += (!grav->IsEnabled() && gravityMode == 0) ? liquidReach : liquidReach*4.0f;
+		}
+		if (!(reach < TILE_REACH) || !tile->ContainsReach(x, y, int(reach)))
+		{
+			tile->deferred.push_back({ i, DeferredParticle::stageMove, surround_space, nt, pGravX, pGravY, transitionOccurred });
+			return;
+		}
+	}
+
+	mv = fmaxf(fabsf(parts[i].vx), fabsf(parts[i].vy));
+	if (mv < ISTP)
+	{
+		clear_x = x;
+		clear_y = y;
+		clear_xf = parts[i].x;
+		clear_yf = parts[i].y;
+		fin_xf = clear_xf + parts[i].vx;
+		fin_yf = clear_yf + parts[i].vy;
+		fin_x = (int)(fin_xf+0.5f);
+		fin_y = (int)(fin_yf+0.5f);
+	}
+	else
+	{
+		if (mv > SIM_MAXVELOCITY)
+		{
+			parts[i].vx *= SIM_MAXVELOCITY/mv;
+			parts[i].vy *= SIM_MAXVELOCITY/mv;
+			mv = SIM_MAXVELOCITY;
+		}
+		// interpolate to see if there is anything in the way
+		dx = parts[i].vx*ISTP/mv;
+		dy = parts[i].vy*ISTP/mv;
+		fin_xf = parts[i].x;
+		fin_yf = parts[i].y;
+		fin_x = (int)(fin_xf+0.5f);
+		fin_y = (int)(fin_yf+0.5f);
+		bool closedEholeStart = this->InBounds(fin_x, fin_y) && (bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]);
+		while (1)
+		{
+			mv -= ISTP;
+			fin_xf += dx;
+			fin_yf += dy;
+			fin_x = (int)(fin_xf+0.5f);
+			fin_y = (int)(fin_yf+0.5f);
+			if (edgeMode == 2)
 			{
-				clear_x = x;
-				clear_y = y;
-				clear_xf = parts[i].x;
-				clear_yf = parts[i].y;
-				fin_xf = clear_xf + parts[i].vx;
-				fin_yf = clear_yf + parts[i].vy;
+				bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
+				bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
+				if (!x_ok)
+					fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
+				if (!y_ok)
+					fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
 				fin_x = (int)(fin_xf+0.5f);
 				fin_y = (int)(fin_yf+0.5f);
 			}
-			else
+			if (mv <= 0.0f)
 			{
-				if (mv > SIM_MAXVELOCITY)
+				// nothing found
+				fin_xf = parts[i].x + parts[i].vx;
+				fin_yf = parts[i].y + parts[i].vy;
+				if (edgeMode == 2)
 				{
-					parts[i].vx *= SIM_MAXVELOCITY/mv;
-					parts[i].vy *= SIM_MAXVELOCITY/mv;
-					mv = SIM_MAXVELOCITY;
+					bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
+					bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
+					if (!x_ok)
+						fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
+					if (!y_ok)
+						fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
 				}
-				// interpolate to see if there is anything in the way
-				dx = parts[i].vx*ISTP/mv;
-				dy = parts[i].vy*ISTP/mv;
-				fin_xf = parts[i].x;
-				fin_yf = parts[i].y;
 				fin_x = (int)(fin_xf+0.5f);
 				fin_y = (int)(fin_yf+0.5f);
-				bool closedEholeStart = this->InBounds(fin_x, fin_y) && (bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]);
-				while (1)
-				{
-					mv -= ISTP;
-					fin_xf += dx;
-					fin_yf += dy;
-					fin_x = (int)(fin_xf+0.5f);
-					fin_y = (int)(fin_yf+0.5f);
-					if (edgeMode == 2)
-					{
-						bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
-						bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
-						if (!x_ok)
-							fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
-						if (!y_ok)
-							fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
-						fin_x = (int)(fin_xf+0.5f);
-						fin_y = (int)(fin_yf+0.5f);
-					}
-					if (mv <= 0.0f)
-					{
-						// nothing found
-						fin_xf = parts[i].x + parts[i].vx;
-						fin_yf = parts[i].y + parts[i].vy;
-						if (edgeMode == 2)
-						{
-							bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
-							bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
-							if (!x_ok)
-								fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
-							if (!y_ok)
-								fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
-						}
-						fin_x = (int)(fin_xf+0.5f);
-						fin_y = (int)(fin_yf+0.5f);
-						clear_xf = fin_xf-dx;
-						clear_yf = fin_yf-dy;
-						clear_x = (int)(clear_xf+0.5f);
-						clear_y = (int)(clear_yf+0.5f);
-						break;
-					}
-					//block if particle can't move (0), or some special cases where it returns 1 (can_move = 3 but returns 1 meaning particle will be eaten)
-					//also photons are still blocked (slowed down) by any particle (even ones it can move through), and absorb wall also blocks particles
-					int eval = eval_move(t, fin_x, fin_y, NULL);
-					if (!eval || (can_move[t][TYP(pmap[fin_y][fin_x])] == 3 && eval == 1) || (t == PT_PHOT && pmap[fin_y][fin_x]) || bmap[fin_y/CELL][fin_x/CELL]==WL_DESTROYALL || closedEholeStart!=(bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]))
-					{
-						// found an obstacle
-						clear_xf = fin_xf-dx;
-						clear_yf = fin_yf-dy;
-						clear_x = (int)(clear_xf+0.5f);
-						clear_y = (int)(clear_yf+0.5f);
-						break;
-					}
-					if (bmap[fin_y/CELL][fin_x/CELL]==WL_DETECT && emap[fin_y/CELL][fin_x/CELL]<8)
-						set_emap(fin_x/CELL, fin_y/CELL);
-				}
+				clear_xf = fin_xf-dx;
+				clear_yf = fin_yf-dy;
+				clear_x = (int)(clear_xf+0.5f);
+				clear_y = (int)(clear_yf+0.5f);
+				break;
 			}
+			//block if particle can't move (0), or some special cases where it returns 1 (can_move = 3 but returns 1 meaning particle will be eaten)
+			//also photons are still blocked (slowed down) by any particle (even ones it can move through), and absorb wall also blocks particles
+			int eval = eval_move(t, fin_x, fin_y, NULL);
+			if (!eval || (can_move[t][TYP(pmap[fin_y][fin_x])] == 3 && eval == 1) || (t == PT_PHOT && pmap[fin_y][fin_x]) || bmap[fin_y/CELL][fin_x/CELL]==WL_DESTROYALL || closedEholeStart!=(bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]))
+			{
+				// found an obstacle
+				clear_xf = fin_xf-dx;
+				clear_yf = fin_yf-dy;
+				clear_x = (int)(clear_xf+0.5f);
+				clear_y = (int)(clear_yf+0.5f);
+				break;
+			}
+			if (bmap[fin_y/CELL][fin_x/CELL]==WL_DETECT && emap[fin_y/CELL][fin_x/CELL]<8)
+				set_emap(fin_x/CELL, fin_y/CELL);
+		}
+	}
 
-			stagnant = parts[i].flags & FLAG_STAGNANT;
-			parts[i].flags &= ~FLAG_STAGNANT;
+	stagnant = parts[i].flags & FLAG_STAGNANT;
+	parts[i].flags &= ~FLAG_STAGNANT;
 
-			if (t==PT_STKM || t==PT_STKM2 || t==PT_FIGH)
+	if (t==PT_STKM || t==PT_STKM2 || t==PT_FIGH)
+	{
+		//head movement, let head pass through anything
+		parts[i].x += parts[i].vx;
+		parts[i].y += parts[i].vy;
+		int nx = (int)((float)parts[i].x+0.5f);
+		int ny = (int)((float)parts[i].y+0.5f);
+		if (edgeMode == 2)
+		{
+			bool x_ok = (nx >= CELL && nx < XRES-CELL);
+			bool y_ok = (ny >= CELL && ny < YRES-CELL);
+			int oldnx = nx, oldny = ny;
+			if (!x_ok)
 			{
-				//head movement, let head pass through anything
-				parts[i].x += parts[i].vx;
-				parts[i].y += parts[i].vy;
-				int nx = (int)((float)parts[i].x+0.5f);
-				int ny = (int)((float)parts[i].y+0.5f);
-				if (edgeMode == 2)
-				{
-					bool x_ok = (nx >= CELL && nx < XRES-CELL);
-					bool y_ok = (ny >= CELL && ny < YRES-CELL);
-					int oldnx = nx, oldny = ny;
-					if (!x_ok)
-					{
-						parts[i].x = remainder_p(parts[i].x-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
-						nx = (int)((float)parts[i].x+0.5f);
-					}
-					if (!y_ok)
-					{
-						parts[i].y = remainder_p(parts[i].y-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
-						ny = (int)((float)parts[i].y+0.5f);
-					}
+				parts[i].x = remainder_p(parts[i].x-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
+				nx = (int)((float)parts[i].x+0.5f);
+			}
+			if (!y_ok)
+			{
+				parts[i].y = remainder_p(parts[i].y-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
+				ny = (int)((float)parts[i].y+0.5f);
+			}
 
-					if (!x_ok || !y_ok) //when moving from left to right stickmen might be able to fall through solid things, fix with "eval_move(t, nx+diffx, ny+diffy, NULL)" but then they die instead
-					{
-						//adjust stickmen legs
-						playerst* stickman = NULL;
-						int t = parts[i].type;
-						if (t == PT_STKM)
-							stickman = &player;
-						else if (t == PT_STKM2)
-							stickman = &player2;
-						else if (t == PT_FIGH && parts[i].tmp >= 0 && parts[i].tmp < MAX_FIGHTERS)
-							stickman = &fighters[parts[i].tmp];
-
-						if (stickman)
-							for (int i = 0; i < 16; i+=2)
-							{
-								stickman->legs[i] += (nx-oldnx);
-								stickman->legs[i+1] += (ny-oldny);
-								stickman->accs[i/2] *= .95f;
-							}
-						parts[i].vy *= .95f;
-						parts[i].vx *= .95f;
-					}
-				}
-				if (ny!=y || nx!=x)
-				{
-					if (ID(pmap[y][x]) == i)
-						pmap[y][x] = 0;
-					else if (ID(photons[y][x]) == i)
-						photons[y][x] = 0;
-					if (nx<CELL || nx>=XRES-CELL || ny<CELL || ny>=YRES-CELL)
+			if (!x_ok || !y_ok) //when moving from left to right stickmen might be able to fall through solid things, fix with "eval_move(t, nx+diffx, ny+diffy, NULL)" but then they die instead
+			{
+				//adjust stickmen legs
+				playerst* stickman = NULL;
+				int t = parts[i].type;
+				if (t == PT_STKM)
+					stickman = &player;
+				else if (t == PT_STKM2)
+					stickman = &player2;
+				else if (t == PT_FIGH && parts[i].tmp >= 0 && parts[i].tmp < MAX_FIGHTERS)
+					stickman = &fighters[parts[i].tmp];
+
+				if (stickman)
+					for (int i = 0; i < 16; i+=2)
 					{
-						kill_part(i);
-						continue;
+						stickman->legs[i] += (nx-oldnx);
+						stickman->legs[i+1] += (ny-oldny);
+						stickman->accs[i/2] *= .95f;
 					}
-					if (elements[t].Properties & TYPE_ENERGY)
-						photons[ny][nx] = PMAP(i, t);
-					else if (t)
-						pmap[ny][nx] = PMAP(i, t);
-				}
+				parts[i].vy *= .95f;
+				parts[i].vx *= .95f;
 			}
-			else if (elements[t].Properties & TYPE_ENERGY)
+		}
+		PartMoved(i);
+		if (ny!=y || nx!=x)
+		{
+			if (ID(pmap[y][x]) == i)
+				pmap[y][x] = 0;
+			else if (ID(photons[y][x]) == i)
+				photons[y][x] = 0;
+			if (nx<CELL || nx>=XRES-CELL || ny<CELL || ny>=YRES-CELL)
 			{
-				if (t == PT_PHOT)
-				{
-					if (parts[i].flags&FLAG_SKIPMOVE)
-					{
-						parts[i].flags &= ~FLAG_SKIPMOVE;
-						continue;
-					}
-
-					if (eval_move(PT_PHOT, fin_x, fin_y, NULL))
-					{
-						int rt = TYP(pmap[fin_y][fin_x]);
-						int lt = TYP(pmap[y][x]);
-						int rt_glas = (rt == PT_GLAS) || (rt == PT_BGLA);
-						int lt_glas = (lt == PT_GLAS) || (lt == PT_BGLA);
-						if ((rt_glas && !lt_glas) || (lt_glas && !rt_glas))
-						{
-							if (!get_normal_interp(REFRACT|t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry)) {
-								kill_part(i);
-								continue;
-							}
+				kill_part(i);
+				return;
+			}
+			if (elements[t].Properties & TYPE_ENERGY)
+				photons[ny][nx] = PMAP(i, t);
+			else if (t)
+				pmap[ny][nx] = PMAP(i, t);
+		}
+	}
+	else if (elements[t].Properties & TYPE_ENERGY)
+	{
+		if (t == PT_PHOT)
+		{
+			if (parts[i].flags&FLAG_SKIPMOVE)
+			{
+				parts[i].flags &= ~FLAG_SKIPMOVE;
+				return;
+			}
 
-							r = get_wavelength_bin(&parts[i].ctype);
-							if (r == -1 || !(parts[i].ctype&0x3FFFFFFF))
-							{
-								kill_part(i);
-								continue;
-							}
-							nn = GLASS_IOR - GLASS_DISP*(r-30)/30.0f;
-							nn *= nn;
-							nrx = -nrx;
-							nry = -nry;
-							if (rt_glas && !lt_glas)
-								nn = 1.0f/nn;
-							ct1 = parts[i].vx*nrx + parts[i].vy*nry;
-							ct2 = 1.0f - (nn*nn)*(1.0f-(ct1*ct1));
-							if (ct2 < 0.0f) {
-								// total internal reflection
-								parts[i].vx -= 2.0f*ct1*nrx;
-								parts[i].vy -= 2.0f*ct1*nry;
-								fin_xf = parts[i].x;
-								fin_yf = parts[i].y;
-								fin_x = x;
-								fin_y = y;
-							} else {
-								// refraction
-								ct2 = sqrtf(ct2);
-								ct2 = ct2 - nn*ct1;
-								parts[i].vx = nn*parts[i].vx + ct2*nrx;
-								parts[i].vy = nn*parts[i].vy + ct2*nry;
-							}
-						}
-					}
-				}
-				if (stagnant)//FLAG_STAGNANT set, was reflected on previous frame
-				{
-					// cast coords as int then back to float for compatibility with existing saves
-					if (!do_move(i, x, y, (float)fin_x, (float)fin_y) && parts[i].type) {
-						kill_part(i);
-						continue;
-					}
-				}
-				else if (!do_move(i, x, y, fin_xf, fin_yf))
+			if (eval_move(PT_PHOT, fin_x, fin_y, NULL))
+			{
+				int rt = TYP(pmap[fin_y][fin_x]);
+				int lt = TYP(pmap[y][x]);
+				int rt_glas = (rt == PT_GLAS) || (rt == PT_BGLA);
+				int lt_glas = (lt == PT_GLAS) || (lt == PT_BGLA);
+				if ((rt_glas && !lt_glas) || (lt_glas && !rt_glas))
 				{
-					if (parts[i].type == PT_NONE)
-						continue;
-					// reflection
-					parts[i].flags |= FLAG_STAGNANT;
-					if (t==PT_NEUT && RNG::Ref().chance(1, 10))
-					{
+					if (!get_normal_interp(REFRACT|t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry)) {
 						kill_part(i);
-						continue;
+						return;
 					}
-					r = pmap[fin_y][fin_x];
 
-					if ((TYP(r)==PT_PIPE || TYP(r) == PT_PPIP) && !TYP(parts[ID(r)].ctype))
+					r = get_wavelength_bin(&parts[i].ctype);
+					if (r == -1 || !(parts[i].ctype&0x3FFFFFFF))
 					{
-						parts[ID(r)].ctype =  parts[i].type;
-						parts[ID(r)].temp = parts[i].temp;
-						parts[ID(r)].tmp2 = parts[i].life;
-						parts[ID(r)].tmp3 = parts[i].tmp;
-						parts[ID(r)].tmp4 = parts[i].ctype;
 						kill_part(i);
-						continue;
-					}
-
-					if (t == PT_PHOT)
-					{
-						auto mask = elements[TYP(r)].PhotonReflectWavelengths;
-						if (TYP(r) == PT_LITH)
-						{
-							int wl_bin = parts[ID(r)].ctype / 4;
-							if (wl_bin < 0) wl_bin = 0;
-							if (wl_bin > 25) wl_bin = 25;
-							mask = (0x1F << wl_bin);
-						}
-						parts[i].ctype &= mask;
-					}
-
-					if (get_normal_interp(t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry))
-					{
-						if (TYP(r) == PT_CRMC)
-						{
-							float r = RNG::Ref().between(-50, 50) * 0.01f, rx, ry, anrx, anry;
-							r = r * r * r;
-							rx = cosf(r); ry = sinf(r);
-							anrx = rx * nrx + ry * nry;
-							anry = rx * nry - ry * nrx;
-							dp = anrx*parts[i].vx + anry*parts[i].vy;
-							parts[i].vx -= 2.0f*dp*anrx;
-							parts[i].vy -= 2.0f*dp*anry;
-						}
-						else
-						{
-							dp = nrx*parts[i].vx + nry*parts[i].vy;
-							parts[i].vx -= 2.0f*dp*nrx;
-							parts[i].vy -= 2.0f*dp*nry;
-						}
-						// leave the actual movement until next frame so that reflection of fast particles and refraction happen correctly
-					}
-					else
-					{
-						if (t!=PT_NEUT)
-							kill_part(i);
-						continue;
+						return;
 					}
-					if (!(parts[i].ctype&0x3FFFFFFF) && t == PT_PHOT)
-					{
-						kill_part(i);
-						continue;
+					nn = GLASS_IOR - GLASS_DISP*(r-30)/30.0f;
+					nn *= nn;
+					nrx = -nrx;
+					nry = -nry;
+					if (rt_glas && !lt_glas)
+						nn = 1.0f/nn;
+					ct1 = parts[i].vx*nrx + parts[i].vy*nry;
+					ct2 = 1.0f - (nn*nn)*(1.0f-(ct1*ct1));
+					if (ct2 < 0.0f) {
+						// total internal reflection
+						parts[i].vx -= 2.0f*ct1*nrx;
+						parts[i].vy -= 2.0f*ct1*nry;
+						fin_xf = parts[i].x;
+						fin_yf = parts[i].y;
+						fin_x = x;
+						fin_y = y;
+					} else {
+						// refraction
+						ct2 = sqrtf(ct2);
+						ct2 = ct2 - nn*ct1;
+						parts[i].vx = nn*parts[i].vx + ct2*nrx;
+						parts[i].vy = nn*parts[i].vy + ct2*nry;
 					}
 				}
 			}
-			else if (elements[t].Falldown==0)
+		}
+		if (stagnant)//FLAG_STAGNANT set, was reflected on previous frame
+		{
+			// cast coords as int then back to float for compatibility with existing saves
+			if (!do_move(i, x, y, (float)fin_x, (float)fin_y) && parts[i].type) {
+				kill_part(i);
+				return;
+			}
+		}
+		else if (!do_move(i, x, y, fin_xf, fin_yf))
+		{
+			if (parts[i].type == PT_NONE)
+				return;
+			// reflection
+			parts[i].flags |= FLAG_STAGNANT;
+			if (t==PT_NEUT && RNG::Ref().chance(1, 10))
+			{
+				kill_part(i);
+				return;
+			}
+			r = pmap[fin_y][fin_x];
+
+			if ((TYP(r)==PT_PIPE || TYP(r) == PT_PPIP) && !TYP(parts[ID(r)].ctype))
+			{
+				parts[ID(r)].ctype =  parts[i].type;
+				parts[ID(r)].temp = parts[i].temp;
+				parts[ID(r)].tmp2 = parts[i].life;
+				parts[ID(r)].tmp3 = parts[i].tmp;
+				parts[ID(r)].tmp4 = parts[i].ctype;
+				kill_part(i);
+				return;
+			}
+
+			if (t == PT_PHOT)
 			{
-				// gasses and solids (but not powders)
-				if (!do_move(i, x, y, fin_xf, fin_yf))
+				auto mask = elements[TYP(r)].PhotonReflectWavelengths;
+				if (TYP(r) == PT_LITH)
 				{
-					if (parts[i].type == PT_NONE)
-						continue;
-					// can't move there, so bounce off
-					// TODO
-					// TODO: Work out what previous TODO was for
-					if (fin_x>x+ISTP) fin_x=x+ISTP;
-					if (fin_x<x-ISTP) fin_x=x-ISTP;
-					if (fin_y>y+ISTP) fin_y=y+ISTP;
-					if (fin_y<y-ISTP) fin_y=y-ISTP;
-					if (do_move(i, x, y, 0.25f+(float)(2*x-fin_x), 0.25f+fin_y))
-					{
-						parts[i].vx *= elements[t].Collision;
-					}
-					else if (do_move(i, x, y, 0.25f+fin_x, 0.25f+(float)(2*y-fin_y)))
-					{
-						parts[i].vy *= elements[t].Collision;
-					}
-					else
-					{
-						parts[i].vx *= elements[t].Collision;
-						parts[i].vy *= elements[t].Collision;
-					}
+					int wl_bin = parts[ID(r)].ctype / 4;
+					if (wl_bin < 0) wl_bin = 0;
+					if (wl_bin > 25) wl_bin = 25;
+					mask = (0x1F << wl_bin);
 				}
+				parts[i].ctype &= mask;
 			}
-			else
+
+			if (get_normal_interp(t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry))
 			{
-				// Checking stagnant is cool, but then it doesn't update when you change it later.
-				if (water_equal_test && elements[t].Falldown == 2 && RNG::Ref().chance(1, 200))
+				if (TYP(r) == PT_CRMC)
 				{
-					if (flood_water(x, y, i))
-						goto movedone;
+					float r = RNG::Ref().between(-50, 50) * 0.01f, rx, ry, anrx, anry;
+					r = r * r * r;
+					rx = cosf(r); ry = sinf(r);
+					anrx = rx * nrx + ry * nry;
+					anry = rx * nry - ry * nrx;
+					dp = anrx*parts[i].vx + anry*parts[i].vy;
+					parts[i].vx -= 2.0f*dp*anrx;
+					parts[i].vy -= 2.0f*dp*anry;
 				}
-				// liquids and powders
-				if (!do_move(i, x, y, fin_xf, fin_yf))
+				else
 				{
-					if (parts[i].type == PT_NONE)
-						continue;
-					if (fin_x!=x && do_move(i, x, y, fin_xf, clear_yf))
+					dp = nrx*parts[i].vx + nry*parts[i].vy;
+					parts[i].vx -= 2.0f*dp*nrx;
+					parts[i].vy -= 2.0f*dp*nry;
+				}
+				// leave the actual movement until next frame so that reflection of fast particles and refraction happen correctly
+			}
+			else
+			{
+				if (t!=PT_NEUT)
+					kill_part(i);
+				return;
+			}
+			if (!(parts[i].ctype&0x3FFFFFFF) && t == PT_PHOT)
+			{
+				kill_part(i);
+				return;
+			}
+		}
+	}
+	else if (elements[t].Falldown==0)
+	{
+		// gasses and solids (but not powders)
+		if (!do_move(i, x, y, fin_xf, fin_yf))
+		{
+			if (parts[i].type == PT_NONE)
+				return;
+			// can't move there, so bounce off
+			// TODO
+			// TODO: Work out what previous TODO was for
+			if (fin_x>x+ISTP) fin_x=x+ISTP;
+			if (fin_x<x-ISTP) fin_x=x-ISTP;
+			if (fin_y>y+ISTP) fin_y=y+ISTP;
+			if (fin_y<y-ISTP) fin_y=y-ISTP;
+			if (do_move(i, x, y, 0.25f+(float)(2*x-fin_x), 0.25f+fin_y))
+			{
+				parts[i].vx *= elements[t].Collision;
+			}
+			else if (do_move(i, x, y, 0.25f+fin_x, 0.25f+(float)(2*y-fin_y)))
+			{
+				parts[i].vy *= elements[t].Collision;
+			}
+			else
+			{
+				parts[i].vx *= elements[t].Collision;
+				parts[i].vy *= elements[t].Collision;
+			}
+		}
+	}
+	else
+	{
+		// Checking stagnant is cool, but then it doesn't update when you change it later.
+		if (water_equal_test && elements[t].Falldown == 2 && RNG::Ref().chance(1, 200))
+		{
+			if (flood_water(x, y, i))
+				goto movedone;
+		}
+		// liquids and powders
+		if (!do_move(i, x, y, fin_xf, fin_yf))
+		{
+			if (parts[i].type == PT_NONE)
+				return;
+			if (fin_x!=x && do_move(i, x, y, fin_xf, clear_yf))
+			{
+				parts[i].vx *= elements[t].Collision;
+				parts[i].vy *= elements[t].Collision;
+			}
+			else if (fin_y!=y && do_move(i, x, y, clear_xf, fin_yf))
+			{
+				parts[i].vx *= elements[t].Collision;
+				parts[i].vy *= elements[t].Collision;
+			}
+			else
+			{
+				s = 1;
+				r = RNG::Ref().between(0, 1) * 2 - 1;// position search direction (left/right first)
+				if ((clear_x!=x || clear_y!=y || nt || surround_space) &&
+					(fabsf(parts[i].vx)>0.01f || fabsf(parts[i].vy)>0.01f))
+				{
+					// allow diagonal movement if target position is blocked
+					// but no point trying this if particle is stuck in a block of identical particles
+					dx = parts[i].vx - parts[i].vy*r;
+					dy = parts[i].vy + parts[i].vx*r;
+					if (fabsf(dy)>fabsf(dx))
+						mv = fabsf(dy);
+					else
+						mv = fabsf(dx);
+					dx /= mv;
+					dy /= mv;
+					if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
 					{
 						parts[i].vx *= elements[t].Collision;
 						parts[i].vy *= elements[t].Collision;
+						goto movedone;
 					}
-					else if (fin_y!=y && do_move(i, x, y, clear_xf, fin_yf))
+					swappage = dx;
+					dx = dy*r;
+					dy = -swappage*r;
+					if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
 					{
 						parts[i].vx *= elements[t].Collision;
 						parts[i].vy *= elements[t].Collision;
+						goto movedone;
 					}
+				}
+				if (elements[t].Falldown>1 && !grav->IsEnabled() && gravityMode==0 && parts[i].vy>fabsf(parts[i].vx))
+				{
+					s = 0;
+					// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
+					if (!stagnant || nt) //nt is if there is an something else besides the current particle type, around the particle
+						rt = 30;//slight less water lag, although it changes how it moves a lot
 					else
+						rt = 10;
+
+					if (t==PT_GEL)
+						rt = int(parts[i].tmp*0.20f+5.0f);
+
+					for (j=clear_x+r; j>=0 && j>=clear_x-rt && j<clear_x+rt && j<XRES; j+=r)
+					{
+						if ((TYP(pmap[fin_y][j])!=t || bmap[fin_y/CELL][j/CELL])
+							&& (s=do_move(i, x, y, (float)j, fin_yf)))
+						{
+							nx = (int)(parts[i].x+0.5f);
+							ny = (int)(parts[i].y+0.5f);
+							break;
+						}
+						if (fin_y!=clear_y && (TYP(pmap[clear_y][j])!=t || bmap[clear_y/CELL][j/CELL])
+							&& (s=do_move(i, x, y, (float)j, clear_yf)))
+						{
+							nx = (int)(parts[i].x+0.5f);
+							ny = (int)(parts[i].y+0.5f);
+							break;
+						}
+						if (TYP(pmap[clear_y][j])!=t || (bmap[clear_y/CELL][j/CELL] && bmap[clear_y/CELL][j/CELL]!=WL_STREAM))
+							break;
+					}
+					if (parts[i].vy>0)
+						r = 1;
+					else
+						r = -1;
+					if (s==1)
+						for (j=ny+r; j>=0 && j<YRES && j>=ny-rt && j<ny+rt; j+=r)
+						{
+							if ((TYP(pmap[j][nx])!=t || bmap[j/CELL][nx/CELL]) && do_move(i, nx, ny, (float)nx, (float)j))
+								break;
+							if (TYP(pmap[j][nx])!=t || (bmap[j/CELL][nx/CELL] && bmap[j/CELL][nx/CELL]!=WL_STREAM))
+								break;
+						}
+					else if (s==-1) {} // particle is out of bounds
+					else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
+					else parts[i].flags |= FLAG_STAGNANT;
+					parts[i].vx *= elements[t].Collision;
+					parts[i].vy *= elements[t].Collision;
+				}
+				else if (elements[t].Falldown>1 && fabsf(pGravX*parts[i].vx+pGravY*parts[i].vy)>fabsf(pGravY*parts[i].vx-pGravX*parts[i].vy))
+				{
+					float nxf, nyf, prev_pGravX, prev_pGravY, ptGrav = elements[t].Gravity;
+					s = 0;
+					// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
+					if (!stagnant || nt) //nt is if there is an something else besides the current particle type, around the particle
+						rt = 30;//slight less water lag, although it changes how it moves a lot
+					else
+						rt = 10;
+					// clear_xf, clear_yf is the last known position that the particle should almost certainly be able to move to
+					nxf = clear_xf;
+					nyf = clear_yf;
+					nx = clear_x;
+					ny = clear_y;
+					// Look for spaces to move horizontally (perpendicular to gravity direction), keep going until a space is found or the number of positions examined = rt
+					for (j=0;j<rt;j++)
 					{
-						s = 1;
-						r = RNG::Ref().between(0, 1) * 2 - 1;// position search direction (left/right first)
-						if ((clear_x!=x || clear_y!=y || nt || surround_space) &&
-							(fabsf(parts[i].vx)>0.01f || fabsf(parts[i].vy)>0.01f))
+						// Calculate overall gravity direction
+						switch (gravityMode)
+						{
+							default:
+							case 0:
+								pGravX = 0.0f;
+								pGravY = ptGrav;
+								break;
+							case 1:
+								pGravX = pGravY = 0.0f;
+								break;
+							case 2:
+								pGravD = 0.01f - hypotf(float(nx - XCNTR), float(ny - YCNTR));
+								pGravX = ptGrav * ((float)(nx - XCNTR) / pGravD);
+								pGravY = ptGrav * ((float)(ny - YCNTR) / pGravD);
+								break;
+						}
+						pGravX += gravx[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
+						pGravY += gravy[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
+						// Scale gravity vector so that the largest component is 1 pixel
+						if (fabsf(pGravY)>fabsf(pGravX))
+							mv = fabsf(pGravY);
+						else
+							mv = fabsf(pGravX);
+						if (mv<0.0001f) break;
+						pGravX /= mv;
+						pGravY /= mv;
+						// Move 1 pixel perpendicularly to gravity
+						// r is +1/-1, to try moving left or right at random
+						if (j)
+						{
+							// Not quite the gravity direction
+							// Gravity direction + last change in gravity direction
+							// This makes liquid movement a bit less frothy, particularly for balls of liquid in radial gravity. With radial gravity, instead of just moving along a tangent, the attempted movement will follow the curvature a bit better.
+							nxf += r*(pGravY*2.0f-prev_pGravY);
+							nyf += -r*(pGravX*2.0f-prev_pGravX);
+						}
+						else
+						{
+							nxf += r*pGravY;
+							nyf += -r*pGravX;
+						}
+						prev_pGravX = pGravX;
+						prev_pGravY = pGravY;
+						// Check whether movement is allowed
+						nx = (int)(nxf+0.5f);
+						ny = (int)(nyf+0.5f);
+						if (nx<0 || ny<0 || nx>=XRES || ny >=YRES)
+							break;
+						if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
 						{
-							// allow diagonal movement if target position is blocked
-							// but no point trying this if particle is stuck in a block of identical particles
-							dx = parts[i].vx - parts[i].vy*r;
-							dy = parts[i].vy + parts[i].vx*r;
-							if (fabsf(dy)>fabsf(dx))
-								mv = fabsf(dy);
-							else
-								mv = fabsf(dx);
-							dx /= mv;
-							dy /= mv;
-							if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
-							{
-								parts[i].vx *= elements[t].Collision;
-								parts[i].vy *= elements[t].Collision;
-								goto movedone;
-							}
-							swappage = dx;
-							dx = dy*r;
-							dy = -swappage*r;
-							if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
+							s = do_move(i, x, y, nxf, nyf);
+							if (s)
 							{
-								parts[i].vx *= elements[t].Collision;
-								parts[i].vy *= elements[t].Collision;
-								goto movedone;
+								// Movement was successful
+								nx = (int)(parts[i].x+0.5f);
+								ny = (int)(parts[i].y+0.5f);
+								break;
 							}
+							// A particle of a different type, or a wall, was found. Stop trying to move any further horizontally unless the wall should be completely invisible to particles.
+							if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
+								break;
 						}
-						if (elements[t].Falldown>1 && !grav->IsEnabled() && gravityMode==0 && parts[i].vy>fabsf(parts[i].vx))
+					}
+					if (s==1)
+					{
+						// The particle managed to move horizontally, now try to move vertically (parallel to gravity direction)
+						// Keep going until the particle is blocked (by something that isn't the same element) or the number of positions examined = rt
+						clear_x = nx;
+						clear_y = ny;
+						for (j=0;j<rt;j++)
 						{
-							s = 0;
-							// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
-							if (!stagnant || nt) //nt is if there is an something else besides the current particle type, around the particle
-								rt = 30;//slight less water lag, although it changes how it moves a lot
-							else
-								rt = 10;
-
-							if (t==PT_GEL)
-								rt = int(parts[i].tmp*0.20f+5.0f);
-
-							for (j=clear_x+r; j>=0 && j>=clear_x-rt && j<clear_x+rt && j<XRES; j+=r)
+							// Calculate overall gravity direction
+							switch (gravityMode)
 							{
-								if ((TYP(pmap[fin_y][j])!=t || bmap[fin_y/CELL][j/CELL])
-									&& (s=do_move(i, x, y, (float)j, fin_yf)))
-								{
-									nx = (int)(parts[i].x+0.5f);
-									ny = (int)(parts[i].y+0.5f);
+								default:
+								case 0:
+									pGravX = 0.0f;
+									pGravY = ptGrav;
 									break;
-								}
-								if (fin_y!=clear_y && (TYP(pmap[clear_y][j])!=t || bmap[clear_y/CELL][j/CELL])
-									&& (s=do_move(i, x, y, (float)j, clear_yf)))
-								{
-									nx = (int)(parts[i].x+0.5f);
-									ny = (int)(parts[i].y+0.5f);
+								case 1:
+									pGravX = pGravY = 0.0f;
 									break;
-								}
-								if (TYP(pmap[clear_y][j])!=t || (bmap[clear_y/CELL][j/CELL] && bmap[clear_y/CELL][j/CELL]!=WL_STREAM))
+								case 2:
+									pGravD = 0.01f - hypotf(float(nx - XCNTR), float(ny - YCNTR));
+									pGravX = ptGrav * ((float)(nx - XCNTR) / pGravD);
+									pGravY = ptGrav * ((float)(ny - YCNTR) / pGravD);
 									break;
 							}
-							if (parts[i].vy>0)
-								r = 1;
+							pGravX += gravx[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
+							pGravY += gravy[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
+							// Scale gravity vector so that the largest component is 1 pixel
+							if (fabsf(pGravY)>fabsf(pGravX))
+								mv = fabsf(pGravY);
 							else
-								r = -1;
-							if (s==1)
-								for (j=ny+r; j>=0 && j<YRES && j>=ny-rt && j<ny+rt; j+=r)
-								{
-									if ((TYP(pmap[j][nx])!=t || bmap[j/CELL][nx/CELL]) && do_move(i, nx, ny, (float)nx, (float)j))
-										break;
-									if (TYP(pmap[j][nx])!=t || (bmap[j/CELL][nx/CELL] && bmap[j/CELL][nx/CELL]!=WL_STREAM))
-										break;
-								}
-							else if (s==-1) {} // particle is out of bounds
-							else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
-							else parts[i].flags |= FLAG_STAGNANT;
-							parts[i].vx *= elements[t].Collision;
-							parts[i].vy *= elements[t].Collision;
-						}
-						else if (elements[t].Falldown>1 && fabsf(pGravX*parts[i].vx+pGravY*parts[i].vy)>fabsf(pGravY*parts[i].vx-pGravX*parts[i].vy))
-						{
-							float nxf, nyf, prev_pGravX, prev_pGravY, ptGrav = elements[t].Gravity;
-							s = 0;
-							// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
-							if (!stagnant || nt) //nt is if there is an something else besides the current particle type, around the particle
-								rt = 30;//slight less water lag, although it changes how it moves a lot
-							else
-								rt = 10;
-							// clear_xf, clear_yf is the last known position that the particle should almost certainly be able to move to
-							nxf = clear_xf;
-							nyf = clear_yf;
-							nx = clear_x;
-							ny = clear_y;
-							// Look for spaces to move horizontally (perpendicular to gravity direction), keep going until a space is found or the number of positions examined = rt
-							for (j=0;j<rt;j++)
-							{
-								// Calculate overall gravity direction
-								switch (gravityMode)
-								{
-									default:
-									case 0:
-										pGravX = 0.0f;
-										pGravY = ptGrav;
-										break;
-									case 1:
-										pGravX = pGravY = 0.0f;
-										break;
-									case 2:
-										pGravD = 0.01f - hypotf(float(nx - XCNTR), float(ny - YCNTR));
-										pGravX = ptGrav * ((float)(nx - XCNTR) / pGravD);
-										pGravY = ptGrav * ((float)(ny - YCNTR) / pGravD);
-										break;
-								}
-								pGravX += gravx[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
-								pGravY += gravy[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
-								// Scale gravity vector so that the largest component is 1 pixel
-								if (fabsf(pGravY)>fabsf(pGravX))
-									mv = fabsf(pGravY);
-								else
-									mv = fabsf(pGravX);
-								if (mv<0.0001f) break;
-								pGravX /= mv;
-								pGravY /= mv;
-								// Move 1 pixel perpendicularly to gravity
-								// r is +1/-1, to try moving left or right at random
-								if (j)
-								{
-									// Not quite the gravity direction
-									// Gravity direction + last change in gravity direction
-									// This makes liquid movement a bit less frothy, particularly for balls of liquid in radial gravity. With radial gravity, instead of just moving along a tangent, the attempted movement will follow the curvature a bit better.
-									nxf += r*(pGravY*2.0f-prev_pGravY);
-									nyf += -r*(pGravX*2.0f-prev_pGravX);
-								}
-								else
-								{
-									nxf += r*pGravY;
-									nyf += -r*pGravX;
-								}
-								prev_pGravX = pGravX;
-								prev_pGravY = pGravY;
-								// Check whether movement is allowed
-								nx = (int)(nxf+0.5f);
-								ny = (int)(nyf+0.5f);
-								if (nx<0 || ny<0 || nx>=XRES || ny >=YRES)
-									break;
-								if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
-								{
-									s = do_move(i, x, y, nxf, nyf);
-									if (s)
-									{
-										// Movement was successful
-										nx = (int)(parts[i].x+0.5f);
-										ny = (int)(parts[i].y+0.5f);
-										break;
-									}
-									// A particle of a different type, or a wall, was found. Stop trying to move any further horizontally unless the wall should be completely invisible to particles.
-									if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
-										break;
-								}
-							}
-							if (s==1)
+								mv = fabsf(pGravX);
+							if (mv<0.0001f) break;
+							pGravX /= mv;
+							pGravY /= mv;
+							// Move 1 pixel in the direction of gravity
+							nxf += pGravX;
+							nyf += pGravY;
+							nx = (int)(nxf+0.5f);
+							ny = (int)(nyf+0.5f);
+							if (nx<0 || ny<0 || nx>=XRES || ny>=YRES)
+								break;
+							// If the space is anything except the same element (a wall, empty space, or occupied by a particle of a different element), try to move into it
+							if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
 							{
-								// The particle managed to move horizontally, now try to move vertically (parallel to gravity direction)
-								// Keep going until the particle is blocked (by something that isn't the same element) or the number of positions examined = rt
-								clear_x = nx;
-								clear_y = ny;
-								for (j=0;j<rt;j++)
-								{
-									// Calculate overall gravity direction
-									switch (gravityMode)
-									{
-										default:
-										case 0:
-											pGravX = 0.0f;
-											pGravY = ptGrav;
-											break;
-										case 1:
-											pGravX = pGravY = 0.0f;
-											break;
-										case 2:
-											pGravD = 0.01f - hypotf(float(nx - XCNTR), float(ny - YCNTR));
-											pGravX = ptGrav * ((float)(nx - XCNTR) / pGravD);
-											pGravY = ptGrav * ((float)(ny - YCNTR) / pGravD);
-											break;
-									}
-									pGravX += gravx[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
-									pGravY += gravy[(ny/CELL)*(XRES/CELL)+(nx/CELL)];
-									// Scale gravity vector so that the largest component is 1 pixel
-									if (fabsf(pGravY)>fabsf(pGravX))
-										mv = fabsf(pGravY);
-									else
-										mv = fabsf(pGravX);
-									if (mv<0.0001f) break;
-									pGravX /= mv;
-									pGravY /= mv;
-									// Move 1 pixel in the direction of gravity
-									nxf += pGravX;
-									nyf += pGravY;
-									nx = (int)(nxf+0.5f);
-									ny = (int)(nyf+0.5f);
-									if (nx<0 || ny<0 || nx>=XRES || ny>=YRES)
-										break;
-									// If the space is anything except the same element (a wall, empty space, or occupied by a particle of a different element), try to move into it
-									if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
-									{
-										s = do_move(i, clear_x, clear_y, nxf, nyf);
-										if (s || TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
-											break; // found the edge of the liquid and movement into it succeeded, so stop moving down
-									}
-								}
+								s = do_move(i, clear_x, clear_y, nxf, nyf);
+								if (s || TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
+									break; // found the edge of the liquid and movement into it succeeded, so stop moving down
 							}
-							else if (s==-1) {} // particle is out of bounds
-							else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {} // try moving to the last clear position
-							else parts[i].flags |= FLAG_STAGNANT;
-							parts[i].vx *= elements[t].Collision;
-							parts[i].vy *= elements[t].Collision;
-						}
-						else
-						{
-							// if interpolation was done, try moving to last clear position
-							if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
-							else parts[i].flags |= FLAG_STAGNANT;
-							parts[i].vx *= elements[t].Collision;
-							parts[i].vy *= elements[t].Collision;
 						}
 					}
+					else if (s==-1) {} // particle is out of bounds
+					else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {} // try moving to the last clear position
+					else parts[i].flags |= FLAG_STAGNANT;
+					parts[i].vx *= elements[t].Collision;
+					parts[i].vy *= elements[t].Collision;
+				}
+				else
+				{
+					// if interpolation was done, try moving to last clear position
+					if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
+					else parts[i].flags |= FLAG_STAGNANT;
+					parts[i].vx *= elements[t].Collision;
+					parts[i].vy *= elements[t].Collision;
 				}
 			}
+		}
+	}
 movedone:
+	return;
+}
+
+// Updates particles in CELL aligned tiles on several threads. Tiles whose surroundings
+// only hold elements flagged PROP_TILELOCAL and no detector walls are updated
+// concurrently, one checkerboard colour at a time. Everything else, and every particle
+// a tile had to give up on, is left to a serial fixup pass that runs in index order.
+// The outcome depends on the tiling but not on the number of threads or their timing.
+void Simulation::UpdateParticlesTiled()
+{
+	auto &builtinElements = GetElements();
+	// callbacks that may touch particles or state anywhere in the simulation
+	auto quietType = [this, &builtinElements](int t) {
+		return !elements[t].ChangeType && !elements[t].CreateAllowed && elements[t].Create == builtinElements[t].Create;
+	};
+	for (int t = 0; t < PT_NUM; t++)
+	{
+		bool local = IsElement(t) && (elements[t].Properties & PROP_TILELOCAL) && !(elements[t].Properties & TYPE_ENERGY)
+		             && elements[t].Update == builtinElements[t].Update && quietType(t);
+		for (int transition : { elements[t].LowPressureTransition, elements[t].HighPressureTransition, elements[t].LowTemperatureTransition, elements[t].HighTemperatureTransition })
+			if (IsElement(transition) && !quietType(transition))
+				local = false;
+		tileLocalType[t] = local;
+	}
+
+	// prefix sums over cells holding something a tile can't safely touch
+	constexpr int hazardStride = XRES/CELL + 1;
+	std::fill(tileHazards.begin(), tileHazards.end(), 0);
+	for (int cy = 0; cy < YRES/CELL; cy++)
+		for (int cx = 0; cx < XRES/CELL; cx++)
+			if (bmap[cy][cx] == WL_DETECT)
+				tileHazards[(cy + 1) * hazardStride + cx + 1] = 1;
+	for (auto &tile : tiles)
+	{
+		tile.parts.clear();
+		tile.deferred.clear();
+	}
+	tileFixup.clear();
+	for (int i = activeParts.Next(0); i <= parts_lastActiveIndex; i = activeParts.Next(i + 1))
+	{
+		int t = partTypes[i];
+		int x = (int)(parts[i].x+0.5f);
+		int y = (int)(parts[i].y+0.5f);
+		if (!InBounds(x, y))
+		{
+			tileFixup.push_back({ i, DeferredParticle::stageStart, 0, 0, 0.0f, 0.0f, false });
 			continue;
 		}
+		tiles[(y / TILE_SIZE) * TILES_X + x / TILE_SIZE].parts.push_back(i);
+		if (!tileLocalType[t] || (IsElement(parts[i].ctype) && !quietType(parts[i].ctype)))
+			tileHazards[(y / CELL + 1) * hazardStride + x / CELL + 1] = 1;
+	}
+	for (int cy = 1; cy <= YRES/CELL; cy++)
+		for (int cx = 1; cx <= XRES/CELL; cx++)
+			tileHazards[cy * hazardStride + cx] += tileHazards[(cy - 1) * hazardStride + cx] + tileHazards[cy * hazardStride + cx - 1] - tileHazards[(cy - 1) * hazardStride + cx - 1];
 
-	//'f' was pressed (single frame)
-	if (framerender)
-		framerender--;
+	for (int ty = 0; ty < TILES_Y; ty++)
+		for (int tx = 0; tx < TILES_X; tx++)
+		{
+			auto &tile = tiles[ty * TILES_X + tx];
+			int cx0 = std::max(tile.x0 - TILE_REACH, 0) / CELL;
+			int cy0 = std::max(tile.y0 - TILE_REACH, 0) / CELL;
+			int cx1 = (std::min(tile.x1 + TILE_REACH, XRES) - 1) / CELL + 1;
+			int cy1 = (std::min(tile.y1 + TILE_REACH, YRES) - 1) / CELL + 1;
+			int hazards = tileHazards[cy1 * hazardStride + cx1] - tileHazards[cy0 * hazardStride + cx1] - tileHazards[cy1 * hazardStride + cx0] + tileHazards[cy0 * hazardStride + cx0];
+			// particles wrap around in loop edge mode, so tiles on the edge touch the ones on the other side
+			bool onEdge = tx == 0 || ty == 0 || tx == TILES_X - 1 || ty == TILES_Y - 1;
+			tile.concurrent = !hazards && !(edgeMode == 2 && onEdge);
+			if (!tile.concurrent)
+				for (auto i : tile.parts)
+					tileFixup.push_back({ i, DeferredParticle::stageStart, 0, 0, 0.0f, 0.0f, false });
+		}
+
+	std::vector<ParticleTile *> phaseTiles;
+	for (int phase = 0; phase < 4; phase++)
+	{
+		phaseTiles.clear();
+		for (int ty = phase >> 1; ty < TILES_Y; ty += 2)
+			for (int tx = phase & 1; tx < TILES_X; tx += 2)
+			{
+				auto &tile = tiles[ty * TILES_X + tx];
+				if (tile.concurrent && tile.parts.size())
+					phaseTiles.push_back(&tile);
+			}
+
+		// give each tile its own generator and a share of the free indices, in tile order
+		for (auto *tile : phaseTiles)
+		{
+			auto &rng = RNG::Ref();
+			tile->rng.state({ (uint64_t(rng()) << 32) | rng(), (uint64_t(rng()) << 32) | rng() });
+			tile->lastActiveIndex = -1;
+			tile->typeChanges.clear();
+			tile->elementCosts.assign(elementTiming ? PT_NUM : 0, ElementCost());
+			tile->freedParts.clear();
+			tile->spareParts.clear();
+			tile->nextSparePart = 0;
+			for (int budget = int(tile->parts.size()) * 8 + 64; budget; budget--)
+			{
+				int i = activeParts.Alloc();
+				if (i == -1)
+					break;
+				tile->spareParts.push_back(i);
+			}
+		}
+
+		workers->Run(int(phaseTiles.size()), [this, &phaseTiles](int index) {
+			auto &tile = *phaseTiles[index];
+			TileBinding &binding = currentTile;
+			binding.tile = &tile;
+			RNG::Override rngOverride(tile.rng);
+			for (auto i : tile.parts)
+				if (partTypes[i])
+					UpdateParticle(i, &tile, nullptr);
+			binding.tile = nullptr;
+		});
+
+		// hand unused indices back so that they are handed out in the same order again,
+		// after the ones freed by the tiles
+		for (auto it = phaseTiles.rbegin(); it != phaseTiles.rend(); ++it)
+		{
+			auto *tile = *it;
+			for (auto i = tile->spareParts.size(); i > tile->nextSparePart; i--)
+				activeParts.Free(tile->spareParts[i - 1]);
+		}
+		for (auto it = phaseTiles.rbegin(); it != phaseTiles.rend(); ++it)
+		{
+			for (auto i : (*it)->freedParts)
+				activeParts.Free(i);
+		}
+		for (auto *tile : phaseTiles)
+		{
+			for (auto &change : tile->typeChanges)
+			{
+				if (change.from)
+				{
+					partsByType.Remove(change.i, change.from);
+					partsGrid.Remove(change.i, change.from);
+				}
+				if (change.to)
+				{
+					partsByType.Add(change.i, change.to);
+					partsGrid.Add(change.i, change.to);
+				}
+			}
+			for (int t = 0; t < int(tile->elementCosts.size()); t++)
+			{
+				elementCosts[t].calls += tile->elementCosts[t].calls;
+				elementCosts[t].seconds += tile->elementCosts[t].seconds;
+			}
+			if (tile->lastActiveIndex > parts_lastActiveIndex)
+				parts_lastActiveIndex = tile->lastActiveIndex;
+			tileFixup.insert(tileFixup.end(), tile->deferred.begin(), tile->deferred.end());
+		}
+	}
+
+	std::sort(tileFixup.begin(), tileFixup.end());
+	for (auto &deferred : tileFixup)
+		if (partTypes[deferred.i])
+			UpdateParticle(deferred.i, nullptr, &deferred);
 }
 
 int Simulation::GetParticleType(ByteString type)
@@ -4711,119 +5109,268 @@ int Simulation::GetParticleType(ByteString type)
 	return -1;
 }
 
-void Simulation::RecalcFreeParticles(bool do_life_dec)
+// * A particle's cell and the cell it moves to are always within reach of the tile updating it, so
+//   concurrently updated tiles never link into or out of the same cell, see ParticleTile. Cells are
+//   marked changed with a byte each rather than put on a list for the same reason.
+void Simulation::LinkPart(int i, int cell)
+{
+	auto &link = cellLinks[i];
+	link.cell = cell;
+	if (cell < 0)
+		return;
+	link.prev = -1;
+	link.next = cellFirst[cell];
+	if (link.next >= 0)
+		cellLinks[link.next].prev = i;
+	cellFirst[cell] = i;
+	if (stackCounted[partTypes[i]])
+		(&pmap_count[0][0])[cell]++;
+	cellChanged[cell] = 1;
+}
+
+void Simulation::UnlinkPart(int i)
+{
+	auto &link = cellLinks[i];
+	int cell = link.cell;
+	if (cell < 0)
+		return;
+	if (link.prev >= 0)
+		cellLinks[link.prev].next = link.next;
+	else
+		cellFirst[cell] = link.next;
+	if (link.next >= 0)
+		cellLinks[link.next].prev = link.prev;
+	if (stackCounted[partTypes[i]])
+		(&pmap_count[0][0])[cell]--;
+	cellChanged[cell] = 1;
+	link.cell = -1;
+}
+
+void Simulation::ResolveCell(int cell)
+{
+	// * RebuildMaps puts particles on the maps in index order, so pmap ends up with the last
+	//   particle that isn't INVS or FILT, or the first INVS or FILT if there is nothing else.
+	int top = -1, bottom = -1, energy = -1;
+	for (int i = cellFirst[cell]; i >= 0; i = cellLinks[i].next)
+	{
+		int t = partTypes[i];
+		if (elements[t].Properties & TYPE_ENERGY)
+			energy = std::max(energy, i);
+		else if (t==PT_INVIS || t==PT_FILT)
+			bottom = bottom < 0 ? i : std::min(bottom, i);
+		else
+			top = std::max(top, i);
+	}
+	int x = cell % XRES, y = cell / XRES;
+	int p = top >= 0 ? top : bottom;
+	pmap[y][x] = p >= 0 ? PMAP(p, partTypes[p]) : 0;
+	photons[y][x] = energy >= 0 ? PMAP(energy, partTypes[energy]) : 0;
+}
+
+int Simulation::RebuildMaps()
 {
 	int x, y, t;
 	int lastPartUsed = 0;
-	int lastPartUnused = -1;
 
 	memset(pmap, 0, sizeof(pmap));
-	memset(pmap_count, 0, sizeof(pmap_count));
 	memset(photons, 0, sizeof(photons));
+	memset(pmap_count, 0, sizeof(pmap_count));
+	std::fill(cellFirst.begin(), cellFirst.end(), -1);
+	for (auto &link : cellLinks)
+		link.cell = -1;
+	for (t = 0; t < PT_NUM; t++)
+	{
+		// (there are a few exceptions, including energy particles - currently no limit on stacking those)
+		stackCounted[t] = !(elements[t].Properties & TYPE_ENERGY) && t!=PT_THDR && t!=PT_EMBR && t!=PT_FIGH && t!=PT_PLSM;
+	}
+	mapsCurrent = true;
 
-	NUM_PARTS = 0;
-	//the particle loop that resets the pmap/photon maps every frame, to update them.
-	for (int i = 0; i <= parts_lastActiveIndex; i++)
+	//the particle loop that resets the pmap/photon maps, to update them.
+	for (int i = activeParts.Next(0); i <= parts_lastActiveIndex; i = activeParts.Next(i + 1))
 	{
-		if (parts[i].type)
+		t = partTypes[i];
+		x = (int)(parts[i].x+0.5f);
+		y = (int)(parts[i].y+0.5f);
+		LinkPart(i, PartCell(i));
+		if (x>=0 && y>=0 && x<XRES && y<YRES)
 		{
-			t = parts[i].type;
-			x = (int)(parts[i].x+0.5f);
-			y = (int)(parts[i].y+0.5f);
-			bool inBounds = false;
-			if (x>=0 && y>=0 && x<XRES && y<YRES)
+			if (elements[t].Properties & TYPE_ENERGY)
+				photons[y][x] = PMAP(i, t);
+			else
 			{
-				if (elements[t].Properties & TYPE_ENERGY)
-					photons[y][x] = PMAP(i, t);
-				else
-				{
-					// Particles are sometimes allowed to go inside INVS and FILT
-					// To make particles collide correctly when inside these elements, these elements must not overwrite an existing pmap entry from particles inside them
-					if (!pmap[y][x] || (t!=PT_INVIS && t!= PT_FILT))
-						pmap[y][x] = PMAP(i, t);
-					// (there are a few exceptions, including energy particles - currently no limit on stacking those)
-					if (t!=PT_THDR && t!=PT_EMBR && t!=PT_FIGH && t!=PT_PLSM)
-						pmap_count[y][x]++;
-				}
-				inBounds = true;
+				// Particles are sometimes allowed to go inside INVS and FILT
+				// To make particles collide correctly when inside these elements, these elements must not overwrite an existing pmap entry from particles inside them
+				if (!pmap[y][x] || (t!=PT_INVIS && t!= PT_FILT))
+					pmap[y][x] = PMAP(i, t);
 			}
-			lastPartUsed = i;
-			NUM_PARTS ++;
+		}
+		lastPartUsed = i;
+	}
+	std::fill(cellChanged.begin(), cellChanged.end(), 0);
+	return lastPartUsed;
+}
 
-			if (elementRecount && t >= 0 && t < PT_NUM && elements[t].Enabled)
-				elementCount[t]++;
+#ifdef DEBUG
+void Simulation::CheckMaps()
+{
+	std::vector<int> rebuiltPmap(XRES*YRES), rebuiltPhotons(XRES*YRES);
+	std::vector<unsigned int> rebuiltCount(XRES*YRES);
+	for (int i = activeParts.Next(0); i <= parts_lastActiveIndex; i = activeParts.Next(i + 1))
+	{
+		int t = partTypes[i];
+		int x = (int)(parts[i].x+0.5f);
+		int y = (int)(parts[i].y+0.5f);
+		if (x<0 || y<0 || x>=XRES || y>=YRES)
+			continue;
+		int cell = y*XRES + x;
+		if (elements[t].Properties & TYPE_ENERGY)
+			rebuiltPhotons[cell] = PMAP(i, t);
+		else if (!rebuiltPmap[cell] || (t!=PT_INVIS && t!= PT_FILT))
+			rebuiltPmap[cell] = PMAP(i, t);
+		if (stackCounted[t])
+			rebuiltCount[cell]++;
+	}
+	for (int y = 0; y < YRES; y++)
+		for (int x = 0; x < XRES; x++)
+		{
+			int cell = y*XRES + x;
+			if (pmap[y][x] != rebuiltPmap[cell] || photons[y][x] != rebuiltPhotons[cell] || pmap_count[y][x] != rebuiltCount[cell])
+				std::cerr << "pmap, photons or pmap_count out of date at " << x << ", " << y << std::endl;
+		}
+}
+#endif
 
-			//decrease particle life
-			if (do_life_dec && (!sys_pause || framerender))
+void Simulation::RecalcFreeParticles(bool do_life_dec, bool countStacking)
+{
+	int x, y, t;
+	int lastPartUsed;
+
+	// Indices of particles killed here that are lower than the first free one are only
+	// handed out again after the next call, which is what the free list this used to
+	// build through parts[i].life ended up doing
+	activeParts.Reset();
+	int firstFree = activeParts.FirstFree();
+
+	// * The maps are only rebuilt from scratch after something the particles in each cell
+	//   can't follow, see InvalidateMaps. Otherwise pmap_count is exact already, and only the
+	//   cells whose particles changed since the last call need pmap and photons put right;
+	//   until then, they are what the particle update left them as, as they always were
+	//   during a frame.
+	if (!mapsCurrent)
+		lastPartUsed = RebuildMaps();
+	else
+	{
+		// * Hardly any cells change on most frames, so they are looked for a word at a time
+		for (int cell = 0; cell < XRES*YRES; cell += 8)
+		{
+			uint64_t word;
+			memcpy(&word, &cellChanged[cell], sizeof(word));
+			if (!word)
+				continue;
+			for (int c = cell; c < cell + 8; c++)
 			{
-				if (t<0 || t>=PT_NUM || !elements[t].Enabled)
+				if (cellChanged[c])
 				{
-					kill_part(i);
-					continue;
+					cellChanged[c] = 0;
+					ResolveCell(c);
 				}
+			}
+		}
+		lastPartUsed = std::max(activeParts.Prev(parts_lastActiveIndex), 0);
+#ifdef DEBUG
+		CheckMaps();
+#endif
+	}
+	NUM_PARTS = 0;
+	for (t = 1; t < PT_NUM; t++)
+		NUM_PARTS += partsByType.Count(t);
+
+	// * Only CheckStacking looks at these, as they are before any particle dies of old age below
+	if (countStacking)
+	{
+		stackedCells.clear();
+		stackCandidates.clear();
+		for (y = 0; y < YRES; y++)
+			for (x = 0; x < XRES; x++)
+				if (pmap_count[y][x] > stackingThreshold)
+					stackedCells.push_back({ y*XRES + x, pmap_count[y][x], false });
+		for (int stacked = 0; stacked < int(stackedCells.size()); stacked++)
+		{
+			for (int i = cellFirst[stackedCells[stacked].cell]; i >= 0; i = cellLinks[i].next)
+			{
+				if (!(elements[partTypes[i]].Properties & TYPE_ENERGY))
+					stackCandidates.push_back({ i, stacked });
+			}
+		}
+	}
 
-				unsigned int elem_properties = elements[t].Properties;
-				if (parts[i].life>0 && (elem_properties&PROP_LIFE_DEC) && !(inBounds && bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8))
+	//decrease particle life
+	// * Only the particles of elements whose life goes down or that die of no life are looked at,
+	//   once the maps are complete rather than as each particle is put on them. They are killed in
+	//   index order, which is the order their indices are handed out again in. The only difference
+	//   is that INVS or FILT in the same spot as a particle that dies here are only put on pmap in
+	//   the next frame, as they are when a particle dies during a frame.
+	if (do_life_dec && (!sys_pause || framerender))
+	{
+		lifeKills.clear();
+		for (t = 0; t < PT_NUM; t++)
+		{
+			if (!partsByType.Count(t))
+				continue;
+			if (!elements[t].Enabled)
+			{
+				auto &bucket = partsByType.Get(t);
+				lifeKills.insert(lifeKills.end(), bucket.begin(), bucket.end());
+				continue;
+			}
+			unsigned int elem_properties = elements[t].Properties;
+			if (!(elem_properties & (PROP_LIFE_DEC | PROP_LIFE_KILL)))
+				continue;
+			for (auto i : partsByType.Get(t))
+			{
+				x = (int)(parts[i].x+0.5f);
+				y = (int)(parts[i].y+0.5f);
+				bool inStasis = x>=0 && y>=0 && x<XRES && y<YRES && bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8;
+				if (parts[i].life>0 && (elem_properties&PROP_LIFE_DEC) && !inStasis)
 				{
 					// automatically decrease life
 					parts[i].life--;
+					// kill on change to no life
 					if (parts[i].life<=0 && (elem_properties&(PROP_LIFE_KILL_DEC|PROP_LIFE_KILL)))
-					{
-						// kill on change to no life
-						kill_part(i);
-						continue;
-					}
-				}
-				else if (parts[i].life<=0 && (elem_properties&PROP_LIFE_KILL) && !(inBounds && bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8))
-				{
-					// kill if no life
-					kill_part(i);
-					continue;
+						lifeKills.push_back(i);
 				}
+				// kill if no life
+				else if (parts[i].life<=0 && (elem_properties&PROP_LIFE_KILL) && !inStasis)
+					lifeKills.push_back(i);
 			}
 		}
-		else
-		{
-			if (lastPartUnused<0) pfree = i;
-			else parts[lastPartUnused].life = i;
-			lastPartUnused = i;
-		}
-	}
-	if (lastPartUnused == -1)
-	{
-		if (parts_lastActiveIndex>=NPART-1)
-			pfree = -1;
-		else
-			pfree = parts_lastActiveIndex+1;
-	}
-	else
-	{
-		if (parts_lastActiveIndex>=NPART-1)
-			parts[lastPartUnused].life = -1;
-		else
-			parts[lastPartUnused].life = parts_lastActiveIndex+1;
+		std::sort(lifeKills.begin(), lifeKills.end());
+		for (auto i : lifeKills)
+			kill_part(i);
 	}
+	activeParts.ForgetFreedBelow(firstFree <= parts_lastActiveIndex ? firstFree : NPART);
 	parts_lastActiveIndex = lastPartUsed;
-	if (elementRecount)
-		elementRecount = false;
 }
 
 void Simulation::SimulateGoL()
 {
 	CGOL = 0;
-	for (int i = 0; i <= parts_lastActiveIndex; ++i)
+	// * Only cells that have a LIFE particle on them or next to them can change, so
+	//   only the CELL sized blocks those are in are gone through after this, in the
+	//   same order as a sweep over the whole GOL space would go through them.
+	bool activeBlocks[YRES / CELL][XRES / CELL];
+	memset(activeBlocks, 0, sizeof(activeBlocks));
+	// neighbours are collected in the order LIFE particles are found in, so go by index
+	for (auto i : partsByType.Sorted(PT_LIFE))
 	{
 		auto &part = parts[i];
-		if (part.type != PT_LIFE)
-		{
-			continue;
-		}
 		auto x = int(part.x + 0.5f);
 		auto y = int(part.y + 0.5f);
 		if (x < CELL || y < CELL || x >= XRES - CELL || y >= YRES - CELL)
 		{
 			continue;
 		}
+		activeBlocks[y / CELL][x / CELL] = true;
 		unsigned int golnum = part.ctype;
 		unsigned int ruleset = golnum;
 		if (golnum < NGOL)
@@ -4849,6 +5396,7 @@ void Simulation::SimulateGoL()
 						{
 							continue;
 						}
+						activeBlocks[ay / CELL][ax / CELL] = true;
 						unsigned int (&neighbourList)[5] = gol[ay][ax];
 						// * Bump overall neighbour counter (bits 30..28) for the entire list.
 						neighbourList[0] += 1U << 28;
@@ -4890,9 +5438,24 @@ void Simulation::SimulateGoL()
 			}
 		}
 	}
+	// * x coordinates of the cells in active blocks, for each row of blocks.
+	std::vector<int> activeColumns[YRES / CELL];
+	for (int by = 1; by < YRES / CELL - 1; ++by)
+	{
+		for (int bx = 1; bx < XRES / CELL - 1; ++bx)
+		{
+			if (activeBlocks[by][bx])
+			{
+				for (int x = bx * CELL; x < (bx + 1) * CELL; ++x)
+				{
+					activeColumns[by].push_back(x);
+				}
+			}
+		}
+	}
 	for (int y = CELL; y < YRES - CELL; ++y)
 	{
-		for (int x = CELL; x < XRES - CELL; ++x)
+		for (auto x : activeColumns[y / CELL])
 		{
 			int r = pmap[y][x];
 			if (r && TYP(r) != PT_LIFE)
@@ -4973,7 +5536,7 @@ void Simulation::SimulateGoL()
 	}
 	for (int y = CELL; y < YRES - CELL; ++y)
 	{
-		for (int x = CELL; x < XRES - CELL; ++x)
+		for (auto x : activeColumns[y / CELL])
 		{
 			int r = pmap[y][x];
 			if (r && TYP(r) == PT_LIFE && parts[ID(r)].tmp2 <= 0)
@@ -4988,76 +5551,97 @@ void Simulation::CheckStacking()
 {
 	bool excessive_stacking_found = false;
 	force_stacking_check = false;
-	for (int y = 0; y < YRES; y++)
-	{
-		for (int x = 0; x < XRES; x++)
+	// * Only the cells RecalcFreeParticles found past the threshold, in the order a sweep over
+	//   the whole screen would visit them, so that random numbers are drawn in the same order.
+	//   Cells that are to form BHOL are marked in stackedCells rather than by adding NPART to
+	//   pmap_count, which follows the particles created and killed below.
+	for (auto &stacked : stackedCells)
+	{
+		int x = stacked.cell % XRES, y = stacked.cell / XRES;
+		// Use a threshold, since some particle stacking can be normal (e.g. BIZR + FILT)
+		if (bmap[y/CELL][x/CELL]==WL_EHOLE)
 		{
-			// Use a threshold, since some particle stacking can be normal (e.g. BIZR + FILT)
-			// Setting pmap_count[y][x] > NPART means BHOL will form in that spot
-			if (pmap_count[y][x]>5)
+			// Allow more stacking in E-hole
+			if (stacked.count>1500)
 			{
-				if (bmap[y/CELL][x/CELL]==WL_EHOLE)
-				{
-					// Allow more stacking in E-hole
-					if (pmap_count[y][x]>1500)
-					{
-						pmap_count[y][x] = pmap_count[y][x] + NPART;
-						excessive_stacking_found = 1;
-					}
-				}
-				else if (pmap_count[y][x]>1500 || (unsigned int)RNG::Ref().between(0, 1599) <= (pmap_count[y][x]+100))
-				{
-					pmap_count[y][x] = pmap_count[y][x] + NPART;
-					excessive_stacking_found = true;
-				}
+				stacked.collapse = true;
+				excessive_stacking_found = true;
 			}
 		}
+		else if (stacked.count>1500 || (unsigned int)RNG::Ref().between(0, 1599) <= (stacked.count+100))
+		{
+			stacked.collapse = true;
+			excessive_stacking_found = true;
+		}
 	}
 	if (excessive_stacking_found)
 	{
-		for (int i = 0; i <= parts_lastActiveIndex; i++)
+		// * Every particle on pmap in a stacked cell is a candidate, handled in index order like a sweep over parts would.
+		std::sort(stackCandidates.begin(), stackCandidates.end());
+		for (auto &candidate : stackCandidates)
 		{
-			if (parts[i].type)
+			int i = candidate.first;
+			auto &stacked = stackedCells[candidate.second];
+			if (!partTypes[i] || !stacked.collapse)
+				continue;
+			int x = stacked.cell % XRES, y = stacked.cell / XRES;
+			// The first particle left in the cell becomes BHOL, the rest are removed
+			if (stacked.count)
 			{
-				int t = parts[i].type;
-				int x = (int)(parts[i].x+0.5f);
-				int y = (int)(parts[i].y+0.5f);
-				if (x>=0 && y>=0 && x<XRES && y<YRES && !(elements[t].Properties&TYPE_ENERGY))
-				{
-					if (pmap_count[y][x]>=NPART)
-					{
-						if (pmap_count[y][x]>NPART)
-						{
-							create_part(i, x, y, PT_NBHL);
-							parts[i].temp = MAX_TEMP;
-							parts[i].tmp = pmap_count[y][x]-NPART;//strength of grav field
-							if (parts[i].tmp>51200) parts[i].tmp = 51200;
-							pmap_count[y][x] = NPART;
-						}
-						else
-						{
-							kill_part(i);
-						}
-					}
-				}
+				create_part(i, x, y, PT_NBHL);
+				parts[i].temp = MAX_TEMP;
+				parts[i].tmp = stacked.count;//strength of grav field
+				if (parts[i].tmp>51200) parts[i].tmp = 51200;
+				stacked.count = 0;
+			}
+			else
+			{
+				kill_part(i);
 			}
 		}
 	}
 }
 
+void Simulation::RecordPhaseHistory()
+{
+	// everything timed since the last call, which includes rendering the last frame
+	auto &frame = phaseHistory[phaseHistoryPos];
+	for (int phase = 0; phase < phaseCount; phase++)
+	{
+		frame[phase] = std::max(float(phaseTimes[phase] - phaseTimesRecorded[phase]) * 1000.0f, 0.0f);
+		phaseTimesRecorded[phase] = phaseTimes[phase];
+	}
+	phaseHistoryPos = (phaseHistoryPos + 1) % phaseHistorySize;
+}
+
 //updates pmap, gol, and some other simulation stuff (but not particles)
 void Simulation::BeforeSim()
 {
+	RNG::Override rngOverride(rng);
+	if (phaseTiming)
+		RecordPhaseHistory();
+	partsGrid.Invalidate();
+
 	if (!sys_pause||framerender)
 	{
-		air->update_air();
+		MarkAllDirty();
+		{
+			PhaseTimer timer(*this, phaseAir);
+			if (air->IsAsync())
+				air->update_air_async(aheat_enable, gravityMode);
+			else
+			{
+				air->update_air();
 
-		if(aheat_enable)
-			air->update_airh();
+				if(aheat_enable)
+					air->update_airh(gravityMode);
+			}
+		}
 
 		if(grav->IsEnabled())
 		{
-			grav->gravity_update_async();
+			PhaseTimer timer(*this, phaseGravity);
+			grav->gravity_update_async(deterministic);
 
 			//Get updated buffer pointers for gravity
 			gravx = grav->gravx;
@@ -5073,10 +5657,6 @@ void Simulation::BeforeSim()
 		etrd_life0_count = 0;
 
 		currentTick++;
-
-		elementRecount |= !(currentTick%180);
-		if (elementRecount)
-			std::fill(elementCount, elementCount+PT_NUM, 0);
 	}
 	sandcolour = (int)(20.0f*sin((float)sandcolour_frame*(M_PI/180.0f)));
 	sandcolour_frame = (sandcolour_frame+1)%360;
@@ -5087,8 +5667,15 @@ void Simulation::BeforeSim()
 		gravWallChanged = false;
 	}
 
+	// check for stacking and create BHOL if found, decided before RecalcFreeParticles, which only
+	// counts stacked particles on frames they are checked on
+	bool checkStacking = (!sys_pause || framerender) && (force_stacking_check || RNG::Ref().chance(1, 10));
+
 	if (debug_currentParticle == 0)
-		RecalcFreeParticles(true);
+	{
+		PhaseTimer timer(*this, phaseRecalc);
+		RecalcFreeParticles(true, checkStacking);
+	}
 
 	if (!sys_pause || framerender)
 	{
@@ -5105,37 +5692,38 @@ void Simulation::BeforeSim()
 			}
 		}
 
-		// check for stacking and create BHOL if found
-		if (force_stacking_check || RNG::Ref().chance(1, 10))
+		if (checkStacking)
 		{
+			PhaseTimer timer(*this, phaseStacking);
 			CheckStacking();
 		}
 
 		// LOVE and LOLZ element handling
-		if (elementCount[PT_LOVE] > 0 || elementCount[PT_LOLZ] > 0)
+		if (partsByType.Count(PT_LOVE) > 0 || partsByType.Count(PT_LOLZ) > 0)
 		{
-			int nx, nnx, ny, nny, r, rt;
-			for (ny=0; ny<YRES-4; ny++)
+			int nx, nnx, ny, nny, rt;
+			// only the ones on top of pmap count, and ones too close to the edge are killed
+			// in the order a scan over pmap would find them in
+			std::vector<std::pair<int, int>> edgeParts;
+			for (auto t : { PT_LOVE, PT_LOLZ })
 			{
-				for (nx=0; nx<XRES-4; nx++)
+				for (auto i : partsByType.Get(t))
 				{
-					r=pmap[ny][nx];
-					if (!r)
-					{
+					nx = (int)(parts[i].x+0.5f);
+					ny = (int)(parts[i].y+0.5f);
+					if (nx<0 || ny<0 || nx>=XRES-4 || ny>=YRES-4 || ID(pmap[ny][nx]) != i || !pmap[ny][nx])
 						continue;
-					}
-					else if ((ny<9||nx<9||ny>YRES-7||nx>XRES-10)&&(parts[ID(r)].type==PT_LOVE||parts[ID(r)].type==PT_LOLZ))
-						kill_part(ID(r));
-					else if (parts[ID(r)].type==PT_LOVE)
-					{
+					if (ny<9||nx<9||ny>YRES-7||nx>XRES-10)
+						edgeParts.push_back({ ny*XRES+nx, i });
+					else if (t==PT_LOVE)
 						Element_LOVE_love[nx/9][ny/9] = 1;
-					}
-					else if (parts[ID(r)].type==PT_LOLZ)
-					{
+					else
 						Element_LOLZ_lolz[nx/9][ny/9] = 1;
-					}
 				}
 			}
+			std::sort(edgeParts.begin(), edgeParts.end());
+			for (auto &edgePart : edgeParts)
+				kill_part(edgePart.second);
 			for (nx=9; nx<=XRES-18; nx++)
 			{
 				for (ny=9; ny<=YRES-7; ny++)
@@ -5182,39 +5770,31 @@ void Simulation::BeforeSim()
 		}
 
 		// make WIRE work
-		if(elementCount[PT_WIRE] > 0)
+		for (auto i : partsByType.Get(PT_WIRE))
 		{
-			for (int nx = 0; nx < XRES; nx++)
-			{
-				for (int ny = 0; ny < YRES; ny++)
-				{
-					int r = pmap[ny][nx];
-					if (!r)
-						continue;
-					if(parts[ID(r)].type == PT_WIRE)
-						parts[ID(r)].tmp = parts[ID(r)].ctype;
-				}
-			}
+			// only the ones on top of pmap, same as when this went through all of pmap
+			int nx = (int)(parts[i].x+0.5f);
+			int ny = (int)(parts[i].y+0.5f);
+			if (nx >= 0 && ny >= 0 && nx < XRES && ny < YRES && pmap[ny][nx] && ID(pmap[ny][nx]) == i)
+				parts[i].tmp = parts[i].ctype;
 		}
 
 		// update PPIP tmp?
 		if (Element_PPIP_ppip_changed)
 		{
-			for (int i = 0; i <= parts_lastActiveIndex; i++)
+			for (auto i : partsByType.Get(PT_PPIP))
 			{
-				if (parts[i].type==PT_PPIP)
-				{
-					parts[i].tmp |= (parts[i].tmp&0xE0000000)>>3;
-					parts[i].tmp &= ~0xE0000000;
-				}
+				parts[i].tmp |= (parts[i].tmp&0xE0000000)>>3;
+				parts[i].tmp &= ~0xE0000000;
 			}
 			Element_PPIP_ppip_changed = 0;
 		}
 
 		// Simulate GoL
 		// GSPEED is frames per generation
-		if (elementCount[PT_LIFE]>0 && ++CGOL>=GSPEED)
+		if (partsByType.Count(PT_LIFE)>0 && ++CGOL>=GSPEED)
 		{
+			PhaseTimer timer(*this, phaseGoL);
 			SimulateGoL();
 		}
 
@@ -5241,6 +5821,9 @@ void Simulation::BeforeSim()
 
 void Simulation::AfterSim()
 {
+	PhaseTimer timer(*this, phaseAfterSim);
+	RNG::Override rngOverride(rng);
+	MarkAllDirty();
 	if (emp_trigger_count)
 	{
 		// pitiful attempt at trying to keep code relating to a given element in the same file
@@ -5248,6 +5831,36 @@ void Simulation::AfterSim()
 		Element_EMP_Trigger(this, emp_trigger_count);
 		emp_trigger_count = 0;
 	}
+	if (deterministic)
+		stateHash = HashMix(stateHash, HashState());
+}
+
+void Simulation::SetSeed(unsigned int seed)
+{
+	// a zero seed leaves the generator stuck at zero
+	rng.seed(seed ? seed : 1);
+	stateHash = 0;
+}
+
+uint64_t Simulation::HashState() const
+{
+	uint64_t hash = 0;
+	for (int i = activeParts.Next(0); i <= parts_lastActiveIndex; i = activeParts.Next(i + 1))
+	{
+		hash = HashMix(hash, uint64_t(i));
+		hash = HashWords(hash, &parts[i], sizeof(Particle));
+	}
+	hash = HashWords(hash, pv, sizeof(pv));
+	hash = HashWords(hash, vx, sizeof(vx));
+	hash = HashWords(hash, vy, sizeof(vy));
+	hash = HashWords(hash, hv, sizeof(hv));
+	if (grav->IsEnabled())
+	{
+		hash = HashWords(hash, gravx, (XRES / CELL) * (YRES / CELL) * sizeof(float));
+		hash = HashWords(hash, gravy, (XRES / CELL) * (YRES / CELL) * sizeof(float));
+		hash = HashWords(hash, gravp, (XRES / CELL) * (YRES / CELL) * sizeof(float));
+	}
+	return hash;
 }
 
 Simulation::~Simulation()
@@ -5267,6 +5880,15 @@ Simulation::Simulation():
 	etrd_count_valid(false),
 	etrd_life0_count(0),
 	lightningRecreate(0),
+	snapshotSerial(0),
+	snapshotDirtyAll(true),
+	snapshotDirtyBegin(NPART),
+	snapshotDirtyEnd(0),
+	phaseTiming(false),
+	phaseHistoryPos(0),
+	elementTiming(false),
+	deterministic(false),
+	stateHash(0),
 	gravWallChanged(false),
 	CGOL(0),
 	GSPEED(1),
@@ -5288,8 +5910,27 @@ Simulation::Simulation():
 	memcpy(portal_ry, tportal_ry, sizeof(tportal_ry));
 
 	currentTick = 0;
-	std::fill(elementCount, elementCount+PT_NUM, 0);
-	elementRecount = true;
+	phaseTimes.fill(0);
+	phaseTimesRecorded.fill(0);
+	for (auto &frame : phaseHistory)
+		frame.fill(0);
+
+	workers = std::make_unique<WorkerPool>();
+	for (int ty = 0; ty < TILES_Y; ty++)
+		for (int tx = 0; tx < TILES_X; tx++)
+		{
+			ParticleTile tile;
+			tile.x0 = tx * TILE_SIZE;
+			tile.y0 = ty * TILE_SIZE;
+			tile.x1 = std::min(tile.x0 + TILE_SIZE, XRES);
+			tile.y1 = std::min(tile.y0 + TILE_SIZE, YRES);
+			tiles.push_back(tile);
+		}
+	tileHazards.resize((YRES/CELL + 1) * (XRES/CELL + 1));
+	cellFirst.resize(XRES * YRES);
+	cellLinks.resize(NPART);
+	// a multiple of 8, see RecalcFreeParticles
+	cellChanged.resize((XRES * YRES + 7) / 8 * 8);
 
 	//Create and attach gravity simulation
 	grav = new Gravity();
@@ -5396,6 +6037,20 @@ String Simulation::BasicParticleInfo(Particle const &sample_part) const
 	return sampleInfo.Build();
 }
 
+ByteString Simulation::ElementCostsCSV() const
+{
+	ByteStringBuilder csv;
+	csv << Format::Precision(3) << "element,calls,totalMs,meanUs\n";
+	for (int t = 1; t < PT_NUM; t++)
+	{
+		auto &cost = elementCosts[t];
+		if (!cost.calls)
+			continue;
+		csv << elements[t].Name.ToUtf8() << "," << cost.calls << "," << cost.seconds * 1000 << "," << cost.seconds * 1000000 / cost.calls << "\n";
+	}
+	return csv.Build();
+}
+
 bool Simulation::InBounds(int x, int y)
 {
 	return (x>=0 && y>=0 && x<XRES && y<YRES);
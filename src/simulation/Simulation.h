@@ -4,6 +4,7 @@
 
 #include <cstring>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <array>
 #include <memory>
@@ -16,12 +17,18 @@
 #include "BuiltinGOL.h"
 #include "MenuSection.h"
 #include "CoordStack.h"
+#include "ParticleTile.h"
+#include "common/tpt-rand.h"
+#include "ActiveParticles.h"
+#include "ParticleBuckets.h"
+#include "ParticleGrid.h"
 
 #include "Element.h"
 
 #define CHANNELS ((int)(MAX_TEMP-73)/100+2)
 
 class Snapshot;
+struct SnapshotDelta;
 class SimTool;
 class Brush;
 class SimulationSample;
@@ -33,6 +40,8 @@ class Renderer;
 class Gravity;
 class Air;
 class GameSave;
+class WorkerPool;
+class WaterBodies;
 
 class Simulation
 {
@@ -56,10 +65,7 @@ public:
 	char can_move[PT_NUM][PT_NUM];
 	int debug_currentParticle;
 	int parts_lastActiveIndex;
-	int pfree;
 	int NUM_PARTS;
-	bool elementRecount;
-	int elementCount[PT_NUM];
 	int ISWIRE;
 	bool force_stacking_check;
 	int emp_decor;
@@ -67,6 +73,43 @@ public:
 	bool etrd_count_valid;
 	int etrd_life0_count;
 	int lightningRecreate;
+	// What changed since the last snapshot, see UpdateSnapshot
+	uint64_t snapshotSerial;
+	bool snapshotDirtyAll;
+	int snapshotDirtyBegin, snapshotDirtyEnd;
+	// Parts of a frame whose time is measured while phaseTiming is set
+	enum FramePhase
+	{
+		phaseAir,
+		phaseGravity,
+		phaseRecalc,
+		phaseStacking,
+		phaseGoL,
+		phaseParticles,
+		phaseAfterSim,
+		phaseRender,
+		phaseCount,
+	};
+	static const char *const phaseNames[phaseCount];
+	static constexpr int phaseHistorySize = 120;
+	// Seconds spent on each phase, added to until cleared by whoever reads them
+	bool phaseTiming;
+	std::array<double, phaseCount> phaseTimes;
+	// Milliseconds spent on each phase in the last phaseHistorySize frames while phaseTiming
+	// was set, oldest first starting at phaseHistoryPos
+	std::array<std::array<float, phaseCount>, phaseHistorySize> phaseHistory;
+	int phaseHistoryPos;
+	// Calls to each element's Update and the time they took, added to while elementTiming is set
+	bool elementTiming;
+	std::array<ElementCost, PT_NUM> elementCosts;
+	// Every random number drawn in Load, Restore, BeforeSim, UpdateParticles and AfterSim comes from here,
+	// so that the same save and seed always simulate the same frames, see SetSeed
+	RNG rng;
+	// While deterministic is set, Newtonian gravity waits for its thread every frame, and stateHash
+	// is mixed with HashState at the end of every frame, so that the first frame where two runs
+	// that should be the same diverge can be found
+	bool deterministic;
+	uint64_t stateHash;
 	//Stickman
 	playerst player;
 	playerst player2;
@@ -99,6 +142,14 @@ public:
 	float fvy[YRES/CELL][XRES/CELL];
 	//Particles
 	Particle parts[NPART];
+	// parts[i].type kept in an array of its own, so that scans which only look at some
+	// types don't pull every particle into the cache; anything that sets parts[i].type
+	// without going through create_part, kill_part or part_change_type has to do it
+	// through SetPartType, which keeps this, activeParts, partsByType and partsGrid up to date
+	int partTypes[NPART];
+	ActiveParticles activeParts;
+	ParticleBuckets partsByType;
+	ParticleGrid partsGrid;
 	int pmap[YRES][XRES];
 	int photons[YRES][XRES];
 	unsigned int pmap_count[YRES][XRES];
@@ -117,13 +168,48 @@ public:
 
 	int Load(const GameSave * save, bool includePressure);
 	int Load(const GameSave * save, bool includePressure, int x, int y);
+	// Element IDs of save's palette for the elements given, partMap[id in save] is the ID to load as
+	static void MapPalette(const GameSave &save, const Element *elements, int (&partMap)[PT_NUM]);
+	// Maps part's type and the properties that hold a type, which must already be expanded
+	static void MapPartTypes(Particle &part, const int (&partMap)[PT_NUM], int pmapbits);
 	GameSave * Save(bool includePressure);
 	GameSave * Save(bool includePressure, int x1, int y1, int x2, int y2);
 	void SaveSimOptions(GameSave * gameSave);
 	SimulationSample GetSample(int x, int y);
 
 	std::unique_ptr<Snapshot> CreateSnapshot();
+	// Same, but reuses the memory snap already holds
+	void CreateSnapshot(Snapshot &snap);
+	// Copies the simulation into snap the same way, but snap is not one UpdateSnapshot can bring
+	// up to date, and the last snapshot CreateSnapshot returned still is; for copies other than the
+	// undo history's, e.g. Timeline's, which takes one every frame
+	void CopySnapshot(Snapshot &snap);
+	// Brings snap, which must be the last snapshot CreateSnapshot returned, up to date and returns
+	// how it changed, only looking at the particles that were changed since. Returns nullptr if snap
+	// isn't the last snapshot or anything could have changed, e.g. because the simulation was stepped.
+	std::unique_ptr<SnapshotDelta> UpdateSnapshot(Snapshot &snap);
 	void Restore(const Snapshot &snap);
+	// Seeds rng and restarts stateHash
+	void SetSeed(unsigned int seed);
+	// Hash of the particles, air and gravity as they are now; not cryptographic, but fast enough
+	// to take every frame
+	uint64_t HashState() const;
+	// Anything that writes to parts without going through create_part, kill_part, part_change_type
+	// or SetPartType has to mark what it wrote to, so that UpdateSnapshot can find it
+	void MarkPartDirty(int i)
+	{
+		// particles are only updated concurrently while everything is dirty anyway
+		if (snapshotDirtyAll)
+			return;
+		if (i < snapshotDirtyBegin)
+			snapshotDirtyBegin = i;
+		if (i >= snapshotDirtyEnd)
+			snapshotDirtyEnd = i + 1;
+	}
+	void MarkAllDirty()
+	{
+		snapshotDirtyAll = true;
+	}
 
 	int is_blocking(int t, int x, int y);
 	int is_boundary(int pt, int x, int y);
@@ -150,6 +236,26 @@ public:
 	int FloodINST(int x, int y);
 	void detach(int i);
 	bool part_change_type(int i, int x, int y, int t);
+	void SetPartType(int i, int t);
+	// Anything that writes to parts[i].x or parts[i].y without going through do_move has to
+	// call this afterwards, so that pmap_count and the particles in each cell follow it
+	void PartMoved(int i)
+	{
+		if (!mapsCurrent)
+			return;
+		int cell = partTypes[i] ? PartCell(i) : -1;
+		if (cell != cellLinks[i].cell)
+		{
+			UnlinkPart(i);
+			LinkPart(i, cell);
+		}
+	}
+	// For changes the particles in each cell can't follow, such as scripts changing what elements
+	// are; pmap, photons and pmap_count are rebuilt from scratch by the next RecalcFreeParticles
+	void InvalidateMaps()
+	{
+		mapsCurrent = false;
+	}
 	//int InCurrentBrush(int i, int j, int rx, int ry);
 	//int get_brush_flags();
 	int create_part(int p, int x, int y, int t, int v = -1);
@@ -162,7 +268,7 @@ public:
 	void create_arc(int sx, int sy, int dx, int dy, int midpoints, int variance, int type, int flags);
 	void UpdateParticles(int start, int end);
 	void SimulateGoL();
-	void RecalcFreeParticles(bool do_life_dec);
+	void RecalcFreeParticles(bool do_life_dec, bool countStacking = true);
 	void CheckStacking();
 	void BeforeSim();
 	void AfterSim();
@@ -171,6 +277,9 @@ public:
 
 	void SetEdgeMode(int newEdgeMode);
 	void SetDecoSpace(int newDecoSpace);
+	// Number of threads UpdateParticles may use, 1 keeps the plain serial update
+	void SetThreads(int newThreads);
+	int GetThreads() const;
 
 	//Drawing Deco
 	void ApplyDecoration(int x, int y, int colR, int colG, int colB, int colA, int mode);
@@ -206,7 +315,7 @@ public:
 
 	int GetParticleType(ByteString type);
 
-	void orbitalparts_get(int block1, int block2, int resblock1[], int resblock2[]);
+	static void orbitalparts_get(int block1, int block2, int resblock1[], int resblock2[]);
 	void orbitalparts_set(int *block1, int *block2, int resblock1[], int resblock2[]);
 	int get_wavelength_bin(int *wm);
 	int get_normal(int pt, int x, int y, float dx, float dy, float *nx, float *ny);
@@ -223,6 +332,7 @@ public:
 
 	String ElementResolve(int type, int ctype) const;
 	String BasicParticleInfo(Particle const &sample_part) const;
+	ByteString ElementCostsCSV() const;
 
 
 	struct CustomGOLData
@@ -246,6 +356,73 @@ public:
 
 private:
 	CoordStack& getCoordStackSingleton();
+
+	std::unique_ptr<WorkerPool> workers;
+	// Only allocated once water equalization is first used
+	std::unique_ptr<WaterBodies> waterBodies;
+	std::vector<ParticleTile> tiles;
+	std::array<bool, PT_NUM> tileLocalType;
+	std::vector<int> tileHazards;
+	std::vector<DeferredParticle> tileFixup;
+
+	// Recorded by RecalcFreeParticles for CheckStacking: cells whose pmap_count is past the
+	// stacking threshold, in screen order, along with their pmap_count at the time, and every
+	// particle that CheckStacking might have to replace, which is every particle in those cells
+	// that isn't an energy particle, along with the index of its cell in stackedCells.
+	static constexpr unsigned int stackingThreshold = 5;
+	struct StackedCell
+	{
+		int cell;
+		unsigned int count;
+		bool collapse; // set by CheckStacking if the cell is to form BHOL
+	};
+	std::vector<StackedCell> stackedCells;
+	std::vector<std::pair<int, int>> stackCandidates;
+	// Particles RecalcFreeParticles kills for running out of life
+	std::vector<int> lifeKills;
+	// The particles in each cell, so that pmap, photons and pmap_count can follow particles as
+	// they are created, killed, changed and moved instead of being rebuilt every frame. cellFirst
+	// holds the first particle in each cell, -1 if there is none, and cellLinks the cell each
+	// particle is linked into, -1 if it is off the screen, and the next and previous particle
+	// in it. cellChanged marks cells whose particles changed since the last RecalcFreeParticles,
+	// only those have pmap and photons worked out again. All of this is only kept up to date
+	// while mapsCurrent is set, see InvalidateMaps.
+	struct CellLink
+	{
+		int cell, next, prev;
+	};
+	std::vector<int> cellFirst;
+	std::vector<CellLink> cellLinks;
+	std::vector<unsigned char> cellChanged;
+	bool mapsCurrent = false;
+	// Whether particles of each type are counted in pmap_count, as of the last RebuildMaps
+	std::array<bool, PT_NUM> stackCounted;
+	// The cell parts[i] is in, -1 if it is off the screen
+	int PartCell(int i) const
+	{
+		int x = (int)(parts[i].x+0.5f), y = (int)(parts[i].y+0.5f);
+		return (x>=0 && y>=0 && x<XRES && y<YRES) ? y*XRES + x : -1;
+	}
+	void LinkPart(int i, int cell);
+	void UnlinkPart(int i);
+	// Puts what RebuildMaps would on pmap and photons in one cell
+	void ResolveCell(int cell);
+	// Returns the highest index in use
+	int RebuildMaps();
+#ifdef DEBUG
+	// Rebuilds the maps on the side and complains about every cell they differ in
+	void CheckMaps();
+#endif
+
+	std::array<double, phaseCount> phaseTimesRecorded; // phaseTimes at the last RecordPhaseHistory
+	void RecordPhaseHistory();
+
+	int AllocParticle();
+	void FreeParticle(int i);
+	void UpdateParticle(int i, ParticleTile *tile, const DeferredParticle *resume);
+	void UpdateParticlesTiled();
+
+	void CopyToSnapshot(Snapshot &snap);
 };
 
 #endif /* SIMULATION_H */
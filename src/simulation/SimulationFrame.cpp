@@ -0,0 +1,275 @@
+#include "SimulationFrame.h"
+
+#include "Air.h"
+#include "ElementClasses.h"
+#include "Gravity.h"
+#include "Simulation.h"
+#include "SimulationData.h"
+#include "WallType.h"
+
+#include "client/GameSave.h"
+
+#include <algorithm>
+
+static void ResolveSigns(Simulation &sim, std::vector<SimulationFrame::DrawnSign> &signs)
+{
+	signs.clear();
+	for (auto &original : sim.signs)
+	{
+		int x, y, w, h;
+		auto text = original.getDisplayText(&sim, x, y, w, h);
+		signs.push_back({ original, text, x, y, w, h });
+	}
+}
+
+void SimulationFrame::Reference(Simulation &sim)
+{
+	elements = sim.elements.data();
+	wtypes = sim.wtypes.data();
+	parts = sim.parts;
+	partTypes = sim.partTypes;
+	activeParts = &sim.activeParts;
+	parts_lastActiveIndex = sim.parts_lastActiveIndex;
+	pmap = sim.pmap;
+	photons = sim.photons;
+	pv = sim.air->pv;
+	vx = sim.air->vx;
+	vy = sim.air->vy;
+	hv = sim.air->hv;
+	gravx = sim.gravx;
+	gravy = sim.gravy;
+	gravmask = sim.grav->gravmask;
+	bmap = sim.bmap;
+	emap = sim.emap;
+	player = &sim.player;
+	player2 = &sim.player2;
+	fighters = sim.fighters;
+	ResolveSigns(sim, signs);
+	currentTick = sim.currentTick;
+	emp_decor = sim.emp_decor;
+	aheat_enable = sim.aheat_enable;
+}
+
+void SimulationFrame::Capture(Simulation &sim)
+{
+	if (!copy)
+	{
+		copy = std::make_unique<Copy>();
+	}
+	// * Only the particles up to the last one in use are copied, that's all render_parts looks at.
+	auto count = std::max(sim.parts_lastActiveIndex + 1, 0);
+	copy->parts.assign(sim.parts, sim.parts + count);
+	copy->partTypes.assign(sim.partTypes, sim.partTypes + count);
+	copy->activeParts.CopyActive(sim.activeParts);
+	std::copy(&sim.pmap[0][0], &sim.pmap[0][0] + YRES * XRES, &copy->pmap[0][0]);
+	std::copy(&sim.photons[0][0], &sim.photons[0][0] + YRES * XRES, &copy->photons[0][0]);
+	std::copy(&sim.air->pv[0][0], &sim.air->pv[0][0] + (YRES/CELL) * (XRES/CELL), &copy->pv[0][0]);
+	std::copy(&sim.air->vx[0][0], &sim.air->vx[0][0] + (YRES/CELL) * (XRES/CELL), &copy->vx[0][0]);
+	std::copy(&sim.air->vy[0][0], &sim.air->vy[0][0] + (YRES/CELL) * (XRES/CELL), &copy->vy[0][0]);
+	std::copy(&sim.air->hv[0][0], &sim.air->hv[0][0] + (YRES/CELL) * (XRES/CELL), &copy->hv[0][0]);
+	auto copyMap = [](auto *from, auto &to) {
+		if (from)
+		{
+			to.assign(from, from + (YRES/CELL) * (XRES/CELL));
+		}
+		else
+		{
+			to.clear();
+		}
+		return from ? to.data() : nullptr;
+	};
+	gravx = copyMap(sim.gravx, copy->gravx);
+	gravy = copyMap(sim.gravy, copy->gravy);
+	gravmask = copyMap(sim.grav->gravmask, copy->gravmask);
+	std::copy(&sim.bmap[0][0], &sim.bmap[0][0] + (YRES/CELL) * (XRES/CELL), &copy->bmap[0][0]);
+	std::copy(&sim.emap[0][0], &sim.emap[0][0] + (YRES/CELL) * (XRES/CELL), &copy->emap[0][0]);
+	copy->player = sim.player;
+	copy->player2 = sim.player2;
+	std::copy(sim.fighters, sim.fighters + MAX_FIGHTERS, copy->fighters);
+
+	elements = sim.elements.data();
+	wtypes = sim.wtypes.data();
+	parts = copy->parts.data();
+	partTypes = copy->partTypes.data();
+	activeParts = &copy->activeParts;
+	parts_lastActiveIndex = sim.parts_lastActiveIndex;
+	pmap = copy->pmap;
+	photons = copy->photons;
+	pv = copy->pv;
+	vx = copy->vx;
+	vy = copy->vy;
+	hv = copy->hv;
+	bmap = copy->bmap;
+	emap = copy->emap;
+	player = &copy->player;
+	player2 = &copy->player2;
+	fighters = copy->fighters;
+	ResolveSigns(sim, signs);
+	currentTick = sim.currentTick;
+	emp_decor = sim.emp_decor;
+	aheat_enable = sim.aheat_enable;
+}
+
+void Element_STKM_init_legs(playerst *playerp, const Particle &part);
+
+bool SimulationFrame::Load(const GameSave &originalSave)
+{
+	auto save = std::unique_ptr<GameSave>(new GameSave(originalSave));
+	try
+	{
+		save->Expand();
+	}
+	catch (const ParseException &)
+	{
+		return false;
+	}
+	if (!copy)
+	{
+		copy = std::make_unique<Copy>();
+	}
+	auto &builtinElements = GetElements();
+	static const std::vector<wall_type> builtinWalls = LoadWalls();
+	elements = builtinElements.data();
+	wtypes = builtinWalls.data();
+
+	int partMap[PT_NUM];
+	Simulation::MapPalette(*save, elements, partMap);
+
+	// * Particles keep the index they have in the save, so SOAP links stay as they are; the ones
+	//   Simulation::Load would refuse to place are left out.
+	auto count = std::min(std::max(save->particlesCount, 0), NPART);
+	copy->parts.assign(save->particles, save->particles + count);
+	copy->partTypes.assign(count, 0);
+	copy->activeParts.Clear();
+	std::fill(&copy->pmap[0][0], &copy->pmap[0][0] + YRES * XRES, 0);
+	std::fill(&copy->photons[0][0], &copy->photons[0][0] + YRES * XRES, 0);
+	copy->player = playerst();
+	copy->player2 = playerst();
+	std::fill(copy->fighters, copy->fighters + MAX_FIGHTERS, playerst());
+	bool spawn = false, spawn2 = false;
+	int fighterCount = 0;
+	parts_lastActiveIndex = -1;
+	for (int i = 0; i < count; i++)
+	{
+		auto &part = copy->parts[i];
+		int x = int(part.x + 0.5f);
+		int y = int(part.y + 0.5f);
+		if (part.type <= 0 || part.type >= PT_NUM || x < 0 || y < 0 || x >= XRES || y >= YRES)
+			continue;
+		Simulation::MapPartTypes(part, partMap, save->pmapbits);
+		int t = part.type;
+		if (t <= 0 || t >= PT_NUM || !elements[t].Enabled)
+			continue;
+		if ((t == PT_STKM && copy->player.spwn) || (t == PT_STKM2 && copy->player2.spwn) || (t == PT_SPAWN && spawn) || (t == PT_SPAWN2 && spawn2))
+			continue;
+		if (t == PT_FIGH && fighterCount == MAX_FIGHTERS)
+			continue;
+
+		playerst *stickman = nullptr;
+		bool fan = (save->majorVersion < 93 && part.ctype == SPC_AIR) || (save->majorVersion < 88 && part.ctype == OLD_SPC_AIR);
+		bool rocketBoots = false;
+		switch (t)
+		{
+		case PT_STKM:
+			stickman = &copy->player;
+			fan = fan || save->stkm.fan1;
+			rocketBoots = save->stkm.rocketBoots1;
+			break;
+		case PT_STKM2:
+			stickman = &copy->player2;
+			fan = fan || save->stkm.fan2;
+			rocketBoots = save->stkm.rocketBoots2;
+			break;
+		case PT_SPAWN:
+			spawn = true;
+			break;
+		case PT_SPAWN2:
+			spawn2 = true;
+			break;
+		case PT_FIGH:
+			if (fan)
+				part.ctype = 0;
+			for (unsigned int fighNum : save->stkm.fanFigh)
+			{
+				if (fighNum == (unsigned int)part.tmp)
+					fan = true;
+			}
+			for (unsigned int fighNum : save->stkm.rocketBootsFigh)
+			{
+				if (fighNum == (unsigned int)part.tmp)
+					rocketBoots = true;
+			}
+			stickman = &copy->fighters[fighterCount];
+			part.tmp = fighterCount++;
+			break;
+		}
+		if (stickman)
+		{
+			Element_STKM_init_legs(stickman, part);
+			stickman->spwn = 1;
+			stickman->elem = (t == PT_FIGH && part.ctype > 0 && part.ctype < PT_NUM) ? part.ctype : PT_DUST;
+			stickman->fan = fan;
+			stickman->rocketBoots = rocketBoots;
+		}
+
+		copy->partTypes[i] = t;
+		copy->activeParts.Add(i);
+		parts_lastActiveIndex = i;
+		if (elements[t].Properties & TYPE_ENERGY)
+			copy->photons[y][x] = PMAP(i, t);
+		else if (!copy->pmap[y][x] || (t != PT_INVIS && t != PT_FILT))
+			copy->pmap[y][x] = PMAP(i, t);
+	}
+
+	for (int y = 0; y < YRES/CELL; y++)
+	{
+		for (int x = 0; x < XRES/CELL; x++)
+		{
+			bool inSave = x < save->blockWidth && y < save->blockHeight;
+			copy->bmap[y][x] = inSave ? save->blockMap[y][x] : 0;
+			copy->emap[y][x] = 0;
+			bool pressure = inSave && save->hasPressure;
+			copy->pv[y][x] = pressure ? save->pressure[y][x] : 0.0f;
+			copy->vx[y][x] = pressure ? save->velocityX[y][x] : 0.0f;
+			copy->vy[y][x] = pressure ? save->velocityY[y][x] : 0.0f;
+			copy->hv[y][x] = (inSave && save->hasAmbientHeat) ? save->ambientHeat[y][x] : save->ambientAirTemp;
+		}
+	}
+	copy->gravx.assign((YRES/CELL) * (XRES/CELL), 0.0f);
+	copy->gravy.assign((YRES/CELL) * (XRES/CELL), 0.0f);
+	copy->gravmask.assign((YRES/CELL) * (XRES/CELL), 0);
+
+	parts = copy->parts.data();
+	partTypes = copy->partTypes.data();
+	activeParts = &copy->activeParts;
+	pmap = copy->pmap;
+	photons = copy->photons;
+	pv = copy->pv;
+	vx = copy->vx;
+	vy = copy->vy;
+	hv = copy->hv;
+	gravx = copy->gravx.data();
+	gravy = copy->gravy.data();
+	gravmask = copy->gravmask.data();
+	bmap = copy->bmap;
+	emap = copy->emap;
+	player = &copy->player;
+	player2 = &copy->player2;
+	fighters = copy->fighters;
+	signs.clear();
+	for (auto &original : save->signs)
+	{
+		if (signs.size() == MAXSIGNS)
+			break;
+		if (!original.text.length())
+			continue;
+		// * There is no simulation for {t}, {p} and {type} to read, they show as they would over empty space.
+		int x, y, w, h;
+		auto text = original.getDisplayText(nullptr, x, y, w, h);
+		signs.push_back({ original, text, x, y, w, h });
+	}
+	currentTick = 0;
+	emp_decor = 0;
+	aheat_enable = false;
+	return true;
+}
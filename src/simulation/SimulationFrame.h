@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Config.h"
+#include "common/String.h"
+#include "ActiveParticles.h"
+#include "Particle.h"
+#include "Sign.h"
+#include "Stickman.h"
+
+class Element;
+class GameSave;
+class Simulation;
+struct wall_type;
+
+// What Renderer draws of a Simulation. Reference points it straight at the simulation, which is
+// what happens unless the simulation is stepped on a thread of its own. Capture copies what the
+// renderer needs out of the simulation instead, so that it can be drawn while the next tick is
+// running, see SimulationRunner. Load lays out a save without any simulation, see SaveRenderer.
+class SimulationFrame
+{
+	// Storage for Capture and Load, only allocated once either is first called
+	struct Copy
+	{
+		std::vector<Particle> parts;
+		std::vector<int> partTypes;
+		ActiveParticles activeParts;
+		int pmap[YRES][XRES];
+		int photons[YRES][XRES];
+		float pv[YRES/CELL][XRES/CELL];
+		float vx[YRES/CELL][XRES/CELL];
+		float vy[YRES/CELL][XRES/CELL];
+		float hv[YRES/CELL][XRES/CELL];
+		std::vector<float> gravx;
+		std::vector<float> gravy;
+		std::vector<unsigned> gravmask;
+		unsigned char bmap[YRES/CELL][XRES/CELL];
+		unsigned char emap[YRES/CELL][XRES/CELL];
+		playerst player;
+		playerst player2;
+		playerst fighters[MAX_FIGHTERS];
+	};
+	std::unique_ptr<Copy> copy;
+
+public:
+	struct DrawnSign
+	{
+		sign original;
+		String text;
+		int x, y, w, h;
+	};
+
+	const Element *elements = nullptr;
+	const wall_type *wtypes = nullptr;
+
+	// Not const, since element graphics functions take a Particle *
+	Particle *parts = nullptr;
+	const int *partTypes = nullptr;
+	const ActiveParticles *activeParts = nullptr;
+	int parts_lastActiveIndex = 0;
+	const int (*pmap)[XRES] = nullptr;
+	const int (*photons)[XRES] = nullptr;
+
+	const float (*pv)[XRES/CELL] = nullptr;
+	const float (*vx)[XRES/CELL] = nullptr;
+	const float (*vy)[XRES/CELL] = nullptr;
+	const float (*hv)[XRES/CELL] = nullptr;
+	const float *gravx = nullptr;
+	const float *gravy = nullptr;
+	const unsigned *gravmask = nullptr;
+	const unsigned char (*bmap)[XRES/CELL] = nullptr;
+	const unsigned char (*emap)[XRES/CELL] = nullptr;
+
+	const playerst *player = nullptr;
+	const playerst *player2 = nullptr;
+	const playerst *fighters = nullptr;
+	// Signs along with the text and box they are drawn with
+	std::vector<DrawnSign> signs;
+
+	int currentTick = 0;
+	int emp_decor = 0;
+	bool aheat_enable = false;
+
+	SimulationFrame() = default;
+	SimulationFrame(const SimulationFrame &) = delete;
+	SimulationFrame &operator =(const SimulationFrame &) = delete;
+
+	void Reference(Simulation &sim);
+	void Capture(Simulation &sim);
+	// Places the particles, walls, air and signs of save at the top left the way Simulation::Load
+	// would with the built-in elements, with no gravity; false if save can't be expanded
+	bool Load(const GameSave &save);
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include "Particle.h"
@@ -36,6 +37,9 @@ public:
 
 	Json::Value Authors;
 
+	// Which Simulation::CreateSnapshot call this came from, see Simulation::UpdateSnapshot
+	uint64_t SimulationSerial;
+
 	Snapshot() :
 		AirPressure(),
 		AirVelocityX(),
@@ -53,7 +57,8 @@ public:
 		PortalParticles(),
 		WirelessData(),
 		stickmen(),
-		signs()
+		signs(),
+		SimulationSerial(0)
 	{
 
 	}
@@ -62,4 +67,31 @@ public:
 	{
 
 	}
+
+	// Roughly how much memory this takes up
+	size_t Bytes() const
+	{
+		size_t bytes = sizeof(Snapshot);
+		bytes += AirPressure    .size() * sizeof(float        );
+		bytes += AirVelocityX   .size() * sizeof(float        );
+		bytes += AirVelocityY   .size() * sizeof(float        );
+		bytes += AmbientHeat    .size() * sizeof(float        );
+		bytes += Particles      .size() * sizeof(Particle     );
+		bytes += GravVelocityX  .size() * sizeof(float        );
+		bytes += GravVelocityY  .size() * sizeof(float        );
+		bytes += GravValue      .size() * sizeof(float        );
+		bytes += GravMap        .size() * sizeof(float        );
+		bytes += BlockMap       .size() * sizeof(unsigned char);
+		bytes += ElecMap        .size() * sizeof(unsigned char);
+		bytes += FanVelocityX   .size() * sizeof(float        );
+		bytes += FanVelocityY   .size() * sizeof(float        );
+		bytes += PortalParticles.size() * sizeof(Particle     );
+		bytes += WirelessData   .size() * sizeof(int          );
+		bytes += stickmen       .size() * sizeof(playerst     );
+		for (auto &item : signs)
+		{
+			bytes += sizeof(item) + item.text.size() * sizeof(String::value_type);
+		}
+		return bytes;
+	}
 };
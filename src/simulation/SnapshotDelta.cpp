@@ -2,7 +2,10 @@
 
 #include "common/tpt-minmax.h"
 
+#include <cstring>
+#include <stdexcept>
 #include <utility>
+#include <zlib.h>
 
 // * A SnapshotDelta is a bidirectional difference type between Snapshots, defined such
 //   that SnapshotDelta d = SnapshotDelta::FromSnapshots(A, B) yields a SnapshotDelta which can be
@@ -25,7 +28,8 @@
 //   of Hunks, a Hunk is an offset combined with a collection of Diffs, and a Diff is a pair of values,
 //   one originating from one stream and the other from the other. Thus, Hunks represent contiguous
 //   sequences of differences between the two streams, and a HunkVector is a compact way to represent
-//   all differences between the two streams it's generated from. In this case, these streams are
+//   all differences between the two streams it's generated from. A Hunk may also hold a few pairs of
+//   equal values, where that is cheaper than ending it and starting another. In this case, these streams are
 //   the data in corresponding fields of static size in two Snapshots, and the HunkVector is the
 //   respective field in the SnapshotDelta that is the difference between the two Snapshots.
 //   * FillHunkVectorPtr is the d = B - A operation, which takes two Snapshot fields of static size and
@@ -68,6 +72,20 @@
 //   structs, even though Snapshot::stickmen is not big enough for us to benefit from this. The
 //   alternative would have been to implement operator ==(const playerst &, const playerst &), which
 //   would have been tedious.
+// * Comparing all of Particles and PortalParticles is by far the most expensive part of FromSnapshots,
+//   and most of the time, e.g. after a brush stroke on a paused simulation, most of it is the same.
+//   FromPartialSnapshot is the d = B - A operation for when it is known which particles can differ:
+//   it takes A and a partial Snapshot which only holds the particles of B from partsBegin up to some
+//   index, partsCount, the size of B's Particles, and B's PortalParticles only if they may differ from
+//   A's. Every other field is complete. The particles before partsBegin, the ones after those held in
+//   the partial Snapshot up to partsCount, and the portal particles if they are missing, are assumed
+//   to be the same in A and B. A is then turned into B by applying d, which is cheaper than copying
+//   B in full. Simulation::UpdateSnapshot builds these partial Snapshots.
+// * Compress writes every field of a SnapshotDelta into one buffer and deflates it, and Decompress
+//   does the opposite. A HunkVector is written as its number of Hunks, followed by the offset and
+//   the Diffs of each, the old and new items interleaved the way they are in memory, which deflate
+//   does well on, as most of the time the two are similar. The buffer never leaves the process, so
+//   items are written as they are in memory.
 
 constexpr size_t ParticleUint32Count = sizeof(Particle) / sizeof(uint32_t);
 static_assert(sizeof(Particle) % sizeof(uint32_t) == 0, "fix me");
@@ -121,37 +139,37 @@ bool operator ==(const std::vector<sign> &lhs, const std::vector<sign> &rhs)
 template<class Item>
 void FillHunkVectorPtr(const Item *oldItems, const Item *newItems, SnapshotDelta::HunkVector<Item> &out, size_t size)
 {
-	auto i = 0U;
-	bool different = false;
-	auto offset = 0U;
-	auto markDifferent = [oldItems, newItems, &out, &i, &different, &offset](bool mark) {
-		if (mark && !different)
+	// * Fewer than maxGap identical items between two differences are cheaper to store as Diffs
+	//   than as the end of one Hunk and the start of another, so they are kept in the same Hunk.
+	constexpr size_t maxGap = (sizeof(SnapshotDelta::Hunk<Item>) + 16U) / sizeof(SnapshotDelta::Diff<Item>);
+	size_t i = 0U;
+	while (i < size)
+	{
+		if (oldItems[i] == newItems[i])
 		{
-			different = true;
-			offset = i;
+			i += 1U;
+			continue;
 		}
-		else if (!mark && different)
+		auto offset = i;
+		auto end = i + 1U;
+		for (i = end; i < size && i - end < maxGap; i += 1U)
 		{
-			different = false;
-			auto size = i - offset;
-			out.emplace_back();
-			auto &hunk = out.back();
-			hunk.offset = offset;
-			auto &diffs = hunk.diffs;
-			diffs.resize(size);
-			for (auto j = 0U; j < size; ++j)
+			if (!(oldItems[i] == newItems[i]))
 			{
-				diffs[j].oldItem = oldItems[offset + j];
-				diffs[j].newItem = newItems[offset + j];
+				end = i + 1U;
 			}
 		}
-	};
-	while (i < size)
-	{
-		markDifferent(!(oldItems[i] == newItems[i]));
-		i += 1U;
+		out.emplace_back();
+		auto &hunk = out.back();
+		hunk.offset = int(offset);
+		auto &diffs = hunk.diffs;
+		diffs.resize(end - offset);
+		for (auto j = 0U; j < diffs.size(); ++j)
+		{
+			diffs[j].oldItem = oldItems[offset + j];
+			diffs[j].newItem = newItems[offset + j];
+		}
 	}
-	markDifferent(false);
 }
 
 template<class Item>
@@ -233,10 +251,82 @@ std::unique_ptr<SnapshotDelta> SnapshotDelta::FromSnapshots(const Snapshot &oldS
 	return ptr;
 }
 
+std::unique_ptr<SnapshotDelta> SnapshotDelta::FromPartialSnapshot(Snapshot &oldSnap, const Snapshot &partial, size_t partsBegin, size_t partsCount)
+{
+	auto ptr = std::make_unique<SnapshotDelta>();
+	auto &delta = *ptr;
+	FillHunkVector(oldSnap.AirPressure    , partial.AirPressure    , delta.AirPressure    );
+	FillHunkVector(oldSnap.AirVelocityX   , partial.AirVelocityX   , delta.AirVelocityX   );
+	FillHunkVector(oldSnap.AirVelocityY   , partial.AirVelocityY   , delta.AirVelocityY   );
+	FillHunkVector(oldSnap.AmbientHeat    , partial.AmbientHeat    , delta.AmbientHeat    );
+	FillHunkVector(oldSnap.GravVelocityX  , partial.GravVelocityX  , delta.GravVelocityX  );
+	FillHunkVector(oldSnap.GravVelocityY  , partial.GravVelocityY  , delta.GravVelocityY  );
+	FillHunkVector(oldSnap.GravValue      , partial.GravValue      , delta.GravValue      );
+	FillHunkVector(oldSnap.GravMap        , partial.GravMap        , delta.GravMap        );
+	FillHunkVector(oldSnap.BlockMap       , partial.BlockMap       , delta.BlockMap       );
+	FillHunkVector(oldSnap.ElecMap        , partial.ElecMap        , delta.ElecMap        );
+	FillHunkVector(oldSnap.FanVelocityX   , partial.FanVelocityX   , delta.FanVelocityX   );
+	FillHunkVector(oldSnap.FanVelocityY   , partial.FanVelocityY   , delta.FanVelocityY   );
+	FillHunkVector(oldSnap.WirelessData   , partial.WirelessData   , delta.WirelessData   );
+	FillSingleDiff(oldSnap.signs          , partial.signs          , delta.signs          );
+	FillSingleDiff(oldSnap.Authors        , partial.Authors        , delta.Authors        );
+	if (partial.PortalParticles.size())
+	{
+		FillHunkVectorPtr(reinterpret_cast<const uint32_t *>(&oldSnap.PortalParticles[0]), reinterpret_cast<const uint32_t *>(&partial.PortalParticles[0]), delta.PortalParticles, partial.PortalParticles.size() * ParticleUint32Count);
+	}
+	FillHunkVectorPtr(reinterpret_cast<const uint32_t *>(&oldSnap.stickmen[0]), reinterpret_cast<const uint32_t *>(&partial.stickmen[0]), delta.stickmen, partial.stickmen.size() * playerstUint32Count);
+
+	// * Only the particles the partial Snapshot holds are diffed, with the offsets of the resulting
+	//   hunks moved to where these particles are in the full arrays.
+	auto commonSize = std::min(oldSnap.Particles.size(), partsCount);
+	auto diffEnd = std::min(partsBegin + partial.Particles.size(), commonSize);
+	if (partsBegin < diffEnd)
+	{
+		FillHunkVectorPtr(reinterpret_cast<const uint32_t *>(&oldSnap.Particles[partsBegin]), reinterpret_cast<const uint32_t *>(&partial.Particles[0]), delta.commonParticles, (diffEnd - partsBegin) * ParticleUint32Count);
+		for (auto &hunk : delta.commonParticles)
+		{
+			hunk.offset += int(partsBegin * ParticleUint32Count);
+		}
+	}
+	delta.extraPartsOld.assign(oldSnap.Particles.begin() + commonSize, oldSnap.Particles.end());
+	if (partsCount > commonSize)
+	{
+		delta.extraPartsNew.assign(partial.Particles.begin() + (commonSize - partsBegin), partial.Particles.end());
+	}
+
+	// * Now turn oldSnap into the logical new Snapshot, the same way Forward would.
+	ApplyHunkVector<false>(delta.AirPressure    , oldSnap.AirPressure    );
+	ApplyHunkVector<false>(delta.AirVelocityX   , oldSnap.AirVelocityX   );
+	ApplyHunkVector<false>(delta.AirVelocityY   , oldSnap.AirVelocityY   );
+	ApplyHunkVector<false>(delta.AmbientHeat    , oldSnap.AmbientHeat    );
+	ApplyHunkVector<false>(delta.GravVelocityX  , oldSnap.GravVelocityX  );
+	ApplyHunkVector<false>(delta.GravVelocityY  , oldSnap.GravVelocityY  );
+	ApplyHunkVector<false>(delta.GravValue      , oldSnap.GravValue      );
+	ApplyHunkVector<false>(delta.GravMap        , oldSnap.GravMap        );
+	ApplyHunkVector<false>(delta.BlockMap       , oldSnap.BlockMap       );
+	ApplyHunkVector<false>(delta.ElecMap        , oldSnap.ElecMap        );
+	ApplyHunkVector<false>(delta.FanVelocityX   , oldSnap.FanVelocityX   );
+	ApplyHunkVector<false>(delta.FanVelocityY   , oldSnap.FanVelocityY   );
+	ApplyHunkVector<false>(delta.WirelessData   , oldSnap.WirelessData   );
+	ApplySingleDiff<false>(delta.signs          , oldSnap.signs          );
+	ApplySingleDiff<false>(delta.Authors        , oldSnap.Authors        );
+	ApplyHunkVectorPtr<false>(delta.PortalParticles, reinterpret_cast<uint32_t *>(&oldSnap.PortalParticles[0]));
+	ApplyHunkVectorPtr<false>(delta.stickmen       , reinterpret_cast<uint32_t *>(&oldSnap.stickmen[0]       ));
+	oldSnap.Particles.resize(partsCount);
+	std::copy(partial.Particles.begin(), partial.Particles.end(), oldSnap.Particles.begin() + partsBegin);
+
+	return ptr;
+}
+
 std::unique_ptr<Snapshot> SnapshotDelta::Forward(const Snapshot &oldSnap)
 {
 	auto ptr = std::make_unique<Snapshot>(oldSnap);
-	auto &newSnap = *ptr;
+	ForwardInPlace(*ptr);
+	return ptr;
+}
+
+void SnapshotDelta::ForwardInPlace(Snapshot &newSnap) const
+{
 	ApplyHunkVector<false>(AirPressure    , newSnap.AirPressure    );
 	ApplyHunkVector<false>(AirVelocityX   , newSnap.AirVelocityX   );
 	ApplyHunkVector<false>(AirVelocityY   , newSnap.AirVelocityY   );
@@ -257,11 +347,9 @@ std::unique_ptr<Snapshot> SnapshotDelta::Forward(const Snapshot &oldSnap)
 
 	// * Slightly more interesting; apply the common hunk vector, copy the extra portion separaterly.
 	ApplyHunkVectorPtr<false>(commonParticles, reinterpret_cast<uint32_t *>(&newSnap.Particles[0]));
-	auto commonSize = oldSnap.Particles.size() - extraPartsOld.size();
+	auto commonSize = newSnap.Particles.size() - extraPartsOld.size();
 	newSnap.Particles.resize(commonSize + extraPartsNew.size());
 	std::copy(extraPartsNew.begin(), extraPartsNew.end(), newSnap.Particles.begin() + commonSize);
-
-	return ptr;
 }
 
 std::unique_ptr<Snapshot> SnapshotDelta::Restore(const Snapshot &newSnap)
@@ -294,3 +382,267 @@ std::unique_ptr<Snapshot> SnapshotDelta::Restore(const Snapshot &newSnap)
 
 	return ptr;
 }
+
+namespace
+{
+	class DeltaWriter
+	{
+	public:
+		std::vector<char> data;
+
+		template<class Item>
+		void Put(const Item &item)
+		{
+			auto *bytes = reinterpret_cast<const char *>(&item);
+			data.insert(data.end(), bytes, bytes + sizeof(Item));
+		}
+
+		template<class Item>
+		void PutItems(const Item *items, size_t count)
+		{
+			Put(uint32_t(count));
+			auto *bytes = reinterpret_cast<const char *>(items);
+			data.insert(data.end(), bytes, bytes + count * sizeof(Item));
+		}
+
+		template<class Item>
+		void PutHunks(const SnapshotDelta::HunkVector<Item> &hunks)
+		{
+			Put(uint32_t(hunks.size()));
+			for (auto &hunk : hunks)
+			{
+				Put(hunk.offset);
+				PutItems(hunk.diffs.data(), hunk.diffs.size());
+			}
+		}
+
+		void PutSigns(const std::vector<sign> &signs)
+		{
+			Put(uint32_t(signs.size()));
+			for (auto &item : signs)
+			{
+				Put(item.x);
+				Put(item.y);
+				Put(int(item.ju));
+				auto text = item.text.ToUtf8();
+				PutItems(text.data(), text.size());
+			}
+		}
+
+		void PutJson(const Json::Value &value)
+		{
+			auto text = Json::FastWriter().write(value);
+			PutItems(text.data(), text.size());
+		}
+
+		template<class Item, class PutItem>
+		void PutSingleDiff(const SnapshotDelta::SingleDiff<Item> &diff, PutItem putItem)
+		{
+			Put(diff.valid);
+			if (diff.valid)
+			{
+				(this->*putItem)(diff.diff.oldItem);
+				(this->*putItem)(diff.diff.newItem);
+			}
+		}
+	};
+
+	class DeltaReader
+	{
+		const char *pos, *end;
+
+		void Need(size_t size)
+		{
+			if (size_t(end - pos) < size)
+			{
+				throw std::runtime_error("truncated snapshot delta");
+			}
+		}
+
+	public:
+		DeltaReader(const std::vector<char> &data) : pos(data.data()), end(data.data() + data.size())
+		{
+		}
+
+		template<class Item>
+		Item Get()
+		{
+			Item item;
+			Need(sizeof(Item));
+			std::memcpy(&item, pos, sizeof(Item));
+			pos += sizeof(Item);
+			return item;
+		}
+
+		template<class Item>
+		void GetItems(std::vector<Item> &items)
+		{
+			auto count = Get<uint32_t>();
+			Need(count * sizeof(Item));
+			items.resize(count);
+			std::memcpy(items.data(), pos, count * sizeof(Item));
+			pos += count * sizeof(Item);
+		}
+
+		template<class Item>
+		void GetHunks(SnapshotDelta::HunkVector<Item> &hunks)
+		{
+			hunks.resize(Get<uint32_t>());
+			for (auto &hunk : hunks)
+			{
+				hunk.offset = Get<int>();
+				GetItems(hunk.diffs);
+			}
+		}
+
+		void GetSigns(std::vector<sign> &signs)
+		{
+			auto count = Get<uint32_t>();
+			for (auto i = 0U; i < count; ++i)
+			{
+				auto x = Get<int>();
+				auto y = Get<int>();
+				auto ju = sign::Justification(Get<int>());
+				std::vector<char> text;
+				GetItems(text);
+				signs.push_back(sign(ByteString(text.begin(), text.end()).FromUtf8(), x, y, ju));
+			}
+		}
+
+		void GetJson(Json::Value &value)
+		{
+			std::vector<char> text;
+			GetItems(text);
+			Json::Reader().parse(std::string(text.begin(), text.end()), value);
+		}
+
+		template<class Item, class GetItem>
+		void GetSingleDiff(SnapshotDelta::SingleDiff<Item> &diff, GetItem getItem)
+		{
+			diff.valid = Get<bool>();
+			if (diff.valid)
+			{
+				(this->*getItem)(diff.diff.oldItem);
+				(this->*getItem)(diff.diff.newItem);
+			}
+		}
+	};
+
+	template<class Item>
+	size_t HunkBytes(const SnapshotDelta::HunkVector<Item> &hunks)
+	{
+		size_t bytes = hunks.size() * sizeof(SnapshotDelta::Hunk<Item>);
+		for (auto &hunk : hunks)
+		{
+			bytes += hunk.diffs.size() * sizeof(SnapshotDelta::Diff<Item>);
+		}
+		return bytes;
+	}
+}
+
+size_t SnapshotDelta::Bytes() const
+{
+	size_t bytes = sizeof(SnapshotDelta);
+	bytes += HunkBytes(AirPressure    );
+	bytes += HunkBytes(AirVelocityX   );
+	bytes += HunkBytes(AirVelocityY   );
+	bytes += HunkBytes(AmbientHeat    );
+	bytes += HunkBytes(commonParticles);
+	bytes += HunkBytes(GravVelocityX  );
+	bytes += HunkBytes(GravVelocityY  );
+	bytes += HunkBytes(GravValue      );
+	bytes += HunkBytes(GravMap        );
+	bytes += HunkBytes(BlockMap       );
+	bytes += HunkBytes(ElecMap        );
+	bytes += HunkBytes(FanVelocityX   );
+	bytes += HunkBytes(FanVelocityY   );
+	bytes += HunkBytes(PortalParticles);
+	bytes += HunkBytes(WirelessData   );
+	bytes += HunkBytes(stickmen       );
+	bytes += (extraPartsOld.size() + extraPartsNew.size()) * sizeof(Particle);
+	if (signs.valid)
+	{
+		bytes += (signs.diff.oldItem.size() + signs.diff.newItem.size()) * sizeof(sign);
+	}
+	return bytes;
+}
+
+std::vector<char> SnapshotDelta::Compress() const
+{
+	DeltaWriter writer;
+	writer.PutHunks(AirPressure    );
+	writer.PutHunks(AirVelocityX   );
+	writer.PutHunks(AirVelocityY   );
+	writer.PutHunks(AmbientHeat    );
+	writer.PutHunks(commonParticles);
+	writer.PutItems(extraPartsOld.data(), extraPartsOld.size());
+	writer.PutItems(extraPartsNew.data(), extraPartsNew.size());
+	writer.PutHunks(GravVelocityX  );
+	writer.PutHunks(GravVelocityY  );
+	writer.PutHunks(GravValue      );
+	writer.PutHunks(GravMap        );
+	writer.PutHunks(BlockMap       );
+	writer.PutHunks(ElecMap        );
+	writer.PutHunks(FanVelocityX   );
+	writer.PutHunks(FanVelocityY   );
+	writer.PutHunks(PortalParticles);
+	writer.PutHunks(WirelessData   );
+	writer.PutHunks(stickmen       );
+	writer.PutSingleDiff(signs  , &DeltaWriter::PutSigns);
+	writer.PutSingleDiff(Authors, &DeltaWriter::PutJson );
+
+	// * The size of the serialised data goes first, so Decompress knows how much to allocate.
+	auto &raw = writer.data;
+	uLongf compressedSize = compressBound(uLong(raw.size()));
+	std::vector<char> compressed(sizeof(uint32_t) + compressedSize);
+	uint32_t rawSize = uint32_t(raw.size());
+	std::memcpy(compressed.data(), &rawSize, sizeof(rawSize));
+	if (compress2(reinterpret_cast<Bytef *>(compressed.data() + sizeof(rawSize)), &compressedSize, reinterpret_cast<const Bytef *>(raw.data()), uLong(raw.size()), Z_BEST_SPEED) != Z_OK)
+	{
+		throw std::runtime_error("failed to compress snapshot delta");
+	}
+	compressed.resize(sizeof(rawSize) + compressedSize);
+	compressed.shrink_to_fit();
+	return compressed;
+}
+
+std::unique_ptr<SnapshotDelta> SnapshotDelta::Decompress(const std::vector<char> &data)
+{
+	uint32_t rawSize;
+	if (data.size() < sizeof(rawSize))
+	{
+		throw std::runtime_error("truncated snapshot delta");
+	}
+	std::memcpy(&rawSize, data.data(), sizeof(rawSize));
+	std::vector<char> raw(rawSize);
+	uLongf decompressedSize = rawSize;
+	if (uncompress(reinterpret_cast<Bytef *>(raw.data()), &decompressedSize, reinterpret_cast<const Bytef *>(data.data() + sizeof(rawSize)), uLong(data.size() - sizeof(rawSize))) != Z_OK || decompressedSize != rawSize)
+	{
+		throw std::runtime_error("failed to decompress snapshot delta");
+	}
+
+	auto ptr = std::make_unique<SnapshotDelta>();
+	auto &delta = *ptr;
+	DeltaReader reader(raw);
+	reader.GetHunks(delta.AirPressure    );
+	reader.GetHunks(delta.AirVelocityX   );
+	reader.GetHunks(delta.AirVelocityY   );
+	reader.GetHunks(delta.AmbientHeat    );
+	reader.GetHunks(delta.commonParticles);
+	reader.GetItems(delta.extraPartsOld  );
+	reader.GetItems(delta.extraPartsNew  );
+	reader.GetHunks(delta.GravVelocityX  );
+	reader.GetHunks(delta.GravVelocityY  );
+	reader.GetHunks(delta.GravValue      );
+	reader.GetHunks(delta.GravMap        );
+	reader.GetHunks(delta.BlockMap       );
+	reader.GetHunks(delta.ElecMap        );
+	reader.GetHunks(delta.FanVelocityX   );
+	reader.GetHunks(delta.FanVelocityY   );
+	reader.GetHunks(delta.PortalParticles);
+	reader.GetHunks(delta.WirelessData   );
+	reader.GetHunks(delta.stickmen       );
+	reader.GetSingleDiff(delta.signs  , &DeltaReader::GetSigns);
+	reader.GetSingleDiff(delta.Authors, &DeltaReader::GetJson );
+	return ptr;
+}
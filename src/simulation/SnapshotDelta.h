@@ -71,6 +71,15 @@ struct SnapshotDelta
 	SingleDiff<Json::Value> Authors;
 
 	static std::unique_ptr<SnapshotDelta> FromSnapshots(const Snapshot &oldSnap, const Snapshot &newSnap);
+	static std::unique_ptr<SnapshotDelta> FromPartialSnapshot(Snapshot &oldSnap, const Snapshot &partial, size_t partsBegin, size_t partsCount);
 	std::unique_ptr<Snapshot> Forward(const Snapshot &oldSnap);
+	// Same as Forward, but turns snap itself into the new Snapshot instead of copying it
+	void ForwardInPlace(Snapshot &snap) const;
 	std::unique_ptr<Snapshot> Restore(const Snapshot &newSnap);
+
+	// Roughly how much memory this takes up
+	size_t Bytes() const;
+	// Serialised and deflated, for deltas that are not going to be needed for a while
+	std::vector<char> Compress() const;
+	static std::unique_ptr<SnapshotDelta> Decompress(const std::vector<char> &data);
 };
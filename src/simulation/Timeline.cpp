@@ -0,0 +1,218 @@
+#include "Timeline.h"
+
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "SnapshotDelta.h"
+
+#include <algorithm>
+
+// * Recording a frame only copies the simulation into a Snapshot, the one recorded the frame
+//   before that having been handed to the diff thread; the two trade places every frame, so
+//   their memory is reused instead of allocated anew. The diff thread diffs the two, or copies
+//   the new one if it's a keyframe, while the simulation goes on to the next frame, and Record
+//   waits for it before handing it the next pair. In a running simulation most particles change
+//   every frame, so diffing takes about as long as copying, and the simulation only ever waits
+//   for it if it takes longer than a whole frame.
+// * Getting a frame back means copying the keyframe at or before it and Forwarding that in place
+//   through the SnapshotDeltas up to it, so it never takes more than keyframeInterval steps.
+// * Frames are only ever dropped a keyframe at a time, so every SnapshotDelta left has the keyframe
+//   it builds on. The newest keyframe is never dropped, which is why the limits can be exceeded by
+//   up to keyframeInterval frames.
+
+Timeline::Timeline(size_t maxFrames, size_t maxBytes, size_t keyframeInterval) :
+	maxFrames(std::max(maxFrames, size_t(1))),
+	maxBytes(maxBytes),
+	keyframeInterval(std::max(keyframeInterval, size_t(1))),
+	keyframes(0),
+	sinceKeyframe(0),
+	bytes(0)
+{
+	diffThread = std::thread([this]() { DiffThread(); });
+}
+
+Timeline::~Timeline()
+{
+	{
+		std::lock_guard<std::mutex> l(diffMutex);
+		diffThreadDone = true;
+	}
+	diffCv.notify_all();
+	diffThread.join();
+}
+
+void Timeline::DiffThread()
+{
+	std::unique_lock<std::mutex> l(diffMutex);
+	while (true)
+	{
+		diffCv.wait(l, [this]() { return diffThreadDone || diffBusy; });
+		if (diffThreadDone)
+			return;
+		l.unlock();
+		Entry entry;
+		if (th_keyframe)
+		{
+			entry.keyframe = std::make_unique<Snapshot>(*latest);
+			entry.bytes = entry.keyframe->Bytes();
+		}
+		else
+		{
+			entry.delta = SnapshotDelta::FromSnapshots(*previous, *latest);
+			entry.bytes = entry.delta->Bytes();
+		}
+		l.lock();
+		th_result = std::move(entry);
+		th_hasResult = true;
+		diffBusy = false;
+		diffCv.notify_all();
+	}
+}
+
+void Timeline::Flush()
+{
+	{
+		std::unique_lock<std::mutex> l(diffMutex);
+		diffCv.wait(l, [this]() { return !diffBusy; });
+	}
+	if (!th_hasResult)
+		return;
+	th_hasResult = false;
+	if (th_result.keyframe)
+		keyframes += 1;
+	bytes += th_result.bytes;
+	entries.push_back(std::move(th_result));
+	th_result = Entry();
+	Trim();
+}
+
+void Timeline::Record(Simulation &sim)
+{
+	Flush();
+	std::swap(latest, previous);
+	if (!latest)
+	{
+		latest = std::make_unique<Snapshot>();
+	}
+	sim.CopySnapshot(*latest);
+
+	if (entries.empty() || !previous || sinceKeyframe + 1 >= keyframeInterval)
+	{
+		th_keyframe = true;
+		sinceKeyframe = 0;
+	}
+	else
+	{
+		th_keyframe = false;
+		sinceKeyframe += 1;
+	}
+	{
+		std::lock_guard<std::mutex> l(diffMutex);
+		diffBusy = true;
+	}
+	diffCv.notify_all();
+}
+
+void Timeline::Trim()
+{
+	while (keyframes > 1 && (entries.size() > maxFrames || bytes > maxBytes))
+	{
+		do
+		{
+			bytes -= entries.front().bytes;
+			if (entries.front().keyframe)
+			{
+				keyframes -= 1;
+			}
+			entries.pop_front();
+		}
+		while (!entries.front().keyframe);
+	}
+}
+
+size_t Timeline::Size()
+{
+	Flush();
+	return entries.size();
+}
+
+size_t Timeline::Bytes()
+{
+	Flush();
+	auto total = bytes;
+	if (latest)
+	{
+		total += latest->Bytes();
+	}
+	if (previous)
+	{
+		total += previous->Bytes();
+	}
+	return total;
+}
+
+size_t Timeline::GetKeyframeInterval() const
+{
+	return keyframeInterval;
+}
+
+std::unique_ptr<Snapshot> Timeline::GetFrame(size_t framesBack)
+{
+	Flush();
+	if (framesBack >= entries.size())
+	{
+		return nullptr;
+	}
+	if (framesBack == 0 && latest)
+	{
+		return std::make_unique<Snapshot>(*latest);
+	}
+	auto index = entries.size() - 1 - framesBack;
+	auto key = index;
+	while (!entries[key].keyframe)
+	{
+		key -= 1;
+	}
+	auto snap = std::make_unique<Snapshot>(*entries[key].keyframe);
+	for (auto i = key + 1; i <= index; ++i)
+	{
+		entries[i].delta->ForwardInPlace(*snap);
+	}
+	return snap;
+}
+
+std::unique_ptr<Snapshot> Timeline::Rewind(size_t framesBack)
+{
+	auto snap = GetFrame(framesBack);
+	if (!snap)
+	{
+		return nullptr;
+	}
+	for (auto i = 0U; i < framesBack; ++i)
+	{
+		bytes -= entries.back().bytes;
+		if (entries.back().keyframe)
+		{
+			keyframes -= 1;
+		}
+		entries.pop_back();
+	}
+	sinceKeyframe = 0;
+	for (auto it = entries.rbegin(); !it->keyframe; ++it)
+	{
+		sinceKeyframe += 1;
+	}
+	latest = std::make_unique<Snapshot>(*snap);
+	previous.reset();
+	return snap;
+}
+
+void Timeline::Clear()
+{
+	Flush();
+	entries.clear();
+	keyframes = 0;
+	sinceKeyframe = 0;
+	bytes = 0;
+	latest.reset();
+	previous.reset();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class Simulation;
+class Snapshot;
+struct SnapshotDelta;
+
+// Records the frames of a running simulation so that it can be rewound to any of the last few
+// thousand of them. Every keyframeInterval-th frame is kept as a Snapshot, the ones between them
+// as SnapshotDeltas from the frame before. Once there are more than maxFrames frames or they take
+// up more than maxBytes, the oldest keyframe is dropped along with the frames that depend on it.
+class Timeline
+{
+	struct Entry
+	{
+		std::unique_ptr<Snapshot> keyframe;
+		std::unique_ptr<SnapshotDelta> delta;
+		size_t bytes = 0;
+	};
+	std::deque<Entry> entries;
+	size_t maxFrames;
+	size_t maxBytes;
+	size_t keyframeInterval;
+	size_t keyframes;
+	size_t sinceKeyframe;
+	size_t bytes;
+	// The frame recorded last and the one before it, swapped every frame so that neither has to be
+	// allocated again
+	std::unique_ptr<Snapshot> latest, previous;
+
+	// The last frame is diffed on a thread of its own while the simulation moves on to the next one
+	std::thread diffThread;
+	std::mutex diffMutex;
+	std::condition_variable diffCv;
+	bool diffBusy = false;
+	bool diffThreadDone = false;
+	bool th_keyframe = false;
+	bool th_hasResult = false;
+	Entry th_result;
+
+	void DiffThread();
+	// Waits for the last frame to be diffed and adds it to entries
+	void Flush();
+	void Trim();
+
+public:
+	Timeline(size_t maxFrames, size_t maxBytes, size_t keyframeInterval);
+	~Timeline();
+	Timeline(const Timeline &) = delete;
+	Timeline &operator =(const Timeline &) = delete;
+
+	// Call after every frame the simulation is stepped
+	void Record(Simulation &sim);
+	size_t Size();
+	size_t Bytes();
+	size_t GetKeyframeInterval() const;
+	// framesBack = 0 is the frame recorded last
+	std::unique_ptr<Snapshot> GetFrame(size_t framesBack);
+	// Same as GetFrame, but also forgets every frame after the one returned, for when the
+	// simulation is about to be restored to it and carry on from there
+	std::unique_ptr<Snapshot> Rewind(size_t framesBack);
+	void Clear();
+};
@@ -0,0 +1,108 @@
+#include "WaterBodies.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Simulation.h"
+
+WaterBodies::WaterBodies() :
+	labels(XRES * YRES, 0),
+	firstLabel(1),
+	nextLabel(1),
+	tick(-1),
+	bodyCount(0)
+{
+}
+
+WaterBodies::Body &WaterBodies::Find(Simulation &sim, int x, int y)
+{
+	if (tick != sim.currentTick)
+	{
+		tick = sim.currentTick;
+		bodyCount = 0;
+		if (nextLabel > std::numeric_limits<unsigned>::max() - XRES * YRES)
+		{
+			std::fill(labels.begin(), labels.end(), 0);
+			nextLabel = 1;
+		}
+		firstLabel = nextLabel;
+	}
+	auto label = labels[y * XRES + x];
+	if (label >= firstLabel)
+	{
+		return bodies[label - firstLabel];
+	}
+	// * Bodies are kept around between ticks so that their openings don't have to be allocated again.
+	if (bodyCount == bodies.size())
+	{
+		bodies.emplace_back();
+	}
+	auto &body = bodies[bodyCount++];
+	body.label = nextLabel++;
+	body.openings.clear();
+	body.next = 0;
+	Fill(sim, body, x, y);
+	std::sort(body.openings.begin(), body.openings.end(), [](const Opening &a, const Opening &b) {
+		return a.y != b.y ? a.y > b.y : a.x < b.x;
+	});
+	return body;
+}
+
+void WaterBodies::Fill(Simulation &sim, Body &body, int x, int y)
+{
+	auto isLiquid = [&sim](int x, int y) {
+		return sim.elements[TYP(sim.pmap[y][x])].Falldown == 2;
+	};
+	auto unlabelled = [this, &body](int x, int y) {
+		return labels[y * XRES + x] != body.label;
+	};
+	stack.clear();
+	stack.push_back({ x, y });
+	while (stack.size())
+	{
+		auto at = stack.back();
+		stack.pop_back();
+		if (!unlabelled(at.x, at.y))
+		{
+			continue;
+		}
+		int x1 = at.x, x2 = at.x;
+		y = at.y;
+		while (x1 >= CELL && isLiquid(x1 - 1, y) && unlabelled(x1 - 1, y))
+		{
+			x1--;
+		}
+		while (x2 < XRES - CELL && isLiquid(x2 + 1, y) && unlabelled(x2 + 1, y))
+		{
+			x2++;
+		}
+		for (x = x1; x <= x2; x++)
+		{
+			labels[y * XRES + x] = body.label;
+			if (!sim.pmap[y - 1][x])
+			{
+				body.openings.push_back({ x, y - 1 });
+			}
+		}
+		if (y >= CELL + 1)
+		{
+			for (x = x1; x <= x2; x++)
+			{
+				if (isLiquid(x, y - 1) && unlabelled(x, y - 1))
+				{
+					stack.push_back({ x, y - 1 });
+				}
+			}
+		}
+		if (y < YRES - CELL - 1)
+		{
+			for (x = x1; x <= x2; x++)
+			{
+				if (isLiquid(x, y + 1) && unlabelled(x, y + 1))
+				{
+					stack.push_back({ x, y + 1 });
+				}
+			}
+		}
+	}
+}
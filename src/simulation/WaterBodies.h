@@ -0,0 +1,52 @@
+#ifndef WATERBODIES_H
+#define WATERBODIES_H
+#include "Config.h"
+
+#include <cstddef>
+#include <vector>
+
+class Simulation;
+
+// Connected bodies of liquid, for water equalization. The first particle of a body to equalize
+// in a tick fills the body, labelling each of its cells, and lists the empty cells right above
+// it, deepest first. Every other particle of the body equalizing in the same tick finds it by
+// the label of its cell instead of filling it again. Labels are never cleared; each tick simply
+// hands out higher ones, so a label below the tick's first one is just stale.
+class WaterBodies
+{
+public:
+	struct Opening
+	{
+		int x, y;
+	};
+
+	struct Body
+	{
+		unsigned label;
+		std::vector<Opening> openings;
+		size_t next; // openings before this have been taken
+	};
+
+private:
+	std::vector<unsigned> labels; // XRES*YRES
+	unsigned firstLabel, nextLabel;
+	int tick;
+	std::vector<Body> bodies;
+	size_t bodyCount;
+	std::vector<Opening> stack;
+
+	void Fill(Simulation &sim, Body &body, int x, int y);
+
+public:
+	WaterBodies();
+
+	// The body of the liquid at x, y, filled if it hasn't been yet this tick
+	Body &Find(Simulation &sim, int x, int y);
+	// Liquid that moves into x, y stays part of the body for the rest of the tick
+	void Claim(const Body &body, int x, int y)
+	{
+		labels[y * XRES + x] = body.label;
+	}
+};
+
+#endif
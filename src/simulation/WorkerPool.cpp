@@ -0,0 +1,85 @@
+#include "WorkerPool.h"
+
+WorkerPool::~WorkerPool()
+{
+	Stop();
+}
+
+int WorkerPool::GetThreads() const
+{
+	return int(threads.size()) + 1;
+}
+
+void WorkerPool::SetThreads(int newThreads)
+{
+	if (newThreads < 1)
+		newThreads = 1;
+	if (newThreads == GetThreads())
+		return;
+	Stop();
+	quit = false;
+	for (int i = 1; i < newThreads; i++)
+		threads.push_back(std::thread([this]() { Worker(); }));
+}
+
+void WorkerPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &thread : threads)
+		thread.join();
+	threads.clear();
+}
+
+void WorkerPool::Worker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	unsigned int seenGeneration = generation;
+	while (true)
+	{
+		wake.wait(lock, [this, seenGeneration]() { return quit || generation != seenGeneration; });
+		if (quit)
+			return;
+		seenGeneration = generation;
+		Drain(lock);
+	}
+}
+
+void WorkerPool::Drain(std::unique_lock<std::mutex> &lock)
+{
+	while (nextJob < jobCount)
+	{
+		int index = nextJob++;
+		lock.unlock();
+		(*job)(index);
+		lock.lock();
+		if (++finishedJobs == jobCount)
+			done.notify_all();
+	}
+}
+
+void WorkerPool::Run(int count, const std::function<void (int)> &newJob)
+{
+	if (count <= 0)
+		return;
+	if (threads.empty() || count == 1)
+	{
+		for (int i = 0; i < count; i++)
+			newJob(i);
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	job = &newJob;
+	jobCount = count;
+	nextJob = 0;
+	finishedJobs = 0;
+	generation++;
+	wake.notify_all();
+	Drain(lock);
+	done.wait(lock, [this]() { return finishedJobs == jobCount; });
+	job = nullptr;
+	jobCount = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+#include "Config.h"
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A small fork-join pool: Run hands out job indices to the worker threads and
+// the calling thread, and returns once every job has finished.
+class WorkerPool
+{
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void (int)> *job = nullptr;
+	int jobCount = 0;
+	int nextJob = 0;
+	int finishedJobs = 0;
+	unsigned int generation = 0;
+	bool quit = false;
+
+	void Worker();
+	void Drain(std::unique_lock<std::mutex> &lock);
+	void Stop();
+
+public:
+	WorkerPool() = default;
+	~WorkerPool();
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator =(const WorkerPool &) = delete;
+
+	// Total number of threads that take part in Run, including the calling one
+	int GetThreads() const;
+	void SetThreads(int newThreads);
+
+	void Run(int count, const std::function<void (int)> &newJob);
+};
+
+#endif
@@ -33,7 +33,7 @@ void Element::Element_ACID()
 	HeatConduct = 34;
 	Description = "Dissolves almost everything.";
 
-	Properties = TYPE_LIQUID|PROP_DEADLY;
+	Properties = TYPE_LIQUID|PROP_DEADLY|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
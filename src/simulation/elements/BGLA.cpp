@@ -29,7 +29,7 @@ void Element::Element_BGLA()
 	HeatConduct = 150;
 	Description = "Broken Glass, heavy particles formed when glass breaks under pressure. Meltable. Bagels.";
 
-	Properties = TYPE_PART | PROP_HOT_GLOW;
+	Properties = TYPE_PART | PROP_HOT_GLOW | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -31,7 +31,7 @@ void Element::Element_BRCK()
 	HeatConduct = 251;
 	Description = "Brick, breakable building material.";
 
-	Properties = TYPE_SOLID|PROP_HOT_GLOW;
+	Properties = TYPE_SOLID|PROP_HOT_GLOW|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -31,7 +31,7 @@ void Element::Element_BRMT()
 	HeatConduct = 211;
 	Description = "Broken metal. Created when iron rusts or when metals break from pressure.";
 
-	Properties = TYPE_PART|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_HOT_GLOW;
+	Properties = TYPE_PART|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_HOT_GLOW|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -80,6 +80,7 @@ static int update(UPDATE_FUNC_ARGS)
 			parts[r].ctype = parts[i].ctype;
 			parts[r].x += dx;
 			parts[r].y += dy;
+			sim->PartMoved(r);
 			parts[r].vx = vx;
 			parts[r].vy = vy;
 			parts[r].temp = parts[i].temp;
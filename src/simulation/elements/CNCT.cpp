@@ -29,7 +29,7 @@ void Element::Element_CNCT()
 	HeatConduct = 100;
 	Description = "Concrete, stronger than stone.";
 
-	Properties = TYPE_PART|PROP_HOT_GLOW;
+	Properties = TYPE_PART|PROP_HOT_GLOW|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
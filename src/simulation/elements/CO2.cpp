@@ -31,7 +31,7 @@ void Element::Element_CO2()
 	HeatConduct = 88;
 	Description = "Carbon Dioxide. Heavy gas, drifts downwards. Carbonates water and turns to dry ice when cold.";
 
-	Properties = TYPE_GAS;
+	Properties = TYPE_GAS|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -33,7 +33,7 @@ void Element::Element_COAL()
 	HeatConduct = 200;
 	Description = "Coal, Burns very slowly. Gets red when hot.";
 
-	Properties = TYPE_SOLID;
+	Properties = TYPE_SOLID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -29,7 +29,7 @@ void Element::Element_DESL()
 	HeatConduct = 42;
 	Description = "Liquid diesel. Explodes under high pressure and temperatures.";
 
-	Properties = TYPE_LIQUID;
+	Properties = TYPE_LIQUID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
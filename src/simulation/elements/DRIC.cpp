@@ -30,7 +30,7 @@ void Element::Element_DRIC()
 	HeatConduct = 2;
 	Description = "Dry Ice, formed when CO2 is cooled.";
 
-	Properties = TYPE_SOLID;
+	Properties = TYPE_SOLID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -30,7 +30,7 @@ void Element::Element_DUST()
 	HeatConduct = 70;
 	Description = "Very light dust. Flammable.";
 
-	Properties = TYPE_PART;
+	Properties = TYPE_PART|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
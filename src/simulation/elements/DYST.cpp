@@ -29,7 +29,7 @@ void Element::Element_DYST()
 	HeatConduct = 70;
 	Description = "Dead Yeast.";
 
-	Properties = TYPE_PART;
+	Properties = TYPE_PART|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
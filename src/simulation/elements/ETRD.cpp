@@ -94,7 +94,7 @@ static void initDeltaPos()
 
 int Element_ETRD_nearestSparkablePart(Simulation *sim, int targetId)
 {
-	if (!sim->elementCount[PT_ETRD])
+	if (!sim->partsByType.Count(PT_ETRD))
 		return -1;
 	if (sim->etrd_count_valid && sim->etrd_life0_count <= 0)
 		return -1;
@@ -103,6 +103,9 @@ int Element_ETRD_nearestSparkablePart(Simulation *sim, int targetId)
 	int foundDistance = XRES + YRES;
 	int foundI = -1;
 	ui::Point targetPos = ui::Point(int(parts[targetId].x), int(parts[targetId].y));
+	auto sparkable = [parts, targetId](int i) {
+		return !parts[i].life && i != targetId;
+	};
 
 	if (sim->etrd_count_valid)
 	{
@@ -134,44 +137,24 @@ int Element_ETRD_nearestSparkablePart(Simulation *sim, int targetId)
 				}
 			}
 		}
-		// If neighbor search didn't find a suitable particle, search all particles
+		// If neighbor search didn't find a suitable particle, look further out in the grid of ETRD
 		if (foundI < 0)
 		{
-			for (int i = 0; i <= sim->parts_lastActiveIndex; i++)
-			{
-				if (parts[i].type == PT_ETRD && !parts[i].life)
-				{
-					ui::Point checkPos = ui::Point(int(parts[i].x)-targetPos.X, int(parts[i].y)-targetPos.Y);
-					int checkDistance = std::abs(checkPos.X) + std::abs(checkPos.Y);
-					if (checkDistance < foundDistance && i != targetId)
-					{
-						foundDistance = checkDistance;
-						foundI = i;
-					}
-				}
-			}
+			foundI = sim->partsGrid.Nearest(*sim, PT_ETRD, targetPos.X, targetPos.Y, foundDistance - 1, sparkable);
 		}
 	}
 	else
 	{
 		// Recalculate countLife0, and search for the closest suitable particle
 		int countLife0 = 0;
-		for (int i = 0; i <= sim->parts_lastActiveIndex; i++)
+		for (auto i : sim->partsByType.Get(PT_ETRD))
 		{
-			if (parts[i].type == PT_ETRD && !parts[i].life)
-			{
+			if (!parts[i].life)
 				countLife0++;
-				ui::Point checkPos = ui::Point(int(parts[i].x)-targetPos.X, int(parts[i].y)-targetPos.Y);
-				int checkDistance = std::abs(checkPos.X) + std::abs(checkPos.Y);
-				if (checkDistance < foundDistance && i != targetId)
-				{
-					foundDistance = checkDistance;
-					foundI = i;
-				}
-			}
 		}
 		sim->etrd_life0_count = countLife0;
 		sim->etrd_count_valid = true;
+		foundI = sim->partsGrid.Nearest(*sim, PT_ETRD, targetPos.X, targetPos.Y, foundDistance - 1, sparkable);
 	}
 	return foundI;
 }
@@ -36,7 +36,7 @@ void Element::Element_FIRE()
 	HeatConduct = 88;
 	Description = "Ignites flammable materials. Heats air.";
 
-	Properties = TYPE_GAS|PROP_LIFE_DEC|PROP_LIFE_KILL;
+	Properties = TYPE_GAS|PROP_LIFE_DEC|PROP_LIFE_KILL|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
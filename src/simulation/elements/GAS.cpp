@@ -30,7 +30,7 @@ void Element::Element_GAS()
 	HeatConduct = 42;
 	Description = "Diffuses quickly and is flammable. Liquefies into OIL under pressure.";
 
-	Properties = TYPE_GAS | PROP_NEUTPASS;
+	Properties = TYPE_GAS | PROP_NEUTPASS | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
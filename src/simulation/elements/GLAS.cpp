@@ -32,7 +32,7 @@ void Element::Element_GLAS()
 	HeatConduct = 150;
 	Description = "Glass. Meltable. Shatters under pressure, and refracts photons.";
 
-	Properties = TYPE_SOLID | PROP_NEUTPASS | PROP_HOT_GLOW | PROP_SPARKSETTLE;
+	Properties = TYPE_SOLID | PROP_NEUTPASS | PROP_HOT_GLOW | PROP_SPARKSETTLE | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
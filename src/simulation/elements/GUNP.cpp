@@ -29,7 +29,7 @@ void Element::Element_GUNP()
 	HeatConduct = 97;
 	Description = "Gunpowder. Light dust, explodes on contact with fire or spark.";
 
-	Properties = TYPE_PART;
+	Properties = TYPE_PART|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
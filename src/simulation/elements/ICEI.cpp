@@ -32,7 +32,7 @@ void Element::Element_ICEI()
 	HeatConduct = 46;
 	Description = "Crushes under pressure. Cools down air.";
 
-	Properties = TYPE_SOLID|PROP_LIFE_DEC|PROP_NEUTPASS;
+	Properties = TYPE_SOLID|PROP_LIFE_DEC|PROP_NEUTPASS|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
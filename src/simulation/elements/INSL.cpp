@@ -29,7 +29,7 @@ void Element::Element_INSL()
 	HeatConduct = 0;
 	Description = "Insulator, does not conduct heat and blocks electricity.";
 
-	Properties = TYPE_SOLID;
+	Properties = TYPE_SOLID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -35,7 +35,7 @@ void Element::Element_LAVA()
 	HeatConduct = 60;
 	Description = "Molten lava. Ignites flammable materials. Generated when metals and other materials melt, solidifies when cold.";
 
-	Properties = TYPE_LIQUID|PROP_LIFE_DEC;
+	Properties = TYPE_LIQUID|PROP_LIFE_DEC|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -33,7 +33,7 @@ void Element::Element_LIFE()
 	HeatConduct = 40;
 	Description = "Game Of Life! B3/S23";
 
-	Properties = TYPE_SOLID|PROP_LIFE;
+	Properties = TYPE_SOLID|PROP_LIFE|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
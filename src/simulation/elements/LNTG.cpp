@@ -30,7 +30,7 @@ void Element::Element_LNTG()
 	HeatConduct = 70;
 	Description = "Liquid Nitrogen. Very cold, disappears whenever it touches anything warmer.";
 
-	Properties = TYPE_LIQUID;
+	Properties = TYPE_LIQUID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -30,7 +30,7 @@ void Element::Element_LO2()
 	HeatConduct = 70;
 	Description = "Liquid Oxygen. Very cold. Reacts with fire.";
 
-	Properties = TYPE_LIQUID;
+	Properties = TYPE_LIQUID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -30,7 +30,7 @@ void Element::Element_LRBD()
 	HeatConduct = 170;
 	Description = "Liquid Rubidium.";
 
-	Properties = TYPE_LIQUID|PROP_CONDUCTS|PROP_LIFE_DEC;
+	Properties = TYPE_LIQUID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
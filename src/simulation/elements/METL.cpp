@@ -29,7 +29,7 @@ void Element::Element_METL()
 	HeatConduct = 251;
 	Description = "The basic conductor. Meltable.";
 
-	Properties = TYPE_SOLID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_HOT_GLOW;
+	Properties = TYPE_SOLID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_HOT_GLOW|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -30,7 +30,7 @@ void Element::Element_MWAX()
 	HeatConduct = 44;
 	Description = "Liquid Wax. Hardens into WAX at 45 degrees.";
 
-	Properties = TYPE_LIQUID;
+	Properties = TYPE_LIQUID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
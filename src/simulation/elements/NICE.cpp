@@ -30,7 +30,7 @@ void Element::Element_NICE()
 	HeatConduct = 46;
 	Description = "Nitrogen Ice. Very cold, will melt into LN2 when heated only slightly.";
 
-	Properties = TYPE_SOLID;
+	Properties = TYPE_SOLID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
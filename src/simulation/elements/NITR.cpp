@@ -30,7 +30,7 @@ void Element::Element_NITR()
 	HeatConduct = 50;
 	Description = "Nitroglycerin. Pressure sensitive explosive. Mix with CLST to make TNT.";
 
-	Properties = TYPE_LIQUID;
+	Properties = TYPE_LIQUID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -29,7 +29,7 @@ void Element::Element_OIL()
 	HeatConduct = 42;
 	Description = "Flammable, turns into GAS at low pressure or high temperature.";
 
-	Properties = TYPE_LIQUID | PROP_NEUTPASS;
+	Properties = TYPE_LIQUID | PROP_NEUTPASS | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
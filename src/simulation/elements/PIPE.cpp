@@ -356,7 +356,7 @@ int Element_PIPE_update(UPDATE_FUNC_ARGS)
 int Element_PIPE_graphics(GRAPHICS_FUNC_ARGS)
 {
 	int t = TYP(cpart->ctype);
-	if (t>0 && t<PT_NUM && ren->sim->elements[t].Enabled)
+	if (t>0 && t<PT_NUM && ren->frame->elements[t].Enabled)
 	{
 		if (t == PT_STKM || t == PT_STKM2 || t == PT_FIGH)
 			return 0;
@@ -381,12 +381,12 @@ int Element_PIPE_graphics(GRAPHICS_FUNC_ARGS)
 			tpart.tmp = cpart->tmp3;
 			tpart.ctype = cpart->tmp4;
 
-			*colr = PIXR(ren->sim->elements[t].Colour);
-			*colg = PIXG(ren->sim->elements[t].Colour);
-			*colb = PIXB(ren->sim->elements[t].Colour);
-			if (ren->sim->elements[t].Graphics)
+			*colr = PIXR(ren->frame->elements[t].Colour);
+			*colg = PIXG(ren->frame->elements[t].Colour);
+			*colb = PIXB(ren->frame->elements[t].Colour);
+			if (ren->frame->elements[t].Graphics)
 			{
-				(*(ren->sim->elements[t].Graphics))(ren, &tpart, nx, ny, pixel_mode, cola, colr, colg, colb, firea, firer, fireg, fireb);
+				(*(ren->frame->elements[t].Graphics))(ren, &tpart, nx, ny, pixel_mode, cola, colr, colg, colb, firea, firer, fireg, fireb);
 			}
 			else
 			{
@@ -30,7 +30,7 @@ void Element::Element_PLEX()
 	HeatConduct = 88;
 	Description = "Solid pressure sensitive explosive.";
 
-	Properties = TYPE_SOLID | PROP_NEUTPENETRATE;
+	Properties = TYPE_SOLID | PROP_NEUTPENETRATE | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -34,7 +34,7 @@ void Element::Element_PLNT()
 	HeatConduct = 65;
 	Description = "Plant, drinks water and grows.";
 
-	Properties = TYPE_SOLID|PROP_NEUTPENETRATE|PROP_LIFE_DEC;
+	Properties = TYPE_SOLID|PROP_NEUTPENETRATE|PROP_LIFE_DEC|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -34,7 +34,7 @@ void Element::Element_PLSM()
 	HeatConduct = 5;
 	Description = "Plasma, extremely hot.";
 
-	Properties = TYPE_GAS|PROP_LIFE_DEC|PROP_LIFE_KILL;
+	Properties = TYPE_GAS|PROP_LIFE_DEC|PROP_LIFE_KILL|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -307,6 +307,7 @@ static int MoveStack(Simulation * sim, int stackX, int stackY, int directionX, i
 				sim->pmap[srcY][srcX] = 0;
 				sim->parts[jP].x = float(destX);
 				sim->parts[jP].y = float(destY);
+				sim->PartMoved(jP);
 				sim->pmap[destY][destX] = PMAP(jP, sim->parts[jP].type);
 			}
 			return amount;
@@ -330,6 +331,7 @@ static int MoveStack(Simulation * sim, int stackX, int stackY, int directionX, i
 				sim->pmap[srcY][srcX] = 0;
 				sim->parts[jP].x = float(destX);
 				sim->parts[jP].y = float(destY);
+				sim->PartMoved(jP);
 				sim->pmap[destY][destX] = PMAP(jP, sim->parts[jP].type);
 			}
 			return possibleMovement;
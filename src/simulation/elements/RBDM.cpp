@@ -29,7 +29,7 @@ void Element::Element_RBDM()
 	HeatConduct = 240;
 	Description = "Rubidium. Explosive, especially on contact with water. Low melting point.";
 
-	Properties = TYPE_SOLID|PROP_CONDUCTS|PROP_LIFE_DEC;
+	Properties = TYPE_SOLID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -32,7 +32,7 @@ void Element::Element_ROCK()
 	HeatConduct = 200;
 	Description = "Rock. Solid material, CNCT can stack on top of it.";
 
-	Properties = TYPE_SOLID | PROP_HOT_GLOW;
+	Properties = TYPE_SOLID | PROP_HOT_GLOW | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
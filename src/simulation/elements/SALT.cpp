@@ -29,7 +29,7 @@ void Element::Element_SALT()
 	HeatConduct = 110;
 	Description = "Salt, dissolves in water.";
 
-	Properties = TYPE_PART;
+	Properties = TYPE_PART|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
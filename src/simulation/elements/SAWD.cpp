@@ -29,7 +29,7 @@ void Element::Element_SAWD()
 	HeatConduct = 70;
 	Description = "Sawdust. Floats on water.";
 
-	Properties = TYPE_PART | PROP_NEUTPASS;
+	Properties = TYPE_PART | PROP_NEUTPASS | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -31,7 +31,7 @@ void Element::Element_SLTW()
 	HeatConduct = 75;
 	Description = "Saltwater, conducts electricity, difficult to freeze.";
 
-	Properties = TYPE_LIQUID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_NEUTPENETRATE;
+	Properties = TYPE_LIQUID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_NEUTPENETRATE|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -32,7 +32,7 @@ void Element::Element_SMKE()
 	HeatConduct = 88;
 	Description = "Smoke, created by fire.";
 
-	Properties = TYPE_GAS|PROP_LIFE_DEC|PROP_LIFE_KILL_DEC;
+	Properties = TYPE_GAS|PROP_LIFE_DEC|PROP_LIFE_KILL_DEC|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -33,7 +33,7 @@ void Element::Element_SNOW()
 	HeatConduct = 46;
 	Description = "Light particles. Created when ICE breaks under pressure.";
 
-	Properties = TYPE_PART|PROP_NEUTPASS;
+	Properties = TYPE_PART|PROP_NEUTPASS|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -58,15 +58,22 @@ void Element_SOAP_detach(Simulation * sim, int i)
 	if ((sim->parts[i].ctype&2) == 2 && sim->parts[i].tmp >= 0 && sim->parts[i].tmp < NPART && sim->parts[sim->parts[i].tmp].type == PT_SOAP)
 	{
 		if ((sim->parts[sim->parts[i].tmp].ctype&4) == 4)
+		{
+			sim->MarkPartDirty(sim->parts[i].tmp);
 			sim->parts[sim->parts[i].tmp].ctype ^= 4;
+		}
 	}
 
 	if ((sim->parts[i].ctype&4) == 4 && sim->parts[i].tmp2 >= 0 && sim->parts[i].tmp2 < NPART && sim->parts[sim->parts[i].tmp2].type == PT_SOAP)
 	{
 		if ((sim->parts[sim->parts[i].tmp2].ctype&2) == 2)
+		{
+			sim->MarkPartDirty(sim->parts[i].tmp2);
 			sim->parts[sim->parts[i].tmp2].ctype ^= 2;
+		}
 	}
 
+	sim->MarkPartDirty(i);
 	sim->parts[i].ctype = 0;
 }
 
@@ -6,6 +6,7 @@ static void create(ELEMENT_CREATE_FUNC_ARGS);
 static bool createAllowed(ELEMENT_CREATE_ALLOWED_FUNC_ARGS);
 static void changeType(ELEMENT_CHANGETYPE_FUNC_ARGS);
 void Element_STKM_init_legs(Simulation * sim, playerst *playerp, int i);
+void Element_STKM_init_legs(playerst *playerp, const Particle &part);
 int Element_STKM_run_stickman(playerst *playerp, UPDATE_FUNC_ARGS);
 void Element_STKM_set_element(Simulation *sim, playerst *playerp, int element);
 void Element_STKM_interact(Simulation *sim, playerst *playerp, int i, int x, int y);
@@ -83,7 +84,7 @@ static void create(ELEMENT_CREATE_FUNC_ARGS)
 
 static bool createAllowed(ELEMENT_CREATE_ALLOWED_FUNC_ARGS)
 {
-	return sim->elementCount[PT_STKM] <= 0 && !sim->player.spwn;
+	return sim->partsByType.Count(PT_STKM) <= 0 && !sim->player.spwn;
 }
 
 static void changeType(ELEMENT_CHANGETYPE_FUNC_ARGS)
@@ -682,11 +683,16 @@ void Element_STKM_interact(Simulation *sim, playerst *playerp, int i, int x, int
 }
 
 void Element_STKM_init_legs(Simulation * sim, playerst *playerp, int i)
+{
+	Element_STKM_init_legs(playerp, sim->parts[i]);
+}
+
+void Element_STKM_init_legs(playerst *playerp, const Particle &part)
 {
 	int x, y;
 
-	x = (int)(sim->parts[i].x+0.5f);
-	y = (int)(sim->parts[i].y+0.5f);
+	x = (int)(part.x+0.5f);
+	y = (int)(part.y+0.5f);
 
 	playerp->legs[0] = float(x-1);
 	playerp->legs[1] = float(y+6);
@@ -74,7 +74,7 @@ static void create(ELEMENT_CREATE_FUNC_ARGS)
 
 static bool createAllowed(ELEMENT_CREATE_ALLOWED_FUNC_ARGS)
 {
-	return sim->elementCount[PT_STKM2] <= 0 && !sim->player2.spwn;
+	return sim->partsByType.Count(PT_STKM2) <= 0 && !sim->player2.spwn;
 }
 
 static void changeType(ELEMENT_CHANGETYPE_FUNC_ARGS)
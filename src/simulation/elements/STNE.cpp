@@ -29,7 +29,7 @@ void Element::Element_STNE()
 	HeatConduct = 150;
 	Description = "Heavy particles. Meltable.";
 
-	Properties = TYPE_PART;
+	Properties = TYPE_PART|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -33,7 +33,7 @@ void Element::Element_VINE()
 	HeatConduct = 65;
 	Description = "Vine, can grow along WOOD.";
 
-	Properties = TYPE_SOLID;
+	Properties = TYPE_SOLID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
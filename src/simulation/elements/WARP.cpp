@@ -73,6 +73,8 @@ static int update(UPDATE_FUNC_ARGS)
 				parts[i].y = parts[ID(r)].y;
 				parts[ID(r)].x = float(x);
 				parts[ID(r)].y = float(y);
+				sim->PartMoved(i);
+				sim->PartMoved(ID(r));
 				parts[ID(r)].vx = RNG::Ref().between(-2, 1) + 0.5f;
 				parts[ID(r)].vy = float(RNG::Ref().between(-2, 1));
 				parts[i].life += 4;
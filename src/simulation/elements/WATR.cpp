@@ -32,7 +32,7 @@ void Element::Element_WATR()
 	HeatConduct = 29;
 	Description = "Water. Conducts electricity, freezes, and extinguishes fires.";
 
-	Properties = TYPE_LIQUID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_NEUTPASS;
+	Properties = TYPE_LIQUID|PROP_CONDUCTS|PROP_LIFE_DEC|PROP_NEUTPASS|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -29,7 +29,7 @@ void Element::Element_WAX()
 	HeatConduct = 44;
 	Description = "Wax. Melts at moderately high temperatures.";
 
-	Properties = TYPE_SOLID;
+	Properties = TYPE_SOLID|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
@@ -33,7 +33,7 @@ void Element::Element_WOOD()
 	HeatConduct = 164;
 	Description = "Wood, flammable.";
 
-	Properties = TYPE_SOLID | PROP_NEUTPENETRATE;
+	Properties = TYPE_SOLID | PROP_NEUTPENETRATE | PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
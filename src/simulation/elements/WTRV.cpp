@@ -32,7 +32,7 @@ void Element::Element_WTRV()
 	HeatConduct = 48;
 	Description = "Steam. Produced from hot water.";
 
-	Properties = TYPE_GAS;
+	Properties = TYPE_GAS|PROP_TILELOCAL;
 
 	LowPressure = IPL;
 	LowPressureTransition = NT;
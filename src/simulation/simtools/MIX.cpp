@@ -20,7 +20,7 @@ static int perform(Simulation * sim, Particle * cpart, int x, int y, int brushX,
 	if(!thisPart)
 		return 0;
 
-	if(random_gen() % 100 != 0)
+	if(RNG::Ref()() % 100 != 0)
 		return 0;
 
 	int distance = (int)(std::pow(strength, .5f) * 10);
@@ -28,8 +28,8 @@ static int perform(Simulation * sim, Particle * cpart, int x, int y, int brushX,
 	if(!(sim->elements[TYP(thisPart)].Properties & (TYPE_PART | TYPE_LIQUID | TYPE_GAS)))
 		return 0;
 
-	int newX = x + (random_gen() % distance) - (distance/2);
-	int newY = y + (random_gen() % distance) - (distance/2);
+	int newX = x + (RNG::Ref()() % distance) - (distance/2);
+	int newY = y + (RNG::Ref()() % distance) - (distance/2);
 
 	if(newX < 0 || newY < 0 || newX >= XRES || newY >= YRES)
 		return 0;
@@ -41,6 +41,8 @@ static int perform(Simulation * sim, Particle * cpart, int x, int y, int brushX,
 	if ((sim->elements[TYP(thisPart)].Properties&STATE_FLAGS) != (sim->elements[TYP(thatPart)].Properties&STATE_FLAGS))
 		return 0;
 
+	sim->MarkPartDirty(ID(thisPart));
+	sim->MarkPartDirty(ID(thatPart));
 	sim->pmap[y][x] = thatPart;
 	sim->parts[ID(thatPart)].x = float(x);
 	sim->parts[ID(thatPart)].y = float(y);
@@ -48,6 +50,8 @@ static int perform(Simulation * sim, Particle * cpart, int x, int y, int brushX,
 	sim->pmap[newY][newX] = thisPart;
 	sim->parts[ID(thisPart)].x = float(newX);
 	sim->parts[ID(thisPart)].y = float(newY);
+	sim->PartMoved(ID(thatPart));
+	sim->PartMoved(ID(thisPart));
 
 	return 1;
 }